@@ -39,6 +39,7 @@
 
 #include <aio4c/buffer.h>
 #include <aio4c/client.h>
+#include <aio4c/clock.h>
 #include <aio4c/connection.h>
 #include <aio4c/log.h>
 #include <aio4c/server.h>
@@ -35,6 +35,7 @@
 
 #include <aio4c/address.h>
 #include <aio4c/connection.h>
+#include <aio4c/thread.h>
 
 /**
  * @struct s_Acceptor
@@ -63,12 +64,243 @@ typedef struct s_Acceptor Acceptor;
 #endif /* __AIO4C_ACCEPTOR_DEFINED__ */
 
 /**
- * @fn Acceptor* NewAcceptor(char*,Address*,Connection*,int)
+ * @var AIO4C_ACCEPTOR_REUSE_PORT
+ * @brief Enables per pipe listening sockets.
+ *
+ * When set to true (option -Ar), each pipe binds its own SO_REUSEPORT
+ * listening socket and accepts its connections from its Reader, letting the
+ * kernel balance incoming connections between pipes. No Acceptor thread is
+ * started in this mode. Ignored if SO_REUSEPORT is not supported.
+ */
+extern AIO4C_API bool AIO4C_ACCEPTOR_REUSE_PORT;
+
+/**
+ * @var AIO4C_ACCEPTOR_CPU_STEERING
+ * @brief Enables CPU steering of incoming connections.
+ *
+ * When set to true (option -Ac) together with AIO4C_ACCEPTOR_REUSE_PORT,
+ * a classic BPF program is attached to the listening sockets so that a
+ * connection received on CPU n is accepted by pipe (n % pipes).
+ */
+extern AIO4C_API bool AIO4C_ACCEPTOR_CPU_STEERING;
+
+/**
+ * @enum AcceptorPlacement
+ * @brief Policies used to choose the pipe of a new Connection.
+ *
+ * Placement only applies when the Acceptor thread accepts connections, the
+ * kernel does it when AIO4C_ACCEPTOR_REUSE_PORT is set.
+ *
+ * AIO4C_PLACEMENT_INCOMING_CPU reads SO_INCOMING_CPU on each accepted socket
+ * and prefers, in order, the pipes pinned to that CPU, then the pipes pinned
+ * to CPUs of the same NUMA node, choosing the least connected one. If no pipe
+ * is pinned (see AIO4C_THREAD_CPUS), connections received on CPU n go to pipe
+ * (n % pipes). It falls back to AIO4C_PLACEMENT_LEAST_CONNECTIONS when the
+ * CPU is unknown.
+ */
+typedef enum e_AcceptorPlacement {
+    AIO4C_PLACEMENT_LEAST_CONNECTIONS = 0, /**< Pipe with the fewest connections (default) */
+    AIO4C_PLACEMENT_LEAST_THROUGHPUT = 1,  /**< Pipe reading the fewest bytes per second over the window */
+    AIO4C_PLACEMENT_LEAST_QUEUED = 2,      /**< Pipe with the fewest pending worker tasks over the window */
+    AIO4C_PLACEMENT_TWO_CHOICES = 3,       /**< Fewest connections among two pipes drawn at random */
+    AIO4C_PLACEMENT_INCOMING_CPU = 4,      /**< Pipe running on the CPU that received the connection */
+    AIO4C_PLACEMENT_MAX = 5                /**< Number of placement policies */
+} AcceptorPlacement;
+
+/**
+ * @var AcceptorPlacementString
+ * @brief Names of the placement policies, as accepted by option -Ap.
+ */
+extern AIO4C_API char* AcceptorPlacementString[AIO4C_PLACEMENT_MAX];
+
+/**
+ * @var AIO4C_ACCEPTOR_PLACEMENT
+ * @brief The placement policy used by Acceptors (option -Ap).
+ */
+extern AIO4C_API AcceptorPlacement AIO4C_ACCEPTOR_PLACEMENT;
+
+/**
+ * @def AIO4C_ACCEPTOR_LOAD_WINDOW
+ * @brief Minimum interval between two pipe load samples, in milliseconds.
+ *
+ * Windowed values (throughput, queued tasks) are smoothed over the last few
+ * samples, each new sample weighting for a quarter of the value.
+ */
+#define AIO4C_ACCEPTOR_LOAD_WINDOW 100
+
+/**
+ * @var AIO4C_ACCEPTOR_REBALANCE_INTERVAL
+ * @brief Interval between two pipe balance checks, in seconds (option -Ab).
+ *
+ * When greater than 0, a rebalancer thread compares the throughput of the
+ * pipes at this interval. If the busiest pipe reads more than
+ * AIO4C_ACCEPTOR_REBALANCE_RATIO times the least busy one for
+ * AIO4C_ACCEPTOR_REBALANCE_PERIODS consecutive checks, one of its
+ * connections is migrated to the least busy pipe.
+ *
+ * @see ConnectionMigrate(Connection*,Reader*)
+ */
+extern AIO4C_API int AIO4C_ACCEPTOR_REBALANCE_INTERVAL;
+
+/**
+ * @def AIO4C_ACCEPTOR_REBALANCE_RATIO
+ * @brief Ratio between the busiest and the least busy pipes considered as imbalanced.
+ */
+#define AIO4C_ACCEPTOR_REBALANCE_RATIO 2
+
+/**
+ * @def AIO4C_ACCEPTOR_REBALANCE_PERIODS
+ * @brief Number of consecutive imbalanced checks before migrating a connection.
+ */
+#define AIO4C_ACCEPTOR_REBALANCE_PERIODS 3
+
+/**
+ * @var AIO4C_ACCEPTOR_RATE
+ * @brief Maximum number of connections accepted per second (option -Aa).
+ *
+ * Connections are admitted from a token bucket holding up to
+ * AIO4C_ACCEPTOR_BURST tokens. Connections arriving when it is empty are
+ * rejected. A value of 0 disables rate limiting.
+ */
+extern AIO4C_API int AIO4C_ACCEPTOR_RATE;
+
+/**
+ * @var AIO4C_ACCEPTOR_BURST
+ * @brief Number of connections that can be accepted at once (option -Aa rate:burst).
+ *
+ * Defaults to AIO4C_ACCEPTOR_RATE when 0.
+ */
+extern AIO4C_API int AIO4C_ACCEPTOR_BURST;
+
+/**
+ * @var AIO4C_ACCEPTOR_MAX_CONNECTIONS
+ * @brief Maximum number of connections of an Acceptor (option -Am, 0 = unlimited).
+ */
+extern AIO4C_API int AIO4C_ACCEPTOR_MAX_CONNECTIONS;
+
+/**
+ * @var AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS
+ * @brief Maximum number of connections of each pipe (option -AM, 0 = unlimited).
+ *
+ * A connection whose chosen pipe is full is rejected, even if other pipes
+ * are not.
+ */
+extern AIO4C_API int AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS;
+
+/**
+ * @var AIO4C_ACCEPTOR_HANDOVER_PATH
+ * @brief Path used to inherit listening sockets from another process (option -Ai).
+ *
+ * When set, Acceptors first try to receive the listening sockets of the
+ * process they replace, which hands them over using ServerHandOver. If one
+ * of the sockets is not bound to the Acceptor Address, the hand over is
+ * refused and the other process keeps serving, and the Acceptor binds its
+ * own sockets as it does when none could be inherited. Both processes should use the
+ * same AIO4C_ACCEPTOR_REUSE_PORT setting and number of pipes, as sockets that
+ * do not have SO_REUSEPORT set prevent binding additional ones.
+ *
+ * @see HandOverReceive(char*,aio4c_socket_t*,int,int,bool(*)(aio4c_socket_t,void*),void*)
+ */
+extern AIO4C_API char* AIO4C_ACCEPTOR_HANDOVER_PATH;
+
+/**
+ * @struct s_AcceptorCounters
+ * @brief Admission counters of an Acceptor.
+ *
+ * Rejected connections are closed with SO_LINGER set to 0 as soon as
+ * accepted, before any Connection is created for them, so that the client
+ * receives a reset.
+ *
+ * @see AcceptorGetCounters(Acceptor*,AcceptorCounters*)
+ */
+typedef struct s_AcceptorCounters {
+    unsigned int accepted;    /**< Number of connections admitted */
+    unsigned int rateLimited; /**< Number of connections rejected by AIO4C_ACCEPTOR_RATE */
+    unsigned int serverFull;  /**< Number of connections rejected by AIO4C_ACCEPTOR_MAX_CONNECTIONS */
+    unsigned int pipeFull;    /**< Number of connections rejected by AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS */
+    int          connections; /**< Number of connections currently open */
+    bool         draining;    /**< Whether the Acceptor stopped listening to drain its connections */
+    unsigned int drained;     /**< Number of connections moved to PENDING_CLOSE by a drain */
+} AcceptorCounters;
+
+/**
+ * @struct s_PipeLoad
+ * @brief Load of a Server pipe.
+ *
+ * @see AcceptorGetPipesLoad(Acceptor*,PipeLoad*,int)
+ */
+typedef struct s_PipeLoad {
+    int          connections;    /**< Number of connections managed by the pipe */
+    aio4c_size_t bytesPerSecond; /**< Smoothed number of bytes read per second */
+    int          queued;         /**< Smoothed number of tasks waiting for the pipe's Worker */
+    int          pendingItems;   /**< Number of received buffers not yet processed by the pipe's Worker */
+    int          pendingBytes;   /**< Number of received bytes not yet processed by the pipe's Worker */
+    int          suspended;      /**< Number of connections whose reads are suspended */
+    int          rejected;       /**< Number of tasks shed by the pipe's Worker since it started */
+} PipeLoad;
+
+/**
+ * @struct s_PipeCounters
+ * @brief Activity counters of a Server pipe.
+ *
+ * Each counter is only updated by the thread of the pipe it belongs to, and
+ * grows since the pipe was started, except connections, pendingItems and
+ * pendingBytes which are sampled. Durations are expressed in nanoseconds.
+ * Sampling twice and dividing the differences gives rates and means, such as
+ * the number of ready keys per wakeup or the mean time tasks waited for the
+ * Worker.
+ *
+ * @see AcceptorGetPipesCounters(Acceptor*,PipeCounters*,int)
+ */
+typedef struct s_PipeCounters {
+    unsigned long long iterations;   /**< Number of iterations of the pipe's Reader loop */
+    unsigned long long wakeups;      /**< Number of iterations where the Reader's Selector returned ready keys */
+    unsigned long long readyKeys;    /**< Number of ready keys returned by the Reader's Selector */
+    unsigned long long pollTime;     /**< Time the Reader spent waiting in its Selector */
+    unsigned long long dispatchTime; /**< Time the Reader spent handling expired timers and ready keys */
+    unsigned long long bytesIn;      /**< Number of bytes read by the Reader */
+    unsigned long long tasks;        /**< Number of tasks dequeued by the pipe's Worker */
+    unsigned long long waitTime;     /**< Time tasks waited in the Worker queue before being dequeued, while the process statistics are enabled */
+    unsigned long long processTime;  /**< Time the Worker spent processing tasks, while the process statistics are enabled */
+    unsigned long long writes;       /**< Number of write attempts of the pipe's Writer */
+    unsigned long long shortWrites;  /**< Number of writes that could not send the whole buffer */
+    unsigned long long bytesOut;     /**< Number of bytes written by the Writer */
+    int                connections;  /**< Number of connections managed by the pipe */
+    int                pendingItems; /**< Number of tasks queued to the Worker */
+    int                pendingBytes; /**< Number of bytes queued to the Worker */
+    int                poolBuffers;  /**< Number of Buffers of the Reader and Worker BufferPools, in use or not */
+    int                poolUsed;     /**< Number of Buffers allocated from the Reader and Worker BufferPools */
+    int                poolFree;     /**< Number of Buffers the Reader and Worker BufferPools hold */
+} PipeCounters;
+
+/**
+ * @fn bool AcceptorTakeToken(volatile aio4c_time_t*,aio4c_time_t,int,int)
+ * @brief Takes a token from the bucket limiting the rate of accepted connections.
+ *
+ * The bucket refills at rate tokens per second and holds up to burst
+ * tokens. It is kept as the time its next token is due, updated atomically.
+ *
+ * @param admitAt
+ *   The bucket, 0 when full.
+ * @param now
+ *   The current time, in microseconds.
+ * @param rate
+ *   Number of tokens per second, 0 to always admit.
+ * @param burst
+ *   Number of tokens the bucket holds, defaults to rate when 0.
+ * @return
+ *   true if a token was taken, false if the bucket was empty.
+ */
+extern AIO4C_API bool AcceptorTakeToken(volatile aio4c_time_t* admitAt, aio4c_time_t now, int rate, int burst);
+
+/**
+ * @fn Acceptor* NewAcceptor(char*,Address*,Connection*,int,ThreadPolicy*,bool)
  * @brief Creates an Acceptor.
  *
  * When this function returns a value different from NULL, the Acceptor is
  * ready to process incoming connection, meaning that the thread has been
- * started and initialized.
+ * started and initialized. If AIO4C_ACCEPTOR_REUSE_PORT is set, the pipes are
+ * started directly and no thread is created.
  *
  * @param name
  *   The Acceptor name (used only for debug purpose).
@@ -79,13 +311,130 @@ typedef struct s_Acceptor Acceptor;
  *   is accepted by the Acceptor.
  * @param nbPipes
  *   The number of pipes to use to manage connections.
+ * @param policies
+ *   Array of nbPipes ThreadPolicy applied to the threads of each pipe, only
+ *   read while the Acceptor is created. If NULL, each pipe uses the default
+ *   policy given by ThreadPolicyForPipe.
+ * @param internal
+ *   true for an Acceptor serving the library itself, such as the metrics
+ *   endpoint. It neither inherits sockets nor applies the AIO4C_ACCEPTOR_*
+ *   admission, placement and memory pausing settings meant for the
+ *   application, and its pipes are not published in the statistics segment.
  * @return
  *   A pointer to the Acceptor structure.
  *
  * @see Address
  * @see NewConnectionFactory(BufferPool,void*(*)(Connection*,void*),void*)
  */
-extern AIO4C_API Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbPipes);
+extern AIO4C_API Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbPipes, ThreadPolicy* policies, bool internal);
+
+/**
+ * @fn int AcceptorGetPipesLoad(Acceptor*,PipeLoad*,int)
+ * @brief Retrieves the load of each pipe of an Acceptor.
+ *
+ * @param acceptor
+ *   The Acceptor to retrieve pipes load from.
+ * @param loads
+ *   Array receiving the load of each pipe.
+ * @param size
+ *   Number of elements of the loads array.
+ * @return
+ *   The number of pipes whose load was stored in loads.
+ */
+extern AIO4C_API int AcceptorGetPipesLoad(Acceptor* acceptor, PipeLoad* loads, int size);
+
+/**
+ * @fn int AcceptorGetPipesCounters(Acceptor*,PipeCounters*,int)
+ * @brief Retrieves the activity counters of each pipe of an Acceptor.
+ *
+ * The counters are read while the pipes go on running, without taking any
+ * lock, so that the counters of one pipe may be sampled a few events apart.
+ *
+ * @param acceptor
+ *   The Acceptor to retrieve pipes counters from.
+ * @param counters
+ *   Array receiving the counters of each pipe.
+ * @param size
+ *   Number of elements of the counters array.
+ * @return
+ *   The number of pipes whose counters were stored in counters.
+ */
+extern AIO4C_API int AcceptorGetPipesCounters(Acceptor* acceptor, PipeCounters* counters, int size);
+
+/**
+ * @fn int AcceptorGetConnectionsCounters(Acceptor*,void(*)(Connection*,ConnectionCounters*,void*),void*)
+ * @brief Visits the counters of each Connection managed by an Acceptor.
+ *
+ * The visitor is called from the calling thread, once the Acceptor's
+ * connection list has been copied and released. Each visited Connection is
+ * referenced until the visitor returns, so it cannot be freed meanwhile, but
+ * it may be closing; the visitor should only read from it.
+ *
+ * @param acceptor
+ *   The Acceptor to visit Connections of.
+ * @param visitor
+ *   Called with each Connection, a snapshot of its counters, and arg.
+ * @param arg
+ *   User argument passed to visitor.
+ * @return
+ *   The number of Connections visited.
+ *
+ * @see ConnectionGetCounters(Connection*,ConnectionCounters*)
+ */
+extern AIO4C_API int AcceptorGetConnectionsCounters(Acceptor* acceptor, void (*visitor)(Connection*,ConnectionCounters*,void*), void* arg);
+
+/**
+ * @fn void AcceptorGetCounters(Acceptor*,AcceptorCounters*)
+ * @brief Retrieves the admission counters of an Acceptor.
+ *
+ * @param acceptor
+ *   The Acceptor to retrieve counters from.
+ * @param counters
+ *   Receives the counters since the Acceptor was created.
+ */
+extern AIO4C_API void AcceptorGetCounters(Acceptor* acceptor, AcceptorCounters* counters);
+
+/**
+ * @fn int AcceptorGetListeningSockets(Acceptor*,aio4c_socket_t*,int)
+ * @brief Retrieves the listening sockets of an Acceptor.
+ *
+ * The sockets remain owned by the Acceptor, and are closed once it starts
+ * draining.
+ *
+ * @param acceptor
+ *   The Acceptor to retrieve listening sockets from.
+ * @param sockets
+ *   Array receiving the sockets.
+ * @param size
+ *   Number of elements of the sockets array.
+ * @return
+ *   The number of sockets stored in sockets.
+ */
+extern AIO4C_API int AcceptorGetListeningSockets(Acceptor* acceptor, aio4c_socket_t* sockets, int size);
+
+/**
+ * @fn int AcceptorDrain(Acceptor*)
+ * @brief Performs a drain pass over the Connections of an Acceptor.
+ *
+ * The first call closes the listening socket(s), so that no more connection
+ * is accepted. Each call then moves to PENDING_CLOSE the Connections that are
+ * CONNECTED and have no data waiting for their Worker, and enables their
+ * write interest, so that their output is flushed before their writing end
+ * is shut down. Busy Connections are left untouched until a later pass.
+ *
+ * The pass is performed by the Acceptor thread, so that close handlers never
+ * run on the caller; it may not be done yet when this function returns. When
+ * each pipe listens on its own socket, there is no Acceptor thread and the
+ * pass is performed by the caller, without holding any lock.
+ *
+ * @param acceptor
+ *   The Acceptor to drain.
+ * @return
+ *   The number of Connections still open before this pass.
+ *
+ * @see ServerDrain(Server*,int)
+ */
+extern AIO4C_API int AcceptorDrain(Acceptor* acceptor);
 
 /**
  * @fn void AcceptorEnd(Acceptor*)
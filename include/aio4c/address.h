@@ -86,6 +86,26 @@ typedef struct s_Address Address;
  */
 extern AIO4C_API Address* NewAddress(AddressType type, char* address, aio4c_port_t port);
 
+/**
+ * @fn Address* NewAddressFromSockAddr(AddressType,aio4c_addr_t*,int)
+ * @brief Allocates a new Address from a POSIX address structure.
+ *
+ * The structure is copied as is, no name resolution is performed. It is meant
+ * to wrap addresses returned by the system, for example by accept.
+ *
+ * @param type
+ *   The kind of address to create.
+ * @param addr
+ *   A pointer to the POSIX address structure matching the AddressType.
+ * @param size
+ *   The size of the POSIX address structure.
+ * @return
+ *   A pointer to the created Address.
+ *
+ * @see AddressType
+ */
+extern AIO4C_API Address* NewAddressFromSockAddr(AddressType type, aio4c_addr_t* addr, int size);
+
 /**
  * @fn aio4c_addr_t* AddressGetAddr(Address*)
  * @brief Gets this address POSIX structure.
@@ -125,7 +145,8 @@ extern AIO4C_API int AddressGetAddrSize(Address* address);
  * @brief Gets this address string representation
  *
  * According to this AddressType, returns the numeric representation of the IP,
- * followed by a colon, and the port number.
+ * followed by a colon, and the port number. The string is formatted the first
+ * time it is requested.
  *
  * @param address
  *   A pointer to the address to retrieve the member from.
@@ -26,7 +26,7 @@
  * @brief Provides memory allocation functions.
  *
  * This modules is provided to collect statistics about memory allocation in
- * the library.
+ * the library, and to account the memory it uses against a budget.
  *
  * @author blakawk
  */
@@ -96,4 +96,87 @@ extern AIO4C_API void* aio4c_realloc(void* ptr, int size);
  */
 extern AIO4C_API void aio4c_free(void* ptr);
 
+/**
+ * @var AIO4C_MEMORY_BUDGET
+ * @brief Memory the library may allocate, in bytes (option -Mb).
+ *
+ * When greater than 0, the memory allocated with aio4c_malloc/realloc is
+ * accounted against this budget, and the library reacts as the usage goes
+ * up:
+ *   - from AIO4C_MEMORY_PRESSURE, BufferPools grow one Buffer at a time,
+ *   - from AIO4C_MEMORY_CRITICAL, accepts and reads are paused,
+ *   - at AIO4C_MEMORY_EXHAUSTED, BufferPools stop growing and each Reader
+ *     closes its suspended Connection with the most data waiting for its
+ *     Worker, every AIO4C_MEMORY_POLL_INTERVAL.
+ * Accepts and reads resume once the usage went back under
+ * AIO4C_MEMORY_PRESSURE.
+ *
+ * Allocations are accounted per thread and published by batches of
+ * AIO4C_MEMORY_ACCOUNTING_BATCH bytes, so the usage seen may be off by that
+ * much per thread.
+ */
+extern AIO4C_API long long AIO4C_MEMORY_BUDGET;
+
+/**
+ * @def AIO4C_MEMORY_ACCOUNTING_BATCH
+ * @brief Bytes allocated or freed by a thread before being published.
+ */
+#ifndef AIO4C_MEMORY_ACCOUNTING_BATCH
+#define AIO4C_MEMORY_ACCOUNTING_BATCH (64 * 1024)
+#endif /* AIO4C_MEMORY_ACCOUNTING_BATCH */
+
+/**
+ * @def AIO4C_MEMORY_POLL_INTERVAL
+ * @brief Interval between two checks of the memory usage while paused, in milliseconds.
+ */
+#define AIO4C_MEMORY_POLL_INTERVAL 100
+
+/**
+ * @enum MemoryState
+ * @brief Usage of the memory budget.
+ */
+typedef enum e_MemoryState {
+    AIO4C_MEMORY_NORMAL = 0,    /**< Below 80% of the budget, or no budget */
+    AIO4C_MEMORY_PRESSURE = 1,  /**< From 80% of the budget */
+    AIO4C_MEMORY_CRITICAL = 2,  /**< From 90% of the budget */
+    AIO4C_MEMORY_EXHAUSTED = 3, /**< Budget reached */
+    AIO4C_MEMORY_STATE_MAX = 4  /**< Number of memory states */
+} MemoryState;
+
+/**
+ * @var MemoryStateString
+ * @brief Names of the memory states.
+ */
+extern AIO4C_API char* MemoryStateString[AIO4C_MEMORY_STATE_MAX];
+
+/**
+ * @fn long long MemoryGetUsed(void)
+ * @brief Gets the memory allocated by the library.
+ *
+ * @return
+ *   The number of bytes allocated with aio4c_malloc/realloc and not freed,
+ *   including their size headers.
+ */
+extern AIO4C_API long long MemoryGetUsed(void);
+
+/**
+ * @fn MemoryState MemoryGetState(void)
+ * @brief Gets the usage of the memory budget.
+ *
+ * This function is cheap enough to be called from handlers on each Event.
+ *
+ * @return
+ *   The MemoryState matching the current usage, AIO4C_MEMORY_NORMAL if no
+ *   budget is set.
+ */
+extern AIO4C_API MemoryState MemoryGetState(void);
+
+/**
+ * @fn void MemoryFlush(void)
+ * @brief Publishes the allocations accounted by the calling thread.
+ *
+ * Called by threads when exiting.
+ */
+extern AIO4C_API void MemoryFlush(void);
+
 #endif /* __AIO4C_ALLOC_H__ */
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/atomic.h
+ * @brief Provides atomic operations on integral values.
+ *
+ * Operations are mapped to the compiler's builtins, and all of them act as a
+ * full memory barrier.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_ATOMIC_H__
+#define __AIO4C_ATOMIC_H__
+
+#include <aio4c/types.h>
+
+/**
+ * @def AtomicGet(ptr)
+ * @brief Reads the value pointed by ptr.
+ *
+ * @param ptr
+ *   Pointer to the value to read.
+ * @return
+ *   The value pointed by ptr.
+ */
+#define AtomicGet(ptr) \
+    __sync_fetch_and_add(ptr, 0)
+
+/**
+ * @def AtomicAdd(ptr,value)
+ * @brief Adds value to the value pointed by ptr.
+ *
+ * @param ptr
+ *   Pointer to the value to modify.
+ * @param value
+ *   The value to add.
+ * @return
+ *   The value pointed by ptr after the addition.
+ */
+#define AtomicAdd(ptr,value) \
+    __sync_add_and_fetch(ptr, value)
+
+/**
+ * @def AtomicSub(ptr,value)
+ * @brief Subtracts value from the value pointed by ptr.
+ *
+ * @param ptr
+ *   Pointer to the value to modify.
+ * @param value
+ *   The value to subtract.
+ * @return
+ *   The value pointed by ptr after the subtraction.
+ */
+#define AtomicSub(ptr,value) \
+    __sync_sub_and_fetch(ptr, value)
+
+/**
+ * @def AtomicOr(ptr,mask)
+ * @brief Sets the bits of mask in the value pointed by ptr.
+ *
+ * @param ptr
+ *   Pointer to the value to modify.
+ * @param mask
+ *   The bits to set.
+ * @return
+ *   The value pointed by ptr before the modification.
+ */
+#define AtomicOr(ptr,mask) \
+    __sync_fetch_and_or(ptr, mask)
+
+/**
+ * @def AtomicAnd(ptr,mask)
+ * @brief Keeps only the bits of mask in the value pointed by ptr.
+ *
+ * @param ptr
+ *   Pointer to the value to modify.
+ * @param mask
+ *   The bits to keep.
+ * @return
+ *   The value pointed by ptr before the modification.
+ */
+#define AtomicAnd(ptr,mask) \
+    __sync_fetch_and_and(ptr, mask)
+
+/**
+ * @def AtomicCompareAndSwap(ptr,expected,value)
+ * @brief Sets the value pointed by ptr if it is equal to expected.
+ *
+ * @param ptr
+ *   Pointer to the value to modify.
+ * @param expected
+ *   The value that ptr must point to for the swap to occur.
+ * @param value
+ *   The new value.
+ * @return
+ *   true if the value has been swapped, false otherwise.
+ */
+#define AtomicCompareAndSwap(ptr,expected,value) \
+    __sync_bool_compare_and_swap(ptr, expected, value)
+
+/**
+ * @def AtomicBarrier()
+ * @brief Prevents memory accesses from being reordered across this point.
+ *
+ * Unlike the other operations, it can be used on read-only memory.
+ */
+#define AtomicBarrier() \
+    __sync_synchronize()
+
+#endif /* __AIO4C_ATOMIC_H__ */
@@ -144,6 +144,28 @@ extern AIO4C_API BufferPool* NewBufferPool(aio4c_size_t bufferSize);
  */
 extern AIO4C_API int GetBufferPoolBufferSize(BufferPool* pool);
 
+/**
+ * @fn int GetBufferPoolUsed(BufferPool*)
+ * @brief Retrieves the number of Buffers allocated from a BufferPool.
+ *
+ * @param pool
+ *   A pointer to the BufferPool.
+ * @return
+ *   The number of Buffers allocated and not yet released.
+ */
+extern AIO4C_API int GetBufferPoolUsed(BufferPool* pool);
+
+/**
+ * @fn int GetBufferPoolAvailable(BufferPool*)
+ * @brief Retrieves the number of Buffers a BufferPool holds.
+ *
+ * @param pool
+ *   A pointer to the BufferPool.
+ * @return
+ *   The number of Buffers ready to be allocated without growing the pool.
+ */
+extern AIO4C_API int GetBufferPoolAvailable(BufferPool* pool);
+
 /**
  * @fn Buffer* AllocateBuffer(BufferPool*)
  * @brief Allocates a Buffer from a BufferPool.
@@ -163,6 +185,21 @@ extern AIO4C_API int GetBufferPoolBufferSize(BufferPool* pool);
  */
 extern AIO4C_API Buffer* AllocateBuffer(BufferPool* pool);
 
+/**
+ * @fn void BufferPoolReserve(BufferPool*)
+ * @brief Refills a BufferPool from the calling thread.
+ *
+ * When fewer than AIO4C_BUFFER_POOL_BATCH_SIZE Buffers are left, allocates
+ * the missing ones, unless memory is short. Their memory is then placed by
+ * the calling thread, which matters when it prefers its NUMA node.
+ *
+ * @param pool
+ *   A pointer to a BufferPool.
+ *
+ * @see AIO4C_THREAD_LOCAL_MEMORY
+ */
+extern AIO4C_API void BufferPoolReserve(BufferPool* pool);
+
 /**
  * @fn void ReleaseBuffer(Buffer**)
  * @brief Releases a Buffer to a BufferPool.
@@ -181,8 +218,9 @@ extern AIO4C_API void ReleaseBuffer(Buffer** pBuffer);
  * @fn void FreeBufferPool(BufferPool**)
  * @brief Frees a BufferPool.
  *
- * Frees all Buffers of the pool, then the BufferPool. If everything goes fine,
- * sets the BufferPool pointer to NULL.
+ * Frees all Buffers of the pool, then the BufferPool. Buffers still allocated
+ * from the pool are freed when released, and the last one frees the
+ * BufferPool. If everything goes fine, sets the BufferPool pointer to NULL.
  *
  * @param pool
  *   A pointer to a BufferPool's pointer.
@@ -740,4 +778,35 @@ extern AIO4C_API bool BufferPutString(Buffer* buffer, char* in);
  */
 extern AIO4C_API bool BufferPut(Buffer* buffer, void* in, int size);
 
+/**
+ * @fn bool BufferPutTimestamp(Buffer*)
+ * @brief Stores the current timestamp in a Buffer.
+ *
+ * Used to timestamp messages, in order to measure their latency once
+ * retrieved with BufferGetTimestamp by the same process.
+ *
+ * @param buffer
+ *   The Buffer where to store the timestamp.
+ * @return
+ *   true if the Buffer had enough remaining space.
+ *
+ * @see BufferPut
+ */
+extern AIO4C_API bool BufferPutTimestamp(Buffer* buffer);
+
+/**
+ * @fn bool BufferGetTimestamp(Buffer*,aio4c_clock_t*)
+ * @brief Retrieves a timestamp stored by BufferPutTimestamp.
+ *
+ * @param buffer
+ *   The Buffer to retrieve the timestamp from.
+ * @param stamp
+ *   Where to store the timestamp.
+ * @return
+ *   true if the Buffer had enough remaining data.
+ *
+ * @see BufferGet
+ */
+extern AIO4C_API bool BufferGetTimestamp(Buffer* buffer, aio4c_clock_t* stamp);
+
 #endif /* __AIO4C_BUFFER_H__ */
@@ -35,6 +35,7 @@
 
 #include <aio4c/address.h>
 #include <aio4c/connection.h>
+#include <aio4c/thread.h>
 #include <aio4c/types.h>
 
 /**
@@ -126,7 +127,8 @@ typedef void (*ClientHandler)(Event,Connection*,ClientHandlerData);
  * If you want to start the Client, uses ClientStart(Client*) function.
  *
  * @param clientIndex
- *   An index identifying the Client. Only used for debug purpose.
+ *   An index identifying the Client, also used to spread Clients over
+ *   AIO4C_THREAD_CPUS.
  * @param type
  *   The kind of AddressType the Client will handle.
  * @param address
@@ -163,6 +165,43 @@ extern AIO4C_API Client* NewClient(
         ClientHandler handler,
         ClientHandlerData arg);
 
+/**
+ * @fn void ClientSetPolicy(Client*,ThreadPolicy*)
+ * @brief Sets the ThreadPolicy of a Client.
+ *
+ * The policy applies to the Client thread and to the threads of its pipe.
+ * It must be set before the Client is started, otherwise the default policy
+ * given by ThreadPolicyForPipe is used.
+ *
+ * @param client
+ *   A pointer to the Client to configure.
+ * @param policy
+ *   The ThreadPolicy to use, or NULL for system defaults.
+ *
+ * @see ThreadPolicy
+ */
+extern AIO4C_API void ClientSetPolicy(Client* client, ThreadPolicy* policy);
+
+/**
+ * @fn void ClientSetTimeouts(Client*,ConnectionTimeouts*)
+ * @brief Sets the inactivity timeouts of a Client's Connection.
+ *
+ * Timeouts are given in milliseconds, 0 disabling them:
+ *   - read: time without receiving data,
+ *   - write: time without sending data,
+ *   - idle: time without receiving nor sending data.
+ *
+ * When one of them expires, the Connection is closed, or if notify is set,
+ * the handler receives an AIO4C_IDLE_EVENT once per expired period. They
+ * apply to the Connections established after this call.
+ *
+ * @param client
+ *   A pointer to the Client to configure.
+ * @param timeouts
+ *   The timeouts to use, or NULL to disable them.
+ */
+extern AIO4C_API void ClientSetTimeouts(Client* client, ConnectionTimeouts* timeouts);
+
 /**
  * @fn bool ClientStart(Client*)
  * @brief Starts a Client.
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/clock.h
+ * @brief Provides a monotonic clock for probes and timestamps.
+ *
+ * Timestamps are taken from a clock that is not affected by system time
+ * changes. The source is chosen once at initialization, and timestamps are
+ * expressed in ticks of that source, which are only meaningful in the
+ * process that took them.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_CLOCK_H__
+#define __AIO4C_CLOCK_H__
+
+#include <aio4c/types.h>
+
+/**
+ * @def AIO4C_CLOCK_CALIBRATION_TIME
+ * @brief Time spent calibrating the TSC against the monotonic clock, in milliseconds.
+ */
+#define AIO4C_CLOCK_CALIBRATION_TIME 20
+
+/**
+ * @enum ClockSource
+ * @brief Sources of timestamps.
+ */
+typedef enum e_ClockSource {
+    AIO4C_CLOCK_MONOTONIC = 0,        /**< CLOCK_MONOTONIC, precise but slewed by NTP */
+    AIO4C_CLOCK_MONOTONIC_COARSE = 1, /**< CLOCK_MONOTONIC_COARSE, cheapest, with the resolution of the kernel tick */
+    AIO4C_CLOCK_MONOTONIC_RAW = 2,    /**< CLOCK_MONOTONIC_RAW, precise and never slewed */
+    AIO4C_CLOCK_TSC = 3,              /**< Time stamp counter calibrated at initialization, requires an invariant TSC */
+    AIO4C_CLOCK_SOURCE_MAX = 4        /**< Number of clock sources */
+} ClockSource;
+
+/**
+ * @var ClockSourceString
+ * @brief Names of the clock sources.
+ */
+extern AIO4C_API char* ClockSourceString[AIO4C_CLOCK_SOURCE_MAX];
+
+/**
+ * @var AIO4C_CLOCK_SOURCE
+ * @brief The source of timestamps.
+ *
+ * Must only be changed before ClockInit, falls back to AIO4C_CLOCK_MONOTONIC
+ * when the source is not available.
+ */
+extern AIO4C_API ClockSource AIO4C_CLOCK_SOURCE;
+
+/**
+ * @fn void ClockInit(void)
+ * @brief Initializes the clock source.
+ *
+ * Checks that AIO4C_CLOCK_SOURCE is available, and calibrates the TSC if it
+ * was chosen. Called by Aio4cInit.
+ */
+extern AIO4C_API void ClockInit(void);
+
+/**
+ * @fn aio4c_clock_t _ClockNow(void)
+ * @brief Takes a timestamp from the system clock.
+ *
+ * Use ClockNow instead.
+ */
+extern AIO4C_API aio4c_clock_t _ClockNow(void);
+
+/**
+ * @fn aio4c_clock_t ClockNow(void)
+ * @brief Takes a timestamp.
+ *
+ * Reads the TSC inline when it is the clock source, otherwise reads the
+ * system clock.
+ *
+ * @return
+ *   The current timestamp, in ticks of the clock source.
+ */
+static inline aio4c_clock_t ClockNow(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int low = 0, high = 0;
+
+    if (AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_TSC) {
+        __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+        return ((aio4c_clock_t)high << 32) | (aio4c_clock_t)low;
+    }
+#endif /* __i386__ || __x86_64__ */
+
+    return _ClockNow();
+}
+
+/**
+ * @fn long long ClockElapsed(aio4c_clock_t,aio4c_clock_t)
+ * @brief Computes the time elapsed between two timestamps.
+ *
+ * @param start
+ *   The timestamp taken first.
+ * @param stop
+ *   The timestamp taken last.
+ * @return
+ *   The elapsed time in nanoseconds, negative if stop was taken before start.
+ */
+extern AIO4C_API long long ClockElapsed(aio4c_clock_t start, aio4c_clock_t stop);
+
+/**
+ * @fn aio4c_time_t ClockMicroseconds(void)
+ * @brief Reads the clock in microseconds.
+ *
+ * Meant for deadlines kept as plain numbers, such as timer wheels or token
+ * buckets. The origin is unspecified, only differences between two values
+ * are meaningful.
+ *
+ * @return
+ *   The current time, in microseconds.
+ */
+extern AIO4C_API aio4c_time_t ClockMicroseconds(void);
+
+#endif /* __AIO4C_CLOCK_H__ */
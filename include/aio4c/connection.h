@@ -27,8 +27,8 @@
 #include <aio4c/address.h>
 #include <aio4c/buffer.h>
 #include <aio4c/event.h>
-#include <aio4c/lock.h>
 #include <aio4c/selector.h>
+#include <aio4c/timer.h>
 #include <aio4c/types.h>
 
 typedef enum e_ConnectionState {
@@ -49,31 +49,93 @@ typedef enum e_ConnectionOwner {
     AIO4C_CONNECTION_OWNER_WRITER,
     AIO4C_CONNECTION_OWNER_ACCEPTOR,
     AIO4C_CONNECTION_OWNER_CLIENT,
+    AIO4C_CONNECTION_OWNER_MIGRATION,
     AIO4C_CONNECTION_OWNER_MAX
 } ConnectionOwner;
 
+#define AIO4C_CONNECTION_OWNER_MASK(owner) \
+    (1u << (owner))
+
+#define AIO4C_CONNECTION_OWNER_ALL \
+    (AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MAX) - 1u)
+
+/* references taken by ConnectionRetain are counted above the owner bits */
+#define AIO4C_CONNECTION_REFERENCE \
+    (1u << 8)
+
+#ifndef AIO4C_CONNECTION_POOL_BATCH_SIZE
+#define AIO4C_CONNECTION_POOL_BATCH_SIZE 64
+#endif /* AIO4C_CONNECTION_POOL_BATCH_SIZE */
+
+#define AIO4C_CONNECTION_STRING_SIZE 256
+
+typedef struct s_ConnectionTimeouts {
+    int  read;
+    int  write;
+    int  idle;
+    bool notify;
+} ConnectionTimeouts;
+
+typedef struct s_WaterMarks {
+    int highBytes;
+    int lowBytes;
+    int highItems;
+    int lowItems;
+} WaterMarks;
+
+extern AIO4C_API WaterMarks AIO4C_CONNECTION_WATER_MARKS;
+
+typedef struct s_OverloadControl {
+    int target;
+    int interval;
+} OverloadControl;
+
+extern AIO4C_API OverloadControl AIO4C_CONNECTION_OVERLOAD_CONTROL;
+
+/* CoDel state of a worker queue, times are in microseconds */
+typedef struct s_OverloadState {
+    aio4c_time_t firstAbove;
+    aio4c_time_t dropNext;
+    int          count;
+    int          lastCount;
+    bool         dropping;
+} OverloadState;
+
+typedef struct s_ConnectionCounters {
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+    unsigned long long messagesIn;
+    unsigned long long messagesOut;
+    /* only accounted while the connection statistics are enabled */
+    unsigned long long handlerTime;
+} ConnectionCounters;
+
 #ifndef __AIO4C_CONNECTION_DEFINED__
 #define __AIO4C_CONNECTION_DEFINED__
 typedef struct s_Connection Connection;
 #endif /* __AIO4C_CONNECTION_DEFINED__ */
 
+#ifndef __AIO4C_CONNECTION_POOL_DEFINED__
+#define __AIO4C_CONNECTION_POOL_DEFINED__
+typedef struct s_ConnectionPool ConnectionPool;
+#endif /* __AIO4C_CONNECTION_POOL_DEFINED__ */
+
 struct s_Connection {
     Buffer*              readBuffer;
     Buffer*              writeBuffer;
     Buffer*              dataBuffer;
     aio4c_socket_t       socket;
     Address*             address;
-    ConnectionState      state;
-    Lock*                stateLock;
+    volatile ConnectionState state;
     EventQueue*          systemHandlers;
     EventQueue*          userHandlers;
+    EventQueue*          ownerHandlers[AIO4C_CONNECTION_OWNER_MAX];
+    volatile unsigned int handledEvents;
     bool         closedForError;
     char*                string;
-    bool                 stringAllocated;
-    bool         closedBy[AIO4C_CONNECTION_OWNER_MAX];
-    Lock*                closedByLock;
-    bool         managedBy[AIO4C_CONNECTION_OWNER_MAX];
-    Lock*                managedByLock;
+    char                 stringBuffer[AIO4C_CONNECTION_STRING_SIZE];
+    volatile unsigned int closedBy;
+    volatile unsigned int managedBy;
     SelectionKey*        readKey;
     SelectionKey*        writeKey;
     BufferPool*          pool;
@@ -83,6 +145,30 @@ struct s_Connection {
     void*              (*dataFactory)(Connection*,void*);
     void*                dataFactoryArg;
     bool         isFactory;
+    Connection*          factory;
+    void*                data;
+    ConnectionPool*      connectionPool;
+    Connection*          nextFree;
+    struct s_Reader*     reader;
+    struct s_Reader*     migrateTo;
+    Timer*               timers;
+    ConnectionTimeouts   timeouts;
+    volatile aio4c_time_t lastRead;
+    volatile aio4c_time_t lastWrite;
+    TimerId              idleTimer;
+    WaterMarks           marks;
+    volatile int         pendingItems;
+    volatile int         pendingBytes;
+    volatile bool        readSuspended;
+    struct s_Node*       suspendedNode;
+    OverloadControl      overload;
+    volatile ConnectionCounters counters;
+    /* traffic seen by the rebalancer at its last check, and between its last two checks */
+    ConnectionCounters   sampled;
+    ConnectionCounters   recent;
+    unsigned int         traceRead;
+    volatile unsigned int traceProcess;
+    volatile unsigned int traceWrite;
 };
 
 #define aio4c_connection_handler(handler) \
@@ -95,7 +181,11 @@ extern AIO4C_API Connection* NewConnection(BufferPool* pool, Address* address, b
 
 extern AIO4C_API Connection* NewConnectionFactory(BufferPool* pool, void* (*dataFactory)(Connection*,void*), void* dataFactoryArg);
 
-extern AIO4C_API Connection* ConnectionFactoryCreate(Connection* factory, Address* address, aio4c_socket_t sock);
+extern AIO4C_API Connection* ConnectionFactoryCreate(Connection* factory, ConnectionPool* pool, BufferPool* buffers, Address* address, aio4c_socket_t sock);
+
+extern AIO4C_API ConnectionPool* NewConnectionPool(void);
+
+extern AIO4C_API void FreeConnectionPool(ConnectionPool** pool);
 
 #define ConnectionState(connection,state) \
     _ConnectionState(__FILE__, __LINE__, connection, state)
@@ -111,6 +201,20 @@ extern AIO4C_API Connection* ConnectionRead(Connection* connection);
 
 extern AIO4C_API Connection* ConnectionProcessData(Connection* connection);
 
+extern AIO4C_API Connection* ConnectionIdle(Connection* connection);
+
+extern AIO4C_API Connection* ConnectionOverload(Connection* connection);
+
+extern AIO4C_API void ConnectionSetTimeouts(Connection* connection, ConnectionTimeouts* timeouts);
+
+extern AIO4C_API void ConnectionSetWaterMarks(Connection* connection, WaterMarks* marks);
+
+extern AIO4C_API void ConnectionSetOverloadControl(Connection* connection, OverloadControl* overload);
+
+extern AIO4C_API aio4c_time_t OverloadControlLaw(aio4c_time_t time, aio4c_time_t interval, int count);
+
+extern AIO4C_API bool OverloadShouldShed(OverloadControl* control, OverloadState* state, aio4c_time_t now, aio4c_time_t sojourn, bool backlog);
+
 extern AIO4C_API void EnableWriteInterest(Connection* connection);
 
 extern AIO4C_API bool ConnectionWrite(Connection* connection);
@@ -121,6 +225,10 @@ extern AIO4C_API Connection* ConnectionClose(Connection* connection, bool force)
 
 extern AIO4C_API bool ConnectionNoMoreUsed(Connection* connection, ConnectionOwner owner);
 
+extern AIO4C_API void ConnectionRetain(Connection* connection);
+
+extern AIO4C_API void ConnectionRelease(Connection* connection);
+
 extern AIO4C_API void ConnectionManagedBy(Connection* connection, ConnectionOwner owner);
 
 extern AIO4C_API Connection* ConnectionAddHandler(Connection* connection, Event event, void (*handler)(Event,Connection*,void*), void* arg, bool once);
@@ -133,6 +241,8 @@ extern AIO4C_API Buffer* ConnectionGetReadBuffer(Connection* connection);
 
 extern AIO4C_API char* ConnectionGetString(Connection* connection);
 
+extern AIO4C_API void ConnectionGetCounters(Connection* connection, ConnectionCounters* counters);
+
 extern AIO4C_API void FreeConnection(Connection** connection);
 
 #endif
@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/contention.h
+ * @brief Profiles the contention of locks.
+ *
+ * When enabled, TakeLock first tries to acquire the lock without blocking,
+ * and only when the lock is held by another thread measures how long it
+ * waited for it. Acquisitions, contended acquisitions and a histogram of
+ * the waits are then accounted both to the call site of TakeLock and to
+ * the Lock itself, in fixed tables updated without any lock.
+ *
+ * Call sites are looked up before the lock is taken. Each Lock keeps the
+ * entry it was given the first time it was taken, described by that call
+ * site, and retires it when freed. Locks reacquired by WaitCondition are
+ * not accounted.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_CONTENTION_H__
+#define __AIO4C_CONTENTION_H__
+
+#include <aio4c/types.h>
+
+#include <stdio.h>
+
+/**
+ * @def AIO4C_CONTENTION_MAX_SITES
+ * @brief Maximum number of call sites profiled, must be a power of two.
+ *
+ * Acquisitions from call sites found beyond this number are not accounted,
+ * and no longer look for a free entry.
+ */
+#ifndef AIO4C_CONTENTION_MAX_SITES
+#define AIO4C_CONTENTION_MAX_SITES 1024
+#endif /* AIO4C_CONTENTION_MAX_SITES */
+
+/**
+ * @def AIO4C_CONTENTION_MAX_LOCKS
+ * @brief Maximum number of locks profiled, must be a power of two.
+ *
+ * Acquisitions of locks created beyond this number are not accounted.
+ */
+#ifndef AIO4C_CONTENTION_MAX_LOCKS
+#define AIO4C_CONTENTION_MAX_LOCKS 1024
+#endif /* AIO4C_CONTENTION_MAX_LOCKS */
+
+/**
+ * @def AIO4C_CONTENTION_BUCKETS
+ * @brief Number of buckets of the wait histograms.
+ *
+ * Bucket n counts the waits lasting less than 2^n nanoseconds, and at
+ * least 2^(n-1). The last bucket counts every longer wait.
+ */
+#define AIO4C_CONTENTION_BUCKETS 40
+
+/**
+ * @var AIO4C_CONTENTION_TOP
+ * @brief Number of call sites and locks reported by ContentionEnd.
+ *
+ * When 0, which is the default, contention is not profiled.
+ */
+extern AIO4C_API int AIO4C_CONTENTION_TOP;
+
+/**
+ * @var AIO4C_CONTENTION_FILE
+ * @brief Where ContentionEnd reports contention.
+ *
+ * Defaults to stderr when NULL.
+ */
+extern AIO4C_API char* AIO4C_CONTENTION_FILE;
+
+/**
+ * @typedef ContentionEntry
+ * @brief Contention accounted to a call site or to a lock.
+ */
+typedef struct s_ContentionEntry ContentionEntry;
+
+/**
+ * @fn int ContentionBucket(long long)
+ * @brief Gives the histogram bucket of a wait.
+ *
+ * @param wait
+ *   The wait, in nanoseconds.
+ * @return
+ *   The bit length of wait, at most AIO4C_CONTENTION_BUCKETS - 1.
+ */
+extern AIO4C_API int ContentionBucket(long long wait);
+
+/**
+ * @fn double ContentionPercentile(volatile unsigned long long*,unsigned long long,unsigned long long,double)
+ * @brief Estimates a percentile of the waits from their histogram.
+ *
+ * @param histogram
+ *   The AIO4C_CONTENTION_BUCKETS counts of the waits.
+ * @param contentions
+ *   How many waits the histogram counts.
+ * @param longest
+ *   The longest wait, in nanoseconds.
+ * @param fraction
+ *   The fraction of the waits, between 0 and 1.
+ * @return
+ *   The upper bound of the bucket holding that fraction of the waits, at
+ *   most longest, in microseconds.
+ */
+extern AIO4C_API double ContentionPercentile(volatile unsigned long long* histogram, unsigned long long contentions, unsigned long long longest, double fraction);
+
+/**
+ * @fn ContentionEntry* ContentionSite(char*,int)
+ * @brief Accounts an acquisition to a call site.
+ *
+ * Called by TakeLock before the lock is taken, when AIO4C_CONTENTION_TOP
+ * is not 0.
+ *
+ * @param file
+ *   The source file of the call site.
+ * @param line
+ *   The line of the call site.
+ * @return
+ *   The entry of the call site, or NULL if it is not accounted.
+ */
+extern AIO4C_API ContentionEntry* ContentionSite(char* file, int line);
+
+/**
+ * @fn ContentionEntry* ContentionClaim(char*,int,void*)
+ * @brief Gives an entry to a lock.
+ *
+ * Called by TakeLock the first time the lock is taken.
+ *
+ * @param file
+ *   The source file of the call site.
+ * @param line
+ *   The line of the call site.
+ * @param lock
+ *   The acquired lock.
+ * @return
+ *   The entry of the lock, or NULL if every entry is used.
+ */
+extern AIO4C_API ContentionEntry* ContentionClaim(char* file, int line, void* lock);
+
+/**
+ * @fn void ContentionAccount(ContentionEntry*,ContentionEntry*,long long)
+ * @brief Accounts an acquisition to a lock, and a wait to both.
+ *
+ * Called by TakeLock once the lock is acquired.
+ *
+ * @param site
+ *   The entry of the call site, or NULL.
+ * @param lock
+ *   The entry of the lock, or NULL.
+ * @param wait
+ *   How long the lock was waited for, in nanoseconds, or a negative value
+ *   if it was acquired without waiting.
+ */
+extern AIO4C_API void ContentionAccount(ContentionEntry* site, ContentionEntry* lock, long long wait);
+
+/**
+ * @fn void ContentionRetire(ContentionEntry*)
+ * @brief Marks the entry of a freed lock.
+ *
+ * Called by FreeLock. The entry keeps being reported.
+ *
+ * @param entry
+ *   The entry of the lock, or NULL.
+ */
+extern AIO4C_API void ContentionRetire(ContentionEntry* entry);
+
+/**
+ * @fn bool ContentionWrite(FILE*,int)
+ * @brief Reports the most contended call sites and locks.
+ *
+ * Both are sorted by total time waited. Can be called at any time, threads
+ * keep accounting meanwhile.
+ *
+ * @param file
+ *   Where to write the report.
+ * @param top
+ *   How many call sites and locks to report.
+ * @return
+ *   true if the report was written, false otherwise.
+ */
+extern AIO4C_API bool ContentionWrite(FILE* file, int top);
+
+/**
+ * @fn void ContentionEnd(void)
+ * @brief Reports contention into AIO4C_CONTENTION_FILE, if it was profiled.
+ *
+ * Called by Aio4cEnd.
+ */
+extern AIO4C_API void ContentionEnd(void);
+
+#endif /* __AIO4C_CONTENTION_H__ */
@@ -78,7 +78,12 @@ typedef enum e_Error {
     AIO4C_THREAD_JOIN_ERROR = 28,              /**< Thread join error */
     AIO4C_ALLOC_ERROR = 29,                    /**< Memory allocation error */
     AIO4C_JNI_FIELD_ERROR = 30,                /**< JNI field access error */
-    AIO4C_MAX_ERRORS = 31                      /**< Number of errors */
+    AIO4C_ACCEPT_ERROR = 31,                   /**< Connection acceptation error */
+    AIO4C_THREAD_AFFINITY_ERROR = 32,          /**< Thread CPU affinity error */
+    AIO4C_THREAD_SCHEDULING_ERROR = 33,        /**< Thread scheduling policy error */
+    AIO4C_THREAD_MEMORY_POLICY_ERROR = 34,     /**< Thread NUMA memory policy error */
+    AIO4C_HANDOVER_ERROR = 35,                 /**< Sockets hand over error */
+    AIO4C_MAX_ERRORS = 36                      /**< Number of errors */
 } Error;
 
 /**
@@ -227,7 +232,7 @@ typedef struct s_ErrorCode {
  * @param code
  *   Pointer to the ErrorCode information associated with the Error
  *
- * @see void Log(LogLevel,char*,...)
+ * @see Log(level,...)
  */
 extern AIO4C_API void _Raise(char* file, int line, LogLevel level, ErrorType type, Error error, ErrorCode* code);
 
@@ -49,7 +49,10 @@ typedef enum e_EventType {
     AIO4C_PENDING_CLOSE_EVENT = 7, /**< Event received when a Connection is about to be closed. */
     AIO4C_CLOSE_EVENT = 8,         /**< Event received when a Connection is closed. */
     AIO4C_FREE_EVENT = 9,          /**< Event received when a Connection is freed. */
-    AIO4C_EVENTS_COUNT = 10        /**< The number of Events. */
+    AIO4C_MIGRATE_EVENT = 10,      /**< Event used internally to move a Connection to another pipe, never dispatched to handlers. */
+    AIO4C_IDLE_EVENT = 11,         /**< Event received when a Connection reaches one of its inactivity timeouts, if notification was requested. */
+    AIO4C_OVERLOAD_EVENT = 12,     /**< Event received in place of AIO4C_READ_EVENT when the Worker sheds a task because its queue is overloaded. */
+    AIO4C_EVENTS_COUNT = 13        /**< The number of Events. */
 } Event;
 
 /**
@@ -161,6 +164,28 @@ extern AIO4C_API EventQueue* EventHandlerAdd(EventQueue* queue, EventHandler* ha
  */
 extern AIO4C_API void EventHandle(EventQueue* queue, Event event, EventSource source);
 
+/**
+ * @fn void EventDispatch(EventQueue*,Event,EventSource,EventData,bool)
+ * @brief Handle an Event without modifying the EventQueue.
+ *
+ * Unlike EventHandle, the EventQueue is left untouched, so that it can be shared
+ * between several EventSources as long as no EventHandler is added or removed
+ * while Events are dispatched. The caller keeps track of the EventHandlers to be
+ * called only once using the first parameter.
+ *
+ * @param queue
+ *   A pointer to the EventQueue.
+ * @param event
+ *   The Event to handle.
+ * @param source
+ *   The EventSource of the Event.
+ * @param data
+ *   If not NULL, this data will be passed to the EventHandlers instead of their own.
+ * @param first
+ *   If <code>false</code>, the EventHandlers set to be called only once are skipped.
+ */
+extern AIO4C_API void EventDispatch(EventQueue* queue, Event event, EventSource source, EventData data, bool first);
+
 /**
  * @fn void EventHandlerRemove(EventQueue*,Event,EventCallback)
  * @brief Remove an EventHandler from an EventQueue.
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/handover.h
+ * @brief Hands listening sockets over to another process.
+ *
+ * A Server being restarted passes its listening sockets to the process
+ * replacing it over an AF_UNIX socket, using SCM_RIGHTS. Both processes
+ * share the same sockets, so that the new one accepts incoming connections
+ * as soon as it received them, while the old one drains its own connections.
+ * No connection is refused meanwhile.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_HANDOVER_H__
+#define __AIO4C_HANDOVER_H__
+
+#include <aio4c/types.h>
+
+/**
+ * @def AIO4C_HANDOVER_MAX_SOCKETS
+ * @brief Maximum number of sockets handed over at once.
+ */
+#define AIO4C_HANDOVER_MAX_SOCKETS 64
+
+/**
+ * @def AIO4C_HANDOVER_RETRY_INTERVAL
+ * @brief Interval between two connection attempts of a receiving process, in milliseconds.
+ */
+#define AIO4C_HANDOVER_RETRY_INTERVAL 100
+
+/**
+ * @var AIO4C_HANDOVER_TIMEOUT
+ * @brief Maximum time a hand over waits for the other process, in milliseconds.
+ */
+extern AIO4C_API int AIO4C_HANDOVER_TIMEOUT;
+
+/**
+ * @fn bool HandOverSend(char*,aio4c_socket_t*,int,int)
+ * @brief Sends sockets to another process.
+ *
+ * Binds an AF_UNIX socket to path, only accessible to the current user,
+ * waits for a process of the same user to connect to it and sends it the
+ * sockets. Returns once the receiving process acknowledged them, the sockets
+ * can then be closed in this process without being closed in the receiving
+ * one. The path is removed before returning.
+ *
+ * @param path
+ *   The path of the AF_UNIX socket.
+ * @param sockets
+ *   The sockets to send.
+ * @param count
+ *   The number of sockets to send, at most AIO4C_HANDOVER_MAX_SOCKETS.
+ * @param timeout
+ *   Maximum time to wait for the receiving process, in milliseconds.
+ * @return
+ *   true if the sockets were received, false if they were refused or not
+ *   received, in which case this process should keep using them.
+ */
+extern AIO4C_API bool HandOverSend(char* path, aio4c_socket_t* sockets, int count, int timeout);
+
+/**
+ * @fn int HandOverReceive(char*,aio4c_socket_t*,int,int,bool(*)(aio4c_socket_t,void*),void*)
+ * @brief Receives sockets sent by another process.
+ *
+ * Connects to the AF_UNIX socket bound to path by HandOverSend, retrying
+ * every AIO4C_HANDOVER_RETRY_INTERVAL milliseconds until the sending process
+ * is ready. The sending process must belong to the same user.
+ *
+ * Each received socket is given to check before the hand over is
+ * acknowledged. If one of them is refused, they are all closed and the
+ * sending process is told to keep them.
+ *
+ * @param path
+ *   The path of the AF_UNIX socket.
+ * @param sockets
+ *   Array receiving the sockets.
+ * @param size
+ *   The number of elements of sockets. Sockets received beyond it are closed.
+ * @param timeout
+ *   Maximum time to wait for the sending process, in milliseconds.
+ * @param check
+ *   Called with each received socket and arg, returns true if the socket
+ *   can be used. May be NULL to accept any socket.
+ * @param arg
+ *   User argument passed to check.
+ * @return
+ *   The number of sockets stored in sockets, 0 if none was received.
+ */
+extern AIO4C_API int HandOverReceive(char* path, aio4c_socket_t* sockets, int size, int timeout, bool (*check)(aio4c_socket_t,void*), void* arg);
+
+#endif /* __AIO4C_HANDOVER_H__ */
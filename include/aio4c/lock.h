@@ -96,12 +96,14 @@ typedef struct s_Thread Thread;
 #define AIO4C_LOCK_INITIALIZER {       \
     .state = AIO4C_LOCK_STATE_NONE,    \
     .owner = NULL,                     \
+    .contention = NULL,                \
     .mutex = PTHREAD_MUTEX_INITIALIZER \
 }
 #else /* AIO4C_WIN32 */
 #define AIO4C_LOCK_INITIALIZER {      \
     .state = AIO4C_LOCK_STATE_NONE,   \
-    .owner = NULL                     \
+    .owner = NULL,                    \
+    .contention = NULL                \
 }
 #endif /* AIO4C_WIN32 */
 
@@ -59,7 +59,12 @@ extern char* AIO4C_LOG_FILE;
 
 extern AIO4C_API void LogInit(void (*handler)(void*,LogLevel,char*), void* logger);
 
-extern AIO4C_API void Log(LogLevel level, char* message, ...) __attribute__((format(printf,2,3)));
+extern AIO4C_API bool LogEnabled(LogLevel level);
+
+/* arguments are only evaluated when the level is logged, some are formatted on first use */
+#define Log(level, ...) \
+    do { if (LogEnabled(level)) _Log(level, __VA_ARGS__); } while (0)
+extern AIO4C_API void _Log(LogLevel level, char* message, ...) __attribute__((format(printf,2,3)));
 
 extern AIO4C_API void LogBuffer(LogLevel level, Buffer* buffer);
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/metrics.h
+ * @brief Serves statistics in the Prometheus text exposition format.
+ *
+ * When AIO4C_METRICS_PORT is set, a dedicated single pipe Server answers
+ * HTTP GET requests to /metrics with the last update of the statistics
+ * segment: the time probes histograms, the size probes totals and the
+ * counters of each Server pipe. Responses are rendered from a copy of the
+ * segment, so that a scrape never takes a lock of the pipes it describes.
+ * When tracing is enabled, GET /trace returns the recorded events as Chrome
+ * trace events.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_METRICS_H__
+#define __AIO4C_METRICS_H__
+
+#include <aio4c/segment.h>
+#include <aio4c/types.h>
+
+#include <stdio.h>
+
+/**
+ * @def AIO4C_METRICS_REQUEST_SIZE
+ * @brief Maximum size of a request head, in bytes.
+ */
+#define AIO4C_METRICS_REQUEST_SIZE 2048
+
+/**
+ * @def AIO4C_METRICS_HEADER_SIZE
+ * @brief Space reserved in front of a response body for its header, in bytes.
+ */
+#define AIO4C_METRICS_HEADER_SIZE 256
+
+/**
+ * @def AIO4C_METRICS_BUFFER_SIZE
+ * @brief Size of the buffers of the metrics Server.
+ */
+#define AIO4C_METRICS_BUFFER_SIZE 8192
+
+/**
+ * @var AIO4C_METRICS_HOST
+ * @brief Address the metrics endpoint listens on.
+ *
+ * Defaults to localhost, so that statistics are not exposed to other hosts
+ * unless requested.
+ */
+extern AIO4C_API char* AIO4C_METRICS_HOST;
+
+/**
+ * @var AIO4C_METRICS_PORT
+ * @brief Port the metrics endpoint listens on.
+ *
+ * When 0, which is the default, the endpoint is not started.
+ */
+extern AIO4C_API int AIO4C_METRICS_PORT;
+
+/**
+ * @fn bool MetricsStart(void)
+ * @brief Starts the metrics endpoint.
+ *
+ * Called by Aio4cInit when AIO4C_METRICS_PORT is set. The metrics Server
+ * is internal: the Acceptor settings of the application do not apply to it,
+ * and its pipe is not published in the statistics segment.
+ *
+ * @return
+ *   true if the endpoint is listening, false otherwise.
+ */
+extern AIO4C_API bool MetricsStart(void);
+
+/**
+ * @fn void MetricsStop(void)
+ * @brief Stops the metrics endpoint, if it was started.
+ *
+ * Called by Aio4cEnd.
+ */
+extern AIO4C_API void MetricsStop(void);
+
+/**
+ * @fn bool MetricsWrite(FILE*,StatsSegment*)
+ * @brief Renders a statistics segment as answered to GET /metrics.
+ *
+ * @param file
+ *   Where to write the metrics.
+ * @param snapshot
+ *   A copy of the segment, as returned by StatsSegmentRead.
+ * @return
+ *   true if the metrics were written, false otherwise.
+ */
+extern AIO4C_API bool MetricsWrite(FILE* file, StatsSegment* snapshot);
+
+#endif /* __AIO4C_METRICS_H__ */
@@ -182,6 +182,14 @@ typedef struct s_QueueDiscriminant* QueueDiscriminant;
  */
 typedef bool (*QueueRemoveCallback)(QueueItem*,QueueDiscriminant);
 
+/**
+ * @typedef QueueVisitCallback
+ * @brief Callback called on each QueueItem visited by QueueForEach.
+ *
+ * Returns false to stop the visit.
+ */
+typedef bool (*QueueVisitCallback)(QueueItem*,void*);
+
 /**
  * @fn Queue* NewQueue(void)
  * @brief Allocates a Queue.
@@ -292,7 +300,7 @@ extern AIO4C_API Event QueueEventItemGetEvent(QueueItem* item);
 extern AIO4C_API EventSource QueueEventItemGetSource(QueueItem* item);
 
 /**
- * @fn bool EnqueueTaskItem(Queue*,Event,Connection*,Buffer*)
+ * @fn bool EnqueueTaskItem(Queue*,Event,Connection*,Buffer*,aio4c_clock_t,unsigned int)
  * @brief Enqueue an item of type TASK.
  *
  * A QueueItem of type TASK allows to send a Task to a Worker in order to process
@@ -306,10 +314,17 @@ extern AIO4C_API EventSource QueueEventItemGetSource(QueueItem* item);
  *   The Connection associated with the Buffer and the Event.
  * @param buffer
  *   The Buffer to retrieve data from.
+ * @param enqueued
+ *   The time of enqueue as returned by ClockNow, or 0 when nobody needs to
+ *   know how long the Task waited.
+ * @param trace
+ *   The trace identifier of the data, 0 if it is not traced.
  * @return
  *   <code>true</code> if the item has been enqueued with success, else <code>false</code>.
+ *
+ * @see TraceSample()
  */
-extern AIO4C_API bool EnqueueTaskItem(Queue* queue, Event event, Connection* connection, Buffer* buffer);
+extern AIO4C_API bool EnqueueTaskItem(Queue* queue, Event event, Connection* connection, Buffer* buffer, aio4c_clock_t enqueued, unsigned int trace);
 
 /**
  * @fn Event QueueTaskItemGetEvent(QueueItem*)
@@ -344,6 +359,28 @@ extern AIO4C_API Connection* QueueTaskItemGetConnection(QueueItem* item);
  */
 extern AIO4C_API Buffer* QueueTaskItemGetBuffer(QueueItem* item);
 
+/**
+ * @fn aio4c_clock_t QueueTaskItemGetTime(QueueItem*)
+ * @brief Gets the time a QueueItem of type TASK was enqueued at.
+ *
+ * @param item
+ *   Pointer to the QueueItem.
+ * @return
+ *   The time given to EnqueueTaskItem, 0 if the Task was not stamped.
+ */
+extern AIO4C_API aio4c_clock_t QueueTaskItemGetTime(QueueItem* item);
+
+/**
+ * @fn unsigned int QueueTaskItemGetTrace(QueueItem*)
+ * @brief Gets the trace identifier of a QueueItem of type TASK.
+ *
+ * @param item
+ *   Pointer to the QueueItem.
+ * @return
+ *   The trace identifier given to EnqueueTaskItem, 0 if the Task is not traced.
+ */
+extern AIO4C_API unsigned int QueueTaskItemGetTrace(QueueItem* item);
+
 /**
  * @fn bool Dequeue(Queue*,QueueItem*,bool)
  * @brief Dequeue an item from a Queue.
@@ -366,6 +403,20 @@ extern AIO4C_API Buffer* QueueTaskItemGetBuffer(QueueItem* item);
  */
 extern AIO4C_API bool Dequeue(Queue* queue, QueueItem* item, bool wait);
 
+/**
+ * @fn int QueueGetSize(Queue*)
+ * @brief Retrieves the number of items waiting in a Queue.
+ *
+ * The value is read without taking the Queue lock, so it is only a snapshot
+ * that may already be outdated when returned; it is meant for monitoring.
+ *
+ * @param queue
+ *   Pointer to the Queue.
+ * @return
+ *   The number of items currently enqueued.
+ */
+extern AIO4C_API int QueueGetSize(Queue* queue);
+
 /**
  * @fn bool RemoveAll(Queue*,QueueRemoveCallback,QueueDiscriminant)
  * @brief Removes several items from a Queue.
@@ -384,6 +435,26 @@ extern AIO4C_API bool Dequeue(Queue* queue, QueueItem* item, bool wait);
  */
 extern AIO4C_API bool RemoveAll(Queue* queue, QueueRemoveCallback removeCallback, QueueDiscriminant discriminant);
 
+/**
+ * @fn int QueueForEach(Queue*,QueueVisitCallback,void*)
+ * @brief Visits the items of a Queue, from the oldest to the newest.
+ *
+ * The Queue is locked during the whole visit, so the callback must be short
+ * and must neither call back into the Queue nor run user code. Items are
+ * neither removed nor modified, and no thread waiting on the Queue is
+ * woken up.
+ *
+ * @param queue
+ *   Pointer to the Queue.
+ * @param visitCallback
+ *   The callback called on each item, returning false to stop the visit.
+ * @param arg
+ *   The parameter given to the callback.
+ * @return
+ *   The number of items visited.
+ */
+extern AIO4C_API int QueueForEach(Queue* queue, QueueVisitCallback visitCallback, void* arg);
+
 /**
  * @fn void FreeQueueItem(QueueItem**)
  * @brief Frees a QueueItem storage.
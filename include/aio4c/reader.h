@@ -24,23 +24,65 @@
 #ifndef __AIO4C_READER_H__
 #define __AIO4C_READER_H__
 
+#include <aio4c/buffer.h>
 #include <aio4c/connection.h>
+#include <aio4c/event.h>
+#include <aio4c/list.h>
+#include <aio4c/lock.h>
+#include <aio4c/selector.h>
 #include <aio4c/thread.h>
+#include <aio4c/timer.h>
 #include <aio4c/types.h>
 #include <aio4c/worker.h>
 
+typedef struct s_ReaderCounters {
+    unsigned long long iterations;
+    unsigned long long wakeups;
+    unsigned long long readyKeys;
+    unsigned long long pollTime;
+    unsigned long long dispatchTime;
+} ReaderCounters;
+
 typedef struct s_Reader {
     char*          name;
     char*          pipe;
     Thread*        thread;
     Queue*         queue;
     Selector*      selector;
+    TimerWheel*    timers;
     Worker*        worker;
-    int            load;
+    volatile int   load;
+    volatile aio4c_size_t bytesRead;
     int            bufferSize;
+    EventQueue*    handlers;
+    ConnectionPool* connectionPool;
+    BufferPool*    bufferPool;
+    aio4c_socket_t listenSocket;
+    SelectionKey*  listenKey;
+    Lock*          listenLock;
+    void         (*acceptHandler)(struct s_Reader*,aio4c_socket_t,void*);
+    void*          acceptArg;
+    List           suspended;
+    volatile int   suspendedCount;
+    volatile bool  flowCheck;
+    bool           memoryWatched;
+    bool           listenPaused;
+    volatile ReaderCounters counters;
 } Reader;
 
-extern AIO4C_API Reader* NewReader(char* pipeName, aio4c_size_t bufferSize);
+extern AIO4C_API Reader* NewReader(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy);
+
+extern AIO4C_API Reader* NewListeningReader(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy, aio4c_socket_t listenSocket, void (*acceptHandler)(Reader*,aio4c_socket_t,void*), void* acceptArg);
+
+extern AIO4C_API void ReaderStopListening(Reader* reader);
+
+extern AIO4C_API bool ConnectionMigrate(Connection* connection, Reader* target);
+
+extern AIO4C_API bool ConnectionScheduleTimer(Connection* connection, int delay, void (*callback)(Connection*,void*), void* arg, TimerId* id);
+
+extern AIO4C_API bool ConnectionCancelTimer(Connection* connection, TimerId id);
+
+extern AIO4C_API bool ReaderAdoptConnection(Reader* reader, Connection* connection, bool pendingWrite);
 
 extern AIO4C_API void ReaderManageConnection(Reader* reader, Connection* connection);
 
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/segment.h
+ * @brief Publishes statistics into a shared memory segment.
+ *
+ * The stats thread copies the probes totals, the time probes histograms and
+ * the counters of each Server pipe into a file mapped in memory, every
+ * AIO4C_STATS_INTERVAL seconds. Other processes map the same file read-only
+ * and copy it out without ever blocking the process being observed: the
+ * segment is protected by a sequence number, odd while it is being updated,
+ * and a copy is only consistent if the sequence number was even and did not
+ * change while it was taken.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_SEGMENT_H__
+#define __AIO4C_SEGMENT_H__
+
+#include <aio4c/acceptor.h>
+#include <aio4c/stats.h>
+#include <aio4c/types.h>
+
+/**
+ * @def AIO4C_STATS_SEGMENT_MAGIC
+ * @brief First bytes of a statistics segment.
+ */
+#define AIO4C_STATS_SEGMENT_MAGIC 0x41344353
+
+/**
+ * @def AIO4C_STATS_SEGMENT_VERSION
+ * @brief Version of the StatsSegment layout.
+ *
+ * Incremented each time the layout changes, including when probes are added.
+ */
+#define AIO4C_STATS_SEGMENT_VERSION 3
+
+/**
+ * @def AIO4C_STATS_SEGMENT_MAX_PIPES
+ * @brief Maximum number of pipes published in a statistics segment.
+ */
+#define AIO4C_STATS_SEGMENT_MAX_PIPES 64
+
+/**
+ * @def AIO4C_STATS_SEGMENT_MAX_SOURCES
+ * @brief Maximum number of pipes sources registered at once.
+ */
+#define AIO4C_STATS_SEGMENT_MAX_SOURCES 16
+
+/**
+ * @def AIO4C_STATS_SEGMENT_READ_RETRIES
+ * @brief Number of copies attempted by StatsSegmentRead before giving up.
+ */
+#define AIO4C_STATS_SEGMENT_READ_RETRIES 1000
+
+/**
+ * @struct s_StatsSegment
+ * @brief Layout of a statistics segment.
+ *
+ * Readers must check magic, version and size before using any other field.
+ *
+ * @see StatsSegmentRead(StatsSegment*,StatsSegment*)
+ */
+typedef struct s_StatsSegment {
+    unsigned int          magic;        /**< AIO4C_STATS_SEGMENT_MAGIC */
+    unsigned int          version;      /**< AIO4C_STATS_SEGMENT_VERSION */
+    unsigned int          size;         /**< Size of the whole segment, in bytes */
+    volatile unsigned int sequence;     /**< Odd while the segment is being updated */
+    long long             pid;          /**< Identifier of the process publishing the segment */
+    int                   interval;     /**< Number of seconds between two updates */
+    bool                  running;      /**< Cleared by the last update, when statistics end */
+    unsigned long long    updates;      /**< Number of updates since the segment was created */
+    unsigned long long    elapsed;      /**< Nanoseconds between the creation of the segment and the last update */
+    int                   timeProbes;   /**< Number of time probes, AIO4C_TIME_MAX_PROBE_TYPE */
+    int                   sizeProbes;   /**< Number of size probes, AIO4C_PROBE_MAX_SIZE_TYPE */
+    int                   buckets;      /**< Number of buckets of each histogram, AIO4C_STATS_HISTOGRAM_BUCKETS */
+    int                   pipes;        /**< Number of pipes published */
+    long long             times[AIO4C_TIME_MAX_PROBE_TYPE];  /**< Sum of the durations of each time probe, in microseconds */
+    long long             sizes[AIO4C_PROBE_MAX_SIZE_TYPE];  /**< Sum of the values of each size probe */
+    long long             histograms[AIO4C_TIME_MAX_PROBE_TYPE][AIO4C_STATS_HISTOGRAM_BUCKETS]; /**< Durations histogram of each time probe */
+    long long             memoryUsed;   /**< Bytes accounted against the memory budget, whether statistics are enabled or not */
+    int                   connections;  /**< Connections opened on the acceptors publishing pipes, whether statistics are enabled or not */
+    PipeCounters          counters[AIO4C_STATS_SEGMENT_MAX_PIPES]; /**< Counters of each pipe, in order of registration */
+} StatsSegment;
+
+/**
+ * @var AIO4C_STATS_SEGMENT
+ * @brief Path of the file mapped as statistics segment.
+ *
+ * When NULL, which is the default, no segment is published.
+ */
+extern AIO4C_API char* AIO4C_STATS_SEGMENT;
+
+/**
+ * @fn bool StatsSegmentCreate(char*,int)
+ * @brief Creates the statistics segment of this process.
+ *
+ * Called by StatsInit when AIO4C_STATS_SEGMENT or AIO4C_METRICS_PORT is set.
+ *
+ * @param path
+ *   The file to map, created or truncated, or NULL to keep the segment in
+ *   the memory of this process only.
+ * @param interval
+ *   The number of seconds between two updates.
+ * @return
+ *   true if the segment was created, false otherwise.
+ */
+extern AIO4C_API bool StatsSegmentCreate(char* path, int interval);
+
+/**
+ * @fn StatsSegment* StatsSegmentGet(void)
+ * @brief Retrieves the statistics segment of this process.
+ *
+ * The returned segment must only be copied out with StatsSegmentRead.
+ *
+ * @return
+ *   The segment created by StatsSegmentCreate, or NULL if there is none.
+ */
+extern AIO4C_API StatsSegment* StatsSegmentGet(void);
+
+/**
+ * @fn void StatsSegmentPublish(long long*,long long*,long long(*)[AIO4C_STATS_HISTOGRAM_BUCKETS],bool)
+ * @brief Updates the statistics segment of this process.
+ *
+ * Must only be called from one thread at a time, the stats thread.
+ *
+ * @param times
+ *   The sum of each time probe.
+ * @param sizes
+ *   The sum of each size probe.
+ * @param histograms
+ *   The histogram of each time probe.
+ * @param running
+ *   false for the last update.
+ */
+extern AIO4C_API void StatsSegmentPublish(long long* times, long long* sizes, long long (*histograms)[AIO4C_STATS_HISTOGRAM_BUCKETS], bool running);
+
+/**
+ * @fn void StatsSegmentDestroy(void)
+ * @brief Releases the statistics segment of this process.
+ *
+ * The file, if any, is left in place, so that the last update can still be
+ * read.
+ */
+extern AIO4C_API void StatsSegmentDestroy(void);
+
+/**
+ * @fn bool StatsSegmentAddPipes(int(*)(void*,PipeCounters*,int,int*),void*)
+ * @brief Registers a source of pipes counters.
+ *
+ * Each update of the segment calls collect with source, and publishes the
+ * counters it stored. Acceptors register themselves when created. collect
+ * is called from the statistics thread and must not take locks used by the
+ * pipes, it should only load their counters.
+ *
+ * @param collect
+ *   Stores at most the given number of pipes counters, returns how many,
+ *   and adds the connections of the source to the last argument.
+ * @param source
+ *   Passed to collect.
+ * @return
+ *   true if the source was registered, false if AIO4C_STATS_SEGMENT_MAX_SOURCES were already.
+ *
+ * @see AcceptorGetPipesCounters(Acceptor*,PipeCounters*,int)
+ */
+extern AIO4C_API bool StatsSegmentAddPipes(int (*collect)(void*,PipeCounters*,int,int*), void* source);
+
+/**
+ * @fn void StatsSegmentRemovePipes(void*)
+ * @brief Unregisters a source of pipes counters.
+ *
+ * Once this function returns, collect is no more called for source.
+ *
+ * @param source
+ *   The source given to StatsSegmentAddPipes.
+ */
+extern AIO4C_API void StatsSegmentRemovePipes(void* source);
+
+/**
+ * @fn StatsSegment* StatsSegmentOpen(char*)
+ * @brief Maps read-only the statistics segment published by a process.
+ *
+ * @param path
+ *   The file given as AIO4C_STATS_SEGMENT to the publishing process.
+ * @return
+ *   The mapped segment, or NULL if it cannot be mapped or is not a statistics
+ *   segment of this layout version.
+ */
+extern AIO4C_API StatsSegment* StatsSegmentOpen(char* path);
+
+/**
+ * @fn bool StatsSegmentRead(StatsSegment*,StatsSegment*)
+ * @brief Copies a consistent snapshot of a statistics segment.
+ *
+ * Never blocks the publishing process, retries while the segment is being
+ * updated.
+ *
+ * @param segment
+ *   The segment returned by StatsSegmentOpen or StatsSegmentGet.
+ * @param copy
+ *   Receives the snapshot.
+ * @return
+ *   true if a consistent snapshot was copied within
+ *   AIO4C_STATS_SEGMENT_READ_RETRIES attempts, false otherwise.
+ */
+extern AIO4C_API bool StatsSegmentRead(StatsSegment* segment, StatsSegment* copy);
+
+/**
+ * @fn void StatsSegmentClose(StatsSegment**)
+ * @brief Unmaps a segment returned by StatsSegmentOpen.
+ *
+ * @param segment
+ *   Pointer to the segment, set to NULL.
+ */
+extern AIO4C_API void StatsSegmentClose(StatsSegment** segment);
+
+#endif
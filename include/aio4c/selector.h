@@ -341,6 +341,44 @@ extern AIO4C_API void Unregister(Selector* selector, SelectionKey* key, bool unr
  */
 extern AIO4C_API int _Select(char* file, int line, Selector* selector);
 
+/**
+ * @def SelectTimeout(selector,timeout)
+ * @brief Wrapper to the _SelectTimeout operation.
+ *
+ * Provides the _SelectTimeout operation with the special preprocessor macros __FILE__ and __LINE__.
+ *
+ * @param selector
+ *   Pointer to the Selector
+ * @param timeout
+ *   Maximum time to wait, in milliseconds
+ *
+ * @see int _SelectTimeout(char*,int,Selector*,int)
+ */
+#define SelectTimeout(selector,timeout) \
+    _SelectTimeout(__FILE__, __LINE__, selector, timeout)
+
+/**
+ * @fn int _SelectTimeout(char*,int,Selector*,int)
+ * @brief Performs a Select operation limited in time.
+ *
+ * Same as _Select, except that the calling Thread does not sleep more than
+ * timeout milliseconds.
+ *
+ * @param file
+ *   File name where the function is called (usually __FILE__ macro)
+ * @param line
+ *   Line number where the function is called (usually __LINE__ macro)
+ * @param selector
+ *   Pointer to the Selector
+ * @param timeout
+ *   Maximum time to wait in milliseconds, or -1 to wait until an operation is
+ *   available
+ * @return
+ *   The number of keys for which an operation is available, 0 if the timeout
+ *   expired
+ */
+extern AIO4C_API int _SelectTimeout(char* file, int line, Selector* selector, int timeout);
+
 /**
  * @def SelectorWakeUp(selector)
  * @brief Wrapper to the _SelectorWakeUp function.
@@ -28,10 +28,15 @@
 #include <aio4c/address.h>
 #include <aio4c/buffer.h>
 #include <aio4c/connection.h>
+#include <aio4c/handover.h>
 #include <aio4c/log.h>
 #include <aio4c/thread.h>
 #include <aio4c/types.h>
 
+#ifndef AIO4C_SERVER_DRAIN_INTERVAL
+#define AIO4C_SERVER_DRAIN_INTERVAL 50
+#endif /* AIO4C_SERVER_DRAIN_INTERVAL */
+
 #define aio4c_server_handler(handler) \
     (void(*)(Event,Connection*,void*))handler
 
@@ -50,14 +55,36 @@ typedef struct s_Server {
     int         nbPipes;
     void      (*handler)(Event,Connection*,void*);
     Queue*      queue;
+    ThreadPolicy* policies;
+    bool        internal;
 } Server;
 
 extern AIO4C_API Server* NewServer(AddressType type, char* host, aio4c_port_t port, int bufferSize, int nbPipes, void (*handler)(Event,Connection*,void*), void* handlerArg, void* (*dataFactory)(Connection*,void*));
 
+extern AIO4C_API bool ServerSetPipePolicy(Server* server, int pipe, ThreadPolicy* policy);
+
+extern AIO4C_API bool ServerSetTimeouts(Server* server, ConnectionTimeouts* timeouts);
+
+extern AIO4C_API bool ServerSetOverloadControl(Server* server, OverloadControl* overload);
+
+extern AIO4C_API bool ServerSetInternal(Server* server);
+
 extern AIO4C_API bool ServerStart(Server* server);
 
 extern AIO4C_API void ServerJoin(Server* server);
 
 extern AIO4C_API void ServerStop(Server* server);
 
+extern AIO4C_API int ServerDrain(Server* server, int timeout);
+
+extern AIO4C_API int ServerHandOver(Server* server, char* path, int timeout);
+
+extern AIO4C_API int ServerGetPipesLoad(Server* server, PipeLoad* loads, int size);
+
+extern AIO4C_API bool ServerGetCounters(Server* server, AcceptorCounters* counters);
+
+extern AIO4C_API int ServerGetPipesCounters(Server* server, PipeCounters* counters, int size);
+
+extern AIO4C_API int ServerGetConnectionsCounters(Server* server, void (*visitor)(Connection*,ConnectionCounters*,void*), void* arg);
+
 #endif
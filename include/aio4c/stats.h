@@ -24,6 +24,7 @@
 #ifndef __AIO4C_STATS_H__
 #define __AIO4C_STATS_H__
 
+#include <aio4c/clock.h>
 #include <aio4c/types.h>
 
 #include <stdio.h>
@@ -33,34 +34,48 @@
 #define AIO4C_ENABLE_STATS 0
 #endif /* AIO4C_ENABLE_STATS */
 
-#if AIO4C_ENABLE_STATS
-
 #define ProbeTimeStart(type) {                 \
-    struct timeval _start, _stop;              \
-    gettimeofday(&_start, NULL);
+    aio4c_clock_t _start = 0;                  \
+    bool _probed = ProbeEnabled(_ProbeTimeCategory(type)); \
+    if (_probed) {                             \
+        _start = ClockNow();                   \
+    }
 
 #define ProbeTimeEnd(type)                     \
-    gettimeofday(&_stop, NULL);                \
-    _ProbeTime(type,&_start,&_stop);           \
+    if (_probed) {                             \
+        _ProbeTime(type,_start,ClockNow());    \
+    }                                          \
 }
 
-#define ProbeTime(type,start,stop) \
-    _ProbeTime(type,start,stop)
-
-#define ProbeSize(type,value) \
-    _ProbeSize(type,value)
-
-#else /* AIO4C_ENABLE_STATS */
-#define ProbeTimeStart(type)
-#define ProbeTimeEnd(type)
-#define ProbeTime(type,start,stop)
-#define ProbeSize(type,value)
-#endif /* AIO4C_ENABLE_STATS */
+#define ProbeTime(type,start,stop) do {      \
+    if (ProbeEnabled(_ProbeTimeCategory(type))) { \
+        _ProbeTime(type,start,stop);           \
+    }                                          \
+} while (0)
+
+/* gauges are sums of deltas, which must all be recorded for them to stay right */
+#define ProbeSize(type,value) do {             \
+    if (_ProbeSizeGauge(type) || ProbeEnabled(_ProbeSizeCategory(type))) { \
+        _ProbeSize(type,value);                \
+    }                                          \
+} while (0)
+
+#define ProbeLatency(stamp) do {               \
+    if (ProbeEnabled(AIO4C_PROBE_CATEGORY_LATENCY)) { \
+        _ProbeSize(AIO4C_PROBE_LATENCY_COUNT,1); \
+        _ProbeTime(AIO4C_TIME_PROBE_LATENCY,stamp,ClockNow()); \
+    }                                          \
+} while (0)
+
+#define ProbeEnabled(category) \
+    ((AIO4C_STATS_PROBES & (category)) != 0)
 
 #define pstats(fmt, ...) \
     fprintf(stderr, fmt, __VA_ARGS__)
 
-#if AIO4C_ENABLE_STATS
+#ifndef AIO4C_STATS_CACHE_LINE_SIZE
+#define AIO4C_STATS_CACHE_LINE_SIZE 64
+#endif /* AIO4C_STATS_CACHE_LINE_SIZE */
 
 typedef enum e_ProbeTimeType {
     AIO4C_TIME_PROBE_MEMORY_ALLOCATION,
@@ -89,6 +104,103 @@ typedef enum e_ProbeSizeType {
     AIO4C_PROBE_MAX_SIZE_TYPE
 } ProbeSizeType;
 
+typedef enum e_ProbeCategory {
+    AIO4C_PROBE_CATEGORY_NONE       = 0x00,
+    AIO4C_PROBE_CATEGORY_MEMORY     = 0x01,
+    AIO4C_PROBE_CATEGORY_BUFFER     = 0x02,
+    AIO4C_PROBE_CATEGORY_NETWORK    = 0x04,
+    AIO4C_PROBE_CATEGORY_PROCESS    = 0x08,
+    AIO4C_PROBE_CATEGORY_THREAD     = 0x10,
+    AIO4C_PROBE_CATEGORY_LATENCY    = 0x20,
+    AIO4C_PROBE_CATEGORY_JNI        = 0x40,
+    AIO4C_PROBE_CATEGORY_CONNECTION = 0x80,
+    AIO4C_PROBE_CATEGORY_ALL        = 0xff
+} ProbeCategory;
+
+#define AIO4C_PROBE_MAX_CATEGORY 8
+
+extern char* ProbeCategoryString[AIO4C_PROBE_MAX_CATEGORY];
+
+static inline unsigned int _ProbeTimeCategory(ProbeTimeType type) {
+    switch (type) {
+        case AIO4C_TIME_PROBE_MEMORY_ALLOCATION:
+            return AIO4C_PROBE_CATEGORY_MEMORY;
+        case AIO4C_TIME_PROBE_BUFFER_ALLOCATION:
+            return AIO4C_PROBE_CATEGORY_BUFFER;
+        case AIO4C_TIME_PROBE_NETWORK_READ:
+        case AIO4C_TIME_PROBE_NETWORK_WRITE:
+        case AIO4C_TIME_PROBE_SELECT_OVERHEAD:
+            return AIO4C_PROBE_CATEGORY_NETWORK;
+        case AIO4C_TIME_PROBE_DATA_PROCESS:
+            return AIO4C_PROBE_CATEGORY_PROCESS;
+        case AIO4C_TIME_PROBE_BLOCK:
+        case AIO4C_TIME_PROBE_IDLE:
+            return AIO4C_PROBE_CATEGORY_THREAD;
+        case AIO4C_TIME_PROBE_LATENCY:
+            return AIO4C_PROBE_CATEGORY_LATENCY;
+        case AIO4C_TIME_PROBE_JNI_OVERHEAD:
+            return AIO4C_PROBE_CATEGORY_JNI;
+        default:
+            return AIO4C_PROBE_CATEGORY_NONE;
+    }
+}
+
+static inline unsigned int _ProbeSizeCategory(ProbeSizeType type) {
+    switch (type) {
+        case AIO4C_PROBE_MEMORY_ALLOCATED_SIZE:
+        case AIO4C_PROBE_MEMORY_ALLOCATE_COUNT:
+        case AIO4C_PROBE_MEMORY_FREE_COUNT:
+            return AIO4C_PROBE_CATEGORY_MEMORY;
+        case AIO4C_PROBE_BUFFER_ALLOCATED_SIZE:
+            return AIO4C_PROBE_CATEGORY_BUFFER;
+        case AIO4C_PROBE_NETWORK_READ_SIZE:
+        case AIO4C_PROBE_NETWORK_WRITE_SIZE:
+            return AIO4C_PROBE_CATEGORY_NETWORK;
+        case AIO4C_PROBE_PROCESSED_DATA_SIZE:
+            return AIO4C_PROBE_CATEGORY_PROCESS;
+        case AIO4C_PROBE_CONNECTION_COUNT:
+            return AIO4C_PROBE_CATEGORY_CONNECTION;
+        case AIO4C_PROBE_LATENCY_COUNT:
+            return AIO4C_PROBE_CATEGORY_LATENCY;
+        default:
+            return AIO4C_PROBE_CATEGORY_NONE;
+    }
+}
+
+static inline bool _ProbeSizeGauge(ProbeSizeType type) {
+    switch (type) {
+        case AIO4C_PROBE_MEMORY_ALLOCATED_SIZE:
+        case AIO4C_PROBE_BUFFER_ALLOCATED_SIZE:
+        case AIO4C_PROBE_CONNECTION_COUNT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#define AIO4C_STATS_HISTOGRAM_SUB_BITS 4
+
+#define AIO4C_STATS_HISTOGRAM_MAX_BITS 36
+
+#define AIO4C_STATS_HISTOGRAM_BUCKETS \
+    ((AIO4C_STATS_HISTOGRAM_MAX_BITS - AIO4C_STATS_HISTOGRAM_SUB_BITS + 1) << AIO4C_STATS_HISTOGRAM_SUB_BITS)
+
+typedef struct s_ProbeTimeSummary {
+    long long count;
+    long long min;
+    long long p50;
+    long long p90;
+    long long p99;
+    long long p999;
+    long long max;
+} ProbeTimeSummary;
+
+extern char* ProbeTimeTypeString[AIO4C_TIME_MAX_PROBE_TYPE];
+
+extern AIO4C_API volatile unsigned int AIO4C_STATS_PROBES;
+
+extern int AIO4C_STATS_SIGNAL;
+
 extern int AIO4C_STATS_INTERVAL;
 
 extern AIO4C_API bool AIO4C_STATS_ENABLE_PERIODIC_OUTPUT;
@@ -97,12 +209,28 @@ extern char* AIO4C_STATS_OUTPUT_FILE;
 
 extern AIO4C_API void StatsInit(void);
 
-extern AIO4C_API void _ProbeTime(ProbeTimeType type, struct timeval* start, struct timeval* stop);
+extern AIO4C_API void _ProbeTime(ProbeTimeType type, aio4c_clock_t start, aio4c_clock_t stop);
 
 extern AIO4C_API void _ProbeSize(ProbeSizeType type, int size);
 
-extern AIO4C_API void StatsEnd(void);
+extern AIO4C_API bool StatsGetTimeSummary(ProbeTimeType type, ProbeTimeSummary* summary, bool interval);
 
-#endif /* AIO4C_ENABLE_STATS */
+extern AIO4C_API long long StatsGetSize(ProbeSizeType type);
+
+extern AIO4C_API void StatsSummarize(long long* buckets, ProbeTimeSummary* summary);
+
+extern AIO4C_API int StatsBucket(long long value);
+
+extern AIO4C_API long long StatsBucketHighest(int bucket);
+
+extern AIO4C_API void StatsEnable(unsigned int categories);
+
+extern AIO4C_API void StatsDisable(unsigned int categories);
+
+extern AIO4C_API unsigned int StatsParseCategories(char* categories);
+
+extern AIO4C_API void StatsThreadExit(void);
+
+extern AIO4C_API void StatsEnd(void);
 
 #endif
@@ -139,6 +139,72 @@ extern char* ThreadStateString[AIO4C_THREAD_STATE_MAX];
 typedef struct s_Thread Thread;
 #endif /* __AIO4C_THREAD_DEFINED__ */
 
+/**
+ * @def AIO4C_THREAD_MAX_CPUS
+ * @brief Number of CPUs that can be designated by a ThreadPolicy.
+ */
+#define AIO4C_THREAD_MAX_CPUS 1024
+
+/**
+ * @struct s_ThreadPolicy
+ * @brief Placement and scheduling of a Thread.
+ *
+ * A ThreadPolicy is applied by the Thread itself when it starts, before its
+ * initialization callback is called, so that memory allocated during the
+ * initialization already follows the policy.
+ *
+ * A zeroed ThreadPolicy leaves the Thread as created by the system.
+ *
+ * @see ThreadSetPolicy(Thread*,ThreadPolicy*)
+ */
+typedef struct s_ThreadPolicy {
+    unsigned char cpus[AIO4C_THREAD_MAX_CPUS / 8]; /**< Bitmask of CPUs the Thread may run on, empty for any */
+    bool          localMemory;                     /**< Prefers memory of the NUMA node the Thread runs on */
+    int           priority;                        /**< SCHED_FIFO priority, 0 for the default scheduling policy */
+} ThreadPolicy;
+
+/**
+ * @var AIO4C_THREAD_CPUS
+ * @brief CPUs shared among pipes threads (option -Tc).
+ *
+ * A list of CPUs and CPU ranges such as "0-3,8-11". When set, the CPUs are
+ * split evenly between pipes in the order of the list, and every thread of
+ * a pipe (Reader, Worker and Writer) is pinned to its pipe's CPUs. When
+ * there are more pipes than CPUs, pipes share CPUs in a round robin manner.
+ *
+ * @see ThreadPolicyForPipe(ThreadPolicy*,int,int)
+ */
+extern AIO4C_API char* AIO4C_THREAD_CPUS;
+
+/**
+ * @var AIO4C_THREAD_LOCAL_MEMORY
+ * @brief Allocates pipes memory on their NUMA node (option -Tn).
+ *
+ * When set to true, pipes threads prefer allocating memory on the NUMA node
+ * they run on. Each pipe allocates the buffers of its connections from its
+ * Reader thread, which makes them local to the pipe when combined with
+ * AIO4C_THREAD_CPUS. Ignored if not supported by the system.
+ */
+extern AIO4C_API bool AIO4C_THREAD_LOCAL_MEMORY;
+
+/**
+ * @var AIO4C_THREAD_PRIORITY
+ * @brief Realtime priority of pipes threads (option -Tp).
+ *
+ * When greater than 0, pipes threads are scheduled using SCHED_FIFO with
+ * this priority. This usually requires privileges.
+ */
+extern AIO4C_API int AIO4C_THREAD_PRIORITY;
+
+/**
+ * @var AIO4C_THREAD_LOCK_MEMORY
+ * @brief Locks the process memory in RAM (option -Tm).
+ *
+ * When set to true, Aio4cInit locks all current and future pages of the
+ * process, preventing latency caused by page faults on swapped out memory.
+ */
+extern AIO4C_API bool AIO4C_THREAD_LOCK_MEMORY;
+
 /**
  * @def __AIO4C_LOCK_DEFINED__
  * @brief Defined when Lock type has been defined.
@@ -195,6 +261,63 @@ extern AIO4C_API int GetNumThreads(void);
  */
 extern AIO4C_API Thread* NewThread(char* name, ThreadInitialization initialize, ThreadRoutine routine, ThreadFinalization finalize, ThreadData data);
 
+/**
+ * @fn bool ThreadPolicyAddCpus(ThreadPolicy*,char*)
+ * @brief Adds CPUs to a ThreadPolicy.
+ *
+ * @param policy
+ *   Pointer to the ThreadPolicy to modify.
+ * @param cpus
+ *   List of CPUs and CPU ranges, such as "0-3,8-11".
+ * @return
+ *   true if the list was valid, else false and the policy is left unchanged.
+ */
+extern AIO4C_API bool ThreadPolicyAddCpus(ThreadPolicy* policy, char* cpus);
+
+/**
+ * @fn void ThreadPolicyForPipe(ThreadPolicy*,int,int)
+ * @brief Computes the default ThreadPolicy of a pipe.
+ *
+ * The policy is built from AIO4C_THREAD_CPUS, AIO4C_THREAD_LOCAL_MEMORY and
+ * AIO4C_THREAD_PRIORITY.
+ *
+ * @param policy
+ *   Pointer to the ThreadPolicy to fill.
+ * @param pipe
+ *   Index of the pipe.
+ * @param nbPipes
+ *   Total number of pipes, or 0 if unknown, each pipe then gets one CPU in a
+ *   round robin manner.
+ */
+extern AIO4C_API void ThreadPolicyForPipe(ThreadPolicy* policy, int pipe, int nbPipes);
+
+/**
+ * @fn void ThreadSetPolicy(Thread*,ThreadPolicy*)
+ * @brief Sets the ThreadPolicy applied when a Thread starts.
+ *
+ * Must be called before ThreadStart. The policy is copied. Failing to apply
+ * a policy is not fatal, the Thread then runs with the system defaults.
+ *
+ * @param thread
+ *   Pointer to a Thread structure.
+ * @param policy
+ *   The ThreadPolicy to apply, or NULL for system defaults.
+ */
+extern AIO4C_API void ThreadSetPolicy(Thread* thread, ThreadPolicy* policy);
+
+/**
+ * @fn ThreadPolicy* ThreadGetPolicy(Thread*)
+ * @brief Retrieves the ThreadPolicy of a Thread.
+ *
+ * Used to give the threads of a pipe the same policy.
+ *
+ * @param thread
+ *   Pointer to a Thread structure.
+ * @return
+ *   The Thread's policy.
+ */
+extern AIO4C_API ThreadPolicy* ThreadGetPolicy(Thread* thread);
+
 /**
  * @fn char* ThreadGetName(Thread*)
  * @brief Retrieves a Thread's name.
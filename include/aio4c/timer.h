@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/timer.h
+ * @brief Provides a hierarchical timer wheel.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_TIMER_H__
+#define __AIO4C_TIMER_H__
+
+#include <aio4c/types.h>
+
+/**
+ * @def AIO4C_TIMER_WHEEL_LEVELS
+ * @brief Number of levels of a TimerWheel.
+ *
+ * The first level holds 256 slots of one millisecond, each following level
+ * holds 64 slots covering a whole turn of the previous level. Timers due
+ * after the last level range (about 18 hours) are kept in the last level
+ * until they come closer.
+ */
+#define AIO4C_TIMER_WHEEL_LEVELS 4
+
+/**
+ * @def AIO4C_TIMER_BATCH_SIZE
+ * @brief Number of Timers allocated at once when a TimerWheel runs out of them.
+ */
+#define AIO4C_TIMER_BATCH_SIZE 256
+
+/**
+ * @struct s_Timer
+ * @brief A callback scheduled on a TimerWheel.
+ *
+ * Timers are allocated from their TimerWheel and recycled once fired or
+ * cancelled, thus they must only be designated using a TimerId.
+ */
+/**
+ * @def __AIO4C_TIMER_DEFINED__
+ * @brief Defined if Timer type has been defined.
+ */
+#ifndef __AIO4C_TIMER_DEFINED__
+#define __AIO4C_TIMER_DEFINED__
+typedef struct s_Timer Timer;
+#endif /* __AIO4C_TIMER_DEFINED__ */
+
+/**
+ * @struct s_TimerWheel
+ * @brief Schedules Timers of a Thread.
+ *
+ * A TimerWheel is driven by a single Thread calling TimerWheelNextTimeout
+ * before waiting and TimerWheelExpire after, Timers callbacks being called
+ * by this Thread. Timers can be scheduled and cancelled from any Thread.
+ *
+ * Scheduling and cancelling a Timer are done in constant time, whatever the
+ * number of Timers.
+ */
+/**
+ * @def __AIO4C_TIMER_WHEEL_DEFINED__
+ * @brief Defined if TimerWheel type has been defined.
+ */
+#ifndef __AIO4C_TIMER_WHEEL_DEFINED__
+#define __AIO4C_TIMER_WHEEL_DEFINED__
+typedef struct s_TimerWheel TimerWheel;
+#endif /* __AIO4C_TIMER_WHEEL_DEFINED__ */
+
+/**
+ * @struct s_TimerId
+ * @brief Designates a scheduled Timer.
+ *
+ * A TimerId stays valid once its Timer fired or was cancelled, it then no
+ * longer designates anything.
+ */
+typedef struct s_TimerId {
+    Timer*       timer;      /**< The Timer, recycled once fired */
+    unsigned int generation; /**< The Timer generation when it was scheduled */
+} TimerId;
+
+/**
+ * @typedef TimerCallback
+ * @brief Function called when a Timer expires.
+ *
+ * It receives the source and the argument given when the Timer was
+ * scheduled.
+ */
+typedef void (*TimerCallback)(void* source, void* arg);
+
+/**
+ * @fn TimerWheel* NewTimerWheel(void)
+ * @brief Allocates a TimerWheel.
+ *
+ * The TimerWheel starts at the current time.
+ *
+ * @return
+ *   A pointer to the allocated TimerWheel, or NULL if allocation failed.
+ */
+extern AIO4C_API TimerWheel* NewTimerWheel(void);
+
+/**
+ * @fn aio4c_time_t TimerWheelGetTime(TimerWheel*)
+ * @brief Retrieves the time a TimerWheel has been advanced to.
+ *
+ * This is a cheap coarse clock, that can be read from any Thread without
+ * locking the TimerWheel.
+ *
+ * @param wheel
+ *   Pointer to a TimerWheel.
+ * @return
+ *   The TimerWheel time, in milliseconds.
+ */
+extern AIO4C_API aio4c_time_t TimerWheelGetTime(TimerWheel* wheel);
+
+/**
+ * @fn bool TimerWheelSchedule(TimerWheel*,Timer**,int,TimerCallback,void*,void*,TimerId*,bool*)
+ * @brief Schedules a Timer.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @param owner
+ *   Pointer to the head of a list of Timers, such as Connection's timers,
+ *   allowing to cancel all Timers of an owner at once. Must be initialized
+ *   to NULL by the owner. May be NULL.
+ * @param delay
+ *   Delay before the callback is called, in milliseconds.
+ * @param callback
+ *   The function to call when the Timer expires.
+ * @param source
+ *   First argument of the callback.
+ * @param arg
+ *   Second argument of the callback.
+ * @param id
+ *   Receives the TimerId of the scheduled Timer. May be NULL.
+ * @param earlier
+ *   Set to true if the Timer expires before the time computed by the last
+ *   TimerWheelNextTimeout call, meaning that the Thread driving the
+ *   TimerWheel has to be woken up. May be NULL.
+ * @return
+ *   true if the Timer was scheduled, false if it could not be allocated.
+ */
+extern AIO4C_API bool TimerWheelSchedule(TimerWheel* wheel, Timer** owner, int delay, TimerCallback callback, void* source, void* arg, TimerId* id, bool* earlier);
+
+/**
+ * @fn bool TimerCancel(TimerId)
+ * @brief Cancels a Timer.
+ *
+ * @param id
+ *   The TimerId returned when the Timer was scheduled.
+ * @return
+ *   true if the Timer was cancelled, false if it has already been fired or
+ *   cancelled.
+ */
+extern AIO4C_API bool TimerCancel(TimerId id);
+
+/**
+ * @fn int TimerWheelCancelAll(TimerWheel*,Timer**)
+ * @brief Cancels all Timers of an owner.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @param owner
+ *   The list of Timers given when scheduling them.
+ * @return
+ *   The number of cancelled Timers.
+ */
+extern AIO4C_API int TimerWheelCancelAll(TimerWheel* wheel, Timer** owner);
+
+/**
+ * @fn bool TimerWheelPending(TimerWheel*,Timer**)
+ * @brief Determines if an owner has Timers not fired yet.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @param owner
+ *   The list of Timers given when scheduling them.
+ * @return
+ *   true if at least one Timer of the owner is pending.
+ */
+extern AIO4C_API bool TimerWheelPending(TimerWheel* wheel, Timer** owner);
+
+/**
+ * @fn int TimerWheelNextTimeout(TimerWheel*)
+ * @brief Computes how long the driving Thread may wait.
+ *
+ * The result may be shorter than the delay to the next Timer, when Timers
+ * of the upper levels have to be moved down.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @return
+ *   The time to wait in milliseconds, or -1 if there is no Timer.
+ */
+extern AIO4C_API int TimerWheelNextTimeout(TimerWheel* wheel);
+
+/**
+ * @fn int TimerWheelExpire(TimerWheel*)
+ * @brief Fires expired Timers.
+ *
+ * Advances the TimerWheel to the current time, calling the callbacks of all
+ * expired Timers. Callbacks may schedule or cancel Timers.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @return
+ *   The number of fired Timers.
+ */
+extern AIO4C_API int TimerWheelExpire(TimerWheel* wheel);
+
+/**
+ * @fn int TimerWheelAdvance(TimerWheel*,aio4c_time_t)
+ * @brief Fires Timers expired at a given time.
+ *
+ * Same as TimerWheelExpire, using the given time instead of the current one.
+ * The TimerWheel never goes back in time.
+ *
+ * @param wheel
+ *   Pointer to the TimerWheel.
+ * @param now
+ *   The time to advance to, in milliseconds.
+ * @return
+ *   The number of fired Timers.
+ */
+extern AIO4C_API int TimerWheelAdvance(TimerWheel* wheel, aio4c_time_t now);
+
+/**
+ * @fn void FreeTimerWheel(TimerWheel**)
+ * @brief Frees a TimerWheel.
+ *
+ * Pending Timers are dropped without being called.
+ *
+ * @param wheel
+ *   Pointer to a pointer to the TimerWheel to free, set to NULL.
+ */
+extern AIO4C_API void FreeTimerWheel(TimerWheel** wheel);
+
+#endif /* __AIO4C_TIMER_H__ */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file aio4c/trace.h
+ * @brief Traces the lifecycle of sampled requests.
+ *
+ * One read out of AIO4C_TRACE_RATE is given a trace identifier, which then
+ * follows the received data through the pipe: queued to the Worker,
+ * dequeued, processed by the READ_EVENT handlers, write interest enabled,
+ * and finally sent by the Writer. Each thread records the points it crosses
+ * into its own ring of AIO4C_TRACE_RING_SIZE events, without any lock, the
+ * oldest events being overwritten.
+ *
+ * The rings are exported as Chrome trace events, which can be opened by
+ * Perfetto or chrome://tracing: each request is shown as an asynchronous
+ * slice split in the phases it went through, and each point as an event of
+ * the thread that recorded it.
+ *
+ * @author blakawk
+ */
+#ifndef __AIO4C_TRACE_H__
+#define __AIO4C_TRACE_H__
+
+#include <aio4c/clock.h>
+#include <aio4c/types.h>
+
+#include <stdio.h>
+
+/**
+ * @def AIO4C_TRACE_RING_SIZE
+ * @brief Number of events kept by each thread, must be a power of two.
+ */
+#ifndef AIO4C_TRACE_RING_SIZE
+#define AIO4C_TRACE_RING_SIZE 4096
+#endif /* AIO4C_TRACE_RING_SIZE */
+
+/**
+ * @def AIO4C_TRACE_MAX_RINGS
+ * @brief Maximum number of threads recording events.
+ *
+ * Events of threads started beyond this number are not recorded.
+ */
+#ifndef AIO4C_TRACE_MAX_RINGS
+#define AIO4C_TRACE_MAX_RINGS 256
+#endif /* AIO4C_TRACE_MAX_RINGS */
+
+/**
+ * @def AIO4C_TRACE_NAME_SIZE
+ * @brief Maximum length of the thread names exported with the events.
+ */
+#define AIO4C_TRACE_NAME_SIZE 32
+
+/**
+ * @enum TracePoint
+ * @brief Points crossed by a traced request.
+ */
+typedef enum e_TracePoint {
+    AIO4C_TRACE_POINT_READ = 0,           /**< Data read by ConnectionRead, starts a trace */
+    AIO4C_TRACE_POINT_ENQUEUE = 1,        /**< Data queued to the Worker */
+    AIO4C_TRACE_POINT_DEQUEUE = 2,        /**< Data dequeued by the Worker */
+    AIO4C_TRACE_POINT_PROCESS = 3,        /**< READ_EVENT handlers run by ConnectionProcessData, with their duration */
+    AIO4C_TRACE_POINT_WRITE_INTEREST = 4, /**< EnableWriteInterest called by the handlers */
+    AIO4C_TRACE_POINT_SEND = 5,           /**< Send emptying the write buffer, with its duration, ends a trace */
+    AIO4C_TRACE_POINT_MAX = 6             /**< Number of trace points */
+} TracePoint;
+
+/**
+ * @var TracePointString
+ * @brief Names of the trace points.
+ */
+extern AIO4C_API char* TracePointString[AIO4C_TRACE_POINT_MAX];
+
+/**
+ * @var AIO4C_TRACE_RATE
+ * @brief One read out of this number is traced.
+ *
+ * When 0, which is the default, nothing is traced.
+ */
+extern AIO4C_API int AIO4C_TRACE_RATE;
+
+/**
+ * @var AIO4C_TRACE_FILE
+ * @brief Where traces are exported by TraceEnd.
+ *
+ * Defaults to trace-[PID].json when NULL.
+ */
+extern AIO4C_API char* AIO4C_TRACE_FILE;
+
+/**
+ * @def TraceSample()
+ * @brief Decides whether a read is traced.
+ *
+ * @return
+ *   A new trace identifier, or 0 if the read is not traced.
+ */
+#define TraceSample() \
+    ((AIO4C_TRACE_RATE > 0) ? _TraceSample() : 0u)
+
+/**
+ * @def TraceMark(trace,point)
+ * @brief Records that a traced request crossed a point now.
+ *
+ * Does nothing if trace is 0.
+ */
+#define TraceMark(trace,point) do {                \
+    if ((trace) != 0u) {                           \
+        aio4c_clock_t _stamp = ClockNow();         \
+        _TraceRecord(trace,point,_stamp,_stamp);   \
+    }                                              \
+} while (0)
+
+/**
+ * @def TraceSpan(trace,point,start,stop)
+ * @brief Records that a traced request spent time in a point.
+ *
+ * Does nothing if trace is 0.
+ */
+#define TraceSpan(trace,point,start,stop) do {     \
+    if ((trace) != 0u) {                           \
+        _TraceRecord(trace,point,start,stop);      \
+    }                                              \
+} while (0)
+
+/**
+ * @fn unsigned int _TraceSample(void)
+ * @brief Counts a read of the calling thread, and traces one out of AIO4C_TRACE_RATE.
+ *
+ * Use TraceSample instead.
+ */
+extern AIO4C_API unsigned int _TraceSample(void);
+
+/**
+ * @fn void _TraceRecord(unsigned int,TracePoint,aio4c_clock_t,aio4c_clock_t)
+ * @brief Records an event in the ring of the calling thread.
+ *
+ * Use TraceMark or TraceSpan instead.
+ */
+extern AIO4C_API void _TraceRecord(unsigned int trace, TracePoint point, aio4c_clock_t start, aio4c_clock_t stop);
+
+/**
+ * @fn bool TraceWrite(FILE*)
+ * @brief Writes the events of every ring as Chrome trace events.
+ *
+ * Can be called at any time, threads keep recording meanwhile. Events
+ * overwritten while the rings are copied are left out.
+ *
+ * @param file
+ *   Where to write the JSON document.
+ * @return
+ *   true if the events were written, false otherwise.
+ */
+extern AIO4C_API bool TraceWrite(FILE* file);
+
+/**
+ * @fn bool TraceExport(char*)
+ * @brief Writes the events of every ring into a file.
+ *
+ * @param path
+ *   The file to create or truncate.
+ * @return
+ *   true if the events were written, false otherwise.
+ *
+ * @see TraceWrite(FILE*)
+ */
+extern AIO4C_API bool TraceExport(char* path);
+
+/**
+ * @fn void TraceEnd(void)
+ * @brief Exports the traces into AIO4C_TRACE_FILE, if tracing was enabled.
+ *
+ * Called by Aio4cEnd.
+ */
+extern AIO4C_API void TraceEnd(void);
+
+#endif /* __AIO4C_TRACE_H__ */
@@ -40,6 +40,24 @@
 # endif /* AIO4C_HAVE_PIPE */
 #endif /* HAVE_PIPE */
 
+#if defined(HAVE_ACCEPT4)
+# ifndef AIO4C_HAVE_ACCEPT4
+#  define AIO4C_HAVE_ACCEPT4
+# endif /* AIO4C_HAVE_ACCEPT4 */
+#endif /* HAVE_ACCEPT4 */
+
+#if defined(HAVE_SCHED_SETAFFINITY)
+# ifndef AIO4C_HAVE_AFFINITY
+#  define AIO4C_HAVE_AFFINITY
+# endif /* AIO4C_HAVE_AFFINITY */
+#endif /* HAVE_SCHED_SETAFFINITY */
+
+#if defined(HAVE_MLOCKALL)
+# ifndef AIO4C_HAVE_MLOCKALL
+#  define AIO4C_HAVE_MLOCKALL
+# endif /* AIO4C_HAVE_MLOCKALL */
+#endif /* HAVE_MLOCKALL */
+
 #if defined(HAVE_INITIALIZECONDITIONVARIABLE)
 # ifndef AIO4C_HAVE_CONDITION
 #  define AIO4C_HAVE_CONDITION
@@ -141,6 +159,10 @@ typedef unsigned char _Bool;
 
 typedef unsigned int aio4c_size_t;
 
+typedef unsigned long long aio4c_time_t;
+
+typedef unsigned long long aio4c_clock_t;
+
 typedef struct sockaddr aio4c_addr_t;
 
 typedef int aio4c_port_t;
@@ -26,10 +26,17 @@
 
 #include <aio4c/buffer.h>
 #include <aio4c/connection.h>
+#include <aio4c/event.h>
 #include <aio4c/thread.h>
 #include <aio4c/types.h>
 #include <aio4c/writer.h>
 
+typedef struct s_WorkerCounters {
+    unsigned long long tasks;
+    unsigned long long waitTime;
+    unsigned long long processTime;
+} WorkerCounters;
+
 typedef struct s_Worker {
     char*        name;
     char*        pipe;
@@ -38,9 +45,22 @@ typedef struct s_Worker {
     Writer*      writer;
     Queue*       queue;
     BufferPool*  pool;
+    EventQueue*  handlers;
+    WaterMarks   marks;
+    volatile int pendingItems;
+    volatile int pendingBytes;
+    OverloadState shedding;
+    volatile int rejected;
+    volatile WorkerCounters counters;
 } Worker;
 
-extern AIO4C_API Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize);
+extern AIO4C_API WaterMarks AIO4C_WORKER_WATER_MARKS;
+
+extern AIO4C_API bool WorkerAboveHighMarks(Worker* worker, Connection* connection);
+
+extern AIO4C_API bool WorkerBelowLowMarks(Worker* worker, Connection* connection);
+
+extern AIO4C_API Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy);
 
 extern AIO4C_API void WorkerManageConnection(Worker* worker, Connection* connection);
 
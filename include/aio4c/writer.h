@@ -30,14 +30,22 @@
 #include <aio4c/thread.h>
 #include <aio4c/types.h>
 
+typedef struct s_WriterCounters {
+    unsigned long long writes;
+    unsigned long long shortWrites;
+    unsigned long long bytesOut;
+} WriterCounters;
+
 typedef struct s_Writer {
     char*         name;
     Thread*       thread;
     aio4c_size_t  bufferSize;
     Queue*        queue;
+    EventQueue*   handlers;
+    volatile WriterCounters counters;
 } Writer;
 
-extern AIO4C_API Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize);
+extern AIO4C_API Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy);
 
 extern AIO4C_API void WriterManageConnection(Writer* writer, Connection* connection);
 
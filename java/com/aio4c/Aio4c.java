@@ -35,6 +35,42 @@ public class Aio4c {
          */
         System.loadLibrary("aio4c");
     }
+    /**
+     * Statistics probes of memory allocations.
+     */
+    public static final int STATS_MEMORY = 0x01;
+    /**
+     * Statistics probes of buffer allocations.
+     */
+    public static final int STATS_BUFFER = 0x02;
+    /**
+     * Statistics probes of network reads, writes and selection.
+     */
+    public static final int STATS_NETWORK = 0x04;
+    /**
+     * Statistics probes of data processing.
+     */
+    public static final int STATS_PROCESS = 0x08;
+    /**
+     * Statistics probes of threads blocked or idle time.
+     */
+    public static final int STATS_THREAD = 0x10;
+    /**
+     * Statistics probes of latency.
+     */
+    public static final int STATS_LATENCY = 0x20;
+    /**
+     * Statistics probes of JNI overhead.
+     */
+    public static final int STATS_JNI = 0x40;
+    /**
+     * Statistics probes of connections count.
+     */
+    public static final int STATS_CONNECTION = 0x80;
+    /**
+     * All statistics probes.
+     */
+    public static final int STATS_ALL = 0xff;
     /**
      * Displays the parameters and usage of the library
      */
@@ -59,4 +95,25 @@ public class Aio4c {
      * Needs to be called once the library is no more used by the program.
      */
     public static native void end();
+    /**
+     * Enables statistics probes at runtime.
+     *
+     * @param categories
+     *   A mask of the <code>STATS_*</code> categories to enable.
+     */
+    public static native void enableStatistics(int categories);
+    /**
+     * Disables statistics probes at runtime.
+     *
+     * @param categories
+     *   A mask of the <code>STATS_*</code> categories to disable.
+     */
+    public static native void disableStatistics(int categories);
+    /**
+     * Retrieves the enabled statistics probes.
+     *
+     * @return
+     *   The mask of the enabled <code>STATS_*</code> categories.
+     */
+    public static native int enabledStatistics();
 }
@@ -21,16 +21,25 @@
  * Aio4c    <http://aio4c.so>.   If   not,   see
  * <http://www.gnu.org/licenses/>.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
 #include <aio4c/acceptor.h>
 
 #include <aio4c/address.h>
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/clock.h>
 #include <aio4c/connection.h>
 #include <aio4c/error.h>
+#include <aio4c/handover.h>
+#include <aio4c/event.h>
 #include <aio4c/lock.h>
 #include <aio4c/log.h>
 #include <aio4c/queue.h>
 #include <aio4c/reader.h>
+#include <aio4c/segment.h>
 #include <aio4c/selector.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
@@ -44,6 +53,9 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#include <linux/filter.h>
+#endif /* SO_ATTACH_REUSEPORT_CBPF */
 #else /* AIO4C_WIN32 */
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -52,8 +64,20 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 
+typedef struct s_PipeWindow {
+    aio4c_size_t bytesRead;
+    aio4c_size_t bytesPerSecond;
+    int          queued;
+    int          node;
+} PipeWindow;
+
+#define AIO4C_ACCEPTOR_NODE_UNKNOWN (-2)
+
+#define AIO4C_ACCEPTOR_MAX_NODES 64
+
 struct s_Acceptor {
     char*          name;
     Thread*        thread;
@@ -65,11 +89,50 @@ struct s_Acceptor {
     SelectionKey*  key;
     Connection*    factory;
     Queue*         queue;
+    EventQueue*    handlers;
+    bool           reusePort;
+    bool           internal;
+    Lock*          loadLock;
+    PipeWindow*    windows;
+    aio4c_clock_t  lastSample;
+    unsigned int   seed;
+    Thread*        rebalancer;
+    int            rebalanceElapsed;
+    int            imbalance;
+    ThreadPolicy*  policies;
+    bool           pinned;
+    int            cpuNodes[AIO4C_THREAD_MAX_CPUS];
+    volatile aio4c_time_t admitAt;
+    volatile int   connections;
+    volatile unsigned int accepted;
+    volatile unsigned int rateLimited;
+    volatile unsigned int serverFull;
+    volatile unsigned int pipeFull;
+    volatile bool  draining;
+    volatile bool  drainPass;
+    volatile unsigned int drained;
 };
 
-static bool _AcceptorInit(ThreadData _acceptor) {
-    Acceptor* acceptor = (Acceptor*)_acceptor;
-    int i = 0;
+bool AIO4C_ACCEPTOR_REUSE_PORT = false;
+bool AIO4C_ACCEPTOR_CPU_STEERING = false;
+AcceptorPlacement AIO4C_ACCEPTOR_PLACEMENT = AIO4C_PLACEMENT_LEAST_CONNECTIONS;
+int AIO4C_ACCEPTOR_REBALANCE_INTERVAL = 0;
+int AIO4C_ACCEPTOR_RATE = 0;
+int AIO4C_ACCEPTOR_BURST = 0;
+int AIO4C_ACCEPTOR_MAX_CONNECTIONS = 0;
+int AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS = 0;
+char* AIO4C_ACCEPTOR_HANDOVER_PATH = NULL;
+
+char* AcceptorPlacementString[AIO4C_PLACEMENT_MAX] = {
+    "connections",
+    "throughput",
+    "queued",
+    "two-choices",
+    "incoming-cpu"
+};
+
+static aio4c_socket_t _AcceptorListen(Acceptor* acceptor, bool reusePort) {
+    aio4c_socket_t sock = -1;
     aio4c_addr_t* addr = NULL;
     int addrSize = 0;
 #ifndef AIO4C_WIN32
@@ -78,57 +141,37 @@ static bool _AcceptorInit(ThreadData _acceptor) {
     char reuseaddr = 1;
 #endif /* AIO4C_WIN32 */
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
-    char* pipeName = NULL;
-
-    for (i = 0; i < acceptor->nbReaders; i++) {
-        pipeName = aio4c_malloc(8);
-
-        if (pipeName != NULL) {
-            snprintf(pipeName, 8, "pipe%03d", i);
-        }
-
-        if ((acceptor->readers[i] = NewReader(pipeName, GetBufferPoolBufferSize(acceptor->factory->pool))) == NULL) {
-            break;
-        }
-    }
-
-    if (i < acceptor->nbReaders) {
-        Log(AIO4C_LOG_LEVEL_WARN, "only %d pipes over %d were started", i, acceptor->nbReaders);
-        acceptor->nbReaders = i;
-    }
 
-    acceptor->socket = socket(PF_INET, SOCK_STREAM, 0);
+    sock = socket(PF_INET, SOCK_STREAM, 0);
 #ifndef AIO4C_WIN32
-    if (acceptor->socket == -1) {
+    if (sock == -1) {
         code.error = errno;
 #else /* AIO4C_WIN32 */
-    if (acceptor->socket == SOCKET_ERROR) {
+    if (sock == SOCKET_ERROR) {
         code.source = AIO4C_ERRNO_SOURCE_WSA;
-        acceptor->socket = -1;
 #endif /* AIO4C_WIN32 */
         Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SOCKET_ERROR, &code);
-        return false;
+        return -1;
     }
 
 #ifndef AIO4C_WIN32
-    if (fcntl(acceptor->socket, F_SETFL, O_NONBLOCK) == -1) {
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
         code.error = errno;
 #else /* AIO4C_WIN32 */
     unsigned long ioctl = 1;
-    if (ioctlsocket(acceptor->socket, FIONBIO, &ioctl) == SOCKET_ERROR) {
+    if (ioctlsocket(sock, FIONBIO, &ioctl) == SOCKET_ERROR) {
         code.source = AIO4C_ERRNO_SOURCE_WSA;
 #endif /* AIO4C_WIN32 */
         Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_FCNTL_ERROR, &code);
 #ifndef AIO4C_WIN32
-        close(acceptor->socket);
+        close(sock);
 #else /* AIO4C_WIN32 */
-        closesocket(acceptor->socket);
+        closesocket(sock);
 #endif /* AIO4C_WIN32 */
-        acceptor->socket = -1;
-        return false;
+        return -1;
     }
 
-    if (setsockopt(acceptor->socket, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr)) != 0) {
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr)) != 0) {
 #ifndef AIO4C_WIN32
         code.error = errno;
 #else /* AIO4C_WIN32 */
@@ -136,121 +179,795 @@ static bool _AcceptorInit(ThreadData _acceptor) {
 #endif /* AIO4C_WIN32 */
         Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SETSOCKOPT_ERROR, &code);
 #ifndef AIO4C_WIN32
-        close(acceptor->socket);
+        close(sock);
 #else /* AIO4C_WIN32 */
-        closesocket(acceptor->socket);
+        closesocket(sock);
 #endif /* AIO4C_WIN32 */
-        acceptor->socket = -1;
-        return false;
+        return -1;
+    }
+
+#ifdef SO_REUSEPORT
+    /* every pipe binds its own socket to the same address, the kernel balances between them */
+    if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &reuseaddr, sizeof(reuseaddr)) != 0) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SETSOCKOPT_ERROR, &code);
+        close(sock);
+        return -1;
     }
+#endif /* SO_REUSEPORT */
 
     addr = AddressGetAddr(acceptor->address);
     addrSize = AddressGetAddrSize(acceptor->address);
 
-    if (bind(acceptor->socket, addr, addrSize) == -1) {
-#ifndef AIO4C_WIN32
-        close(acceptor->socket);
-#else /* AIO4C_WIN32 */
-        closesocket(acceptor->socket);
-#endif /* AIO4C_WIN32 */
-        acceptor->socket = -1;
-        return false;
+    if (bind(sock, addr, addrSize) == -1) {
+#ifndef AIO4C_WIN32
+        close(sock);
+#else /* AIO4C_WIN32 */
+        closesocket(sock);
+#endif /* AIO4C_WIN32 */
+        return -1;
+    }
+
+    if (listen(sock, SOMAXCONN) == -1) {
+#ifndef AIO4C_WIN32
+        close(sock);
+#else /* AIO4C_WIN32 */
+        closesocket(sock);
+#endif /* AIO4C_WIN32 */
+        return -1;
+    }
+
+    return sock;
+}
+
+static void _AcceptorClose(aio4c_socket_t sock) {
+#ifndef AIO4C_WIN32
+    close(sock);
+#else /* AIO4C_WIN32 */
+    closesocket(sock);
+#endif /* AIO4C_WIN32 */
+}
+
+static bool _AcceptorCheckInherited(aio4c_socket_t sock, Acceptor* acceptor) {
+#ifndef AIO4C_WIN32
+    struct sockaddr_storage bound;
+    socklen_t boundSize = sizeof(struct sockaddr_storage);
+    aio4c_addr_t* addr = AddressGetAddr(acceptor->address);
+    int type = 0;
+    socklen_t typeSize = sizeof(type);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &typeSize) != 0 || type != SOCK_STREAM) {
+        Log(AIO4C_LOG_LEVEL_WARN, "inherited socket %d is not a stream socket", sock);
+        return false;
+    }
+
+    /* sin_port and sin6_port share the same offset */
+    if (getsockname(sock, (aio4c_addr_t*)&bound, &boundSize) != 0 || bound.ss_family != addr->sa_family ||
+        ((struct sockaddr_in*)&bound)->sin_port != ((struct sockaddr_in*)addr)->sin_port) {
+        Log(AIO4C_LOG_LEVEL_WARN, "inherited socket %d is not bound to %s", sock, AddressGetString(acceptor->address));
+        return false;
+    }
+
+    return true;
+#else /* AIO4C_WIN32 */
+    return false;
+#endif /* AIO4C_WIN32 */
+}
+
+static aio4c_socket_t _AcceptorInherit(Acceptor* acceptor, aio4c_socket_t sock) {
+#ifndef AIO4C_WIN32
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+
+    if (!_AcceptorCheckInherited(sock, acceptor)) {
+        close(sock);
+        return -1;
+    }
+
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_FCNTL_ERROR, &code);
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+#else /* AIO4C_WIN32 */
+    closesocket(sock);
+    return -1;
+#endif /* AIO4C_WIN32 */
+}
+
+static void _AcceptorSteer(Acceptor* acceptor) {
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    /* selects the socket at index (current cpu % pipes) in the reuseport group */
+    struct sock_filter filter[] = {
+        { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_ALU | BPF_MOD | BPF_K,   0, 0, (unsigned int)acceptor->nbReaders },
+        { BPF_RET | BPF_A,             0, 0, 0 }
+    };
+    struct sock_fprog program = {
+        .len = sizeof(filter) / sizeof(filter[0]),
+        .filter = filter
+    };
+
+    /* the program applies to the whole group, sockets were bound in readers order */
+    if (setsockopt(acceptor->readers[0]->listenSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SETSOCKOPT_ERROR, &code);
+        return;
+    }
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "incoming connections steered to pipe (cpu %% %d)", acceptor->nbReaders);
+#else /* SO_ATTACH_REUSEPORT_CBPF */
+    Log(AIO4C_LOG_LEVEL_WARN, "cpu steering not supported, using kernel balancing for %d pipes", acceptor->nbReaders);
+#endif /* SO_ATTACH_REUSEPORT_CBPF */
+}
+
+static void _AcceptorSampleLoad(Acceptor* acceptor) {
+    aio4c_clock_t now = 0;
+    long elapsed = 0;
+    aio4c_size_t bytesRead = 0;
+    aio4c_size_t rate = 0;
+    Worker* worker = NULL;
+    PipeWindow* window = NULL;
+    int i = 0, queued = 0;
+
+    now = ClockNow();
+
+    elapsed = (long)(ClockElapsed(acceptor->lastSample, now) / 1000000);
+
+    if (elapsed < AIO4C_ACCEPTOR_LOAD_WINDOW) {
+        return;
+    }
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        window = &acceptor->windows[i];
+        worker = acceptor->readers[i]->worker;
+
+        /* counters may wrap, the difference stays correct */
+        bytesRead = acceptor->readers[i]->bytesRead;
+        rate = (aio4c_size_t)(((double)(aio4c_size_t)(bytesRead - window->bytesRead)) * 1000.0 / (double)elapsed);
+        window->bytesRead = bytesRead;
+        window->bytesPerSecond = (3 * window->bytesPerSecond + rate) / 4;
+
+        queued = (worker != NULL && worker->queue != NULL) ? QueueGetSize(worker->queue) : 0;
+        window->queued = (3 * window->queued + queued) / 4;
+    }
+
+    acceptor->lastSample = now;
+}
+
+static int _AcceptorCpuNode(Acceptor* acceptor, int cpu) {
+#ifdef __linux__
+    char path[64];
+    int node = 0;
+
+    if (cpu < 0 || cpu >= AIO4C_THREAD_MAX_CPUS) {
+        return -1;
+    }
+
+    /* topology does not change while running, sysfs is only read once per cpu */
+    if (acceptor->cpuNodes[cpu] == AIO4C_ACCEPTOR_NODE_UNKNOWN) {
+        acceptor->cpuNodes[cpu] = -1;
+
+        for (node = 0; node < AIO4C_ACCEPTOR_MAX_NODES; node++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+            if (access(path, F_OK) == 0) {
+                acceptor->cpuNodes[cpu] = node;
+                break;
+            }
+        }
+    }
+
+    return acceptor->cpuNodes[cpu];
+#else /* __linux__ */
+    return -1;
+#endif /* __linux__ */
+}
+
+static void _AcceptorLocatePipes(Acceptor* acceptor) {
+    ThreadPolicy* policy = NULL;
+    int i = 0, cpu = 0;
+
+    acceptor->pinned = false;
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        policy = ThreadGetPolicy(acceptor->readers[i]->thread);
+        acceptor->windows[i].node = -1;
+
+        for (cpu = 0; cpu < AIO4C_THREAD_MAX_CPUS; cpu++) {
+            if (policy->cpus[cpu / 8] & (1 << (cpu % 8))) {
+                acceptor->windows[i].node = _AcceptorCpuNode(acceptor, cpu);
+                acceptor->pinned = true;
+                break;
+            }
+        }
+    }
+}
+
+static Reader* _PlaceLeastConnections(Acceptor* acceptor, aio4c_socket_t sock __attribute__((unused))) {
+    int i = 0, load = 0, minLoad = INT_MAX, choosen = 0;
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        load = AtomicGet(&acceptor->readers[i]->load);
+        if (load < minLoad) {
+            choosen = i;
+            minLoad = load;
+        }
+    }
+
+    return acceptor->readers[choosen];
+}
+
+static Reader* _PlaceLeastThroughput(Acceptor* acceptor, aio4c_socket_t sock __attribute__((unused))) {
+    int i = 0, choosen = 0;
+
+    for (i = 1; i < acceptor->nbReaders; i++) {
+        if (acceptor->windows[i].bytesPerSecond < acceptor->windows[choosen].bytesPerSecond ||
+            (acceptor->windows[i].bytesPerSecond == acceptor->windows[choosen].bytesPerSecond &&
+             AtomicGet(&acceptor->readers[i]->load) < AtomicGet(&acceptor->readers[choosen]->load))) {
+            choosen = i;
+        }
+    }
+
+    return acceptor->readers[choosen];
+}
+
+static Reader* _PlaceLeastQueued(Acceptor* acceptor, aio4c_socket_t sock __attribute__((unused))) {
+    int i = 0, choosen = 0;
+
+    for (i = 1; i < acceptor->nbReaders; i++) {
+        if (acceptor->windows[i].queued < acceptor->windows[choosen].queued ||
+            (acceptor->windows[i].queued == acceptor->windows[choosen].queued &&
+             AtomicGet(&acceptor->readers[i]->load) < AtomicGet(&acceptor->readers[choosen]->load))) {
+            choosen = i;
+        }
+    }
+
+    return acceptor->readers[choosen];
+}
+
+static int _AcceptorRandom(Acceptor* acceptor, int max) {
+    /* xorshift, only used from the acceptor thread */
+    acceptor->seed ^= acceptor->seed << 13;
+    acceptor->seed ^= acceptor->seed >> 17;
+    acceptor->seed ^= acceptor->seed << 5;
+
+    return (int)(acceptor->seed % (unsigned int)max);
+}
+
+static Reader* _PlaceTwoChoices(Acceptor* acceptor, aio4c_socket_t sock __attribute__((unused))) {
+    int first = 0, second = 0;
+
+    if (acceptor->nbReaders < 2) {
+        return acceptor->readers[0];
+    }
+
+    first = _AcceptorRandom(acceptor, acceptor->nbReaders);
+    second = (first + 1 + _AcceptorRandom(acceptor, acceptor->nbReaders - 1)) % acceptor->nbReaders;
+
+    if (AtomicGet(&acceptor->readers[second]->load) < AtomicGet(&acceptor->readers[first]->load)) {
+        return acceptor->readers[second];
+    }
+
+    return acceptor->readers[first];
+}
+
+static Reader* _PlaceIncomingCpu(Acceptor* acceptor, aio4c_socket_t sock) {
+    ThreadPolicy* policy = NULL;
+    int cpu = -1, node = -1;
+    int i = 0, rank = 0, load = 0, choosen = 0, minRank = INT_MAX, minLoad = INT_MAX;
+#ifdef SO_INCOMING_CPU
+    socklen_t size = sizeof(int);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, (void*)&cpu, &size) != 0) {
+        cpu = -1;
+    }
+#endif /* SO_INCOMING_CPU */
+
+    if (cpu < 0 || cpu >= AIO4C_THREAD_MAX_CPUS) {
+        return _PlaceLeastConnections(acceptor, sock);
+    }
+
+    /* same mapping as the reuseport cpu steering */
+    if (!acceptor->pinned) {
+        return acceptor->readers[cpu % acceptor->nbReaders];
+    }
+
+    node = _AcceptorCpuNode(acceptor, cpu);
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        policy = ThreadGetPolicy(acceptor->readers[i]->thread);
+
+        if (policy->cpus[cpu / 8] & (1 << (cpu % 8))) {
+            rank = 0;
+        } else if (node != -1 && acceptor->windows[i].node == node) {
+            rank = 1;
+        } else {
+            rank = 2;
+        }
+
+        load = AtomicGet(&acceptor->readers[i]->load);
+
+        if (rank < minRank || (rank == minRank && load < minLoad)) {
+            choosen = i;
+            minRank = rank;
+            minLoad = load;
+        }
+    }
+
+    return acceptor->readers[choosen];
+}
+
+static Reader* (*_AcceptorPlacements[AIO4C_PLACEMENT_MAX])(Acceptor*,aio4c_socket_t) = {
+    _PlaceLeastConnections,
+    _PlaceLeastThroughput,
+    _PlaceLeastQueued,
+    _PlaceTwoChoices,
+    _PlaceIncomingCpu
+};
+
+static Reader* _ChooseReader(Acceptor* acceptor, aio4c_socket_t sock) {
+    AcceptorPlacement placement = acceptor->internal ? AIO4C_PLACEMENT_LEAST_CONNECTIONS : AIO4C_ACCEPTOR_PLACEMENT;
+    Reader* reader = NULL;
+
+    if (placement != AIO4C_PLACEMENT_LEAST_THROUGHPUT && placement != AIO4C_PLACEMENT_LEAST_QUEUED) {
+        return _AcceptorPlacements[placement](acceptor, sock);
+    }
+
+    /* windows are shared with AcceptorGetPipesLoad */
+    TakeLock(acceptor->loadLock);
+    _AcceptorSampleLoad(acceptor);
+    reader = _AcceptorPlacements[placement](acceptor, sock);
+    ReleaseLock(acceptor->loadLock);
+
+    return reader;
+}
+
+static aio4c_socket_t _AcceptorAccept(aio4c_socket_t listenSocket, struct sockaddr_storage* addr, socklen_t* addrSize) {
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    aio4c_socket_t sock = -1;
+
+    while (true) {
+        *addrSize = sizeof(struct sockaddr_storage);
+
+#ifdef AIO4C_HAVE_ACCEPT4
+        sock = accept4(listenSocket, (aio4c_addr_t*)addr, addrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else /* AIO4C_HAVE_ACCEPT4 */
+        sock = accept(listenSocket, (aio4c_addr_t*)addr, addrSize);
+#endif /* AIO4C_HAVE_ACCEPT4 */
+
+#ifndef AIO4C_WIN32
+        if (sock == -1) {
+            code.error = errno;
+            switch (errno) {
+                case EINTR:
+                case ECONNABORTED:
+                    continue;
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif /* EAGAIN != EWOULDBLOCK */
+                    return -1;
+                default:
+                    break;
+            }
+#else /* AIO4C_WIN32 */
+        if (sock == INVALID_SOCKET) {
+            code.source = AIO4C_ERRNO_SOURCE_WSA;
+            switch (WSAGetLastError()) {
+                case WSAEINTR:
+                case WSAECONNRESET:
+                    continue;
+                case WSAEWOULDBLOCK:
+                    return -1;
+                default:
+                    break;
+            }
+#endif /* AIO4C_WIN32 */
+            Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_ACCEPT_ERROR, &code);
+            return -1;
+        }
+
+#ifndef AIO4C_HAVE_ACCEPT4
+#ifndef AIO4C_WIN32
+        if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+            code.error = errno;
+#else /* AIO4C_WIN32 */
+        unsigned long ioctl = 1;
+        if (ioctlsocket(sock, FIONBIO, &ioctl) != 0) {
+            code.source = AIO4C_ERRNO_SOURCE_WSA;
+#endif /* AIO4C_WIN32 */
+            Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_FCNTL_ERROR, &code);
+#ifndef AIO4C_WIN32
+            close(sock);
+#else /* AIO4C_WIN32 */
+            closesocket(sock);
+#endif /* AIO4C_WIN32 */
+            continue;
+        }
+#endif /* AIO4C_HAVE_ACCEPT4 */
+
+        return sock;
+    }
+}
+
+/*
+ * The bucket is kept as the time its next token is due, so that pipes
+ * accepting on their own share it without a lock.
+ */
+bool AcceptorTakeToken(volatile aio4c_time_t* admitAt, aio4c_time_t now, int rate, int burst) {
+    aio4c_time_t due = 0, next = 0, interval = 0, tolerance = 0;
+
+    if (rate <= 0) {
+        return true;
+    }
+
+    if (burst <= 0) {
+        burst = rate;
+    }
+
+    interval = 1000000 / (aio4c_time_t)rate;
+    tolerance = interval * (aio4c_time_t)(burst - 1);
+
+    do {
+        due = *admitAt;
+
+        if (due > now + tolerance) {
+            return false;
+        }
+
+        next = ((due > now) ? due : now) + interval;
+    } while (!AtomicCompareAndSwap(admitAt, due, next));
+
+    return true;
+}
+
+static bool _AcceptorTakeToken(Acceptor* acceptor) {
+    if (AIO4C_ACCEPTOR_RATE <= 0 || acceptor->internal) {
+        return true;
+    }
+
+    return AcceptorTakeToken(&acceptor->admitAt, ClockMicroseconds(), AIO4C_ACCEPTOR_RATE, AIO4C_ACCEPTOR_BURST);
+}
+
+/* a reset is sent at once, without waiting in TIME_WAIT nor allocating a connection */
+static void _AcceptorReject(aio4c_socket_t sock) {
+    struct linger linger;
+
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+
+#ifndef AIO4C_WIN32
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, sizeof(struct linger));
+    close(sock);
+#else /* AIO4C_WIN32 */
+    setsockopt(sock, SOL_SOCKET, SO_LINGER, (char*)&linger, sizeof(struct linger));
+    closesocket(sock);
+#endif /* AIO4C_WIN32 */
+}
+
+static void _AcceptorDrain(Acceptor* acceptor, aio4c_socket_t listenSocket, Reader* reader) {
+    struct sockaddr_storage addr;
+    socklen_t addrSize = sizeof(struct sockaddr_storage);
+    aio4c_socket_t sock = -1;
+    Address* address = NULL;
+    Connection* connection = NULL;
+    Reader* target = reader;
+
+    memset(&addr, 0, sizeof(struct sockaddr_storage));
+
+    /* drain the whole backlog before going back to select */
+    while ((sock = _AcceptorAccept(listenSocket, &addr, &addrSize)) != (aio4c_socket_t)-1) {
+        if (!_AcceptorTakeToken(acceptor)) {
+            AtomicAdd(&acceptor->rateLimited, 1);
+            _AcceptorReject(sock);
+            continue;
+        }
+
+        if (AIO4C_ACCEPTOR_MAX_CONNECTIONS > 0 && !acceptor->internal && AtomicGet(&acceptor->connections) >= AIO4C_ACCEPTOR_MAX_CONNECTIONS) {
+            AtomicAdd(&acceptor->serverFull, 1);
+            _AcceptorReject(sock);
+            continue;
+        }
+
+        if (reader == NULL) {
+            target = _ChooseReader(acceptor, sock);
+        }
+
+        if (AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS > 0 && !acceptor->internal && AtomicGet(&target->load) >= AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS) {
+            AtomicAdd(&acceptor->pipeFull, 1);
+            _AcceptorReject(sock);
+            continue;
+        }
+
+        if ((address = NewAddressFromSockAddr(AddressGetType(acceptor->address), (aio4c_addr_t*)&addr, addrSize)) == NULL) {
+#ifndef AIO4C_WIN32
+            close(sock);
+#else /* AIO4C_WIN32 */
+            closesocket(sock);
+#endif /* AIO4C_WIN32 */
+            continue;
+        }
+
+        Log(AIO4C_LOG_LEVEL_INFO, "new connection from %s", AddressGetString(address));
+
+        if ((connection = ConnectionFactoryCreate(acceptor->factory, target->connectionPool, target->bufferPool, address, sock)) == NULL) {
+            FreeAddress(&address);
+#ifndef AIO4C_WIN32
+            close(sock);
+#else /* AIO4C_WIN32 */
+            closesocket(sock);
+#endif /* AIO4C_WIN32 */
+            continue;
+        }
+
+        connection->ownerHandlers[AIO4C_CONNECTION_OWNER_ACCEPTOR] = acceptor->handlers;
+
+        ConnectionState(connection, AIO4C_CONNECTION_STATE_INITIALIZED);
+
+        EnqueueDataItem(acceptor->queue, connection);
+
+        AtomicAdd(&acceptor->connections, 1);
+        AtomicAdd(&acceptor->accepted, 1);
+
+        ReaderManageConnection(target, connection);
+
+        ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, 1);
+    }
+}
+
+static void _AcceptorReaderAccept(Reader* reader, aio4c_socket_t listenSocket, Acceptor* acceptor) {
+    _AcceptorDrain(acceptor, listenSocket, reader);
+}
+
+static bool _AcceptorInit(ThreadData _acceptor) {
+    Acceptor* acceptor = (Acceptor*)_acceptor;
+    int i = 0;
+    aio4c_socket_t sock = -1;
+    char* pipeName = NULL;
+    ThreadPolicy defaultPolicy;
+    ThreadPolicy* policy = NULL;
+    aio4c_socket_t inherited[AIO4C_HANDOVER_MAX_SOCKETS];
+    int nbInherited = 0, nextInherited = 0;
+
+    /* sockets handed over by a process being restarted are already listening */
+    if (AIO4C_ACCEPTOR_HANDOVER_PATH != NULL && !acceptor->internal) {
+        nbInherited = HandOverReceive(AIO4C_ACCEPTOR_HANDOVER_PATH, inherited, AIO4C_HANDOVER_MAX_SOCKETS, AIO4C_HANDOVER_TIMEOUT,
+                (bool(*)(aio4c_socket_t,void*))_AcceptorCheckInherited, (void*)acceptor);
+    }
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        pipeName = aio4c_malloc(8);
+
+        if (pipeName != NULL) {
+            snprintf(pipeName, 8, "pipe%03d", i);
+        }
+
+        if (acceptor->policies != NULL) {
+            policy = &acceptor->policies[i];
+        } else {
+            ThreadPolicyForPipe(&defaultPolicy, i, acceptor->nbReaders);
+            policy = &defaultPolicy;
+        }
+
+        if (acceptor->reusePort) {
+            sock = -1;
+            while (sock == -1 && nextInherited < nbInherited) {
+                sock = _AcceptorInherit(acceptor, inherited[nextInherited++]);
+            }
+
+            if (sock == -1 && (sock = _AcceptorListen(acceptor, true)) == -1) {
+                if (pipeName != NULL) {
+                    aio4c_free(pipeName);
+                }
+                break;
+            }
+
+            if ((acceptor->readers[i] = NewListeningReader(pipeName, GetBufferPoolBufferSize(acceptor->factory->pool), policy, sock,
+                            (void(*)(Reader*,aio4c_socket_t,void*))_AcceptorReaderAccept, (void*)acceptor)) == NULL) {
+#ifndef AIO4C_WIN32
+                close(sock);
+#else /* AIO4C_WIN32 */
+                closesocket(sock);
+#endif /* AIO4C_WIN32 */
+                break;
+            }
+        } else if ((acceptor->readers[i] = NewReader(pipeName, GetBufferPoolBufferSize(acceptor->factory->pool), policy)) == NULL) {
+            break;
+        }
+    }
+
+    if (i < acceptor->nbReaders) {
+        Log(AIO4C_LOG_LEVEL_WARN, "only %d pipes over %d were started", i, acceptor->nbReaders);
+        acceptor->nbReaders = i;
+    }
+
+    if (acceptor->reusePort) {
+        /* the kernel stops steering connections to closed sockets, those in their backlog are reset */
+        if (nextInherited < nbInherited) {
+            Log(AIO4C_LOG_LEVEL_WARN, "closing %d inherited sockets unused by the %d pipes", nbInherited - nextInherited, acceptor->nbReaders);
+            while (nextInherited < nbInherited) {
+                _AcceptorClose(inherited[nextInherited++]);
+            }
+        }
+
+        if (acceptor->nbReaders == 0) {
+            return false;
+        }
+
+        if (AIO4C_ACCEPTOR_CPU_STEERING) {
+            _AcceptorSteer(acceptor);
+        }
+
+        Log(AIO4C_LOG_LEVEL_DEBUG, "each of the %d pipes accepts its own incoming connections", acceptor->nbReaders);
+        Log(AIO4C_LOG_LEVEL_INFO, "listening on %s", AddressGetString(acceptor->address));
+        return true;
+    }
+
+    while (acceptor->socket == -1 && nextInherited < nbInherited) {
+        acceptor->socket = _AcceptorInherit(acceptor, inherited[nextInherited++]);
+    }
+
+    while (nextInherited < nbInherited) {
+        Log(AIO4C_LOG_LEVEL_WARN, "closing inherited socket %d, a single one is used without -Ar", inherited[nextInherited]);
+        _AcceptorClose(inherited[nextInherited++]);
     }
 
-    if (listen(acceptor->socket, SOMAXCONN) == -1) {
-#ifndef AIO4C_WIN32
-        close(acceptor->socket);
-#else /* AIO4C_WIN32 */
-        closesocket(acceptor->socket);
-#endif /* AIO4C_WIN32 */
+    if (acceptor->socket == -1 && (acceptor->socket = _AcceptorListen(acceptor, false)) == -1) {
         return false;
     }
 
     acceptor->key = Register(acceptor->selector, AIO4C_OP_READ, acceptor->socket, NULL);
 
+    if (AIO4C_ACCEPTOR_PLACEMENT == AIO4C_PLACEMENT_INCOMING_CPU && !acceptor->internal) {
+#ifdef SO_INCOMING_CPU
+        _AcceptorLocatePipes(acceptor);
+#else /* SO_INCOMING_CPU */
+        Log(AIO4C_LOG_LEVEL_WARN, "SO_INCOMING_CPU not supported, connections placed on the least connected pipe");
+#endif /* SO_INCOMING_CPU */
+    }
+
     Log(AIO4C_LOG_LEVEL_DEBUG, "using %d pipes to manage incoming connections", acceptor->nbReaders);
     Log(AIO4C_LOG_LEVEL_INFO, "listening on %s", AddressGetString(acceptor->address));
     return true;
 }
 
-static Reader* _ChooseReader(Acceptor* acceptor) {
-    int i = 0, minLoad = INT_MAX, choosen = -1;
+typedef struct s_ConnectionsSnapshot {
+    Connection** connections;
+    int          size;
+    int          count;
+} ConnectionsSnapshot;
 
-    for (i = 0; i < acceptor->nbReaders; i++) {
-        if (acceptor->readers[i]->load < minLoad) {
-            choosen = i;
-            minLoad = acceptor->readers[i]->load;
+static bool _AcceptorSnapshotCallback(QueueItem* item, void* arg) {
+    ConnectionsSnapshot* snapshot = (ConnectionsSnapshot*)arg;
+    Connection* connection = NULL;
+
+    if (QueueItemGetType(item) != AIO4C_QUEUE_ITEM_DATA) {
+        return true;
+    }
+
+    if (snapshot->count == snapshot->size) {
+        return false;
+    }
+
+    /* the queue lock keeps the connection alive until it is referenced */
+    connection = (Connection*)QueueDataItemGet(item);
+    ConnectionRetain(connection);
+    snapshot->connections[snapshot->count++] = connection;
+
+    return true;
+}
+
+/*
+ * Copies the connections managed by the acceptor, each one referenced so
+ * that it can be used once the queue lock is released. Every connection
+ * must then be released with ConnectionRelease.
+ */
+static Connection** _AcceptorSnapshot(Acceptor* acceptor, int* count) {
+    ConnectionsSnapshot snapshot;
+    int i = 0;
+
+    memset(&snapshot, 0, sizeof(ConnectionsSnapshot));
+
+    do {
+        for (i = 0; i < snapshot.count; i++) {
+            ConnectionRelease(snapshot.connections[i]);
         }
+
+        if (snapshot.connections != NULL) {
+            aio4c_free(snapshot.connections);
+        }
+
+        /* connections accepted meanwhile are retried with a larger array */
+        snapshot.size = QueueGetSize(acceptor->queue) * 2 + 16;
+        snapshot.count = 0;
+
+        if ((snapshot.connections = aio4c_malloc(snapshot.size * sizeof(Connection*))) == NULL) {
+            *count = 0;
+            return NULL;
+        }
+
+        QueueForEach(acceptor->queue, _AcceptorSnapshotCallback, &snapshot);
+    } while (snapshot.count == snapshot.size);
+
+    *count = snapshot.count;
+
+    return snapshot.connections;
+}
+
+static void _AcceptorDrainConnections(Acceptor* acceptor) {
+    Connection** connections = NULL;
+    Connection* connection = NULL;
+    int count = 0, i = 0;
+
+    if ((connections = _AcceptorSnapshot(acceptor, &count)) == NULL) {
+        return;
     }
 
-    return acceptor->readers[choosen];
+    /* closed without the queue lock, their close handlers take it */
+    for (i = 0; i < count; i++) {
+        connection = connections[i];
+
+        /* busy connections are visited again on the next pass */
+        if (connection->state == AIO4C_CONNECTION_STATE_CONNECTED && connection->migrateTo == NULL && AtomicGet(&connection->pendingItems) == 0) {
+            Log(AIO4C_LOG_LEVEL_DEBUG, "draining connection %s", ConnectionGetString(connection));
+
+            /* the writer shuts the connection down once its output is flushed */
+            ConnectionClose(connection, false);
+            EnableWriteInterest(connection);
+
+            AtomicAdd(&acceptor->drained, 1);
+        }
+
+        ConnectionRelease(connection);
+    }
+
+    aio4c_free(connections);
 }
 
 static bool _AcceptorRun(ThreadData _acceptor) {
     Acceptor* acceptor = (Acceptor*)_acceptor;
-    struct sockaddr addr;
-    struct sockaddr_in addr_in;
-    struct sockaddr_in6 addr_in6;
-#ifndef AIO4C_WIN32
-    struct sockaddr_un addr_un;
-#endif /* AIO4C_WIN32 */
-    socklen_t addrSize = sizeof(struct sockaddr);
     aio4c_size_t numConnectionsReady = 0;
-    aio4c_socket_t sock = -1;
-    Address* address = NULL;
-    Connection* connection = NULL;
-    char hbuf[NI_MAXHOST];
     SelectionKey* key = NULL;
+    MemoryState state = MemoryGetState();
 
-    memset(&addr, 0, sizeof(struct sockaddr));
-    memset(&addr_in, 0, sizeof(struct sockaddr_in));
-    memset(&addr_in6, 0, sizeof(struct sockaddr_in6));
-#ifndef AIO4C_WIN32
-    memset(&addr_un, 0, sizeof(struct sockaddr_un));
-#endif /* AIO4C_WIN32 */
-
-    numConnectionsReady = Select(acceptor->selector);
-
-    if (numConnectionsReady > 0) {
-        while (SelectionKeyReady(acceptor->selector, &key)) {
-            if ((sock = accept(acceptor->socket, &addr, &addrSize)) >= 0) {
-                memset(hbuf, 0, sizeof(hbuf));
-
-                switch(AddressGetType(acceptor->address)) {
-                    case AIO4C_ADDRESS_IPV4:
-                        if (getnameinfo(&addr, sizeof(struct sockaddr_in), hbuf, sizeof(hbuf), NULL, 0, NI_NUMERICHOST) == 0) {
-                            memcpy(&addr_in, &addr, sizeof(struct sockaddr_in));    
-                            address = NewAddress(AIO4C_ADDRESS_IPV4, hbuf, ntohs(addr_in.sin_port));
-                        }
-                        break;
-                    case AIO4C_ADDRESS_IPV6:
-                        if (getnameinfo(&addr, sizeof(struct sockaddr_in6), hbuf, sizeof(hbuf), NULL, 0, NI_NUMERICHOST) == 0) {
-                            memcpy(&addr_in6, &addr, sizeof(struct sockaddr_in6));
-                            address = NewAddress(AIO4C_ADDRESS_IPV6, hbuf, ntohs(addr_in6.sin6_port));
-                        }
-                        break;
+    /* closing the socket lets the clients still in the backlog be refused instead of waiting */
+    if (acceptor->draining && acceptor->socket != -1) {
+        if (acceptor->key != NULL) {
+            Unregister(acceptor->selector, acceptor->key, true, NULL);
+            acceptor->key = NULL;
+        }
 #ifndef AIO4C_WIN32
-                    case AIO4C_ADDRESS_UNIX:
-                        memcpy(&addr_un, &addr, sizeof(struct sockaddr_un));
-                        address = NewAddress(AIO4C_ADDRESS_UNIX, addr_un.sun_path, 0);
-                        break;
+        close(acceptor->socket);
+#else /* AIO4C_WIN32 */
+        closesocket(acceptor->socket);
 #endif /* AIO4C_WIN32 */
-                    default:
-                        break;
-                }
-
-                Log(AIO4C_LOG_LEVEL_INFO, "new connection from %s", AddressGetString(address));
-
-                connection = ConnectionFactoryCreate(acceptor->factory, address, sock);
+        acceptor->socket = -1;
+        Log(AIO4C_LOG_LEVEL_INFO, "stopped listening on %s", AddressGetString(acceptor->address));
+    }
 
-                ConnectionState(connection, AIO4C_CONNECTION_STATE_INITIALIZED);
+    if (acceptor->drainPass) {
+        acceptor->drainPass = false;
+        _AcceptorDrainConnections(acceptor);
+    }
 
-                EnqueueDataItem(acceptor->queue, connection);
+    /* connections are left in the backlog while memory is short, its usage is polled meanwhile */
+    if (acceptor->key != NULL && state >= AIO4C_MEMORY_CRITICAL && !acceptor->internal) {
+        Log(AIO4C_LOG_LEVEL_WARN, "memory is %s, pausing accepts", MemoryStateString[state]);
+        Unregister(acceptor->selector, acceptor->key, true, NULL);
+        acceptor->key = NULL;
+    } else if (acceptor->key == NULL && acceptor->socket != -1 && state == AIO4C_MEMORY_NORMAL) {
+        Log(AIO4C_LOG_LEVEL_INFO, "memory is %s, resuming accepts", MemoryStateString[state]);
+        acceptor->key = Register(acceptor->selector, AIO4C_OP_READ, acceptor->socket, NULL);
+    }
 
-                ReaderManageConnection(_ChooseReader(acceptor), connection);
+    numConnectionsReady = SelectTimeout(acceptor->selector, (acceptor->key == NULL && acceptor->socket != -1) ? AIO4C_MEMORY_POLL_INTERVAL : -1);
 
-                ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, 1);
-            }
+    if (numConnectionsReady > 0) {
+        while (SelectionKeyReady(acceptor->selector, &key)) {
+            _AcceptorDrain(acceptor, acceptor->socket, NULL);
         }
     }
 
@@ -276,10 +993,12 @@ static void _AcceptorCloseHandler(Event event, Connection* source, Acceptor* acc
         return;
     }
 
-    Log(AIO4C_LOG_LEVEL_DEBUG, "received close for connection %s", source->string);
+    Log(AIO4C_LOG_LEVEL_DEBUG, "received close for connection %s", ConnectionGetString(source));
 
     RemoveAll(acceptor->queue, _AcceptorRemoveCallback, (QueueDiscriminant)source);
 
+    AtomicSub(&acceptor->connections, 1);
+
     if (ConnectionNoMoreUsed(source, AIO4C_CONNECTION_OWNER_ACCEPTOR)) {
         FreeConnection(&source);
     }
@@ -287,12 +1006,186 @@ static void _AcceptorCloseHandler(Event event, Connection* source, Acceptor* acc
     ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, -1);
 }
 
+typedef struct s_Rebalance {
+    Reader*            from;
+    aio4c_size_t       gap;
+    Connection*        chosen;
+    unsigned long long traffic;
+} Rebalance;
+
+/*
+ * Samples the traffic of every connection since the previous check, and keeps
+ * a reference to the busiest one of the source pipe whose reads would not
+ * overturn the imbalance once moved.
+ */
+static bool _AcceptorRebalanceCallback(QueueItem* item, void* arg) {
+    Rebalance* rebalance = (Rebalance*)arg;
+    Connection* connection = NULL;
+    unsigned long long traffic = 0;
+
+    if (QueueItemGetType(item) != AIO4C_QUEUE_ITEM_DATA) {
+        return true;
+    }
+
+    connection = (Connection*)QueueDataItemGet(item);
+
+    /* counters may wrap, the difference stays correct */
+    connection->recent.bytesIn = connection->counters.bytesIn - connection->sampled.bytesIn;
+    connection->recent.bytesOut = connection->counters.bytesOut - connection->sampled.bytesOut;
+    connection->sampled.bytesIn += connection->recent.bytesIn;
+    connection->sampled.bytesOut += connection->recent.bytesOut;
+
+    if (rebalance->from == NULL || connection->reader != rebalance->from || connection->state != AIO4C_CONNECTION_STATE_CONNECTED) {
+        return true;
+    }
+
+    traffic = connection->recent.bytesIn + connection->recent.bytesOut;
+
+    if (traffic <= rebalance->traffic ||
+        connection->recent.bytesIn / (unsigned long long)AIO4C_ACCEPTOR_REBALANCE_INTERVAL >= (unsigned long long)rebalance->gap) {
+        return true;
+    }
+
+    if (rebalance->chosen != NULL) {
+        ConnectionRelease(rebalance->chosen);
+    }
+
+    ConnectionRetain(connection);
+    rebalance->chosen = connection;
+    rebalance->traffic = traffic;
+
+    return true;
+}
+
+static void _AcceptorRebalance(Acceptor* acceptor) {
+    Rebalance rebalance = { .from = NULL, .gap = 0, .chosen = NULL, .traffic = 0 };
+    Reader* to = NULL;
+    int i = 0, busiest = 0, idlest = 0;
+
+    TakeLock(acceptor->loadLock);
+
+    if (acceptor->nbReaders < 2) {
+        ReleaseLock(acceptor->loadLock);
+        return;
+    }
+
+    _AcceptorSampleLoad(acceptor);
+
+    for (i = 0; i < acceptor->nbReaders; i++) {
+        if (acceptor->windows[i].bytesPerSecond > acceptor->windows[busiest].bytesPerSecond) {
+            busiest = i;
+        }
+        if (acceptor->windows[i].bytesPerSecond < acceptor->windows[idlest].bytesPerSecond) {
+            idlest = i;
+        }
+    }
+
+    if (busiest == idlest || AtomicGet(&acceptor->readers[busiest]->load) < 2 ||
+        (double)acceptor->windows[busiest].bytesPerSecond <= AIO4C_ACCEPTOR_REBALANCE_RATIO * (double)acceptor->windows[idlest].bytesPerSecond) {
+        acceptor->imbalance = 0;
+    } else if (++acceptor->imbalance >= AIO4C_ACCEPTOR_REBALANCE_PERIODS) {
+        acceptor->imbalance = 0;
+        rebalance.from = acceptor->readers[busiest];
+        rebalance.gap = acceptor->windows[busiest].bytesPerSecond - acceptor->windows[idlest].bytesPerSecond;
+        to = acceptor->readers[idlest];
+    }
+
+    /* every check samples the connections, so that their traffic covers one interval */
+    QueueForEach(acceptor->queue, _AcceptorRebalanceCallback, &rebalance);
+
+    if (rebalance.chosen != NULL) {
+        if (ConnectionMigrate(rebalance.chosen, to)) {
+            Log(AIO4C_LOG_LEVEL_INFO, "pipe %s overloaded (%u bytes/s), moved connection %s (%llu bytes/s) to pipe %s (%u bytes/s)",
+                    rebalance.from->pipe, acceptor->windows[busiest].bytesPerSecond,
+                    ConnectionGetString(rebalance.chosen), rebalance.traffic / (unsigned long long)AIO4C_ACCEPTOR_REBALANCE_INTERVAL,
+                    to->pipe, acceptor->windows[idlest].bytesPerSecond);
+        }
+
+        ConnectionRelease(rebalance.chosen);
+    }
+
+    ReleaseLock(acceptor->loadLock);
+}
+
+static bool _RebalancerInit(ThreadData _acceptor) {
+    Acceptor* acceptor = (Acceptor*)_acceptor;
+
+    acceptor->rebalanceElapsed = 0;
+    acceptor->imbalance = 0;
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "checking pipes balance every %d seconds", AIO4C_ACCEPTOR_REBALANCE_INTERVAL);
+
+    return true;
+}
+
+static bool _RebalancerRun(ThreadData _acceptor) {
+    Acceptor* acceptor = (Acceptor*)_acceptor;
+#ifndef AIO4C_WIN32
+    struct timespec window = { .tv_sec = 0, .tv_nsec = AIO4C_ACCEPTOR_LOAD_WINDOW * 1000000L };
+#endif /* AIO4C_WIN32 */
+
+    /* sleeps by windows to stay responsive to ThreadStop */
+#ifndef AIO4C_WIN32
+    nanosleep(&window, NULL);
+#else /* AIO4C_WIN32 */
+    Sleep(AIO4C_ACCEPTOR_LOAD_WINDOW);
+#endif /* AIO4C_WIN32 */
+
+    acceptor->rebalanceElapsed += AIO4C_ACCEPTOR_LOAD_WINDOW;
+
+    if (acceptor->rebalanceElapsed >= AIO4C_ACCEPTOR_REBALANCE_INTERVAL * 1000) {
+        acceptor->rebalanceElapsed = 0;
+        _AcceptorRebalance(acceptor);
+    }
+
+    return true;
+}
+
+static void _RebalancerExit(ThreadData _acceptor __attribute__((unused))) {
+    Log(AIO4C_LOG_LEVEL_DEBUG, "exited");
+}
+
+static void _AcceptorStartRebalancer(Acceptor* acceptor) {
+    if (AIO4C_ACCEPTOR_REBALANCE_INTERVAL <= 0 || acceptor->nbReaders < 2 || acceptor->internal) {
+        return;
+    }
+
+    acceptor->rebalancer = NewThread(
+            "rebalancer",
+            _RebalancerInit,
+            _RebalancerRun,
+            _RebalancerExit,
+            (ThreadData)acceptor);
+
+    if (acceptor->rebalancer != NULL && !ThreadStart(acceptor->rebalancer)) {
+        FreeThread(&acceptor->rebalancer);
+    }
+}
+
 static void _AcceptorExit(ThreadData _acceptor) {
     Acceptor* acceptor = (Acceptor*)_acceptor;
     QueueItem* item = NewQueueItem();
     Connection* connection = NULL;
     int i = 0;
 
+    StatsSegmentRemovePipes((void*)acceptor);
+
+    /* no migration must be started while pipes are shut down */
+    if (acceptor->rebalancer != NULL) {
+        ThreadStop(acceptor->rebalancer);
+        ThreadJoin(acceptor->rebalancer);
+        acceptor->rebalancer = NULL;
+    }
+
+    /* pipes accepting on their own must not create connections while they are closed below */
+    if (acceptor->reusePort && acceptor->readers != NULL) {
+        for (i = 0; i < acceptor->nbReaders; i++) {
+            if (acceptor->readers[i] != NULL) {
+                ReaderStopListening(acceptor->readers[i]);
+            }
+        }
+    }
+
     if (acceptor->key != NULL) {
         Unregister(acceptor->selector, acceptor->key, true, NULL);
     }
@@ -307,7 +1200,7 @@ static void _AcceptorExit(ThreadData _acceptor) {
 
     while (acceptor->queue != NULL && Dequeue(acceptor->queue, item, false)) {
         connection = (Connection*)QueueDataItemGet(item);
-        EventHandlerRemove(connection->systemHandlers, AIO4C_CLOSE_EVENT, (EventCallback)_AcceptorCloseHandler);
+        connection->ownerHandlers[AIO4C_CONNECTION_OWNER_ACCEPTOR] = NULL;
         ConnectionClose(connection, true);
         if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_ACCEPTOR)) {
             FreeConnection(&connection);
@@ -317,6 +1210,8 @@ static void _AcceptorExit(ThreadData _acceptor) {
     FreeQueueItem(&item);
     FreeQueue(&acceptor->queue);
 
+    TakeLock(acceptor->loadLock);
+
     if (acceptor->readers != NULL) {
         for (i = 0; i < acceptor->nbReaders; i++) {
             if (acceptor->readers[i] != NULL) {
@@ -324,14 +1219,71 @@ static void _AcceptorExit(ThreadData _acceptor) {
             }
         }
         aio4c_free(acceptor->readers);
+        acceptor->readers = NULL;
+        acceptor->nbReaders = 0;
     }
 
+    ReleaseLock(acceptor->loadLock);
+
     Log(AIO4C_LOG_LEVEL_DEBUG, "exited");
 }
 
-Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbPipes) {
+static int _AcceptorReadPipesCounters(Acceptor* acceptor, PipeCounters* counters, int size) {
+    Reader* reader = NULL;
+    Worker* worker = NULL;
+    Writer* writer = NULL;
+    int i = 0;
+
+    memset(counters, 0, size * sizeof(PipeCounters));
+
+    for (i = 0; i < acceptor->nbReaders && i < size; i++) {
+        reader = acceptor->readers[i];
+        counters[i].iterations = reader->counters.iterations;
+        counters[i].wakeups = reader->counters.wakeups;
+        counters[i].readyKeys = reader->counters.readyKeys;
+        counters[i].pollTime = reader->counters.pollTime;
+        counters[i].dispatchTime = reader->counters.dispatchTime;
+        counters[i].bytesIn = reader->bytesRead;
+        counters[i].connections = AtomicGet(&reader->load);
+        if (reader->bufferPool != NULL) {
+            counters[i].poolUsed += GetBufferPoolUsed(reader->bufferPool);
+            counters[i].poolFree += GetBufferPoolAvailable(reader->bufferPool);
+        }
+        if ((worker = reader->worker) == NULL) {
+            counters[i].poolBuffers = counters[i].poolUsed + counters[i].poolFree;
+            continue;
+        }
+        if (worker->pool != NULL) {
+            counters[i].poolUsed += GetBufferPoolUsed(worker->pool);
+            counters[i].poolFree += GetBufferPoolAvailable(worker->pool);
+        }
+        counters[i].poolBuffers = counters[i].poolUsed + counters[i].poolFree;
+        counters[i].pendingItems = AtomicGet(&worker->pendingItems);
+        counters[i].pendingBytes = AtomicGet(&worker->pendingBytes);
+        counters[i].tasks = worker->counters.tasks;
+        counters[i].waitTime = worker->counters.waitTime;
+        counters[i].processTime = worker->counters.processTime;
+        if ((writer = worker->writer) == NULL) {
+            continue;
+        }
+        counters[i].writes = writer->counters.writes;
+        counters[i].shortWrites = writer->counters.shortWrites;
+        counters[i].bytesOut = writer->counters.bytesOut;
+    }
+
+    return i;
+}
+
+/* unregistered before the pipes are freed, so that the statistics thread never needs the load lock */
+static int _AcceptorCollectPipes(void* acceptor, PipeCounters* counters, int size, int* connections) {
+    *connections += AtomicGet(&((Acceptor*)acceptor)->connections);
+    return _AcceptorReadPipesCounters((Acceptor*)acceptor, counters, size);
+}
+
+Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbPipes, ThreadPolicy* policies, bool internal) {
     Acceptor* acceptor = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    int i = 0;
 
     if ((acceptor = aio4c_malloc(sizeof(Acceptor))) == NULL) {
 #ifndef AIO4C_WIN32
@@ -349,7 +1301,8 @@ Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbP
     acceptor->address = address;
     acceptor->factory = factory;
     acceptor->queue = NewQueue();
-    ConnectionAddSystemHandler(acceptor->factory, AIO4C_CLOSE_EVENT, aio4c_connection_handler(_AcceptorCloseHandler), aio4c_connection_handler_arg(acceptor), true);
+    acceptor->handlers = NewEventQueue();
+    EventHandlerAdd(acceptor->handlers, NewEventHandler(AIO4C_CLOSE_EVENT, (EventCallback)_AcceptorCloseHandler, (EventData)acceptor, true));
     acceptor->socket = -1;
     acceptor->nbReaders = nbPipes;
     if ((acceptor->readers = aio4c_malloc(nbPipes * sizeof(Reader*))) == NULL) {
@@ -362,12 +1315,90 @@ Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbP
         code.type = "Reader*";
         Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
         FreeAddress(&acceptor->address);
+        FreeEventQueue(&acceptor->handlers);
         aio4c_free(acceptor);
         return NULL;
     }
 
+    if ((acceptor->windows = aio4c_malloc(nbPipes * sizeof(PipeWindow))) == NULL) {
+#ifndef AIO4C_WIN32
+        code.error = errno;
+#else /* AIO4C_WIN32 */
+        code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+        code.size = nbPipes * sizeof(PipeWindow);
+        code.type = "PipeWindow";
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+        FreeAddress(&acceptor->address);
+        FreeEventQueue(&acceptor->handlers);
+        aio4c_free(acceptor->readers);
+        aio4c_free(acceptor);
+        return NULL;
+    }
+
+    for (i = 0; i < nbPipes; i++) {
+        acceptor->windows[i].node = -1;
+    }
+
+    for (i = 0; i < AIO4C_THREAD_MAX_CPUS; i++) {
+        acceptor->cpuNodes[i] = AIO4C_ACCEPTOR_NODE_UNKNOWN;
+    }
+
+    acceptor->pinned = false;
+    acceptor->admitAt = 0;
+    acceptor->connections = 0;
+    acceptor->accepted = 0;
+    acceptor->rateLimited = 0;
+    acceptor->serverFull = 0;
+    acceptor->pipeFull = 0;
+    acceptor->draining = false;
+    acceptor->drainPass = false;
+    acceptor->drained = 0;
+    acceptor->loadLock = NewLock();
+    acceptor->lastSample = ClockNow();
+    acceptor->seed = (unsigned int)acceptor->lastSample | 1u;
+
     acceptor->thread = NULL;
+    acceptor->rebalancer = NULL;
     acceptor->selector = NewSelector();
+    acceptor->key = NULL;
+    acceptor->internal = internal;
+    acceptor->reusePort = AIO4C_ACCEPTOR_REUSE_PORT && !internal;
+    acceptor->policies = policies;
+
+#ifndef SO_REUSEPORT
+    if (acceptor->reusePort) {
+        Log(AIO4C_LOG_LEVEL_WARN, "SO_REUSEPORT not supported, using a dedicated acceptor thread");
+        acceptor->reusePort = false;
+    }
+#endif /* SO_REUSEPORT */
+
+    if (acceptor->reusePort) {
+        /* pipes accept their connections by themselves, no thread is needed */
+        if (!_AcceptorInit((ThreadData)acceptor)) {
+            _AcceptorExit((ThreadData)acceptor);
+            FreeAddress(&acceptor->address);
+            FreeSelector(&acceptor->selector);
+            if (acceptor->name != NULL) {
+                aio4c_free(acceptor->name);
+            }
+            FreeEventQueue(&acceptor->handlers);
+            FreeLock(&acceptor->loadLock);
+            aio4c_free(acceptor->windows);
+            aio4c_free(acceptor);
+            return NULL;
+        }
+
+        acceptor->policies = NULL;
+
+        _AcceptorStartRebalancer(acceptor);
+
+        if (!internal) {
+            StatsSegmentAddPipes(_AcceptorCollectPipes, (void*)acceptor);
+        }
+
+        return acceptor;
+    }
 
     acceptor->thread = NewThread(
             acceptor->name,
@@ -382,6 +1413,9 @@ Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbP
         if (acceptor->name != NULL) {
             aio4c_free(acceptor->name);
         }
+        FreeEventQueue(&acceptor->handlers);
+        FreeLock(&acceptor->loadLock);
+        aio4c_free(acceptor->windows);
         aio4c_free(acceptor);
         return NULL;
     }
@@ -392,13 +1426,136 @@ Acceptor* NewAcceptor(char* name, Address* address, Connection* factory, int nbP
         if (acceptor->name != NULL) {
             aio4c_free(acceptor->name);
         }
+        FreeEventQueue(&acceptor->handlers);
+        FreeLock(&acceptor->loadLock);
+        aio4c_free(acceptor->windows);
         aio4c_free(acceptor);
         return NULL;
     }
 
+    acceptor->policies = NULL;
+
+    _AcceptorStartRebalancer(acceptor);
+
+    /* the pipes of the library itself would otherwise be listed among those of the application */
+    if (!internal) {
+        StatsSegmentAddPipes(_AcceptorCollectPipes, (void*)acceptor);
+    }
+
     return acceptor;
 }
 
+int AcceptorGetPipesLoad(Acceptor* acceptor, PipeLoad* loads, int size) {
+    Worker* worker = NULL;
+    int i = 0;
+
+    TakeLock(acceptor->loadLock);
+
+    _AcceptorSampleLoad(acceptor);
+
+    for (i = 0; i < acceptor->nbReaders && i < size; i++) {
+        loads[i].connections = AtomicGet(&acceptor->readers[i]->load);
+        loads[i].bytesPerSecond = acceptor->windows[i].bytesPerSecond;
+        loads[i].queued = acceptor->windows[i].queued;
+        worker = acceptor->readers[i]->worker;
+        loads[i].pendingItems = (worker != NULL) ? AtomicGet(&worker->pendingItems) : 0;
+        loads[i].pendingBytes = (worker != NULL) ? AtomicGet(&worker->pendingBytes) : 0;
+        loads[i].suspended = acceptor->readers[i]->suspendedCount;
+        loads[i].rejected = (worker != NULL) ? AtomicGet(&worker->rejected) : 0;
+    }
+
+    ReleaseLock(acceptor->loadLock);
+
+    return i;
+}
+
+int AcceptorGetPipesCounters(Acceptor* acceptor, PipeCounters* counters, int size) {
+    int count = 0;
+
+    /* pipes are freed under this lock when the acceptor exits */
+    TakeLock(acceptor->loadLock);
+    count = _AcceptorReadPipesCounters(acceptor, counters, size);
+    ReleaseLock(acceptor->loadLock);
+
+    return count;
+}
+
+int AcceptorGetConnectionsCounters(Acceptor* acceptor, void (*visitor)(Connection*,ConnectionCounters*,void*), void* arg) {
+    Connection** connections = NULL;
+    ConnectionCounters counters;
+    int count = 0, i = 0;
+
+    if ((connections = _AcceptorSnapshot(acceptor, &count)) == NULL) {
+        return 0;
+    }
+
+    /* visited without the queue lock, the visitor may take as long as it needs */
+    for (i = 0; i < count; i++) {
+        ConnectionGetCounters(connections[i], &counters);
+        visitor(connections[i], &counters, arg);
+        ConnectionRelease(connections[i]);
+    }
+
+    aio4c_free(connections);
+
+    return count;
+}
+
+void AcceptorGetCounters(Acceptor* acceptor, AcceptorCounters* counters) {
+    counters->accepted = AtomicGet(&acceptor->accepted);
+    counters->rateLimited = AtomicGet(&acceptor->rateLimited);
+    counters->serverFull = AtomicGet(&acceptor->serverFull);
+    counters->pipeFull = AtomicGet(&acceptor->pipeFull);
+    counters->connections = AtomicGet(&acceptor->connections);
+    counters->draining = acceptor->draining;
+    counters->drained = AtomicGet(&acceptor->drained);
+}
+
+int AcceptorGetListeningSockets(Acceptor* acceptor, aio4c_socket_t* sockets, int size) {
+    int i = 0, count = 0;
+
+    if (!acceptor->reusePort) {
+        if (acceptor->socket != -1 && size > 0) {
+            sockets[count++] = acceptor->socket;
+        }
+        return count;
+    }
+
+    for (i = 0; i < acceptor->nbReaders && count < size; i++) {
+        if (acceptor->readers[i]->listenSocket != -1) {
+            sockets[count++] = acceptor->readers[i]->listenSocket;
+        }
+    }
+
+    return count;
+}
+
+int AcceptorDrain(Acceptor* acceptor) {
+    int i = 0;
+
+    if (!acceptor->draining) {
+        acceptor->draining = true;
+
+        if (acceptor->reusePort) {
+            for (i = 0; i < acceptor->nbReaders; i++) {
+                ReaderStopListening(acceptor->readers[i]);
+            }
+        }
+
+        Log(AIO4C_LOG_LEVEL_INFO, "draining %d connections", AtomicGet(&acceptor->connections));
+    }
+
+    /* closing runs handlers, which must not run on a caller that may hold locks they need */
+    if (acceptor->thread != NULL) {
+        acceptor->drainPass = true;
+        SelectorWakeUp(acceptor->selector);
+    } else {
+        _AcceptorDrainConnections(acceptor);
+    }
+
+    return AtomicGet(&acceptor->connections);
+}
+
 void AcceptorEnd(Acceptor* acceptor) {
     if (acceptor->thread != NULL) {
         ThreadStop(acceptor->thread);
@@ -408,10 +1565,18 @@ void AcceptorEnd(Acceptor* acceptor) {
         }
 
         ThreadJoin(acceptor->thread);
+    } else {
+        _AcceptorExit((ThreadData)acceptor);
     }
 
     FreeSelector(&acceptor->selector);
 
+    FreeEventQueue(&acceptor->handlers);
+
+    FreeLock(&acceptor->loadLock);
+
+    aio4c_free(acceptor->windows);
+
     aio4c_free(acceptor);
 }
 
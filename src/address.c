@@ -24,6 +24,7 @@
 #include <aio4c/address.h>
 
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
 #include <aio4c/types.h>
 
 #ifndef AIO4C_WIN32
@@ -91,23 +92,15 @@ static void ResolveIP(AddressType type, char* address, struct sockaddr* ip) {
     freeaddrinfo(result);
 }
 
-Address* NewAddress(AddressType type, char* address, aio4c_port_t port) {
+static Address* _NewAddress(AddressType type) {
     Address* pAddress = NULL;
-    struct sockaddr_in* ipv4 = NULL;
-    struct sockaddr_in6* ipv6 = NULL;
-#ifndef AIO4C_WIN32
-    struct sockaddr_un* un = NULL;
-#endif
-    char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-
-    memset(hbuf, 0, NI_MAXHOST * sizeof(char));
-    memset(sbuf, 0, NI_MAXSERV * sizeof(char));
 
     if ((pAddress = aio4c_malloc(sizeof(Address))) == NULL) {
         return NULL;
     }
 
     pAddress->type = type;
+    pAddress->string = NULL;
 
     switch(type) {
         case AIO4C_ADDRESS_IPV4:
@@ -130,17 +123,27 @@ Address* NewAddress(AddressType type, char* address, aio4c_port_t port) {
         return NULL;
     }
 
+    return pAddress;
+}
+
+Address* NewAddress(AddressType type, char* address, aio4c_port_t port) {
+    Address* pAddress = NULL;
+    struct sockaddr_in* ipv4 = NULL;
+    struct sockaddr_in6* ipv6 = NULL;
+#ifndef AIO4C_WIN32
+    struct sockaddr_un* un = NULL;
+#endif
+
+    if ((pAddress = _NewAddress(type)) == NULL) {
+        return NULL;
+    }
+
     switch(type) {
         case AIO4C_ADDRESS_IPV4:
             ipv4 = (struct sockaddr_in*)pAddress->address;
             ipv4->sin_family = AF_INET;
             ipv4->sin_port = htons(port);
             ResolveIP(type, address, (struct sockaddr*)ipv4);
-            if (getnameinfo((struct sockaddr*)ipv4, sizeof(struct sockaddr_in), hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
-                if ((pAddress->string = aio4c_malloc((strlen(hbuf) + strlen(sbuf) + 4) * sizeof(char))) != NULL) {
-                    snprintf(pAddress->string, strlen(hbuf) + strlen(sbuf) + 4, "[%s]:%s", hbuf, sbuf);
-                }
-            }
             break;
         case AIO4C_ADDRESS_IPV6:
             ipv6 = (struct sockaddr_in6*)pAddress->address;
@@ -149,11 +152,6 @@ Address* NewAddress(AddressType type, char* address, aio4c_port_t port) {
             ipv6->sin6_flowinfo = 0;
             ipv6->sin6_scope_id = 0;
             ResolveIP(type, address, (struct sockaddr*)ipv6);
-            if (getnameinfo((struct sockaddr*)ipv6, sizeof(struct sockaddr_in6), hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
-                if ((pAddress->string = aio4c_malloc((strlen(hbuf) + strlen(sbuf) + 4) * sizeof(char))) != NULL) {
-                    snprintf(pAddress->string, strlen(hbuf) + strlen(sbuf) + 4, "[%s]:%s", hbuf, sbuf);
-                }
-            }
             break;
 #ifndef AIO4C_WIN32
         case AIO4C_ADDRESS_UNIX:
@@ -170,6 +168,47 @@ Address* NewAddress(AddressType type, char* address, aio4c_port_t port) {
     return pAddress;
 }
 
+Address* NewAddressFromSockAddr(AddressType type, aio4c_addr_t* addr, int size) {
+    Address* pAddress = NULL;
+
+    if ((pAddress = _NewAddress(type)) == NULL) {
+        return NULL;
+    }
+
+    if (size > (int)pAddress->size) {
+        size = pAddress->size;
+    }
+
+    memcpy(pAddress->address, addr, size);
+
+    return pAddress;
+}
+
+static char* _AddressFormat(Address* address) {
+    char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
+    char* string = NULL;
+    int size = 0;
+
+    memset(hbuf, 0, NI_MAXHOST * sizeof(char));
+    memset(sbuf, 0, NI_MAXSERV * sizeof(char));
+
+    switch (address->type) {
+        case AIO4C_ADDRESS_IPV4:
+        case AIO4C_ADDRESS_IPV6:
+            if (getnameinfo(address->address, address->size, hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+                size = strlen(hbuf) + strlen(sbuf) + 4;
+                if ((string = aio4c_malloc(size * sizeof(char))) != NULL) {
+                    snprintf(string, size, "[%s]:%s", hbuf, sbuf);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+
+    return string;
+}
+
 aio4c_addr_t* AddressGetAddr(Address* address) {
     return address->address;
 }
@@ -180,6 +219,14 @@ int AddressGetAddrSize(Address* address) {
 
 char* AddressGetString(Address* address) {
     char* result = "<unknown address>";
+    char* string = NULL;
+
+    if (address->string == NULL && (string = _AddressFormat(address)) != NULL) {
+        /* another thread may have formatted the string concurrently */
+        if (!AtomicCompareAndSwap(&address->string, NULL, string)) {
+            aio4c_free(string);
+        }
+    }
 
     if (address->string != NULL) {
         result = address->string;
@@ -23,15 +23,29 @@
  */
 #include <aio4c.h>
 
+#include <aio4c/acceptor.h>
+#include <aio4c/alloc.h>
+#include <aio4c/clock.h>
+#include <aio4c/contention.h>
 #include <aio4c/log.h>
+#include <aio4c/metrics.h>
+#include <aio4c/segment.h>
+#include <aio4c/trace.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
+#include <aio4c/worker.h>
 
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <unistd.h>
 
+#ifdef AIO4C_HAVE_MLOCKALL
+#include <errno.h>
+#include <sys/mman.h>
+#endif /* AIO4C_HAVE_MLOCKALL */
+
 #ifdef AIO4C_WIN32
 #include <winbase.h>
 #include <winsock2.h>
@@ -73,9 +87,46 @@ static void _RetrieveWinVer(void) {
 }
 #endif /* AIO4C_WIN32 */
 
+static void _LockMemory(void) {
+#ifdef AIO4C_HAVE_MLOCKALL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot lock memory: %s", strerror(errno));
+    } else {
+        Log(AIO4C_LOG_LEVEL_DEBUG, "process memory locked");
+    }
+#else /* AIO4C_HAVE_MLOCKALL */
+    Log(AIO4C_LOG_LEVEL_WARN, "memory locking not supported");
+#endif /* AIO4C_HAVE_MLOCKALL */
+}
+
 void Aio4cUsage(void) {
     fprintf(stderr, "Aio4c options:\n");
     fprintf(stderr, "\t-Ah: displays this help message\n");
+    fprintf(stderr, "\t-Ar: each server pipe accepts on its own SO_REUSEPORT socket (default: disabled)\n");
+    fprintf(stderr, "\t-Ac: steers incoming connections to the pipe of the receiving CPU, with -Ar (default: disabled)\n");
+    fprintf(stderr, "\t-Ap policy: how server pipes are chosen for new connections, between the following:\n");
+    fprintf(stderr, "\t\tconnections: pipe with the fewest connections (default)\n");
+    fprintf(stderr, "\t\tthroughput : pipe reading the fewest bytes per second\n");
+    fprintf(stderr, "\t\tqueued     : pipe with the fewest pending tasks\n");
+    fprintf(stderr, "\t\ttwo-choices: least connected pipe of two chosen at random\n");
+    fprintf(stderr, "\t\tincoming-cpu: pipe pinned to, or nearest to, the CPU that received the connection\n");
+    fprintf(stderr, "\t-Ab interval: checks server pipes balance every interval seconds and migrates connections (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-Aa rate[:burst]: accepts at most rate connections per second, burst at once (default: 0 = unlimited)\n");
+    fprintf(stderr, "\t-Am max     : maximum number of connections of a server (default: 0 = unlimited)\n");
+    fprintf(stderr, "\t-AM max     : maximum number of connections of each server pipe (default: 0 = unlimited)\n");
+    fprintf(stderr, "\t\t*Note*: connections over these limits are reset as soon as accepted\n");
+    fprintf(stderr, "\t-Ai path    : inherits listening sockets handed over on the AF_UNIX socket path (default: none)\n");
+    fprintf(stderr, "\t-Tc cpus    : CPUs shared among pipes threads, as a list such as 0-3,8-11 (default: any)\n");
+    fprintf(stderr, "\t-Tn         : pipes threads allocate memory on their NUMA node (default: disabled)\n");
+    fprintf(stderr, "\t-Tp priority: SCHED_FIFO priority of pipes threads (default: 0 = not realtime)\n");
+    fprintf(stderr, "\t-Tm         : locks process memory in RAM (default: disabled)\n");
+    fprintf(stderr, "\t-Wb high[:low]: suspends reading a connection with high bytes not yet processed (default: 1048576:262144)\n");
+    fprintf(stderr, "\t-Wi high[:low]: suspends reading a connection with high buffers not yet processed (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-WB high[:low]: suspends reading a pipe with high bytes not yet processed (default: 67108864:33554432)\n");
+    fprintf(stderr, "\t-WI high[:low]: suspends reading a pipe with high buffers not yet processed (default: 0 = disabled)\n");
+    fprintf(stderr, "\t\t*Note*: reads resume below low, which defaults to high / 2\n");
+    fprintf(stderr, "\t-Wo target[:interval]: sheds tasks waiting more than target ms for a whole interval ms (default: 0:100 = disabled)\n");
+    fprintf(stderr, "\t-Mb size   : memory budget of the library, in bytes or suffixed by k, m or g (default: 0 = unlimited)\n");
     fprintf(stderr, "\t-Ll loglevel: loglevel (as integer or string) between the following:\n");
     fprintf(stderr, "\t\tFATAL(0): displays only fatal errors\n");
     fprintf(stderr, "\t\tERROR(1): displays non fatal errors\n");
@@ -84,18 +135,84 @@ void Aio4cUsage(void) {
     fprintf(stderr, "\t\tDEBUG(4): displays debugging informations\n");
     fprintf(stderr, "\t\t*Note*: each log level displays it's level message plus messages of lower level\n");
     fprintf(stderr, "\t-Lo logfile : where to output the logs (default: stderr)\n");
-#if AIO4C_ENABLE_STATS
     fprintf(stderr, "\t-So statfile: where to output stats (default: stats-[PID].csv)\n");
     fprintf(stderr, "\t-Si interval: defines the statistics sample interval (default: 0 = disabled)\n");
     fprintf(stderr, "\t-Se         : enable periodic statistics output to stderr (default: disabled)\n");
-#endif /* AIO4C_ENABLE_STATS */
+    fprintf(stderr, "\t-Sc probes  : probe categories enabled at startup, as a mask or a comma separated list of\n");
+    fprintf(stderr, "\t\tmemory, buffer, network, process, thread, latency, jni, connection, all or none (default: %s)\n",
+            (AIO4C_ENABLE_STATS ? "all" : "none"));
+    fprintf(stderr, "\t-Ss signal : signal toggling the enabled probes on and off at runtime (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-St clock  : clock used to timestamp probes and messages, between monotonic, coarse, raw or tsc (default: monotonic)\n");
+    fprintf(stderr, "\t-Sm segment: file mapped to publish statistics every interval, read by aio4c-top (default: none)\n");
+    fprintf(stderr, "\t-Sw port   : port serving statistics at /metrics in Prometheus text format (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-Sa host   : address the metrics endpoint listens on (default: %s)\n", AIO4C_METRICS_HOST);
+    fprintf(stderr, "\t-Sr rate   : traces one read out of rate through its pipe, also served at /trace by the metrics endpoint (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-Sj tracefile: where to export traces at exit, as Chrome trace events (default: trace-[PID].json)\n");
+    fprintf(stderr, "\t-Sl count  : profiles lock contention, reporting the count most contended call sites and locks at exit,\n");
+    fprintf(stderr, "\t\talso served at /locks by the metrics endpoint (default: 0 = disabled)\n");
+    fprintf(stderr, "\t-Sk lockfile: where to report lock contention at exit (default: stderr)\n");
+}
+
+static void _ParseWaterMark(char* arg, int* high, int* low) {
+    long int value = 0, lowValue = 0;
+    char* endptr = NULL;
+
+    value = strtol(arg, &endptr, 10);
+    if (value < 0 || value >= INT_MAX || endptr == arg) {
+        return;
+    }
+
+    lowValue = value / 2;
+    if (*endptr == ':') {
+        lowValue = strtol(endptr + 1, &endptr, 10);
+        if (lowValue < 0 || lowValue > value) {
+            return;
+        }
+    }
+
+    *high = (int)value;
+    *low = (int)lowValue;
+}
+
+static void _ParseMemorySize(char* arg, long long* size) {
+    long long value = 0;
+    char* endptr = NULL;
+
+    value = strtoll(arg, &endptr, 10);
+    if (value < 0 || endptr == arg) {
+        return;
+    }
+
+    switch (*endptr) {
+        case 'g':
+        case 'G':
+            value *= 1024;
+            /* fall through */
+        case 'm':
+        case 'M':
+            value *= 1024;
+            /* fall through */
+        case 'k':
+        case 'K':
+            value *= 1024;
+            break;
+        case '\0':
+            break;
+        default:
+            return;
+    }
+
+    *size = value;
 }
 
 static void _ParseArguments(int argc, char* argv[]) {
     int optind = 0;
     long int value = 0;
     char* levelStr = NULL;
+    int placement = 0;
+    int source = 0;
     char* endptr = NULL;
+    ThreadPolicy policy;
 
     for (optind = 1; optind < argc; optind++) {
         switch(argv[optind][0]) {
@@ -136,7 +253,6 @@ static void _ParseArguments(int argc, char* argv[]) {
                                 break;
                         }
                         break;
-#if AIO4C_ENABLE_STATS
                     case 'S':
                         switch (argv[optind][2]) {
                             case 'o':
@@ -158,11 +274,168 @@ static void _ParseArguments(int argc, char* argv[]) {
                             case 'e':
                                 AIO4C_STATS_ENABLE_PERIODIC_OUTPUT = true;
                                 break;
+                            case 'c':
+                                if (optind + 1 < argc) {
+                                    AIO4C_STATS_PROBES = StatsParseCategories(argv[optind + 1]);
+                                    optind++;
+                                }
+                                break;
+                            case 's':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX) {
+                                        AIO4C_STATS_SIGNAL = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 't':
+                                if (optind + 1 < argc) {
+                                    for (source = 0; source < AIO4C_CLOCK_SOURCE_MAX; source++) {
+                                        if (strcasecmp(ClockSourceString[source], argv[optind + 1]) == 0) {
+                                            AIO4C_CLOCK_SOURCE = (ClockSource)source;
+                                            break;
+                                        }
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'm':
+                                if (optind + 1 < argc) {
+                                    AIO4C_STATS_SEGMENT = argv[optind + 1];
+                                    optind++;
+                                }
+                                break;
+                            case 'w':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value <= 65535) {
+                                        AIO4C_METRICS_PORT = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'a':
+                                if (optind + 1 < argc) {
+                                    AIO4C_METRICS_HOST = argv[optind + 1];
+                                    optind++;
+                                }
+                                break;
+                            case 'r':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX) {
+                                        AIO4C_TRACE_RATE = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'j':
+                                if (optind + 1 < argc) {
+                                    AIO4C_TRACE_FILE = argv[optind + 1];
+                                    optind++;
+                                }
+                                break;
+                            case 'l':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX) {
+                                        AIO4C_CONTENTION_TOP = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'k':
+                                if (optind + 1 < argc) {
+                                    AIO4C_CONTENTION_FILE = argv[optind + 1];
+                                    optind++;
+                                }
+                                break;
+                            default:
+                                break;
+                        }
+                        break;
+                    case 'T':
+                        switch (argv[optind][2]) {
+                            case 'c':
+                                if (optind + 1 < argc) {
+                                    memset(&policy, 0, sizeof(ThreadPolicy));
+                                    if (ThreadPolicyAddCpus(&policy, argv[optind + 1])) {
+                                        AIO4C_THREAD_CPUS = argv[optind + 1];
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'n':
+                                AIO4C_THREAD_LOCAL_MEMORY = true;
+                                break;
+                            case 'p':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value <= 99) {
+                                        AIO4C_THREAD_PRIORITY = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'm':
+                                AIO4C_THREAD_LOCK_MEMORY = true;
+                                break;
                             default:
                                 break;
                         }
                         break;
-#endif /* AIO4C_ENABLE_STATS */
+                    case 'M':
+                        if (optind + 1 < argc) {
+                            switch (argv[optind][2]) {
+                                case 'b':
+                                    _ParseMemorySize(argv[optind + 1], &AIO4C_MEMORY_BUDGET);
+                                    break;
+                                default:
+                                    break;
+                            }
+                            optind++;
+                        }
+                        break;
+                    case 'W':
+                        if (optind + 1 < argc) {
+                            switch (argv[optind][2]) {
+                                case 'b':
+                                    _ParseWaterMark(argv[optind + 1], &AIO4C_CONNECTION_WATER_MARKS.highBytes, &AIO4C_CONNECTION_WATER_MARKS.lowBytes);
+                                    break;
+                                case 'i':
+                                    _ParseWaterMark(argv[optind + 1], &AIO4C_CONNECTION_WATER_MARKS.highItems, &AIO4C_CONNECTION_WATER_MARKS.lowItems);
+                                    break;
+                                case 'B':
+                                    _ParseWaterMark(argv[optind + 1], &AIO4C_WORKER_WATER_MARKS.highBytes, &AIO4C_WORKER_WATER_MARKS.lowBytes);
+                                    break;
+                                case 'I':
+                                    _ParseWaterMark(argv[optind + 1], &AIO4C_WORKER_WATER_MARKS.highItems, &AIO4C_WORKER_WATER_MARKS.lowItems);
+                                    break;
+                                case 'o':
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX / 1000) {
+                                        AIO4C_CONNECTION_OVERLOAD_CONTROL.target = (int)value;
+                                        if (*endptr == ':') {
+                                            value = strtol(endptr + 1, &endptr, 10);
+                                            if (value > 0 && value < INT_MAX / 1000) {
+                                                AIO4C_CONNECTION_OVERLOAD_CONTROL.interval = (int)value;
+                                            }
+                                        }
+                                    }
+                                    break;
+                                default:
+                                    break;
+                            }
+                            optind++;
+                        }
+                        break;
                     case 'A':
                         switch (argv[optind][2]) {
                             case 'h':
@@ -170,6 +443,75 @@ static void _ParseArguments(int argc, char* argv[]) {
                                 Aio4cEnd();
                                 exit(EXIT_SUCCESS);
                                 break;
+                            case 'r':
+                                AIO4C_ACCEPTOR_REUSE_PORT = true;
+                                break;
+                            case 'c':
+                                AIO4C_ACCEPTOR_CPU_STEERING = true;
+                                break;
+                            case 'b':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX / 1000) {
+                                        AIO4C_ACCEPTOR_REBALANCE_INTERVAL = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'a':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value <= 1000000) {
+                                        AIO4C_ACCEPTOR_RATE = (int)value;
+                                        if (*endptr == ':') {
+                                            value = strtol(endptr + 1, &endptr, 10);
+                                            if (value > 0 && value < INT_MAX) {
+                                                AIO4C_ACCEPTOR_BURST = (int)value;
+                                            }
+                                        }
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'i':
+                                if (optind + 1 < argc) {
+                                    AIO4C_ACCEPTOR_HANDOVER_PATH = argv[optind + 1];
+                                    optind++;
+                                }
+                                break;
+                            case 'm':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX) {
+                                        AIO4C_ACCEPTOR_MAX_CONNECTIONS = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'M':
+                                if (optind + 1 < argc) {
+                                    value = 0;
+                                    value = strtol(argv[optind + 1], &endptr, 10);
+                                    if (value >= 0 && value < INT_MAX) {
+                                        AIO4C_ACCEPTOR_MAX_PIPE_CONNECTIONS = (int)value;
+                                    }
+                                    optind++;
+                                }
+                                break;
+                            case 'p':
+                                if (optind + 1 < argc) {
+                                    for (placement = 0; placement < AIO4C_PLACEMENT_MAX; placement++) {
+                                        if (strcasecmp(AcceptorPlacementString[placement], argv[optind + 1]) == 0) {
+                                            AIO4C_ACCEPTOR_PLACEMENT = (AcceptorPlacement)placement;
+                                            break;
+                                        }
+                                    }
+                                    optind++;
+                                }
+                                break;
                             default:
                                 break;
                         }
@@ -191,17 +533,25 @@ void Aio4cInit(int argc, char* argv[], void (*loghandler)(void*,LogLevel,char*),
     _InitWinSock();
     _RetrieveWinVer();
 #endif /* AIO4C_WIN32 */
-#if AIO4C_ENABLE_STATS
-    StatsInit();
-#endif /* AIO4C_ENABLE_STATS */
     LogInit(loghandler, logger);
+    ClockInit();
+    StatsInit();
+
+    if (AIO4C_THREAD_LOCK_MEMORY) {
+        _LockMemory();
+    }
+
+    if (AIO4C_METRICS_PORT > 0) {
+        MetricsStart();
+    }
 }
 
 void Aio4cEnd(void) {
+    MetricsStop();
+    TraceEnd();
+    ContentionEnd();
     LogEnd();
-#if AIO4C_ENABLE_STATS
     StatsEnd();
-#endif /* AIO4C_ENABLE_STATS */
 #ifdef AIO4C_WIN32
     _CleanUpWinSock();
 #endif /* AIO4C_WIN32 */
@@ -23,6 +23,7 @@
  */
 #include <aio4c/alloc.h>
 
+#include <aio4c/atomic.h>
 #include <aio4c/log.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
@@ -34,6 +35,29 @@
 #include <stdlib.h>
 #include <string.h>
 
+long long AIO4C_MEMORY_BUDGET = 0;
+
+char* MemoryStateString[AIO4C_MEMORY_STATE_MAX] = {
+    "normal",
+    "pressure",
+    "critical",
+    "exhausted"
+};
+
+static volatile long long _memoryUsed = 0;
+
+/* only published once large enough, to keep the shared counter out of most allocations */
+static __thread long long _memoryDelta = 0;
+
+static void _MemoryAccount(long long size) {
+    _memoryDelta += size;
+
+    if (_memoryDelta >= AIO4C_MEMORY_ACCOUNTING_BATCH || _memoryDelta <= -AIO4C_MEMORY_ACCOUNTING_BATCH) {
+        AtomicAdd(&_memoryUsed, _memoryDelta);
+        _memoryDelta = 0;
+    }
+}
+
 void* aio4c_malloc(int size) {
     void* ptr = NULL;
     int* sPtr = NULL;
@@ -48,6 +72,7 @@ void* aio4c_malloc(int size) {
 
     ProbeSize(AIO4C_PROBE_MEMORY_ALLOCATED_SIZE, size);
     ProbeSize(AIO4C_PROBE_MEMORY_ALLOCATE_COUNT, 1);
+    _MemoryAccount(size + sizeof(int));
 
     sPtr = (int*)ptr;
     sPtr[0] = size;
@@ -94,6 +119,7 @@ void* aio4c_realloc(void* ptr, int size) {
 
     ProbeSize(AIO4C_PROBE_MEMORY_ALLOCATE_COUNT, 1);
     ProbeSize(AIO4C_PROBE_MEMORY_ALLOCATED_SIZE, size - prevSize);
+    _MemoryAccount(size - prevSize);
 
     ProbeTimeEnd(AIO4C_TIME_PROBE_MEMORY_ALLOCATION);
 
@@ -121,6 +147,36 @@ void aio4c_free(void* ptr) {
 
     ProbeSize(AIO4C_PROBE_MEMORY_ALLOCATED_SIZE, -size);
     ProbeSize(AIO4C_PROBE_MEMORY_FREE_COUNT, 1);
+    _MemoryAccount(-(long long)(size + sizeof(int)));
 
     ProbeTimeEnd(AIO4C_TIME_PROBE_MEMORY_ALLOCATION);
 }
+
+long long MemoryGetUsed(void) {
+    return _memoryUsed;
+}
+
+MemoryState MemoryGetState(void) {
+    long long used = _memoryUsed;
+
+    if (AIO4C_MEMORY_BUDGET <= 0) {
+        return AIO4C_MEMORY_NORMAL;
+    }
+
+    if (used >= AIO4C_MEMORY_BUDGET) {
+        return AIO4C_MEMORY_EXHAUSTED;
+    } else if (used >= AIO4C_MEMORY_BUDGET / 10 * 9) {
+        return AIO4C_MEMORY_CRITICAL;
+    } else if (used >= AIO4C_MEMORY_BUDGET / 10 * 8) {
+        return AIO4C_MEMORY_PRESSURE;
+    }
+
+    return AIO4C_MEMORY_NORMAL;
+}
+
+void MemoryFlush(void) {
+    if (_memoryDelta != 0) {
+        AtomicAdd(&_memoryUsed, _memoryDelta);
+        _memoryDelta = 0;
+    }
+}
@@ -24,6 +24,8 @@
 #include <aio4c/buffer.h>
 
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/clock.h>
 #include <aio4c/error.h>
 #include <aio4c/log.h>
 #include <aio4c/queue.h>
@@ -41,9 +43,12 @@ struct s_Buffer {
 };
 
 struct s_BufferPool {
-    Queue*   buffers;
-    int      batch;
-    int      bufferSize;
+    Queue*        buffers;
+    int           batch;
+    int           bufferSize;
+    volatile int  available;
+    volatile int  references;
+    volatile bool exiting;
 };
 
 Buffer* NewBuffer(int size) {
@@ -79,19 +84,13 @@ void FreeBuffer(Buffer** buffer) {
     }
 }
 
-BufferPool* NewBufferPool(aio4c_size_t bufferSize) {
-    BufferPool* pool = NULL;
+/* buffers are zeroed when allocated, so their memory is placed by the calling thread */
+static void _BufferPoolGrow(BufferPool* pool, int count) {
     Buffer* buffer = NULL;
     int i = 0;
 
-    if ((pool = aio4c_malloc(sizeof(BufferPool))) == NULL) {
-        return NULL;
-    }
-
-    pool->buffers = NewQueue();
-
-    for (i = 0; i < AIO4C_BUFFER_POOL_BATCH_SIZE; i++) {
-        buffer = NewBuffer(bufferSize);
+    for (i = 0; i < count; i++) {
+        buffer = NewBuffer(pool->bufferSize);
 
         if (buffer == NULL) {
             break;
@@ -100,43 +99,102 @@ BufferPool* NewBufferPool(aio4c_size_t bufferSize) {
         buffer->pool = pool;
 
         EnqueueDataItem(pool->buffers, buffer);
+        AtomicAdd(&pool->available, 1);
+    }
+}
+
+static void _BufferPoolDestroy(BufferPool* pool) {
+    QueueItem* item = NewQueueItem();
+    Buffer* buffer = NULL;
+
+    while (Dequeue(pool->buffers, item, false)) {
+        buffer = QueueDataItemGet(item);
+        FreeBuffer(&buffer);
+    }
+
+    FreeQueueItem(&item);
+    FreeQueue(&pool->buffers);
+
+    aio4c_free(pool);
+}
+
+/* the pool is referenced by its owner and by each allocated buffer */
+static void _BufferPoolRelease(BufferPool* pool) {
+    if (AtomicSub(&pool->references, 1) == 0) {
+        _BufferPoolDestroy(pool);
     }
+}
 
+BufferPool* NewBufferPool(aio4c_size_t bufferSize) {
+    BufferPool* pool = NULL;
+
+    if ((pool = aio4c_malloc(sizeof(BufferPool))) == NULL) {
+        return NULL;
+    }
+
+    pool->buffers = NewQueue();
     pool->batch = AIO4C_BUFFER_POOL_BATCH_SIZE;
     pool->bufferSize = bufferSize;
+    pool->available = 0;
+    pool->references = 1;
+    pool->exiting = false;
+
+    _BufferPoolGrow(pool, pool->batch);
 
     return pool;
 }
 
+void BufferPoolReserve(BufferPool* pool) {
+    int available = pool->available;
+
+    if (available < pool->batch && MemoryGetState() == AIO4C_MEMORY_NORMAL) {
+        _BufferPoolGrow(pool, pool->batch - available);
+    }
+}
+
 int GetBufferPoolBufferSize(BufferPool* pool) {
     return pool->bufferSize;
 }
 
+int GetBufferPoolUsed(BufferPool* pool) {
+    /* the owner reference is dropped once the pool is freed */
+    return pool->references - (pool->exiting ? 0 : 1);
+}
+
+int GetBufferPoolAvailable(BufferPool* pool) {
+    return pool->available;
+}
+
 Buffer* AllocateBuffer(BufferPool* pool) {
     Buffer* buffer = NULL;
     QueueItem* item = NewQueueItem();
-    int i = 0;
+    MemoryState state = AIO4C_MEMORY_NORMAL;
+    int count = 0;
 
     ProbeTimeStart(AIO4C_TIME_PROBE_BUFFER_ALLOCATION);
 
     if (!Dequeue(pool->buffers, item, false)) {
-        for (i = 0; i < pool->batch; i++) {
-            buffer = NewBuffer(pool->bufferSize);
-
-            if (buffer == NULL) {
-                break;
-            }
-
-            buffer->pool = pool;
-
-            EnqueueDataItem(pool->buffers, buffer);
+        /* near the memory budget the pool grows one buffer at a time, and no more once reached */
+        state = MemoryGetState();
+        if (state == AIO4C_MEMORY_EXHAUSTED) {
+            count = 0;
+        } else if (state != AIO4C_MEMORY_NORMAL) {
+            count = 1;
+        } else {
+            count = pool->batch;
         }
 
+        _BufferPoolGrow(pool, count);
+
         if (!Dequeue(pool->buffers, item, false)) {
+            FreeQueueItem(&item);
             return NULL;
         }
     }
 
+    AtomicSub(&pool->available, 1);
+    AtomicAdd(&pool->references, 1);
+
     buffer = (Buffer*)QueueDataItemGet(item);
 
     ProbeSize(AIO4C_PROBE_BUFFER_ALLOCATED_SIZE, buffer->size);
@@ -160,13 +218,19 @@ void ReleaseBuffer(Buffer** pBuffer) {
             return;
         }
 
-        BufferReset(buffer);
-
-        EnqueueDataItem(pool->buffers, buffer);
-
         ProbeSize(AIO4C_PROBE_BUFFER_ALLOCATED_SIZE, -buffer->size);
 
-        *pBuffer = NULL;
+        /* near the memory budget pools shrink instead of keeping released buffers, as freed pools do */
+        if (pool->exiting || MemoryGetState() != AIO4C_MEMORY_NORMAL) {
+            FreeBuffer(pBuffer);
+        } else {
+            BufferReset(buffer);
+            EnqueueDataItem(pool->buffers, buffer);
+            AtomicAdd(&pool->available, 1);
+            *pBuffer = NULL;
+        }
+
+        _BufferPoolRelease(pool);
     }
 
     ProbeTimeEnd(AIO4C_TIME_PROBE_BUFFER_ALLOCATION);
@@ -178,14 +242,16 @@ void FreeBufferPool(BufferPool** pPool) {
     Buffer* buffer = NULL;
 
     if (pPool != NULL && (pool = *pPool) != NULL) {
+        pool->exiting = true;
+
         while (Dequeue(pool->buffers, item, false)) {
+            AtomicSub(&pool->available, 1);
             buffer = QueueDataItemGet(item);
             FreeBuffer(&buffer);
         }
 
-        FreeQueue(&pool->buffers);
-
-        aio4c_free(pool);
+        /* buffers still allocated, such as those of migrated connections, destroy the pool once all released */
+        _BufferPoolRelease(pool);
 
         *pPool = NULL;
     }
@@ -327,3 +393,13 @@ int BufferRemaining(Buffer* buffer) {
 aio4c_byte_t* BufferGetBytes(Buffer* buffer) {
     return buffer->data;
 }
+
+bool BufferPutTimestamp(Buffer* buffer) {
+    aio4c_clock_t stamp = ClockNow();
+
+    return BufferPut(buffer, &stamp, sizeof(aio4c_clock_t));
+}
+
+bool BufferGetTimestamp(Buffer* buffer, aio4c_clock_t* stamp) {
+    return BufferGet(buffer, stamp, sizeof(aio4c_clock_t));
+}
@@ -31,6 +31,7 @@
 #include <aio4c/reader.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
+#include <aio4c/timer.h>
 #include <aio4c/types.h>
 
 #ifdef AIO4C_WIN32
@@ -56,6 +57,7 @@ struct s_Client {
     int               interval;
     int               retryCount;
     int               bufferSize;
+    ConnectionTimeouts timeouts;
     bool      connected;
     bool      exiting;
 };
@@ -64,10 +66,30 @@ static void _clientEventHandler(Event event, Connection* source, Client* client)
     EnqueueEventItem(client->queue, event, (EventSource)source);
 }
 
+static void _clientRetry(void* _client, void* arg __attribute__((unused))) {
+    Client* client = (Client*)_client;
+
+    EnqueueDataItem(client->queue, client);
+}
+
 static void _connection(Client* client) {
+    bool earlier = false;
+
     client->connected = false;
     client->connection = NewConnection(client->pool, client->address, false);
     ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, 1);
+
+    /* no buffer can be allocated once the memory budget is reached */
+    if (client->connection == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot create connection to %s, retrying in %d seconds...", AddressGetString(client->address), client->interval);
+        if (!TimerWheelSchedule(client->reader->timers, NULL, client->interval * 1000, _clientRetry, (void*)client, NULL, NULL, &earlier)) {
+            EnqueueDataItem(client->queue, client);
+        } else if (earlier) {
+            SelectorWakeUp(client->reader->selector);
+        }
+        return;
+    }
+
     ConnectionAddSystemHandler(client->connection, AIO4C_INIT_EVENT, aio4c_connection_handler(_clientEventHandler), aio4c_connection_handler_arg(client), true);
     ConnectionAddSystemHandler(client->connection, AIO4C_CONNECTING_EVENT, aio4c_connection_handler(_clientEventHandler), aio4c_connection_handler_arg(client), true);
     ConnectionAddSystemHandler(client->connection, AIO4C_CONNECTED_EVENT, aio4c_connection_handler(_clientEventHandler), aio4c_connection_handler_arg(client), true);
@@ -79,6 +101,9 @@ static void _connection(Client* client) {
     ConnectionAddHandler(client->connection, AIO4C_WRITE_EVENT, aio4c_connection_handler(client->handler), aio4c_connection_handler_arg(client->handlerData), false);
     ConnectionAddHandler(client->connection, AIO4C_CLOSE_EVENT, aio4c_connection_handler(client->handler), aio4c_connection_handler_arg(client->handlerData), true);
     ConnectionAddHandler(client->connection, AIO4C_FREE_EVENT, aio4c_connection_handler(client->handler), aio4c_connection_handler_arg(client->handlerData), true);
+    ConnectionAddHandler(client->connection, AIO4C_IDLE_EVENT, aio4c_connection_handler(client->handler), aio4c_connection_handler_arg(client->handlerData), false);
+    ConnectionAddHandler(client->connection, AIO4C_OVERLOAD_EVENT, aio4c_connection_handler(client->handler), aio4c_connection_handler_arg(client->handlerData), false);
+    ConnectionSetTimeouts(client->connection, &client->timeouts);
     ConnectionInit(client->connection);
 }
 
@@ -91,7 +116,7 @@ static bool _clientInit(ThreadData _client) {
         snprintf(pipeName, strlen(client->name) + 1, "%s", client->name);
     }
 
-    client->reader = NewReader(pipeName, client->bufferSize);
+    client->reader = NewReader(pipeName, client->bufferSize, ThreadGetPolicy(client->thread));
 
     if (client->reader == NULL) {
         return false;
@@ -109,12 +134,17 @@ static bool _clientRun(ThreadData _client) {
     QueueItem* item = NewQueueItem();
     bool closedForError = false;
     Connection* connection;
+    bool earlier = false;
 
     while (Dequeue(client->queue, item, true)) {
         switch (QueueItemGetType(item)) {
             case AIO4C_QUEUE_ITEM_EXIT:
                 FreeQueueItem(&item);
                 return false;
+            case AIO4C_QUEUE_ITEM_DATA:
+                ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, -1);
+                _connection(client);
+                break;
             case AIO4C_QUEUE_ITEM_EVENT:
                 connection = (Connection*)QueueEventItemGetSource(item);
                 switch (QueueEventItemGetEvent(item)) {
@@ -145,15 +175,12 @@ static bool _clientRun(ThreadData _client) {
                             if (client->retryCount < client->retries) {
                                 client->retryCount++;
                                 Log(AIO4C_LOG_LEVEL_WARN, "connection with %s lost, retrying (%d/%d) in %d seconds...", AddressGetString(client->address), client->retryCount, client->retries, client->interval);
-                                ProbeTimeStart(AIO4C_TIME_PROBE_IDLE);
-#ifdef AIO4C_WIN32
-                                Sleep(client->interval * 1000);
-#else /* AIO4C_WIN32 */
-                                sleep(client->interval);
-#endif /* AIO4C_WIN32 */
-                                ProbeTimeEnd(AIO4C_TIME_PROBE_IDLE);
-                                ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, -1);
-                                _connection(client);
+                                /* the reader fires the retry, this thread keeps handling events meanwhile */
+                                if (!TimerWheelSchedule(client->reader->timers, NULL, client->interval * 1000, _clientRetry, (void*)client, NULL, NULL, &earlier)) {
+                                    EnqueueDataItem(client->queue, client);
+                                } else if (earlier) {
+                                    SelectorWakeUp(client->reader->selector);
+                                }
                             } else {
                                 Log(AIO4C_LOG_LEVEL_ERROR, "retried too many times to connect %s, giving up", AddressGetString(client->address));
                                 client->exiting = true;
@@ -197,6 +224,7 @@ static void _clientExit(ThreadData _client) {
 Client* NewClient(int clientIndex, AddressType type, char* address, aio4c_port_t port, int retries, int retryInterval, int bufferSize, ClientHandler handler, ClientHandlerData handlerData) {
     Client* client = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    ThreadPolicy policy;
 
     if ((client = aio4c_malloc(sizeof(Client))) == NULL) {
 #ifndef AIO4C_WIN32
@@ -226,6 +254,7 @@ Client* NewClient(int clientIndex, AddressType type, char* address, aio4c_port_t
     client->queue       = NewQueue();
     client->thread      = NULL;
     client->bufferSize  = bufferSize;
+    memset(&client->timeouts, 0, sizeof(ConnectionTimeouts));
     client->connected   = false;
     client->exiting     = false;
 
@@ -246,9 +275,25 @@ Client* NewClient(int clientIndex, AddressType type, char* address, aio4c_port_t
         return NULL;
     }
 
+    /* clients are spread over AIO4C_THREAD_CPUS one CPU each, as pipes are when more numerous than CPUs */
+    ThreadPolicyForPipe(&policy, (clientIndex > 0) ? clientIndex : 0, 0);
+    ThreadSetPolicy(client->thread, &policy);
+
     return client;
 }
 
+void ClientSetPolicy(Client* client, ThreadPolicy* policy) {
+    ThreadSetPolicy(client->thread, policy);
+}
+
+void ClientSetTimeouts(Client* client, ConnectionTimeouts* timeouts) {
+    if (timeouts != NULL) {
+        memcpy(&client->timeouts, timeouts, sizeof(ConnectionTimeouts));
+    } else {
+        memset(&client->timeouts, 0, sizeof(ConnectionTimeouts));
+    }
+}
+
 bool ClientStart(Client* client) {
     return ThreadStart(client->thread);
 }
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/clock.h>
+
+#include <aio4c/log.h>
+#include <aio4c/types.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif /* __i386__ || __x86_64__ */
+
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+char* ClockSourceString[AIO4C_CLOCK_SOURCE_MAX] = {
+    "monotonic",
+    "coarse",
+    "raw",
+    "tsc"
+};
+
+ClockSource AIO4C_CLOCK_SOURCE = AIO4C_CLOCK_MONOTONIC;
+
+/* nanoseconds per tick, only used when ticks are not nanoseconds */
+static double _clockNanosPerTick = 1.0;
+static bool   _clockScaled = false;
+
+#if !defined(AIO4C_WIN32) && defined(HAVE_CLOCK_GETTIME)
+static clockid_t _clockId = CLOCK_MONOTONIC;
+#endif /* !AIO4C_WIN32 && HAVE_CLOCK_GETTIME */
+
+aio4c_clock_t _ClockNow(void) {
+#ifndef AIO4C_WIN32
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec now;
+
+    clock_gettime(_clockId, &now);
+
+    return (aio4c_clock_t)now.tv_sec * 1000000000ULL + (aio4c_clock_t)now.tv_nsec;
+#else /* HAVE_CLOCK_GETTIME */
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (aio4c_clock_t)now.tv_sec * 1000000000ULL + (aio4c_clock_t)now.tv_usec * 1000ULL;
+#endif /* HAVE_CLOCK_GETTIME */
+#else /* AIO4C_WIN32 */
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+
+    return (aio4c_clock_t)now.QuadPart;
+#endif /* AIO4C_WIN32 */
+}
+
+static bool _ClockHasInvariantTSC(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+        return false;
+    }
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+
+    return ((edx & (1u << 8)) != 0);
+#else /* __i386__ || __x86_64__ */
+    return false;
+#endif /* __i386__ || __x86_64__ */
+}
+
+static void _ClockCalibrate(void) {
+    aio4c_clock_t startTime = 0, stopTime = 0, startTicks = 0, stopTicks = 0;
+#ifndef AIO4C_WIN32
+    struct timespec wait;
+#endif /* AIO4C_WIN32 */
+
+    startTime = _ClockNow();
+    startTicks = ClockNow();
+
+#ifndef AIO4C_WIN32
+    wait.tv_sec = AIO4C_CLOCK_CALIBRATION_TIME / 1000;
+    wait.tv_nsec = (AIO4C_CLOCK_CALIBRATION_TIME % 1000) * 1000000;
+    nanosleep(&wait, NULL);
+#else /* AIO4C_WIN32 */
+    Sleep(AIO4C_CLOCK_CALIBRATION_TIME);
+#endif /* AIO4C_WIN32 */
+
+    stopTicks = ClockNow();
+    stopTime = _ClockNow();
+
+    if (stopTicks <= startTicks || stopTime <= startTime) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot calibrate TSC, using %s clock", ClockSourceString[AIO4C_CLOCK_MONOTONIC]);
+        AIO4C_CLOCK_SOURCE = AIO4C_CLOCK_MONOTONIC;
+        return;
+    }
+
+    /* the system clock may itself count in ticks that are not nanoseconds */
+    _clockNanosPerTick = (double)(stopTime - startTime) * _clockNanosPerTick / (double)(stopTicks - startTicks);
+    _clockScaled = true;
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "TSC calibrated at %.3f MHz", 1000.0 / _clockNanosPerTick);
+}
+
+void ClockInit(void) {
+    bool available = true;
+#ifdef AIO4C_WIN32
+    LARGE_INTEGER frequency;
+#endif /* AIO4C_WIN32 */
+
+    if (AIO4C_CLOCK_SOURCE < 0 || AIO4C_CLOCK_SOURCE >= AIO4C_CLOCK_SOURCE_MAX) {
+        AIO4C_CLOCK_SOURCE = AIO4C_CLOCK_MONOTONIC;
+    }
+
+    _clockNanosPerTick = 1.0;
+    _clockScaled = false;
+
+#ifdef AIO4C_WIN32
+    QueryPerformanceFrequency(&frequency);
+    _clockNanosPerTick = 1000000000.0 / (double)frequency.QuadPart;
+    _clockScaled = true;
+    available = (AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_MONOTONIC || AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_TSC);
+#elif defined(HAVE_CLOCK_GETTIME)
+    _clockId = CLOCK_MONOTONIC;
+
+    switch (AIO4C_CLOCK_SOURCE) {
+        case AIO4C_CLOCK_MONOTONIC_COARSE:
+#ifdef CLOCK_MONOTONIC_COARSE
+            _clockId = CLOCK_MONOTONIC_COARSE;
+#else /* CLOCK_MONOTONIC_COARSE */
+            available = false;
+#endif /* CLOCK_MONOTONIC_COARSE */
+            break;
+        case AIO4C_CLOCK_MONOTONIC_RAW:
+#ifdef CLOCK_MONOTONIC_RAW
+            _clockId = CLOCK_MONOTONIC_RAW;
+#else /* CLOCK_MONOTONIC_RAW */
+            available = false;
+#endif /* CLOCK_MONOTONIC_RAW */
+            break;
+        default:
+            break;
+    }
+#else /* HAVE_CLOCK_GETTIME */
+    available = (AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_MONOTONIC || AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_TSC);
+#endif /* AIO4C_WIN32 */
+
+    if (AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_TSC) {
+        available = _ClockHasInvariantTSC();
+    }
+
+    if (!available) {
+        Log(AIO4C_LOG_LEVEL_WARN, "%s clock not available, using %s clock", ClockSourceString[AIO4C_CLOCK_SOURCE], ClockSourceString[AIO4C_CLOCK_MONOTONIC]);
+        AIO4C_CLOCK_SOURCE = AIO4C_CLOCK_MONOTONIC;
+    } else if (AIO4C_CLOCK_SOURCE == AIO4C_CLOCK_TSC) {
+        _ClockCalibrate();
+    }
+}
+
+long long ClockElapsed(aio4c_clock_t start, aio4c_clock_t stop) {
+    long long ticks = (long long)(stop - start);
+
+    if (!_clockScaled) {
+        return ticks;
+    }
+
+    return (long long)((double)ticks * _clockNanosPerTick);
+}
+
+aio4c_time_t ClockMicroseconds(void) {
+    return (aio4c_time_t)(ClockElapsed(0, ClockNow()) / 1000);
+}
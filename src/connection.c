@@ -25,12 +25,18 @@
 
 #include <aio4c/address.h>
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
 #include <aio4c/buffer.h>
+#include <aio4c/clock.h>
 #include <aio4c/error.h>
 #include <aio4c/event.h>
+#include <aio4c/list.h>
 #include <aio4c/lock.h>
 #include <aio4c/log.h>
+#include <aio4c/reader.h>
 #include <aio4c/stats.h>
+#include <aio4c/timer.h>
+#include <aio4c/trace.h>
 #include <aio4c/types.h>
 
 #include <stdio.h>
@@ -61,34 +67,201 @@ char* ConnectionStateString[AIO4C_CONNECTION_STATE_MAX] = {
     "CLOSED"
 };
 
-Connection* NewConnection(BufferPool* pool, Address* address, bool freeAddress) {
+/* pending bytes and tasks queued to the worker for one connection, 0 meaning unlimited */
+WaterMarks AIO4C_CONNECTION_WATER_MARKS = {
+    .highBytes = 1024 * 1024,
+    .lowBytes  = 256 * 1024,
+    .highItems = 0,
+    .lowItems  = 0
+};
+
+/* worker queue sojourn time target and interval in milliseconds, a target of 0 disabling shedding */
+OverloadControl AIO4C_CONNECTION_OVERLOAD_CONTROL = {
+    .target   = 0,
+    .interval = 100
+};
+
+struct s_ConnectionPool {
+    Lock*       lock;
+    Connection* free;
+    List        slabs;
+    int         batch;
+    int         used;
+    bool        exiting;
+};
+
+static void _DestroyConnectionPool(ConnectionPool* pool) {
+    Node* node = NULL;
+
+    while ((node = ListPop(&pool->slabs)) != NULL) {
+        aio4c_free(node->data);
+        FreeNode(&node);
+    }
+
+    FreeLock(&pool->lock);
+    aio4c_free(pool);
+}
+
+static Connection* _AllocateConnection(ConnectionPool* pool) {
     Connection* connection = NULL;
+    Connection* slab = NULL;
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    int i = 0;
+
+    if (pool == NULL) {
+        if ((connection = aio4c_malloc(sizeof(Connection))) == NULL) {
+#ifndef AIO4C_WIN32
+            code.error = errno;
+#else /* AIO4C_WIN32 */
+            code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+            code.size = sizeof(Connection);
+            code.type = "Connection";
+            Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+        }
+
+        return connection;
+    }
+
+    TakeLock(pool->lock);
+
+    if (pool->free == NULL) {
+        if ((slab = aio4c_malloc(pool->batch * sizeof(Connection))) == NULL) {
+            ReleaseLock(pool->lock);
+#ifndef AIO4C_WIN32
+            code.error = errno;
+#else /* AIO4C_WIN32 */
+            code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+            code.size = pool->batch * sizeof(Connection);
+            code.type = "Connection[]";
+            Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+            return NULL;
+        }
+
+        ListAddLast(&pool->slabs, NewNode(slab));
+
+        for (i = pool->batch - 1; i >= 0; i--) {
+            slab[i].nextFree = pool->free;
+            pool->free = &slab[i];
+        }
+    }
+
+    connection = pool->free;
+    pool->free = connection->nextFree;
+    pool->used++;
+
+    ReleaseLock(pool->lock);
+
+    memset(connection, 0, sizeof(Connection));
+    connection->connectionPool = pool;
+
+    return connection;
+}
+
+static void _ReleaseConnection(Connection* connection) {
+    ConnectionPool* pool = connection->connectionPool;
+    bool destroy = false;
 
-    if ((connection = aio4c_malloc(sizeof(Connection))) == NULL) {
+    if (pool == NULL) {
+        aio4c_free(connection);
+        return;
+    }
+
+    TakeLock(pool->lock);
+
+    connection->nextFree = pool->free;
+    pool->free = connection;
+    pool->used--;
+    destroy = (pool->exiting && pool->used == 0);
+
+    ReleaseLock(pool->lock);
+
+    if (destroy) {
+        _DestroyConnectionPool(pool);
+    }
+}
+
+ConnectionPool* NewConnectionPool(void) {
+    ConnectionPool* pool = NULL;
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+
+    if ((pool = aio4c_malloc(sizeof(ConnectionPool))) == NULL) {
+#ifndef AIO4C_WIN32
+        code.error = errno;
+#else /* AIO4C_WIN32 */
+        code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+        code.size = sizeof(ConnectionPool);
+        code.type = "ConnectionPool";
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
         return NULL;
     }
 
+    pool->lock = NewLock();
+    pool->free = NULL;
+    AIO4C_LIST_INITIALIZER(&pool->slabs);
+    pool->batch = AIO4C_CONNECTION_POOL_BATCH_SIZE;
+    pool->used = 0;
+    pool->exiting = false;
+
+    return pool;
+}
+
+void FreeConnectionPool(ConnectionPool** pool) {
+    ConnectionPool* pPool = NULL;
+    bool destroy = false;
+
+    if (pool != NULL && (pPool = *pool) != NULL) {
+        TakeLock(pPool->lock);
+        pPool->exiting = true;
+        destroy = (pPool->used == 0);
+        ReleaseLock(pPool->lock);
+
+        /* connections still in use will destroy the pool once all released */
+        if (destroy) {
+            _DestroyConnectionPool(pPool);
+        }
+
+        *pool = NULL;
+    }
+}
+
+static Connection* _NewConnection(ConnectionPool* connectionPool, BufferPool* pool, Address* address, bool freeAddress) {
+    Connection* connection = NULL;
+
+    if ((connection = _AllocateConnection(connectionPool)) == NULL) {
+        return NULL;
+    }
 
     connection->readBuffer = AllocateBuffer(pool);
     connection->writeBuffer = AllocateBuffer(pool);
+
+    /* buffer pools stop growing once the memory budget is reached */
+    if (connection->readBuffer == NULL || connection->writeBuffer == NULL) {
+        ReleaseBuffer(&connection->readBuffer);
+        ReleaseBuffer(&connection->writeBuffer);
+        _ReleaseConnection(connection);
+        return NULL;
+    }
+
     BufferLimit(connection->writeBuffer, 0);
     connection->dataBuffer = NULL;
     connection->socket = -1;
     connection->state = AIO4C_CONNECTION_STATE_NONE;
-    connection->stateLock = NewLock();
-    connection->systemHandlers = NewEventQueue();
-    connection->userHandlers = NewEventQueue();
+    connection->systemHandlers = NULL;
+    connection->userHandlers = NULL;
+    memset(connection->ownerHandlers, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(EventQueue*));
+    connection->handledEvents = 0;
     connection->address = address;
     connection->closedForError = false;
-    connection->string = AddressGetString(address);
-    connection->stringAllocated = false;
-    memset(connection->closedBy, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(bool));
-    connection->closedBy[AIO4C_CONNECTION_OWNER_ACCEPTOR] = true;
-    connection->closedByLock = NewLock();
-    memset(connection->managedBy, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(bool));
-    connection->managedBy[AIO4C_CONNECTION_OWNER_ACCEPTOR] = true;
-    connection->managedBy[AIO4C_CONNECTION_OWNER_CLIENT] = true;
-    connection->managedByLock = NewLock();
+    connection->string = NULL;
+    /* the migration owner is only released while the connection moves to another pipe */
+    connection->closedBy = AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_ACCEPTOR) |
+                           AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MIGRATION);
+    connection->managedBy = AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_ACCEPTOR) |
+                            AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_CLIENT) |
+                            AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MIGRATION);
     connection->readKey = NULL;
     connection->writeKey = NULL;
     connection->pool = NULL;
@@ -98,14 +271,38 @@ Connection* NewConnection(BufferPool* pool, Address* address, bool freeAddress)
     connection->canRead = false;
     connection->canWrite = false;
     connection->isFactory = false;
+    connection->factory = NULL;
+    connection->data = NULL;
+    connection->reader = NULL;
+    connection->migrateTo = NULL;
+    connection->timers = NULL;
+    memset(&connection->timeouts, 0, sizeof(ConnectionTimeouts));
+    connection->lastRead = 0;
+    connection->lastWrite = 0;
+    connection->idleTimer.timer = NULL;
+    connection->idleTimer.generation = 0;
+    memcpy(&connection->marks, &AIO4C_CONNECTION_WATER_MARKS, sizeof(WaterMarks));
+    connection->pendingItems = 0;
+    connection->pendingBytes = 0;
+    connection->readSuspended = false;
+    connection->suspendedNode = NULL;
+    memcpy(&connection->overload, &AIO4C_CONNECTION_OVERLOAD_CONTROL, sizeof(OverloadControl));
+    /* pooled connections are reused, their counters start over */
+    memset((void*)&connection->counters, 0, sizeof(ConnectionCounters));
+    memset(&connection->sampled, 0, sizeof(ConnectionCounters));
+    memset(&connection->recent, 0, sizeof(ConnectionCounters));
 
     return connection;
 }
 
+Connection* NewConnection(BufferPool* pool, Address* address, bool freeAddress) {
+    return _NewConnection(NULL, pool, address, freeAddress);
+}
+
 Connection* NewConnectionFactory(BufferPool* pool, void* (*dataFactory)(Connection*,void*), void* dataFactoryArg) {
     Connection* connection = NULL;
 
-    if ((connection = aio4c_malloc(sizeof(Connection))) == NULL) {
+    if ((connection = _AllocateConnection(NULL)) == NULL) {
         return NULL;
     }
 
@@ -115,17 +312,15 @@ Connection* NewConnectionFactory(BufferPool* pool, void* (*dataFactory)(Connecti
     connection->writeBuffer = NULL;
     connection->pool = pool;
     connection->state = AIO4C_CONNECTION_STATE_NONE;
-    connection->stateLock = NULL;
     connection->systemHandlers = NewEventQueue();
     connection->userHandlers = NewEventQueue();
+    memset(connection->ownerHandlers, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(EventQueue*));
+    connection->handledEvents = 0;
     connection->address = NULL;
     connection->closedForError = false;
     connection->string = "factory";
-    connection->stringAllocated = false;
-    memset(connection->closedBy, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(bool));
-    connection->closedByLock = NULL;
-    memset(connection->managedBy, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(bool));
-    connection->managedByLock = NULL;
+    connection->closedBy = 0;
+    connection->managedBy = 0;
     connection->readKey = NULL;
     connection->writeKey = NULL;
     connection->freeAddress = false;
@@ -134,69 +329,115 @@ Connection* NewConnectionFactory(BufferPool* pool, void* (*dataFactory)(Connecti
     connection->canRead = false;
     connection->canWrite = false;
     connection->isFactory = true;
+    connection->factory = NULL;
+    connection->data = NULL;
+    connection->reader = NULL;
+    connection->migrateTo = NULL;
+    connection->timers = NULL;
+    memset(&connection->timeouts, 0, sizeof(ConnectionTimeouts));
+    connection->lastRead = 0;
+    connection->lastWrite = 0;
+    connection->idleTimer.timer = NULL;
+    connection->idleTimer.generation = 0;
+    memcpy(&connection->marks, &AIO4C_CONNECTION_WATER_MARKS, sizeof(WaterMarks));
+    connection->pendingItems = 0;
+    connection->pendingBytes = 0;
+    connection->readSuspended = false;
+    connection->suspendedNode = NULL;
+    memcpy(&connection->overload, &AIO4C_CONNECTION_OVERLOAD_CONTROL, sizeof(OverloadControl));
 
     return connection;
 }
 
-Connection* ConnectionFactoryCreate(Connection* factory, Address* address, aio4c_socket_t socket) {
-    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+Connection* ConnectionFactoryCreate(Connection* factory, ConnectionPool* pool, BufferPool* buffers, Address* address, aio4c_socket_t socket) {
     Connection* connection = NULL;
-    void* data = NULL;
 
-    connection = NewConnection(factory->pool, address, true);
-
-    connection->socket = socket;
-
-#ifndef AIO4C_WIN32
-    if (fcntl(connection->socket, F_SETFL, O_NONBLOCK) == -1) {
-        code.error = errno;
-        code.connection = connection;
-        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_CONNECTION_ERROR_TYPE, AIO4C_FCNTL_ERROR, &code);
-        shutdown(connection->socket, SHUT_RDWR);
-        close(connection->socket);
-#else /* AIO4C_WIN32 */
-    unsigned long ioctl = 1;
-    if (ioctlsocket(connection->socket, FIONBIO, &ioctl) != 0) {
-        code.source = AIO4C_ERRNO_SOURCE_WSA;
-        code.connection = connection;
-        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_CONNECTION_ERROR_TYPE, AIO4C_FCNTL_ERROR, &code);
-        shutdown(connection->socket, SD_BOTH);
-        closesocket(connection->socket);
-#endif /* AIO4C_WIN32 */
-        aio4c_free(connection);
+    if ((connection = _NewConnection(pool, (buffers != NULL) ? buffers : factory->pool, address, true)) == NULL) {
         return NULL;
     }
 
-    data = factory->dataFactory(connection, factory->dataFactoryArg);
+    /* the socket is expected to be already in non-blocking mode */
+    connection->socket = socket;
 
-    CopyEventQueue(connection->userHandlers, factory->userHandlers, data);
-    CopyEventQueue(connection->systemHandlers, factory->systemHandlers, NULL);
+    /* handlers are shared with the factory, only the user data is per connection */
+    connection->factory = factory;
+    connection->data = factory->dataFactory(connection, factory->dataFactoryArg);
+    memcpy(&connection->timeouts, &factory->timeouts, sizeof(ConnectionTimeouts));
+    memcpy(&connection->marks, &factory->marks, sizeof(WaterMarks));
+    memcpy(&connection->overload, &factory->overload, sizeof(OverloadControl));
 
-    connection->closedBy[AIO4C_CONNECTION_OWNER_ACCEPTOR] = false;
-    connection->closedBy[AIO4C_CONNECTION_OWNER_CLIENT] = true;
+    connection->closedBy = AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_CLIENT) |
+                           AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MIGRATION);
 
     return connection;
 }
 
+static aio4c_time_t _ConnectionNow(Connection* connection) {
+    Reader* reader = connection->reader;
+
+    /* the pipe clock is refreshed each time its reader wakes up */
+    if (reader == NULL || reader->timers == NULL) {
+        return 0;
+    }
+
+    return TimerWheelGetTime(reader->timers);
+}
+
 static void _ConnectionEventHandle(Connection* connection, Event event) {
-    Log(AIO4C_LOG_LEVEL_DEBUG, "handling event %d for connection %s", event, connection->string);
-    EventHandle(connection->systemHandlers, event, (EventSource)connection);
-    EventHandle(connection->userHandlers, event, (EventSource)connection);
+    Connection* factory = connection->factory;
+    unsigned int mask = (1u << event);
+    bool first = false;
+    int i = 0;
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "handling event %d for connection %s", event, ConnectionGetString(connection));
+
+    first = ((AtomicOr(&connection->handledEvents, mask) & mask) == 0);
+
+    if (connection->systemHandlers != NULL) {
+        EventHandle(connection->systemHandlers, event, (EventSource)connection);
+    }
+
+    if (factory != NULL) {
+        EventDispatch(factory->systemHandlers, event, (EventSource)connection, NULL, first);
+    }
+
+    for (i = 0; i < AIO4C_CONNECTION_OWNER_MAX; i++) {
+        if (connection->ownerHandlers[i] != NULL) {
+            EventDispatch(connection->ownerHandlers[i], event, (EventSource)connection, NULL, first);
+        }
+    }
+
+    if (connection->userHandlers != NULL) {
+        EventHandle(connection->userHandlers, event, (EventSource)connection);
+    }
+
+    if (factory != NULL) {
+        EventDispatch(factory->userHandlers, event, (EventSource)connection, (EventData)connection->data, first);
+    }
 }
 
 void _ConnectionState(char* file, int line, Connection* connection, ConnectionState state) {
-    if (connection->state == state) {
-        Log(AIO4C_LOG_LEVEL_DEBUG, "%s:%d: connection %s already in state %s", file, line,
-                connection->string, ConnectionStateString[state]);
-        return;
-    }
+    ConnectionState previous = AIO4C_CONNECTION_STATE_NONE;
 
-    TakeLock(connection->stateLock);
+    do {
+        previous = connection->state;
 
-    Log(AIO4C_LOG_LEVEL_DEBUG, "%s:%d: connection %s [%s] -> [%s]", file, line, connection->string,
-           ConnectionStateString[connection->state], ConnectionStateString[state]);
+        if (previous == state) {
+            Log(AIO4C_LOG_LEVEL_DEBUG, "%s:%d: connection %s already in state %s", file, line,
+                    ConnectionGetString(connection), ConnectionStateString[state]);
+            return;
+        }
+
+        /* handlers are only called once per connection, so CLOSED is final */
+        if (previous == AIO4C_CONNECTION_STATE_CLOSED) {
+            Log(AIO4C_LOG_LEVEL_DEBUG, "%s:%d: connection %s already closed, ignoring state %s", file, line,
+                    ConnectionGetString(connection), ConnectionStateString[state]);
+            return;
+        }
+    } while (!AtomicCompareAndSwap(&connection->state, previous, state));
 
-    connection->state = state;
+    Log(AIO4C_LOG_LEVEL_DEBUG, "%s:%d: connection %s [%s] -> [%s]", file, line, ConnectionGetString(connection),
+           ConnectionStateString[previous], ConnectionStateString[state]);
 
     switch (state) {
         case AIO4C_CONNECTION_STATE_NONE:
@@ -211,32 +452,16 @@ void _ConnectionState(char* file, int line, Connection* connection, ConnectionSt
             break;
         case AIO4C_CONNECTION_STATE_CONNECTED: {
             char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-            char* newName = NULL;
-            aio4c_addr_t* addr = NULL;
-            socklen_t addrSize = 0;
+            struct sockaddr_storage addr;
+            socklen_t addrSize = sizeof(addr);
             memset(hbuf, 0, NI_MAXHOST * sizeof(char));
             memset(sbuf, 0, NI_MAXSERV * sizeof(char));
-            if (connection->string != NULL) {
-                addrSize = AddressGetAddrSize(connection->address);
-                addr = aio4c_malloc(addrSize);
-                if (addr != NULL) {
-                    memcpy(addr, AddressGetAddr(connection->address), addrSize);
-                    if (getsockname(connection->socket, addr, &addrSize) == 0) {
-                        if (getnameinfo(addr, addrSize, hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
-                            if (connection->stringAllocated) {
-                                newName = aio4c_realloc(connection->string, (strlen(AddressGetString(connection->address)) + strlen(hbuf) + strlen(sbuf) + 8) * sizeof(char));
-                            } else {
-                                newName = aio4c_malloc((strlen(AddressGetString(connection->address)) + strlen(hbuf) + strlen(sbuf) + 8) * sizeof(char));
-                            }
-                            if (newName != NULL) {
-                                snprintf(newName, strlen(AddressGetString(connection->address)) + strlen(hbuf) + strlen(sbuf) + 8, "[%s]:%s -> %s", hbuf, sbuf, AddressGetString(connection->address));
-                                connection->string = newName;
-                                connection->stringAllocated = true;
-                            }
-                        }
+            if (getsockname(connection->socket, (aio4c_addr_t*)&addr, &addrSize) == 0) {
+                if (getnameinfo((aio4c_addr_t*)&addr, addrSize, hbuf, sizeof(hbuf), sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+                    if (snprintf(connection->stringBuffer, AIO4C_CONNECTION_STRING_SIZE, "[%s]:%s -> %s", hbuf, sbuf, AddressGetString(connection->address)) > 0) {
+                        connection->string = connection->stringBuffer;
                     }
                 }
-                aio4c_free(addr);
             }
             connection->canRead = true;
             connection->canWrite = true;
@@ -255,8 +480,6 @@ void _ConnectionState(char* file, int line, Connection* connection, ConnectionSt
         case AIO4C_CONNECTION_STATE_MAX:
             break;
     }
-
-    ReleaseLock(connection->stateLock);
 }
 
 #define _ConnectionHandleError(connection,level,error,code) \
@@ -444,25 +667,146 @@ Connection* ConnectionRead(Connection* connection) {
     }
 
     if (!connection->canRead) {
-        Log(AIO4C_LOG_LEVEL_WARN, "received data on connection %s when reading is not allowed", connection->string);
+        Log(AIO4C_LOG_LEVEL_WARN, "received data on connection %s when reading is not allowed", ConnectionGetString(connection));
         BufferReset(buffer);
         return connection;
     }
 
     BufferPosition(buffer, BufferGetPosition(buffer) + nbRead);
 
+    connection->lastRead = _ConnectionNow(connection);
+    connection->counters.bytesIn += nbRead;
+
+    /* only the reader assigns traces, the worker handler picks it up when queueing the data */
+    connection->traceRead = TraceSample();
+    TraceMark(connection->traceRead, AIO4C_TRACE_POINT_READ);
+
     _ConnectionEventHandle(connection, AIO4C_INBOUND_DATA_EVENT);
 
     return connection;
 }
 
 Connection* ConnectionProcessData(Connection* connection) {
+    bool timed = ProbeEnabled(AIO4C_PROBE_CATEGORY_CONNECTION);
+    aio4c_clock_t start = 0, stop = 0;
+
+    if (timed || connection->traceProcess != 0) {
+        start = ClockNow();
+    }
+
     _ConnectionEventHandle(connection, AIO4C_READ_EVENT);
+
+    if (start != 0) {
+        stop = ClockNow();
+        TraceSpan(connection->traceProcess, AIO4C_TRACE_POINT_PROCESS, start, stop);
+    }
+
+    /* only the worker counts received messages, the writer adds its own handler time */
+    connection->counters.messagesIn++;
+    if (timed) {
+        AtomicAdd(&connection->counters.handlerTime, ClockElapsed(start, stop));
+    }
+
+    return connection;
+}
+
+Connection* ConnectionIdle(Connection* connection) {
+    _ConnectionEventHandle(connection, AIO4C_IDLE_EVENT);
+    return connection;
+}
+
+Connection* ConnectionOverload(Connection* connection) {
+    _ConnectionEventHandle(connection, AIO4C_OVERLOAD_EVENT);
     return connection;
 }
 
+void ConnectionSetWaterMarks(Connection* connection, WaterMarks* marks) {
+    if (marks != NULL) {
+        memcpy(&connection->marks, marks, sizeof(WaterMarks));
+    } else {
+        memset(&connection->marks, 0, sizeof(WaterMarks));
+    }
+}
+
+void ConnectionSetOverloadControl(Connection* connection, OverloadControl* overload) {
+    if (overload != NULL) {
+        memcpy(&connection->overload, overload, sizeof(OverloadControl));
+    } else {
+        memset(&connection->overload, 0, sizeof(OverloadControl));
+    }
+}
+
+aio4c_time_t OverloadControlLaw(aio4c_time_t time, aio4c_time_t interval, int count) {
+    aio4c_time_t root = 1;
+
+    while ((root + 1) * (root + 1) <= (aio4c_time_t)count) {
+        root++;
+    }
+
+    return time + interval / root;
+}
+
+/*
+ * CoDel: tasks are shed once the sojourn time in the queue stayed above the
+ * target for a whole interval, then at a rate growing with the square root of
+ * the number of tasks shed, until one task spends less than the target.
+ */
+bool OverloadShouldShed(OverloadControl* control, OverloadState* state, aio4c_time_t now, aio4c_time_t sojourn, bool backlog) {
+    aio4c_time_t target = 0, interval = 0;
+    bool above = false;
+    int delta = 0;
+
+    if (control->target <= 0 || control->interval <= 0) {
+        return false;
+    }
+
+    target = (aio4c_time_t)control->target * 1000;
+    interval = (aio4c_time_t)control->interval * 1000;
+
+    /* a task alone in the queue cannot have waited for another one */
+    if (sojourn < target || !backlog) {
+        state->firstAbove = 0;
+    } else if (state->firstAbove == 0) {
+        state->firstAbove = now + interval;
+    } else if (now >= state->firstAbove) {
+        above = true;
+    }
+
+    if (state->dropping) {
+        if (!above) {
+            state->dropping = false;
+        } else if (now >= state->dropNext) {
+            state->count++;
+            state->dropNext = OverloadControlLaw(state->dropNext, interval, state->count);
+            return true;
+        }
+    } else if (above) {
+        state->dropping = true;
+        /* resume near the previous rate when overload comes back shortly */
+        delta = state->count - state->lastCount;
+        if (delta > 1 && now < state->dropNext + 16 * interval) {
+            state->count = delta;
+        } else {
+            state->count = 1;
+        }
+        state->lastCount = state->count;
+        state->dropNext = OverloadControlLaw(now, interval, state->count);
+        return true;
+    }
+
+    return false;
+}
+
+void ConnectionSetTimeouts(Connection* connection, ConnectionTimeouts* timeouts) {
+    if (timeouts != NULL) {
+        memcpy(&connection->timeouts, timeouts, sizeof(ConnectionTimeouts));
+    } else {
+        memset(&connection->timeouts, 0, sizeof(ConnectionTimeouts));
+    }
+}
+
 Connection* ConnectionShutdown(Connection* connection) {
-    Log(AIO4C_LOG_LEVEL_DEBUG, "shutting down writing end on connection %s", connection->string);
+    Log(AIO4C_LOG_LEVEL_DEBUG, "shutting down writing end on connection %s", ConnectionGetString(connection));
 #ifndef AIO4C_WIN32
     shutdown(connection->socket, SHUT_WR);
 #else /* AIO4C_WIN32 */
@@ -477,6 +821,8 @@ bool ConnectionWrite(Connection* connection) {
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
     bool pendingCloseMemorized = false;
     aio4c_byte_t* data = NULL;
+    aio4c_clock_t start = 0;
+    unsigned int trace = connection->traceWrite;
 
     if (!connection->canWrite) {
         code.expected = AIO4C_CONNECTION_STATE_CONNECTED;
@@ -490,7 +836,14 @@ bool ConnectionWrite(Connection* connection) {
 
     if (!BufferHasRemaining(buffer)) {
         BufferReset(buffer);
+        if (ProbeEnabled(AIO4C_PROBE_CATEGORY_CONNECTION)) {
+            start = ClockNow();
+        }
         _ConnectionEventHandle(connection, AIO4C_WRITE_EVENT);
+        connection->counters.messagesOut++;
+        if (start != 0) {
+            AtomicAdd(&connection->counters.handlerTime, ClockElapsed(start, ClockNow()));
+        }
         BufferFlip(buffer);
     }
 
@@ -500,6 +853,10 @@ bool ConnectionWrite(Connection* connection) {
         return false;
     }
 
+    if (trace != 0) {
+        start = ClockNow();
+    }
+
     data = BufferGetBytes(buffer);
     if ((nbWrite = send(connection->socket, (void*)&data[BufferGetPosition(buffer)], BufferRemaining(buffer), MSG_NOSIGNAL)) < 0) {
 #ifndef AIO4C_WIN32
@@ -515,9 +872,21 @@ bool ConnectionWrite(Connection* connection) {
 
     BufferPosition(buffer, BufferGetPosition(buffer) + nbWrite);
 
+    if (nbWrite > 0) {
+        connection->lastWrite = _ConnectionNow(connection);
+        connection->counters.bytesOut += nbWrite;
+    }
+
     if (BufferHasRemaining(connection->writeBuffer)) {
         return true;
-    } else if (pendingCloseMemorized) {
+    }
+
+    /* the trace ends with the send emptying the buffer filled after its write interest */
+    if (trace != 0 && AtomicCompareAndSwap(&connection->traceWrite, trace, 0u)) {
+        TraceSpan(trace, AIO4C_TRACE_POINT_SEND, start, ClockNow());
+    }
+
+    if (pendingCloseMemorized) {
         ConnectionShutdown(connection);
     }
 
@@ -525,17 +894,25 @@ bool ConnectionWrite(Connection* connection) {
 }
 
 void EnableWriteInterest(Connection* connection) {
-    Log(AIO4C_LOG_LEVEL_DEBUG, "write interest for connection %s", connection->string);
+    unsigned int trace = connection->traceProcess;
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "write interest for connection %s", ConnectionGetString(connection));
+
+    /* set while the worker processes traced data, followed up to the writer */
+    if (trace != 0) {
+        TraceMark(trace, AIO4C_TRACE_POINT_WRITE_INTEREST);
+        connection->traceWrite = trace;
+    }
 
     if (connection->canWrite) {
         _ConnectionEventHandle(connection, AIO4C_OUTBOUND_DATA_EVENT);
     } else {
-        Log(AIO4C_LOG_LEVEL_WARN, "lost write interest for connection %s in state %s", connection->string, ConnectionStateString[connection->state]);
+        Log(AIO4C_LOG_LEVEL_WARN, "lost write interest for connection %s in state %s", ConnectionGetString(connection), ConnectionStateString[connection->state]);
     }
 }
 
 Connection* ConnectionClose(Connection* connection, bool force) {
-    Log(AIO4C_LOG_LEVEL_DEBUG, "closing connection %s (force: %s)", connection->string, (force?"true":"false"));
+    Log(AIO4C_LOG_LEVEL_DEBUG, "closing connection %s (force: %s)", ConnectionGetString(connection), (force?"true":"false"));
 
     if (force) {
         ConnectionState(connection, AIO4C_CONNECTION_STATE_CLOSED);
@@ -546,55 +923,59 @@ Connection* ConnectionClose(Connection* connection, bool force) {
     return connection;
 }
 
-bool ConnectionNoMoreUsed (Connection* connection, ConnectionOwner owner) {
-    bool result = true;
-    int i = 0;
+bool ConnectionNoMoreUsed(Connection* connection, ConnectionOwner owner) {
+    unsigned int closedBy = 0;
 
-    TakeLock(connection->closedByLock);
+    closedBy = AtomicOr(&connection->closedBy, AIO4C_CONNECTION_OWNER_MASK(owner)) | AIO4C_CONNECTION_OWNER_MASK(owner);
 
-    connection->closedBy[owner] = true;
+    Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s closed by: [reader:%u,worker:%u,writer:%u,acceptor:%u,client:%u,migration:%u]", ConnectionGetString(connection),
+            (closedBy >> AIO4C_CONNECTION_OWNER_READER) & 1u, (closedBy >> AIO4C_CONNECTION_OWNER_WORKER) & 1u,
+            (closedBy >> AIO4C_CONNECTION_OWNER_WRITER) & 1u, (closedBy >> AIO4C_CONNECTION_OWNER_ACCEPTOR) & 1u,
+            (closedBy >> AIO4C_CONNECTION_OWNER_CLIENT) & 1u, (closedBy >> AIO4C_CONNECTION_OWNER_MIGRATION) & 1u);
 
-    Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s closed by: [reader:%u,worker:%u,writer:%u,acceptor:%u,client:%u]", connection->string,
-            connection->closedBy[AIO4C_CONNECTION_OWNER_READER], connection->closedBy[AIO4C_CONNECTION_OWNER_WORKER],
-            connection->closedBy[AIO4C_CONNECTION_OWNER_WRITER], connection->closedBy[AIO4C_CONNECTION_OWNER_ACCEPTOR],
-            connection->closedBy[AIO4C_CONNECTION_OWNER_CLIENT]);
-
-    for (i = 0; i < AIO4C_CONNECTION_OWNER_MAX && result; i++) {
-        result = (result && connection->closedBy[i]);
-    }
-
-    if (result) {
-        memset(connection->closedBy, 0, AIO4C_CONNECTION_OWNER_MAX * sizeof(bool));
+    if (closedBy != AIO4C_CONNECTION_OWNER_ALL) {
+        return false;
     }
 
-    ReleaseLock(connection->closedByLock);
-
-    return result;
+    /* only the owner that resets the mask is allowed to free the connection */
+    return AtomicCompareAndSwap(&connection->closedBy, AIO4C_CONNECTION_OWNER_ALL, 0u);
 }
 
-void ConnectionManagedBy(Connection* connection, ConnectionOwner owner) {
-    bool managedByAll = true;
-    int i = 0;
+/*
+ * Keeps the connection from being freed once every owner is done with it.
+ * Only valid while something else guarantees the connection is still alive,
+ * such as the lock of the acceptor connections list.
+ */
+void ConnectionRetain(Connection* connection) {
+    AtomicAdd(&connection->closedBy, AIO4C_CONNECTION_REFERENCE);
+}
 
-    TakeLock(connection->managedByLock);
+void ConnectionRelease(Connection* connection) {
+    if (AtomicSub(&connection->closedBy, AIO4C_CONNECTION_REFERENCE) != AIO4C_CONNECTION_OWNER_ALL) {
+        return;
+    }
 
-    connection->managedBy[owner] = true;
+    /* the last owner left while referenced, freeing is up to the last reference */
+    if (AtomicCompareAndSwap(&connection->closedBy, AIO4C_CONNECTION_OWNER_ALL, 0u)) {
+        FreeConnection(&connection);
+    }
+}
 
-    Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s managed by: [reader:%u,worker:%u,writer:%u]", connection->string,
-        connection->managedBy[AIO4C_CONNECTION_OWNER_READER], connection->managedBy[AIO4C_CONNECTION_OWNER_WORKER],
-        connection->managedBy[AIO4C_CONNECTION_OWNER_WRITER]);
+void ConnectionManagedBy(Connection* connection, ConnectionOwner owner) {
+    unsigned int previous = 0;
+    unsigned int managedBy = 0;
 
-    for (i = 0; i < AIO4C_CONNECTION_OWNER_MAX; i++) {
-        managedByAll = (managedByAll && connection->managedBy[i]);
-    }
+    previous = AtomicOr(&connection->managedBy, AIO4C_CONNECTION_OWNER_MASK(owner));
+    managedBy = previous | AIO4C_CONNECTION_OWNER_MASK(owner);
 
-    ReleaseLock(connection->managedByLock);
+    Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s managed by: [reader:%u,worker:%u,writer:%u]", ConnectionGetString(connection),
+        (managedBy >> AIO4C_CONNECTION_OWNER_READER) & 1u, (managedBy >> AIO4C_CONNECTION_OWNER_WORKER) & 1u,
+        (managedBy >> AIO4C_CONNECTION_OWNER_WRITER) & 1u);
 
-    if (managedByAll) {
-        Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s is managed by all threads", connection->string);
+    if (managedBy == AIO4C_CONNECTION_OWNER_ALL && previous != AIO4C_CONNECTION_OWNER_ALL) {
+        Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s is managed by all threads", ConnectionGetString(connection));
         ConnectionState(connection, AIO4C_CONNECTION_STATE_CONNECTED);
     }
-
 }
 
 Connection* ConnectionAddHandler(Connection* connection, Event event, void (*handler)(Event,Connection*,void*), void* arg, bool once) {
@@ -603,7 +984,11 @@ Connection* ConnectionAddHandler(Connection* connection, Event event, void (*han
 
     eventHandler = NewEventHandler(event, (EventCallback)handler, (EventData)arg, once);
 
-    if (eventHandler != NULL) {
+    if (connection->userHandlers == NULL) {
+        connection->userHandlers = NewEventQueue();
+    }
+
+    if (eventHandler != NULL && connection->userHandlers != NULL) {
         if (EventHandlerAdd(connection->userHandlers, eventHandler) != NULL) {
             return connection;
         }
@@ -618,7 +1003,11 @@ Connection* ConnectionAddSystemHandler(Connection* connection, Event event, void
 
     eventHandler = NewEventHandler(event, (EventCallback)handler, (EventData)arg, once);
 
-    if (eventHandler != NULL) {
+    if (connection->systemHandlers == NULL) {
+        connection->systemHandlers = NewEventQueue();
+    }
+
+    if (eventHandler != NULL && connection->systemHandlers != NULL) {
         if (EventHandlerAdd(connection->systemHandlers, eventHandler) != NULL) {
             return connection;
         }
@@ -636,9 +1025,23 @@ Buffer* ConnectionGetWriteBuffer(Connection* connection) {
 }
 
 char* ConnectionGetString(Connection* connection) {
+    /* formatted on first use, most accepted connections are never named */
+    if (connection->string == NULL) {
+        AtomicCompareAndSwap(&connection->string, NULL, AddressGetString(connection->address));
+    }
+
     return connection->string;
 }
 
+void ConnectionGetCounters(Connection* connection, ConnectionCounters* counters) {
+    /* each counter is only written by the thread owning that part of the pipe */
+    counters->bytesIn = connection->counters.bytesIn;
+    counters->bytesOut = connection->counters.bytesOut;
+    counters->messagesIn = connection->counters.messagesIn;
+    counters->messagesOut = connection->counters.messagesOut;
+    counters->handlerTime = AtomicGet(&connection->counters.handlerTime);
+}
+
 void FreeConnection(Connection** connection) {
     Connection* pConnection = NULL;
 
@@ -675,24 +1078,7 @@ void FreeConnection(Connection** connection) {
             FreeEventQueue(&pConnection->systemHandlers);
         }
 
-        if (pConnection->managedByLock != NULL) {
-            FreeLock(&pConnection->managedByLock);
-        }
-
-        if (pConnection->stateLock != NULL) {
-            FreeLock(&pConnection->stateLock);
-        }
-
-        if (pConnection->closedByLock != NULL) {
-            FreeLock(&pConnection->closedByLock);
-        }
-
-        if (pConnection->stringAllocated) {
-            aio4c_free(pConnection->string);
-            pConnection->stringAllocated = false;
-        }
-
-        aio4c_free(pConnection);
+        _ReleaseConnection(pConnection);
         *connection = NULL;
     }
 }
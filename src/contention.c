@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/contention.h>
+
+#include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/log.h>
+#include <aio4c/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AIO4C_CONTENTION_ENTRY_FREE    0
+#define AIO4C_CONTENTION_ENTRY_CLAIMED 1
+#define AIO4C_CONTENTION_ENTRY_READY   2
+
+#define AIO4C_CONTENTION_LABEL_SIZE 64
+
+struct s_ContentionEntry {
+    volatile int                state;
+    void*                       lock;
+    bool                        retired;
+    char*                       file;
+    int                         line;
+    volatile unsigned long long acquisitions;
+    volatile unsigned long long contentions;
+    volatile unsigned long long waited;
+    volatile unsigned long long longest;
+    volatile unsigned long long histogram[AIO4C_CONTENTION_BUCKETS];
+};
+
+int   AIO4C_CONTENTION_TOP = 0;
+char* AIO4C_CONTENTION_FILE = NULL;
+
+/* never freed, entries are claimed once and kept until exit */
+static ContentionEntry _contentionSites[AIO4C_CONTENTION_MAX_SITES];
+static ContentionEntry _contentionLocks[AIO4C_CONTENTION_MAX_LOCKS];
+
+/* number of described call sites, and how far from its hash one was put at most */
+static volatile int _contentionSitesUsed = 0;
+static volatile int _contentionSitesProbe = 0;
+
+/* locks are never looked up, each one keeps its entry, so they are just handed out in order */
+static volatile int _contentionLocksUsed = 0;
+
+static bool _ContentionMatch(ContentionEntry* entry, char* file, int line) {
+    /* the same file may be named by distinct strings in distinct objects */
+    return (entry->line == line && (entry->file == file || strcmp(entry->file, file) == 0));
+}
+
+static ContentionEntry* _ContentionFindSite(char* file, int line) {
+    unsigned int hash = (unsigned int)line * 2654435761u;
+    ContentionEntry* entry = NULL;
+    int probe = 0;
+    int i = 0;
+
+    for (i = 0; i < AIO4C_CONTENTION_MAX_SITES; i++) {
+        /* once full, no site can be found further than the farthest one put */
+        if (i > _contentionSitesProbe && _contentionSitesUsed == AIO4C_CONTENTION_MAX_SITES) {
+            break;
+        }
+
+        entry = &_contentionSites[(hash + i) & (AIO4C_CONTENTION_MAX_SITES - 1)];
+
+        if (entry->state == AIO4C_CONTENTION_ENTRY_FREE && AtomicCompareAndSwap(&entry->state, AIO4C_CONTENTION_ENTRY_FREE, AIO4C_CONTENTION_ENTRY_CLAIMED)) {
+            entry->file = file;
+            entry->line = line;
+
+            do {
+                probe = _contentionSitesProbe;
+            } while (i > probe && !AtomicCompareAndSwap(&_contentionSitesProbe, probe, i));
+
+            AtomicBarrier();
+            entry->state = AIO4C_CONTENTION_ENTRY_READY;
+            AtomicAdd(&_contentionSitesUsed, 1);
+            return entry;
+        }
+
+        /* another thread is describing this entry, which may be ours */
+        while (entry->state != AIO4C_CONTENTION_ENTRY_READY) {
+            AtomicBarrier();
+        }
+
+        if (_ContentionMatch(entry, file, line)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+int ContentionBucket(long long wait) {
+    int bucket = 0;
+
+    while (wait > 0 && bucket < AIO4C_CONTENTION_BUCKETS - 1) {
+        wait >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+ContentionEntry* ContentionSite(char* file, int line) {
+    ContentionEntry* entry = NULL;
+
+    if ((entry = _ContentionFindSite(file, line)) != NULL) {
+        AtomicAdd(&entry->acquisitions, 1);
+    }
+
+    return entry;
+}
+
+ContentionEntry* ContentionClaim(char* file, int line, void* lock) {
+    ContentionEntry* entry = NULL;
+    int index = 0;
+
+    if (_contentionLocksUsed >= AIO4C_CONTENTION_MAX_LOCKS) {
+        return NULL;
+    }
+
+    if ((index = AtomicAdd(&_contentionLocksUsed, 1) - 1) >= AIO4C_CONTENTION_MAX_LOCKS) {
+        return NULL;
+    }
+
+    entry = &_contentionLocks[index];
+    entry->lock = lock;
+    entry->file = file;
+    entry->line = line;
+    AtomicBarrier();
+    entry->state = AIO4C_CONTENTION_ENTRY_READY;
+
+    return entry;
+}
+
+void ContentionAccount(ContentionEntry* site, ContentionEntry* lock, long long wait) {
+    unsigned long long longest = 0;
+    int bucket = ContentionBucket(wait);
+
+    /* the lock entry is only written with the lock held, so it needs no atomic */
+    if (lock != NULL) {
+        lock->acquisitions++;
+
+        if (wait >= 0) {
+            lock->contentions++;
+            lock->waited += (unsigned long long)wait;
+            lock->histogram[bucket]++;
+            if ((unsigned long long)wait > lock->longest) {
+                lock->longest = (unsigned long long)wait;
+            }
+        }
+    }
+
+    if (site == NULL || wait < 0) {
+        return;
+    }
+
+    AtomicAdd(&site->contentions, 1);
+    AtomicAdd(&site->waited, (unsigned long long)wait);
+    AtomicAdd(&site->histogram[bucket], 1);
+
+    do {
+        longest = site->longest;
+    } while ((unsigned long long)wait > longest && !AtomicCompareAndSwap(&site->longest, longest, (unsigned long long)wait));
+}
+
+void ContentionRetire(ContentionEntry* entry) {
+    if (entry != NULL) {
+        entry->retired = true;
+    }
+}
+
+static int _ContentionCompare(const void* first, const void* second) {
+    const ContentionEntry* a = (const ContentionEntry*)first;
+    const ContentionEntry* b = (const ContentionEntry*)second;
+
+    if (a->waited != b->waited) {
+        return (a->waited < b->waited) ? 1 : -1;
+    }
+
+    if (a->contentions != b->contentions) {
+        return (a->contentions < b->contentions) ? 1 : -1;
+    }
+
+    if (a->acquisitions != b->acquisitions) {
+        return (a->acquisitions < b->acquisitions) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+double ContentionPercentile(volatile unsigned long long* histogram, unsigned long long contentions, unsigned long long longest, double fraction) {
+    unsigned long long rank = (unsigned long long)((double)contentions * fraction + 0.5);
+    unsigned long long count = 0;
+    unsigned long long highest = 0;
+    int i = 0;
+
+    if (contentions == 0) {
+        return 0.0;
+    }
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (i = 0; i < AIO4C_CONTENTION_BUCKETS; i++) {
+        count += histogram[i];
+        if (count >= rank) {
+            break;
+        }
+    }
+
+    highest = (i == 0) ? 0 : (1ULL << i);
+    if (highest > longest) {
+        highest = longest;
+    }
+
+    return (double)highest / 1e3;
+}
+
+static char* _ContentionFileName(char* file) {
+    char* name = strrchr(file, '/');
+
+#ifdef AIO4C_WIN32
+    if (name == NULL) {
+        name = strrchr(file, '\\');
+    }
+#endif /* AIO4C_WIN32 */
+
+    return (name != NULL) ? name + 1 : file;
+}
+
+static int _ContentionSnapshot(ContentionEntry* table, int size, ContentionEntry* snapshot) {
+    int i = 0, count = 0;
+
+    for (i = 0; i < size; i++) {
+        if (table[i].state == AIO4C_CONTENTION_ENTRY_READY) {
+            AtomicBarrier();
+            memcpy(&snapshot[count], (void*)&table[i], sizeof(ContentionEntry));
+            count++;
+        }
+    }
+
+    qsort(snapshot, count, sizeof(ContentionEntry), _ContentionCompare);
+
+    return count;
+}
+
+static void _ContentionWriteTable(FILE* file, char* title, char* column, ContentionEntry* snapshot, int count, int top) {
+    char label[AIO4C_CONTENTION_LABEL_SIZE];
+    ContentionEntry* entry = NULL;
+    int i = 0;
+
+    fprintf(file, "lock contention: top %d %s by time waited\n", top, title);
+    fprintf(file, "%-40s %12s %12s %7s %12s %10s %10s %10s %10s\n", column,
+            "ACQUIRED", "CONTENDED", "%", "WAITED(ms)", "MEAN(us)", "P50(us)", "P99(us)", "MAX(us)");
+
+    for (i = 0; i < count && i < top; i++) {
+        entry = &snapshot[i];
+
+        memset(label, 0, sizeof(label));
+        if (entry->lock != NULL) {
+            snprintf(label, sizeof(label), "%p (%s:%d)%s", entry->lock, _ContentionFileName(entry->file), entry->line,
+                     entry->retired ? " freed" : "");
+        } else {
+            snprintf(label, sizeof(label), "%s:%d", _ContentionFileName(entry->file), entry->line);
+        }
+
+        fprintf(file, "%-40s %12llu %12llu %7.2f %12.3f %10.2f %10.2f %10.2f %10.2f\n", label,
+                entry->acquisitions,
+                entry->contentions,
+                (entry->acquisitions > 0) ? (double)entry->contentions * 100.0 / (double)entry->acquisitions : 0.0,
+                (double)entry->waited / 1e6,
+                (entry->contentions > 0) ? (double)entry->waited / (double)entry->contentions / 1e3 : 0.0,
+                ContentionPercentile(entry->histogram, entry->contentions, entry->longest, 0.50),
+                ContentionPercentile(entry->histogram, entry->contentions, entry->longest, 0.99),
+                (double)entry->longest / 1e3);
+    }
+}
+
+bool ContentionWrite(FILE* file, int top) {
+    ContentionEntry* snapshot = NULL;
+    int size = AIO4C_CONTENTION_MAX_SITES;
+    int count = 0;
+
+    if (file == NULL || top <= 0) {
+        return false;
+    }
+
+    if (AIO4C_CONTENTION_MAX_LOCKS > size) {
+        size = AIO4C_CONTENTION_MAX_LOCKS;
+    }
+
+    /* copied out of the tables, so that sorting does not race with accounting */
+    if ((snapshot = aio4c_malloc(size * sizeof(ContentionEntry))) == NULL) {
+        return false;
+    }
+
+    count = _ContentionSnapshot(_contentionSites, AIO4C_CONTENTION_MAX_SITES, snapshot);
+    _ContentionWriteTable(file, "call sites", "SITE", snapshot, count, top);
+
+    fprintf(file, "\n");
+
+    count = _ContentionSnapshot(_contentionLocks, AIO4C_CONTENTION_MAX_LOCKS, snapshot);
+    _ContentionWriteTable(file, "locks", "LOCK (FIRST TAKEN AT)", snapshot, count, top);
+
+    aio4c_free(snapshot);
+
+    return (ferror(file) == 0);
+}
+
+void ContentionEnd(void) {
+    FILE* file = NULL;
+    bool written = false;
+
+    if (AIO4C_CONTENTION_TOP <= 0) {
+        return;
+    }
+
+    if (AIO4C_CONTENTION_FILE == NULL) {
+        ContentionWrite(stderr, AIO4C_CONTENTION_TOP);
+        return;
+    }
+
+    if ((file = fopen(AIO4C_CONTENTION_FILE, "w")) == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot open contention file %s for writing: %s", AIO4C_CONTENTION_FILE, strerror(errno));
+        return;
+    }
+
+    written = ContentionWrite(file, AIO4C_CONTENTION_TOP);
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+
+    if (written) {
+        Log(AIO4C_LOG_LEVEL_INFO, "lock contention reported into %s", AIO4C_CONTENTION_FILE);
+    } else {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot write contention file %s", AIO4C_CONTENTION_FILE);
+    }
+}
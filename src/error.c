@@ -73,7 +73,12 @@ char* ErrorStrings[AIO4C_MAX_ERRORS] = {
     "cancel",            /* AIO4C_THREAD_CANCEL_ERROR */
     "join",              /* AIO4C_THREAD_JOIN_ERROR */
     "allocate",          /* AIO4C_ALLOC_ERROR */
-    "retrieve field"     /* AIO4C_JNI_FIELD_ERROR */
+    "retrieve field",    /* AIO4C_JNI_FIELD_ERROR */
+    "accept",            /* AIO4C_ACCEPT_ERROR */
+    "set affinity",      /* AIO4C_THREAD_AFFINITY_ERROR */
+    "set scheduling",    /* AIO4C_THREAD_SCHEDULING_ERROR */
+    "set memory policy", /* AIO4C_THREAD_MEMORY_POLICY_ERROR */
+    "hand over"          /* AIO4C_HANDOVER_ERROR */
 };
 
 void _Raise(char* file, int line, LogLevel level, ErrorType type, Error error, ErrorCode* code) {
@@ -111,17 +116,17 @@ void _Raise(char* file, int line, LogLevel level, ErrorType type, Error error, E
             break;
         case AIO4C_CONNECTION_ERROR_TYPE:
             if (error == AIO4C_CONNECTION_DISCONNECTED) {
-                Log(level, "connection %s disconnected", code->connection->string);
+                Log(level, "connection %s disconnected", ConnectionGetString(code->connection));
             } else {
                 Log(level, "[E:%02d,T:%02d] %s:%d: %s for connection %s [%s]: [%08ld] %s", error, type, file, line, ErrorStrings[error],
-                        code->connection->string, ConnectionStateString[code->connection->state],
+                        ConnectionGetString(code->connection), ConnectionStateString[code->connection->state],
                         errorCode, errorMessage);
             }
             break;
         case AIO4C_EVENT_ERROR_TYPE:
             Log(level, "[E:%02d,T:%02d] %s:%d: %s for connection %s[%s]",
                     error, type, file, line, ErrorStrings[error],
-                    code->connection->string, ConnectionStateString[code->connection->state]);
+                    ConnectionGetString(code->connection), ConnectionStateString[code->connection->state]);
             break;
         case AIO4C_THREAD_ERROR_TYPE:
             Log(level, "[E:%02d,T:%02d] %s:%d: %s for thread %s[i:0x%lx,s:%s]: [%08ld] %s", error, type, file, line, ErrorStrings[error],
@@ -177,7 +182,7 @@ void _Raise(char* file, int line, LogLevel level, ErrorType type, Error error, E
             break;
         case AIO4C_CONNECTION_STATE_ERROR_TYPE:
             Log(level, "[E:%02d,T:%02d] %s:%d: %s for connection %s[%s], expected %s", error, type, file, line, ErrorStrings[error],
-                    code->connection->string, ConnectionStateString[code->connection->state], ConnectionStateString[code->expected]);
+                    ConnectionGetString(code->connection), ConnectionStateString[code->connection->state], ConnectionStateString[code->expected]);
             break;
         case AIO4C_SOCKET_ERROR_TYPE:
             Log(level, "[E:%02d,T:%02d] %s:%d: %s: [%08ld] %s", error, type, file, line, ErrorStrings[error], errorCode, errorMessage);
@@ -114,6 +114,24 @@ void EventHandle(EventQueue* queue, Event event, EventSource source) {
     }
 }
 
+void EventDispatch(EventQueue* queue, Event event, EventSource source, EventData data, bool first) {
+    Node* i = NULL;
+    EventHandler* handler = NULL;
+
+    for (i = queue->handlers[event].first; i != NULL; i = i->next) {
+        handler = (EventHandler*)i->data;
+        if (handler->once && !first) {
+            continue;
+        }
+
+        if (data != NULL) {
+            handler->callback(event, source, data);
+        } else {
+            handler->callback(event, source, handler->data);
+        }
+    }
+}
+
 void EventHandlerRemove(EventQueue* queue, Event event, EventCallback callback) {
     Node* i = NULL;
     Node* j = NULL;
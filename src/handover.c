@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
+#include <aio4c/handover.h>
+
+#include <aio4c/clock.h>
+#include <aio4c/error.h>
+#include <aio4c/log.h>
+#include <aio4c/types.h>
+
+#ifndef AIO4C_WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif /* AIO4C_WIN32 */
+
+#include <string.h>
+#include <time.h>
+
+int AIO4C_HANDOVER_TIMEOUT = 5000;
+
+#ifndef AIO4C_WIN32
+
+#define AIO4C_HANDOVER_MAGIC 0x41696f34
+
+typedef struct s_HandOverHeader {
+    int magic;
+    int count;
+} HandOverHeader;
+
+typedef union u_HandOverControl {
+    struct cmsghdr header;
+    char           buffer[CMSG_SPACE(AIO4C_HANDOVER_MAX_SOCKETS * sizeof(int))];
+} HandOverControl;
+
+static bool _HandOverAddress(char* path, struct sockaddr_un* addr) {
+    if (path == NULL || strlen(path) >= sizeof(addr->sun_path)) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "invalid hand over path %s", (path != NULL) ? path : "(null)");
+        return false;
+    }
+
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path, strlen(path) + 1);
+
+    return true;
+}
+
+/* listening sockets are only handed between processes of the same user */
+static bool _HandOverCheckPeer(aio4c_socket_t peer) {
+    uid_t uid = 0;
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t size = sizeof(struct ucred);
+
+    if (getsockopt(peer, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+        return false;
+    }
+
+    uid = credentials.uid;
+#else /* SO_PEERCRED */
+    gid_t gid = 0;
+
+    if (getpeereid(peer, &uid, &gid) != 0) {
+        return false;
+    }
+#endif /* SO_PEERCRED */
+
+    if (uid != geteuid()) {
+        Log(AIO4C_LOG_LEVEL_WARN, "refusing to hand sockets over with uid %u", (unsigned int)uid);
+        return false;
+    }
+
+    return true;
+}
+
+static bool _HandOverWait(aio4c_socket_t sock, int timeout) {
+    struct pollfd polled;
+    int result = 0;
+
+    polled.fd = sock;
+    polled.events = POLLIN;
+    polled.revents = 0;
+
+    do {
+        result = poll(&polled, 1, timeout);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == 0) {
+        errno = ETIMEDOUT;
+    }
+
+    return (result > 0);
+}
+
+static int _HandOverRemaining(aio4c_time_t deadline) {
+    aio4c_time_t now = ClockMicroseconds() / 1000;
+
+    return (now < deadline) ? (int)(deadline - now) : 0;
+}
+
+static bool _HandOverSendTo(aio4c_socket_t peer, aio4c_socket_t* sockets, int count, int timeout) {
+    HandOverHeader header;
+    HandOverControl control;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* cmsg = NULL;
+    char ack = 0;
+    int i = 0;
+
+    header.magic = AIO4C_HANDOVER_MAGIC;
+    header.count = count;
+    vector.iov_base = (void*)&header;
+    vector.iov_len = sizeof(HandOverHeader);
+
+    memset(&message, 0, sizeof(struct msghdr));
+    memset(&control, 0, sizeof(HandOverControl));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    for (i = 0; i < count; i++) {
+        memcpy(CMSG_DATA(cmsg) + i * sizeof(int), &sockets[i], sizeof(int));
+    }
+
+    if (sendmsg(peer, &message, MSG_NOSIGNAL) != (ssize_t)sizeof(HandOverHeader)) {
+        return false;
+    }
+
+    /* the receiving process holds the sockets once it answered */
+    if (!_HandOverWait(peer, timeout) || recv(peer, &ack, sizeof(ack), 0) != (ssize_t)sizeof(ack)) {
+        return false;
+    }
+
+    return (ack == 1);
+}
+
+static int _HandOverReceiveFrom(aio4c_socket_t peer, aio4c_socket_t* sockets, int size, int timeout, bool (*check)(aio4c_socket_t,void*), void* arg) {
+    HandOverHeader header;
+    HandOverControl control;
+    struct msghdr message;
+    struct iovec vector;
+    struct cmsghdr* cmsg = NULL;
+    int received = 0, count = 0, sock = -1, i = 0;
+    int flags = 0;
+    char ack = 1;
+
+    vector.iov_base = (void*)&header;
+    vector.iov_len = sizeof(HandOverHeader);
+
+    memset(&message, 0, sizeof(struct msghdr));
+    memset(&header, 0, sizeof(HandOverHeader));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(HandOverControl);
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags = MSG_CMSG_CLOEXEC;
+#endif /* MSG_CMSG_CLOEXEC */
+
+    if (!_HandOverWait(peer, timeout) || recvmsg(peer, &message, flags) != (ssize_t)sizeof(HandOverHeader)) {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+        /* every received descriptor is open in this process, the unused ones must be closed */
+        for (i = 0; i < count; i++) {
+            memcpy(&sock, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (header.magic == AIO4C_HANDOVER_MAGIC && received < size) {
+                sockets[received++] = sock;
+            } else {
+                close(sock);
+            }
+        }
+    }
+
+    if (header.magic != AIO4C_HANDOVER_MAGIC) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "invalid hand over message");
+        return 0;
+    }
+
+    if (message.msg_flags & MSG_CTRUNC) {
+        Log(AIO4C_LOG_LEVEL_WARN, "only %d sockets over %d were handed over", received, header.count);
+    }
+
+    /* the sending process stops accepting once acknowledged, every socket must be usable here first */
+    for (i = 0; i < received && ack == 1; i++) {
+        if (check != NULL && !check(sockets[i], arg)) {
+            ack = 0;
+        }
+    }
+
+    if (received == 0 || ack == 0) {
+        Log(AIO4C_LOG_LEVEL_WARN, "rejecting the %d sockets handed over", received);
+        ack = 0;
+    }
+
+    if (send(peer, &ack, sizeof(ack), MSG_NOSIGNAL) != (ssize_t)sizeof(ack) || ack == 0) {
+        /* the sending process keeps its sockets open and goes on accepting */
+        for (i = 0; i < received; i++) {
+            close(sockets[i]);
+        }
+        return (ack == 0) ? 0 : -1;
+    }
+
+    return received;
+}
+
+bool HandOverSend(char* path, aio4c_socket_t* sockets, int count, int timeout) {
+    struct sockaddr_un addr;
+    aio4c_socket_t sock = -1;
+    aio4c_socket_t peer = -1;
+    aio4c_time_t deadline = 0;
+    bool sent = false;
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+
+    if (count <= 0 || count > AIO4C_HANDOVER_MAX_SOCKETS || !_HandOverAddress(path, &addr)) {
+        return false;
+    }
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SOCKET_ERROR, &code);
+        return false;
+    }
+
+    /* a previous hand over may have left the path behind */
+    unlink(path);
+
+    /* nobody can connect before listen, so that other users never reach the socket */
+    if (bind(sock, (aio4c_addr_t*)&addr, sizeof(struct sockaddr_un)) == -1 || chmod(path, S_IRUSR | S_IWUSR) == -1 || listen(sock, 1) == -1) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_HANDOVER_ERROR, &code);
+        close(sock);
+        return false;
+    }
+
+    Log(AIO4C_LOG_LEVEL_INFO, "waiting on %s to hand %d sockets over", path, count);
+
+    deadline = (ClockMicroseconds() / 1000) + timeout;
+
+    /* peers of another user are refused, the hand over then waits for the next one */
+    while (!sent && _HandOverWait(sock, _HandOverRemaining(deadline)) && (peer = accept(sock, NULL, NULL)) != -1) {
+        if (_HandOverCheckPeer(peer)) {
+            sent = _HandOverSendTo(peer, sockets, count, _HandOverRemaining(deadline));
+            break;
+        }
+
+        close(peer);
+        peer = -1;
+    }
+
+    if (!sent) {
+        code.error = errno;
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_HANDOVER_ERROR, &code);
+    } else {
+        Log(AIO4C_LOG_LEVEL_INFO, "%d sockets handed over on %s", count, path);
+    }
+
+    if (peer != -1) {
+        close(peer);
+    }
+
+    close(sock);
+    unlink(path);
+
+    return sent;
+}
+
+int HandOverReceive(char* path, aio4c_socket_t* sockets, int size, int timeout, bool (*check)(aio4c_socket_t,void*), void* arg) {
+    struct sockaddr_un addr;
+    aio4c_socket_t sock = -1;
+    aio4c_time_t deadline = 0;
+    int received = -1;
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = AIO4C_HANDOVER_RETRY_INTERVAL * 1000000L };
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+
+    if (size <= 0 || !_HandOverAddress(path, &addr)) {
+        return 0;
+    }
+
+    deadline = (ClockMicroseconds() / 1000) + timeout;
+
+    /* the sending process may not be waiting yet */
+    while (true) {
+        if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+            code.error = errno;
+            Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_SOCKET_ERROR_TYPE, AIO4C_SOCKET_ERROR, &code);
+            return 0;
+        }
+
+        if (connect(sock, (aio4c_addr_t*)&addr, sizeof(struct sockaddr_un)) == 0) {
+            break;
+        }
+
+        code.error = errno;
+        close(sock);
+        sock = -1;
+
+        if ((code.error != ENOENT && code.error != ECONNREFUSED) || (ClockMicroseconds() / 1000) >= deadline) {
+            break;
+        }
+
+        nanosleep(&interval, NULL);
+    }
+
+    if (sock != -1 && !_HandOverCheckPeer(sock)) {
+        code.error = EPERM;
+        close(sock);
+        sock = -1;
+    }
+
+    if (sock != -1) {
+        received = _HandOverReceiveFrom(sock, sockets, size, _HandOverRemaining(deadline), check, arg);
+        code.error = errno;
+        close(sock);
+    }
+
+    if (received < 0) {
+        Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_SOCKET_ERROR_TYPE, AIO4C_HANDOVER_ERROR, &code);
+        return 0;
+    }
+
+    Log(AIO4C_LOG_LEVEL_INFO, "%d sockets received on %s", received, path);
+
+    return received;
+}
+
+#else /* AIO4C_WIN32 */
+
+bool HandOverSend(char* path __attribute__((unused)), aio4c_socket_t* sockets __attribute__((unused)), int count __attribute__((unused)), int timeout __attribute__((unused))) {
+    Log(AIO4C_LOG_LEVEL_WARN, "sockets hand over not supported");
+    return false;
+}
+
+int HandOverReceive(char* path __attribute__((unused)), aio4c_socket_t* sockets __attribute__((unused)), int size __attribute__((unused)), int timeout __attribute__((unused)),
+        bool (*check)(aio4c_socket_t,void*) __attribute__((unused)), void* arg __attribute__((unused))) {
+    Log(AIO4C_LOG_LEVEL_WARN, "sockets hand over not supported");
+    return 0;
+}
+
+#endif /* AIO4C_WIN32 */
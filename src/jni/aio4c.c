@@ -26,6 +26,7 @@
 #include <aio4c/alloc.h>
 #include <aio4c/jni.h>
 #include <aio4c/log.h>
+#include <aio4c/stats.h>
 
 #include "com_aio4c_Aio4c.h"
 
@@ -116,3 +117,15 @@ JNIEXPORT void JNICALL Java_com_aio4c_Aio4c_end(JNIEnv* jvm __attribute__((unuse
         _argv = NULL;
     }
 }
+
+JNIEXPORT void JNICALL Java_com_aio4c_Aio4c_enableStatistics(JNIEnv* jvm __attribute__((unused)), jclass aio4c __attribute__((unused)), jint categories) {
+    StatsEnable((unsigned int)categories);
+}
+
+JNIEXPORT void JNICALL Java_com_aio4c_Aio4c_disableStatistics(JNIEnv* jvm __attribute__((unused)), jclass aio4c __attribute__((unused)), jint categories) {
+    StatsDisable((unsigned int)categories);
+}
+
+JNIEXPORT jint JNICALL Java_com_aio4c_Aio4c_enabledStatistics(JNIEnv* jvm __attribute__((unused)), jclass aio4c __attribute__((unused))) {
+    return (jint)AIO4C_STATS_PROBES;
+}
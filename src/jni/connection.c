@@ -42,7 +42,7 @@ JNIEXPORT jstring JNICALL Java_com_aio4c_Connection_toString(JNIEnv* jvm, jobjec
     GetPointer(jvm, connection, &pConnection);
     myConnection = (Connection*)pConnection;
 
-    string = (*jvm)->NewStringUTF(jvm, myConnection->string);
+    string = (*jvm)->NewStringUTF(jvm, ConnectionGetString(myConnection));
 
     return string;
 }
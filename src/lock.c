@@ -24,6 +24,8 @@
 #include <aio4c/lock.h>
 
 #include <aio4c/alloc.h>
+#include <aio4c/clock.h>
+#include <aio4c/contention.h>
 #include <aio4c/error.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
@@ -39,6 +41,7 @@
 struct s_Lock {
     LockState        state;
     Thread*          owner;
+    ContentionEntry* contention;
 #ifndef AIO4C_WIN32
     pthread_mutex_t  mutex;
 #else /* AIO4C_WIN32 */
@@ -70,6 +73,7 @@ Lock* NewLock(void) {
 
     pLock->state = AIO4C_LOCK_STATE_DESTROYED;
     pLock->owner = NULL;
+    pLock->contention = NULL;
 
 #ifndef AIO4C_WIN32
     if ((code.error = pthread_mutex_init(&pLock->mutex, NULL)) != 0) {
@@ -92,6 +96,10 @@ Lock* _TakeLock(char* file, int line, Lock* lock) {
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
 #endif /* AIO4C_WIN32 */
     Thread* current = ThreadSelf();
+    bool profiled = (AIO4C_CONTENTION_TOP > 0);
+    bool contended = true;
+    aio4c_clock_t start = 0;
+    ContentionEntry* site = NULL;
 
     ProbeTimeStart(AIO4C_TIME_PROBE_BLOCK);
 
@@ -101,8 +109,21 @@ Lock* _TakeLock(char* file, int line, Lock* lock) {
 
     dthread("%s:%d: %s lock %p\n", file, line, (current!=NULL)?ThreadGetName(current):NULL, (void*)lock);
 
+    /* only waits are timed, uncontended acquisitions are just counted */
+    if (profiled) {
+        site = ContentionSite(file, line);
 #ifndef AIO4C_WIN32
-    if ((code.error = pthread_mutex_lock(&lock->mutex)) != 0) {
+        contended = (pthread_mutex_trylock(&lock->mutex) != 0);
+#else /* AIO4C_WIN32 */
+        contended = (TryEnterCriticalSection(&lock->mutex) == 0);
+#endif /* AIO4C_WIN32 */
+        if (contended) {
+            start = ClockNow();
+        }
+    }
+
+#ifndef AIO4C_WIN32
+    if (contended && (code.error = pthread_mutex_lock(&lock->mutex)) != 0) {
         code.lock = lock;
 
         if (current != NULL) {
@@ -113,9 +134,19 @@ Lock* _TakeLock(char* file, int line, Lock* lock) {
         return NULL;
     }
 #else /* AIO4C_WIN32 */
-    EnterCriticalSection(&lock->mutex);
+    if (contended) {
+        EnterCriticalSection(&lock->mutex);
+    }
 #endif /* AIO4C_WIN32 */
 
+    if (profiled) {
+        if (lock->contention == NULL) {
+            lock->contention = ContentionClaim(file, line, lock);
+        }
+
+        ContentionAccount(site, lock->contention, contended ? ClockElapsed(start, ClockNow()) : -1);
+    }
+
     lock->owner = current;
     lock->state = AIO4C_LOCK_STATE_LOCKED;
 
@@ -183,6 +214,10 @@ void FreeLock(Lock** lock) {
     if (lock != NULL && (pLock = *lock) != NULL) {
         pLock->state = AIO4C_LOCK_STATE_DESTROYED;
 
+        /* so that a lock allocated at the same address gets its own entry */
+        ContentionRetire(pLock->contention);
+        pLock->contention = NULL;
+
 #ifndef AIO4C_WIN32
         if ((code.error = pthread_mutex_destroy(&pLock->mutex)) != 0) {
             code.lock = pLock;
@@ -251,7 +251,13 @@ static void _logprefix(char** pMessage, int* pos, bool allocate) {
     *pMessage = message;
 }
 
-void Log(LogLevel level, char* message, ...) {
+bool LogEnabled(LogLevel level) {
+    Logger* logger = &_logger;
+
+    return ((logger->custom || level <= logger->level) && logger->handler != NULL);
+}
+
+void _Log(LogLevel level, char* message, ...) {
     va_list va;
     Logger* logger = &_logger;
     char* _message = NULL;
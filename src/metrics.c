@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/metrics.h>
+
+#include <aio4c/acceptor.h>
+#include <aio4c/address.h>
+#include <aio4c/alloc.h>
+#include <aio4c/buffer.h>
+#include <aio4c/connection.h>
+#include <aio4c/contention.h>
+#include <aio4c/event.h>
+#include <aio4c/log.h>
+#include <aio4c/segment.h>
+#include <aio4c/server.h>
+#include <aio4c/stats.h>
+#include <aio4c/trace.h>
+#include <aio4c/types.h>
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define AIO4C_METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+typedef enum e_MetricsValue {
+    AIO4C_METRICS_VALUE_COUNT,
+    AIO4C_METRICS_VALUE_DURATION,
+    AIO4C_METRICS_VALUE_SAMPLE
+} MetricsValue;
+
+typedef struct s_MetricsSizeFamily {
+    ProbeSizeType probe;
+    char*         name;
+    char*         type;
+    char*         help;
+} MetricsSizeFamily;
+
+typedef struct s_MetricsPipeFamily {
+    char*         name;
+    char*         type;
+    char*         help;
+    size_t        offset;
+    MetricsValue  value;
+} MetricsPipeFamily;
+
+typedef struct s_MetricsExchange {
+    char  request[AIO4C_METRICS_REQUEST_SIZE];
+    int   received;
+    char* response;
+    int   length;
+    int   capacity;
+    int   sent;
+    char* type;
+    bool  failed;
+} MetricsExchange;
+
+char* AIO4C_METRICS_HOST = "localhost";
+int   AIO4C_METRICS_PORT = 0;
+
+static Server* _metricsServer = NULL;
+
+/* gauges come from values accounted even when statistics are disabled, see _MetricsRenderSnapshot */
+static MetricsSizeFamily _metricsSizeFamilies[] = {
+    { AIO4C_PROBE_NETWORK_READ_SIZE, "aio4c_network_read_bytes_total", "counter", "Bytes read from connections." },
+    { AIO4C_PROBE_NETWORK_WRITE_SIZE, "aio4c_network_written_bytes_total", "counter", "Bytes written to connections." },
+    { AIO4C_PROBE_PROCESSED_DATA_SIZE, "aio4c_processed_bytes_total", "counter", "Bytes processed by the workers." },
+    { AIO4C_PROBE_MEMORY_ALLOCATE_COUNT, "aio4c_memory_allocations_total", "counter", "Memory allocations." },
+    { AIO4C_PROBE_MEMORY_FREE_COUNT, "aio4c_memory_frees_total", "counter", "Memory releases." },
+    { AIO4C_PROBE_LATENCY_COUNT, "aio4c_latency_samples_total", "counter", "Latency samples measured." }
+};
+
+#define AIO4C_METRICS_SIZE_FAMILIES \
+    ((int)(sizeof(_metricsSizeFamilies) / sizeof(_metricsSizeFamilies[0])))
+
+static MetricsPipeFamily _metricsPipeFamilies[] = {
+    { "aio4c_pipe_connections", "gauge", "Connections managed by the pipe.", offsetof(PipeCounters, connections), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_pending_items", "gauge", "Tasks queued to the pipe worker.", offsetof(PipeCounters, pendingItems), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_pending_bytes", "gauge", "Bytes queued to the pipe worker.", offsetof(PipeCounters, pendingBytes), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_pool_buffers", "gauge", "Buffers of the pipe buffer pools, in use or not.", offsetof(PipeCounters, poolBuffers), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_pool_used_buffers", "gauge", "Buffers allocated from the pipe buffer pools.", offsetof(PipeCounters, poolUsed), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_pool_free_buffers", "gauge", "Buffers held by the pipe buffer pools.", offsetof(PipeCounters, poolFree), AIO4C_METRICS_VALUE_SAMPLE },
+    { "aio4c_pipe_iterations_total", "counter", "Iterations of the pipe reader loop.", offsetof(PipeCounters, iterations), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_wakeups_total", "counter", "Iterations where the pipe reader had ready keys.", offsetof(PipeCounters, wakeups), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_ready_keys_total", "counter", "Ready keys returned to the pipe reader.", offsetof(PipeCounters, readyKeys), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_poll_seconds_total", "counter", "Time the pipe reader waited in its selector.", offsetof(PipeCounters, pollTime), AIO4C_METRICS_VALUE_DURATION },
+    { "aio4c_pipe_dispatch_seconds_total", "counter", "Time the pipe reader handled timers and ready keys.", offsetof(PipeCounters, dispatchTime), AIO4C_METRICS_VALUE_DURATION },
+    { "aio4c_pipe_read_bytes_total", "counter", "Bytes read by the pipe reader.", offsetof(PipeCounters, bytesIn), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_tasks_total", "counter", "Tasks dequeued by the pipe worker.", offsetof(PipeCounters, tasks), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_task_wait_seconds_total", "counter", "Time tasks waited for the pipe worker.", offsetof(PipeCounters, waitTime), AIO4C_METRICS_VALUE_DURATION },
+    { "aio4c_pipe_task_process_seconds_total", "counter", "Time the pipe worker processed tasks.", offsetof(PipeCounters, processTime), AIO4C_METRICS_VALUE_DURATION },
+    { "aio4c_pipe_writes_total", "counter", "Write attempts of the pipe writer.", offsetof(PipeCounters, writes), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_short_writes_total", "counter", "Writes of the pipe writer that did not send the whole buffer.", offsetof(PipeCounters, shortWrites), AIO4C_METRICS_VALUE_COUNT },
+    { "aio4c_pipe_written_bytes_total", "counter", "Bytes written by the pipe writer.", offsetof(PipeCounters, bytesOut), AIO4C_METRICS_VALUE_COUNT }
+};
+
+#define AIO4C_METRICS_PIPE_FAMILIES \
+    ((int)(sizeof(_metricsPipeFamilies) / sizeof(_metricsPipeFamilies[0])))
+
+static void _MetricsPrint(MetricsExchange* exchange, char* format, ...) {
+    va_list args;
+    int size = 0;
+    int capacity = 0;
+    char* response = NULL;
+
+    while (!exchange->failed) {
+        va_start(args, format);
+        size = vsnprintf(&exchange->response[exchange->length], exchange->capacity - exchange->length, format, args);
+        va_end(args);
+
+        if (size < 0) {
+            exchange->failed = true;
+        } else if (size < exchange->capacity - exchange->length) {
+            exchange->length += size;
+            return;
+        } else {
+            capacity = exchange->capacity * 2;
+            if (capacity < exchange->length + size + 1) {
+                capacity = exchange->length + size + 1;
+            }
+
+            if ((response = aio4c_realloc(exchange->response, capacity)) == NULL) {
+                exchange->failed = true;
+            } else {
+                exchange->response = response;
+                exchange->capacity = capacity;
+            }
+        }
+    }
+}
+
+static void _MetricsFamily(MetricsExchange* exchange, char* name, char* type, char* help) {
+    _MetricsPrint(exchange, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void _MetricsRenderProbes(MetricsExchange* exchange, StatsSegment* snapshot) {
+    char label[64];
+    long long count = 0;
+    long long highest = 0;
+    int i = 0, j = 0;
+
+    _MetricsFamily(exchange, "aio4c_probe_duration_seconds", "histogram", "Durations measured by the time probes.");
+
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        for (j = 0; ProbeTimeTypeString[i][j] != '\0' && j < (int)sizeof(label) - 1; j++) {
+            label[j] = (ProbeTimeTypeString[i][j] == ' ') ? '_' : (char)tolower((unsigned char)ProbeTimeTypeString[i][j]);
+        }
+        label[j] = '\0';
+
+        /* buckets are merged up to powers of two microseconds, which is precise enough for quantiles */
+        count = 0;
+        for (j = 0; j < AIO4C_STATS_HISTOGRAM_BUCKETS; j++) {
+            count += snapshot->histograms[i][j];
+            highest = StatsBucketHighest(j) + 1;
+            if ((highest & (highest - 1)) == 0) {
+                _MetricsPrint(exchange, "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"%g\"} %lld\n", label, (double)highest / 1e6, count);
+            }
+        }
+
+        _MetricsPrint(exchange, "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"+Inf\"} %lld\n", label, count);
+        _MetricsPrint(exchange, "aio4c_probe_duration_seconds_sum{probe=\"%s\"} %.6f\n", label, (double)snapshot->times[i] / 1e6);
+        _MetricsPrint(exchange, "aio4c_probe_duration_seconds_count{probe=\"%s\"} %lld\n", label, count);
+    }
+
+    for (i = 0; i < AIO4C_METRICS_SIZE_FAMILIES; i++) {
+        _MetricsFamily(exchange, _metricsSizeFamilies[i].name, _metricsSizeFamilies[i].type, _metricsSizeFamilies[i].help);
+        _MetricsPrint(exchange, "%s %lld\n", _metricsSizeFamilies[i].name, snapshot->sizes[_metricsSizeFamilies[i].probe]);
+    }
+}
+
+static void _MetricsRenderPipes(MetricsExchange* exchange, StatsSegment* snapshot) {
+    unsigned char* counters = NULL;
+    int i = 0, j = 0;
+
+    for (i = 0; i < AIO4C_METRICS_PIPE_FAMILIES; i++) {
+        _MetricsFamily(exchange, _metricsPipeFamilies[i].name, _metricsPipeFamilies[i].type, _metricsPipeFamilies[i].help);
+
+        for (j = 0; j < snapshot->pipes; j++) {
+            counters = (unsigned char*)&snapshot->counters[j] + _metricsPipeFamilies[i].offset;
+
+            switch (_metricsPipeFamilies[i].value) {
+                case AIO4C_METRICS_VALUE_COUNT:
+                    _MetricsPrint(exchange, "%s{pipe=\"%d\"} %llu\n", _metricsPipeFamilies[i].name, j, *(unsigned long long*)counters);
+                    break;
+                case AIO4C_METRICS_VALUE_DURATION:
+                    _MetricsPrint(exchange, "%s{pipe=\"%d\"} %.9f\n", _metricsPipeFamilies[i].name, j, (double)*(unsigned long long*)counters / 1e9);
+                    break;
+                case AIO4C_METRICS_VALUE_SAMPLE:
+                    _MetricsPrint(exchange, "%s{pipe=\"%d\"} %d\n", _metricsPipeFamilies[i].name, j, *(int*)counters);
+                    break;
+            }
+        }
+    }
+}
+
+static char* _MetricsRenderTrace(MetricsExchange* exchange) {
+    char chunk[AIO4C_METRICS_BUFFER_SIZE];
+    FILE* file = NULL;
+    size_t size = 0;
+
+    /* written to a temporary file first, the document may be larger than any fixed buffer */
+    if (AIO4C_TRACE_RATE <= 0 || (file = tmpfile()) == NULL || !TraceWrite(file)) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        _MetricsPrint(exchange, "traces unavailable\n");
+        return "503 Service Unavailable";
+    }
+
+    rewind(file);
+    while ((size = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        _MetricsPrint(exchange, "%.*s", (int)size, chunk);
+    }
+    fclose(file);
+
+    exchange->type = "application/json";
+
+    return "200 OK";
+}
+
+static char* _MetricsRenderLocks(MetricsExchange* exchange) {
+    char chunk[AIO4C_METRICS_BUFFER_SIZE];
+    FILE* file = NULL;
+    size_t size = 0;
+
+    if (AIO4C_CONTENTION_TOP <= 0 || (file = tmpfile()) == NULL || !ContentionWrite(file, AIO4C_CONTENTION_TOP)) {
+        if (file != NULL) {
+            fclose(file);
+        }
+        _MetricsPrint(exchange, "lock contention unavailable\n");
+        return "503 Service Unavailable";
+    }
+
+    rewind(file);
+    while ((size = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        _MetricsPrint(exchange, "%.*s", (int)size, chunk);
+    }
+    fclose(file);
+
+    exchange->type = "text/plain; charset=utf-8";
+
+    return "200 OK";
+}
+
+static void _MetricsRenderSnapshot(MetricsExchange* exchange, StatsSegment* snapshot) {
+    _MetricsRenderProbes(exchange, snapshot);
+    _MetricsRenderPipes(exchange, snapshot);
+
+    _MetricsFamily(exchange, "aio4c_memory_used_bytes", "gauge", "Bytes currently allocated, as accounted against the memory budget.");
+    _MetricsPrint(exchange, "aio4c_memory_used_bytes %lld\n", snapshot->memoryUsed);
+    _MetricsFamily(exchange, "aio4c_connections", "gauge", "Connections currently opened on the servers.");
+    _MetricsPrint(exchange, "aio4c_connections %d\n", snapshot->connections);
+    _MetricsFamily(exchange, "aio4c_memory_budget_bytes", "gauge", "Memory budget, 0 when unlimited.");
+    _MetricsPrint(exchange, "aio4c_memory_budget_bytes %lld\n", AIO4C_MEMORY_BUDGET);
+    _MetricsFamily(exchange, "aio4c_stats_updates_total", "counter", "Updates of the statistics segment.");
+    _MetricsPrint(exchange, "aio4c_stats_updates_total %llu\n", snapshot->updates);
+    _MetricsFamily(exchange, "aio4c_stats_elapsed_seconds", "gauge", "Time between the start of statistics and their last update.");
+    _MetricsPrint(exchange, "aio4c_stats_elapsed_seconds %.3f\n", (double)snapshot->elapsed / 1e9);
+}
+
+static char* _MetricsRender(MetricsExchange* exchange) {
+    StatsSegment* segment = StatsSegmentGet();
+    StatsSegment* snapshot = NULL;
+    char* path = NULL;
+    int length = 0;
+
+    if (strncmp(exchange->request, "GET ", 4) != 0) {
+        _MetricsPrint(exchange, "method not allowed\n");
+        return "405 Method Not Allowed";
+    }
+
+    path = &exchange->request[4];
+    length = strcspn(path, " ?\r\n");
+    if (length == 6 && strncmp(path, "/trace", 6) == 0) {
+        return _MetricsRenderTrace(exchange);
+    }
+
+    if (length == 6 && strncmp(path, "/locks", 6) == 0) {
+        return _MetricsRenderLocks(exchange);
+    }
+
+    if (length != 8 || strncmp(path, "/metrics", 8) != 0) {
+        _MetricsPrint(exchange, "not found\n");
+        return "404 Not Found";
+    }
+
+    /* copied out of the segment, the stats thread is never blocked by a scrape */
+    if (segment == NULL || (snapshot = aio4c_malloc(sizeof(StatsSegment))) == NULL || !StatsSegmentRead(segment, snapshot)) {
+        if (snapshot != NULL) {
+            aio4c_free(snapshot);
+        }
+        _MetricsPrint(exchange, "statistics unavailable\n");
+        return "503 Service Unavailable";
+    }
+
+    _MetricsRenderSnapshot(exchange, snapshot);
+
+    aio4c_free(snapshot);
+
+    return "200 OK";
+}
+
+bool MetricsWrite(FILE* file, StatsSegment* snapshot) {
+    MetricsExchange exchange;
+    bool written = false;
+
+    if (file == NULL || snapshot == NULL) {
+        return false;
+    }
+
+    memset(&exchange, 0, sizeof(MetricsExchange));
+    exchange.capacity = AIO4C_METRICS_BUFFER_SIZE;
+    if ((exchange.response = aio4c_malloc(exchange.capacity)) == NULL) {
+        return false;
+    }
+
+    _MetricsRenderSnapshot(&exchange, snapshot);
+
+    if (!exchange.failed) {
+        written = (fwrite(exchange.response, 1, exchange.length, file) == (size_t)exchange.length && ferror(file) == 0);
+    }
+
+    aio4c_free(exchange.response);
+
+    return written;
+}
+
+static void _MetricsRespond(MetricsExchange* exchange) {
+    char header[AIO4C_METRICS_HEADER_SIZE];
+    char* status = NULL;
+    int length = 0;
+
+    exchange->capacity = AIO4C_METRICS_BUFFER_SIZE;
+    if ((exchange->response = aio4c_malloc(exchange->capacity)) == NULL) {
+        exchange->failed = true;
+        return;
+    }
+
+    /* the body is rendered behind room left for the header, which needs its length */
+    exchange->length = AIO4C_METRICS_HEADER_SIZE;
+    exchange->type = AIO4C_METRICS_CONTENT_TYPE;
+    status = _MetricsRender(exchange);
+
+    if (exchange->failed) {
+        return;
+    }
+
+    length = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+            status, exchange->type, exchange->length - AIO4C_METRICS_HEADER_SIZE);
+
+    exchange->sent = AIO4C_METRICS_HEADER_SIZE - length;
+    memcpy(&exchange->response[exchange->sent], header, length);
+}
+
+static void _MetricsHandler(Event event, Connection* source, MetricsExchange* exchange) {
+    Buffer* buffer = NULL;
+    int size = 0;
+
+    if (exchange == NULL) {
+        if (event == AIO4C_READ_EVENT) {
+            ConnectionClose(source, true);
+        }
+        return;
+    }
+
+    switch (event) {
+        case AIO4C_READ_EVENT:
+            if (exchange->response != NULL) {
+                break;
+            }
+
+            buffer = source->dataBuffer;
+            size = BufferRemaining(buffer);
+            if (size > AIO4C_METRICS_REQUEST_SIZE - 1 - exchange->received) {
+                size = AIO4C_METRICS_REQUEST_SIZE - 1 - exchange->received;
+            }
+            BufferGet(buffer, &exchange->request[exchange->received], size);
+            exchange->received += size;
+            exchange->request[exchange->received] = '\0';
+
+            if (strstr(exchange->request, "\r\n\r\n") == NULL && strstr(exchange->request, "\n\n") == NULL) {
+                if (exchange->received == AIO4C_METRICS_REQUEST_SIZE - 1) {
+                    Log(AIO4C_LOG_LEVEL_WARN, "request too large on metrics connection %s", ConnectionGetString(source));
+                    ConnectionClose(source, true);
+                }
+                break;
+            }
+
+            _MetricsRespond(exchange);
+
+            if (exchange->failed) {
+                Log(AIO4C_LOG_LEVEL_WARN, "cannot render metrics for connection %s", ConnectionGetString(source));
+                ConnectionClose(source, true);
+                break;
+            }
+
+            EnableWriteInterest(source);
+            break;
+        case AIO4C_WRITE_EVENT:
+            if (exchange->response == NULL || exchange->sent == exchange->length) {
+                break;
+            }
+
+            buffer = source->writeBuffer;
+            size = BufferRemaining(buffer);
+            if (size > exchange->length - exchange->sent) {
+                size = exchange->length - exchange->sent;
+            }
+            BufferPut(buffer, &exchange->response[exchange->sent], size);
+            exchange->sent += size;
+
+            /* the connection is only closed once the last chunk was handed to the writer */
+            if (exchange->sent == exchange->length) {
+                ConnectionClose(source, false);
+            }
+            EnableWriteInterest(source);
+            break;
+        case AIO4C_FREE_EVENT:
+            if (exchange->response != NULL) {
+                aio4c_free(exchange->response);
+            }
+            aio4c_free(exchange);
+            break;
+        default:
+            break;
+    }
+}
+
+static void* _MetricsExchangeFactory(Connection* connection __attribute__((unused)), void* arg __attribute__((unused))) {
+    return aio4c_malloc(sizeof(MetricsExchange));
+}
+
+bool MetricsStart(void) {
+    if (AIO4C_METRICS_PORT <= 0 || AIO4C_METRICS_PORT > 65535 || _metricsServer != NULL) {
+        return false;
+    }
+
+    _metricsServer = NewServer(AIO4C_ADDRESS_IPV4, AIO4C_METRICS_HOST, (aio4c_port_t)AIO4C_METRICS_PORT, AIO4C_METRICS_BUFFER_SIZE, 1,
+            aio4c_server_handler(_MetricsHandler), NULL, aio4c_server_factory(_MetricsExchangeFactory));
+
+    if (_metricsServer == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot create metrics endpoint on %s:%d", AIO4C_METRICS_HOST, AIO4C_METRICS_PORT);
+        return false;
+    }
+
+    /* neither inherits the application sockets nor applies its admission and placement settings */
+    ServerSetInternal(_metricsServer);
+
+    if (!ServerStart(_metricsServer)) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot start metrics endpoint on %s:%d", AIO4C_METRICS_HOST, AIO4C_METRICS_PORT);
+        ServerJoin(_metricsServer);
+        _metricsServer = NULL;
+        return false;
+    }
+
+    Log(AIO4C_LOG_LEVEL_INFO, "serving metrics on http://%s:%d/metrics", AIO4C_METRICS_HOST, AIO4C_METRICS_PORT);
+
+    return true;
+}
+
+void MetricsStop(void) {
+    if (_metricsServer != NULL) {
+        ServerStop(_metricsServer);
+        ServerJoin(_metricsServer);
+        _metricsServer = NULL;
+    }
+}
@@ -49,6 +49,8 @@ struct s_QueueTaskItem {
     Event       event;
     Connection* connection;
     Buffer*     buffer;
+    aio4c_clock_t enqueued;
+    unsigned int trace;
 };
 
 union u_QueueItemData {
@@ -69,6 +71,7 @@ struct s_Queue {
     Lock*        lock;
     bool exit;
     bool emptied;
+    volatile int size;
 };
 
 Queue* NewQueue(void) {
@@ -93,6 +96,7 @@ Queue* NewQueue(void) {
     queue->condition = NewCondition();
     queue->emptied   = false;
     queue->exit      = false;
+    queue->size      = 0;
 
     return queue;
 }
@@ -150,6 +154,7 @@ bool Dequeue(Queue* queue, QueueItem* item, bool wait) {
         dthread("dequeue item #%d %p from queue %p\n", QueueItemGetType(node->data), (void*)node->data, (void*)queue);
         memcpy(item, node->data, sizeof(QueueItem));
         ListAddLast(&queue->free, node);
+        queue->size--;
         queue->emptied = ListEmpty(&queue->busy);
         dequeued = true;
     } else {
@@ -207,6 +212,7 @@ static bool _Enqueue(Queue* queue, QueueItem* item) {
     memcpy(node->data, item, sizeof(QueueItem));
 
     ListAddLast(&queue->busy, node);
+    queue->size++;
 
     if (item->type == AIO4C_QUEUE_ITEM_EXIT) {
         queue->exit = true;
@@ -264,7 +270,7 @@ EventSource QueueEventItemGetSource(QueueItem* item) {
     return item->content.event.source;
 }
 
-bool EnqueueTaskItem(Queue* queue, Event event, Connection* connection, Buffer* buffer) {
+bool EnqueueTaskItem(Queue* queue, Event event, Connection* connection, Buffer* buffer, aio4c_clock_t enqueued, unsigned int trace) {
     QueueItem item;
 
     memset(&item, 0, sizeof(QueueItem));
@@ -273,6 +279,8 @@ bool EnqueueTaskItem(Queue* queue, Event event, Connection* connection, Buffer*
     item.content.task.event = event;
     item.content.task.connection = connection;
     item.content.task.buffer = buffer;
+    item.content.task.enqueued = enqueued;
+    item.content.task.trace = trace;
 
     return _Enqueue(queue, &item);
 }
@@ -289,6 +297,18 @@ Buffer* QueueTaskItemGetBuffer(QueueItem* item) {
     return item->content.task.buffer;
 }
 
+aio4c_clock_t QueueTaskItemGetTime(QueueItem* item) {
+    return item->content.task.enqueued;
+}
+
+unsigned int QueueTaskItemGetTrace(QueueItem* item) {
+    return item->content.task.trace;
+}
+
+int QueueGetSize(Queue* queue) {
+    return queue->size;
+}
+
 bool RemoveAll(Queue* queue, QueueRemoveCallback removeCallback, QueueDiscriminant discriminant) {
     bool removed = false;
     Node* i = NULL;
@@ -304,6 +324,7 @@ bool RemoveAll(Queue* queue, QueueRemoveCallback removeCallback, QueueDiscrimina
             i = i->next;
             ListRemove(&queue->busy, toRemove);
             ListAddLast(&queue->free, toRemove);
+            queue->size--;
             removed = true;
         } else {
             i = i->next;
@@ -315,6 +336,24 @@ bool RemoveAll(Queue* queue, QueueRemoveCallback removeCallback, QueueDiscrimina
     return removed;
 }
 
+int QueueForEach(Queue* queue, QueueVisitCallback visitCallback, void* arg) {
+    Node* i = NULL;
+    int visited = 0;
+
+    TakeLock(queue->lock);
+
+    for (i = queue->busy.first; i != NULL; i = i->next) {
+        visited++;
+        if (!visitCallback((QueueItem*)i->data, arg)) {
+            break;
+        }
+    }
+
+    ReleaseLock(queue->lock);
+
+    return visited;
+}
+
 void FreeQueueItem(QueueItem** item) {
     QueueItem* pItem = NULL;
 
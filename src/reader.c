@@ -24,34 +24,62 @@
 #include <aio4c/reader.h>
 
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/buffer.h>
+#include <aio4c/clock.h>
 #include <aio4c/connection.h>
 #include <aio4c/error.h>
+#include <aio4c/event.h>
+#include <aio4c/lock.h>
 #include <aio4c/log.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
+#include <aio4c/timer.h>
 #include <aio4c/types.h>
 #include <aio4c/worker.h>
 
 #ifndef AIO4C_WIN32
 
 #include <errno.h>
+#include <unistd.h>
+
+#else /* AIO4C_WIN32 */
+
+#include <winsock2.h>
 
 #endif /* AIO4C_WIN32 */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 static bool _ReaderInit(ThreadData _reader) {
     Reader* reader = (Reader*)_reader;
+
+    /* created once the pipe policy is applied, so that connections buffers are local to the pipe */
+    if ((reader->bufferPool = NewBufferPool(reader->bufferSize)) == NULL) {
+        return false;
+    }
+
     if ((reader->selector = NewSelector()) == NULL) {
         return false;
     }
 
+    if ((reader->timers = NewTimerWheel()) == NULL) {
+        return false;
+    }
+
+    if (reader->listenSocket != -1) {
+        if ((reader->listenKey = Register(reader->selector, AIO4C_OP_READ, reader->listenSocket, NULL)) == NULL) {
+            return false;
+        }
+    }
+
     if ((reader->queue = NewQueue()) == NULL) {
         return false;
     }
 
-    if ((reader->worker = NewWorker(reader->pipe, reader->bufferSize)) == NULL) {
+    if ((reader->worker = NewWorker(reader->pipe, reader->bufferSize, ThreadGetPolicy(reader->thread))) == NULL) {
         return false;
     }
 
@@ -60,12 +88,336 @@ static bool _ReaderInit(ThreadData _reader) {
     return true;
 }
 
+static bool _ReaderAccept(Reader* reader) {
+    bool listening = false;
+
+    TakeLock(reader->listenLock);
+
+    if (reader->acceptHandler != NULL) {
+        reader->acceptHandler(reader, reader->listenSocket, reader->acceptArg);
+        listening = true;
+    }
+
+    ReleaseLock(reader->listenLock);
+
+    return listening;
+}
+
+static aio4c_time_t _ReaderIdleDeadline(aio4c_time_t last, int timeout, aio4c_time_t deadline) {
+    if (timeout <= 0) {
+        return deadline;
+    }
+
+    if (deadline == 0 || last + (aio4c_time_t)timeout < deadline) {
+        return last + (aio4c_time_t)timeout;
+    }
+
+    return deadline;
+}
+
+static void _ReaderIdleCheck(void* _connection, void* _reader);
+
+static void _ReaderIdleSchedule(Reader* reader, Connection* connection, aio4c_time_t deadline) {
+    aio4c_time_t now = TimerWheelGetTime(reader->timers);
+    int delay = 0;
+
+    if (deadline > now) {
+        delay = (deadline - now > INT_MAX) ? INT_MAX : (int)(deadline - now);
+    }
+
+    /* not owned by the connection, a connection only watched for inactivity can still migrate */
+    TimerWheelSchedule(reader->timers, NULL, delay, _ReaderIdleCheck, (void*)connection, (void*)reader, &connection->idleTimer, NULL);
+}
+
+static void _ReaderIdleCheck(void* _connection, void* _reader) {
+    Connection* connection = (Connection*)_connection;
+    Reader* reader = (Reader*)_reader;
+    ConnectionTimeouts* timeouts = &connection->timeouts;
+    aio4c_time_t now = TimerWheelGetTime(reader->timers);
+    aio4c_time_t lastRead = connection->lastRead, lastWrite = connection->lastWrite;
+    aio4c_time_t last = (lastRead > lastWrite) ? lastRead : lastWrite;
+    aio4c_time_t deadline = 0;
+
+    if (connection->state == AIO4C_CONNECTION_STATE_CLOSED) {
+        return;
+    }
+
+    deadline = _ReaderIdleDeadline(lastRead, timeouts->read, deadline);
+    deadline = _ReaderIdleDeadline(lastWrite, timeouts->write, deadline);
+    deadline = _ReaderIdleDeadline(last, timeouts->idle, deadline);
+
+    if (deadline > now) {
+        _ReaderIdleSchedule(reader, connection, deadline);
+        return;
+    }
+
+    if (!timeouts->notify) {
+        Log(AIO4C_LOG_LEVEL_INFO, "closing inactive connection %s", ConnectionGetString(connection));
+        ConnectionClose(connection, true);
+        return;
+    }
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s is inactive", ConnectionGetString(connection));
+
+    ConnectionIdle(connection);
+
+    /* expired timeouts are notified again after a whole period of inactivity */
+    deadline = 0;
+    deadline = _ReaderIdleDeadline((lastRead + (aio4c_time_t)timeouts->read > now) ? lastRead : now, timeouts->read, deadline);
+    deadline = _ReaderIdleDeadline((lastWrite + (aio4c_time_t)timeouts->write > now) ? lastWrite : now, timeouts->write, deadline);
+    deadline = _ReaderIdleDeadline((last + (aio4c_time_t)timeouts->idle > now) ? last : now, timeouts->idle, deadline);
+
+    _ReaderIdleSchedule(reader, connection, deadline);
+}
+
+static void _ReaderIdleWatch(Reader* reader, Connection* connection) {
+    ConnectionTimeouts* timeouts = &connection->timeouts;
+    aio4c_time_t now = TimerWheelGetTime(reader->timers);
+    aio4c_time_t deadline = 0;
+
+    if (timeouts->read <= 0 && timeouts->write <= 0 && timeouts->idle <= 0) {
+        return;
+    }
+
+    connection->lastRead = now;
+    connection->lastWrite = now;
+
+    deadline = _ReaderIdleDeadline(now, timeouts->read, deadline);
+    deadline = _ReaderIdleDeadline(now, timeouts->write, deadline);
+    deadline = _ReaderIdleDeadline(now, timeouts->idle, deadline);
+
+    _ReaderIdleSchedule(reader, connection, deadline);
+}
+
+static void _ReaderShed(Reader* reader) {
+    Node* node = NULL;
+    Connection* connection = NULL;
+    Connection* expensive = NULL;
+
+    for (node = reader->suspended.first; node != NULL; node = node->next) {
+        connection = (Connection*)node->data;
+        if (connection->state != AIO4C_CONNECTION_STATE_CLOSED &&
+                (expensive == NULL || connection->pendingBytes > expensive->pendingBytes)) {
+            expensive = connection;
+        }
+    }
+
+    if (expensive != NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "memory budget exhausted, closing connection %s (%d bytes pending)", ConnectionGetString(expensive), expensive->pendingBytes);
+        ConnectionClose(expensive, true);
+    }
+}
+
+static void _ReaderMemoryPoll(void* _reader, void* arg __attribute__((unused)));
+
+static void _ReaderMemoryWatch(Reader* reader) {
+    if (reader->memoryWatched) {
+        return;
+    }
+
+    /* nothing wakes the reader when memory is freed, its usage is polled instead */
+    reader->memoryWatched = TimerWheelSchedule(reader->timers, NULL, AIO4C_MEMORY_POLL_INTERVAL, _ReaderMemoryPoll, (void*)reader, NULL, NULL, NULL);
+}
+
+static void _ReaderMemoryPoll(void* _reader, void* arg __attribute__((unused))) {
+    Reader* reader = (Reader*)_reader;
+    MemoryState state = MemoryGetState();
+
+    reader->memoryWatched = false;
+
+    if (state == AIO4C_MEMORY_EXHAUSTED) {
+        _ReaderShed(reader);
+    }
+
+    /* processed before the next select */
+    reader->flowCheck = true;
+
+    if (state != AIO4C_MEMORY_NORMAL && (reader->suspendedCount > 0 || reader->listenPaused)) {
+        _ReaderMemoryWatch(reader);
+    }
+}
+
+static void _ReaderListenCheck(Reader* reader) {
+    MemoryState state = AIO4C_MEMORY_NORMAL;
+
+    /* once accepts are stopped, clients left in the backlog are refused when the socket is closed */
+    if (reader->listenSocket != -1 && reader->acceptHandler == NULL) {
+        if (reader->listenKey != NULL) {
+            Unregister(reader->selector, reader->listenKey, true, NULL);
+            reader->listenKey = NULL;
+        }
+#ifndef AIO4C_WIN32
+        close(reader->listenSocket);
+#else /* AIO4C_WIN32 */
+        closesocket(reader->listenSocket);
+#endif /* AIO4C_WIN32 */
+        reader->listenSocket = -1;
+        reader->listenPaused = false;
+        Log(AIO4C_LOG_LEVEL_DEBUG, "listening socket closed");
+        return;
+    }
+
+    if (reader->listenKey == NULL && !reader->listenPaused) {
+        return;
+    }
+
+    state = MemoryGetState();
+
+    /* connections are left in the backlog while memory is short */
+    if (reader->listenKey != NULL && state >= AIO4C_MEMORY_CRITICAL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "memory is %s, pausing accepts", MemoryStateString[state]);
+        Unregister(reader->selector, reader->listenKey, true, NULL);
+        reader->listenKey = NULL;
+        reader->listenPaused = true;
+        _ReaderMemoryWatch(reader);
+    } else if (reader->listenPaused && state == AIO4C_MEMORY_NORMAL) {
+        Log(AIO4C_LOG_LEVEL_INFO, "memory is %s, resuming accepts", MemoryStateString[state]);
+        TakeLock(reader->listenLock);
+        if (reader->acceptHandler != NULL) {
+            reader->listenKey = Register(reader->selector, AIO4C_OP_READ, reader->listenSocket, NULL);
+        }
+        ReleaseLock(reader->listenLock);
+        reader->listenPaused = false;
+    }
+}
+
+static void _ReaderSuspend(Reader* reader, Connection* connection) {
+    Node* node = NULL;
+
+    if (connection->suspendedNode != NULL || connection->state == AIO4C_CONNECTION_STATE_CLOSED) {
+        return;
+    }
+
+    if ((node = NewNode(connection)) == NULL) {
+        return;
+    }
+
+    /* the read key is only unregistered once the ready keys have been walked */
+    ListAddLast(&reader->suspended, node);
+    connection->suspendedNode = node;
+    connection->readSuspended = true;
+    reader->suspendedCount++;
+
+    if (MemoryGetState() != AIO4C_MEMORY_NORMAL) {
+        _ReaderMemoryWatch(reader);
+    }
+}
+
+static void _ReaderStopReading(Reader* reader, Connection* connection) {
+    Node* node = connection->suspendedNode;
+
+    if (node != NULL) {
+        ListRemove(&reader->suspended, node);
+        FreeNode(&node);
+        connection->suspendedNode = NULL;
+        connection->readSuspended = false;
+        reader->suspendedCount--;
+
+        /* a suspended connection is still counted in the reader load */
+        if (connection->readKey == NULL) {
+            AtomicSub(&reader->load, 1);
+        }
+    }
+
+    if (connection->readKey != NULL) {
+        Unregister(reader->selector, connection->readKey, true, NULL);
+        connection->readKey = NULL;
+        AtomicSub(&reader->load, 1);
+    }
+}
+
+static void _ReaderFlowControl(Reader* reader) {
+    Node* node = reader->suspended.first;
+    Node* next = NULL;
+    Connection* connection = NULL;
+
+    while (node != NULL) {
+        next = node->next;
+        connection = (Connection*)node->data;
+
+        if (!WorkerBelowLowMarks(reader->worker, connection)) {
+            if (connection->readKey != NULL) {
+                Log(AIO4C_LOG_LEVEL_DEBUG, "suspending reads of connection %s (%d bytes pending)", ConnectionGetString(connection), connection->pendingBytes);
+                Unregister(reader->selector, connection->readKey, true, NULL);
+                connection->readKey = NULL;
+            }
+        } else {
+            ListRemove(&reader->suspended, node);
+            FreeNode(&node);
+            connection->suspendedNode = NULL;
+            connection->readSuspended = false;
+            reader->suspendedCount--;
+
+            if (connection->readKey == NULL && connection->state != AIO4C_CONNECTION_STATE_CLOSED) {
+                Log(AIO4C_LOG_LEVEL_DEBUG, "resuming reads of connection %s", ConnectionGetString(connection));
+                connection->readKey = Register(reader->selector, AIO4C_OP_READ, connection->socket, (void*)connection);
+            }
+        }
+
+        node = next;
+    }
+}
+
+static void _ReaderMigrate(Reader* reader, Connection* connection) {
+    if (connection->state == AIO4C_CONNECTION_STATE_CLOSED) {
+        Log(AIO4C_LOG_LEVEL_DEBUG, "migration aborted for closed connection %s", ConnectionGetString(connection));
+        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+            FreeConnection(&connection);
+        }
+        return;
+    }
+
+    if (connection->migrateTo != reader) {
+        /* stop reading, the worker then the writer will flush what they hold for the connection */
+        _ReaderStopReading(reader, connection);
+
+        TimerCancel(connection->idleTimer);
+
+        Log(AIO4C_LOG_LEVEL_DEBUG, "connection %s leaving pipe %s", ConnectionGetString(connection), reader->pipe);
+
+        if (!EnqueueEventItem(reader->worker->queue, AIO4C_MIGRATE_EVENT, (EventSource)connection)) {
+            if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+                FreeConnection(&connection);
+            }
+        }
+        return;
+    }
+
+    connection->migrateTo = NULL;
+
+    /* no pipe would read the connection anymore */
+    if ((connection->readKey = Register(reader->selector, AIO4C_OP_READ, connection->socket, (void*)connection)) == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot read connection %s on pipe %s, closing it", ConnectionGetString(connection), reader->pipe);
+        ConnectionClose(connection, true);
+        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+            FreeConnection(&connection);
+        }
+        return;
+    }
+
+    AtomicAdd(&reader->load, 1);
+
+    /* the activity stamps are kept, a migration must not restart the idle timeouts */
+    if (connection->timeouts.read > 0 || connection->timeouts.write > 0 || connection->timeouts.idle > 0) {
+        _ReaderIdleCheck((void*)connection, (void*)reader);
+    }
+
+    Log(AIO4C_LOG_LEVEL_INFO, "connection %s migrated to pipe %s", ConnectionGetString(connection), reader->pipe);
+
+    if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+        FreeConnection(&connection);
+    }
+}
+
 static bool _ReaderRun(ThreadData _reader) {
     Reader* reader = (Reader*)_reader;
     QueueItem* item = NewQueueItem();
     Connection* connection = NULL;
     SelectionKey* key = NULL;
     int numConnectionsReady = 0;
+    bool stopListening = false;
+    bool suspend = false;
+    aio4c_clock_t start = 0, stop = 0;
 
     while(Dequeue(reader->queue, item, false)) {
         switch(QueueItemGetType(item)) {
@@ -74,26 +426,31 @@ static bool _ReaderRun(ThreadData _reader) {
                 return false;
             case AIO4C_QUEUE_ITEM_DATA:
                 connection = (Connection*)QueueDataItemGet(item);
-                connection->readKey = Register(reader->selector, AIO4C_OP_READ, connection->socket, (void*)connection);
-                Log(AIO4C_LOG_LEVEL_DEBUG, "managing connection %s", connection->string);
+                /* counted in the load since handed to this reader */
+                if ((connection->readKey = Register(reader->selector, AIO4C_OP_READ, connection->socket, (void*)connection)) == NULL) {
+                    AtomicSub(&reader->load, 1);
+                }
+                Log(AIO4C_LOG_LEVEL_DEBUG, "managing connection %s", ConnectionGetString(connection));
                 ConnectionManagedBy(connection, AIO4C_CONNECTION_OWNER_READER);
-                reader->load++;
+                _ReaderIdleWatch(reader, connection);
                 break;
             case AIO4C_QUEUE_ITEM_EVENT:
                 connection = (Connection*)QueueEventItemGetSource(item);
                 if (QueueEventItemGetEvent(item) == AIO4C_CLOSE_EVENT) {
-                    if (connection->readKey != NULL) {
-                        Unregister(reader->selector, connection->readKey, true, NULL);
-                        connection->readKey = NULL;
-                    }
-                    Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", connection->string);
-                    reader->load--;
+                    /* a migrating connection is not counted in any reader load */
+                    _ReaderStopReading(reader, connection);
+                    /* timers fire on this thread, none can run once cancelled here */
+                    TimerWheelCancelAll(reader->timers, &connection->timers);
+                    TimerCancel(connection->idleTimer);
+                    Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", ConnectionGetString(connection));
                     if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_READER)) {
-                        Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", connection->string);
+                        Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", ConnectionGetString(connection));
                         FreeConnection(&connection);
                     }
                 } else if (QueueEventItemGetEvent(item) == AIO4C_PENDING_CLOSE_EVENT) {
-                    Log(AIO4C_LOG_LEVEL_DEBUG, "pending close received for connection %s", connection->string);
+                    Log(AIO4C_LOG_LEVEL_DEBUG, "pending close received for connection %s", ConnectionGetString(connection));
+                } else if (QueueEventItemGetEvent(item) == AIO4C_MIGRATE_EVENT) {
+                    _ReaderMigrate(reader, connection);
                 }
                 break;
             default:
@@ -101,20 +458,60 @@ static bool _ReaderRun(ThreadData _reader) {
         }
     }
 
+    if (reader->flowCheck) {
+        reader->flowCheck = false;
+        _ReaderFlowControl(reader);
+    }
+
+    _ReaderListenCheck(reader);
+
+    /* accepted connections took buffers, the pool grows back here rather than on the acceptor thread */
+    BufferPoolReserve(reader->bufferPool);
+
     ProbeTimeStart(AIO4C_TIME_PROBE_IDLE);
-    numConnectionsReady = Select(reader->selector);
+    start = ClockNow();
+    numConnectionsReady = SelectTimeout(reader->selector, TimerWheelNextTimeout(reader->timers));
+    stop = ClockNow();
     ProbeTimeEnd(AIO4C_TIME_PROBE_IDLE);
 
+    /* only this reader thread updates its counters, they are read by AcceptorGetPipesCounters */
+    reader->counters.iterations++;
+    reader->counters.pollTime += ClockElapsed(start, stop);
+
+    TimerWheelExpire(reader->timers);
+
     if (numConnectionsReady > 0) {
         ProbeTimeStart(AIO4C_TIME_PROBE_NETWORK_READ);
         while (SelectionKeyReady(reader->selector, &key)) {
-            if (SelectionKeyIsOperationSuccessful(key)) {
+            if (key == reader->listenKey) {
+                stopListening = !_ReaderAccept(reader);
+            } else if (SelectionKeyIsOperationSuccessful(key)) {
                 connection = ConnectionRead(SelectionKeyGetAttachment(key));
+                if (connection->state != AIO4C_CONNECTION_STATE_CLOSED && WorkerAboveHighMarks(reader->worker, connection)) {
+                    _ReaderSuspend(reader, connection);
+                    suspend = true;
+                }
             } else {
-                Log(AIO4C_LOG_LEVEL_WARN, "select operation unsuccessful for connection %s", ((Connection*)SelectionKeyGetAttachment(key))->string);
+                Log(AIO4C_LOG_LEVEL_WARN, "select operation unsuccessful for connection %s", ConnectionGetString((Connection*)SelectionKeyGetAttachment(key)));
             }
         }
         ProbeTimeEnd(AIO4C_TIME_PROBE_NETWORK_READ);
+        reader->counters.wakeups++;
+        reader->counters.readyKeys += numConnectionsReady;
+    }
+
+    /* expired timers are dispatched along with ready keys */
+    reader->counters.dispatchTime += ClockElapsed(stop, ClockNow());
+
+    /* keys cannot be unregistered while ready ones are walked */
+    if (suspend) {
+        _ReaderFlowControl(reader);
+    }
+
+    /* the socket itself is closed before the next select */
+    if (stopListening) {
+        Unregister(reader->selector, reader->listenKey, true, NULL);
+        reader->listenKey = NULL;
     }
 
     FreeQueueItem(&item);
@@ -124,6 +521,19 @@ static bool _ReaderRun(ThreadData _reader) {
 
 static void _ReaderExit(ThreadData _reader) {
     Reader* reader = (Reader*)_reader;
+    Node* node = NULL;
+
+    while ((node = ListPop(&reader->suspended)) != NULL) {
+        ((Connection*)node->data)->suspendedNode = NULL;
+        FreeNode(&node);
+    }
+    reader->suspendedCount = 0;
+
+    if (reader->listenKey != NULL) {
+        Unregister(reader->selector, reader->listenKey, true, NULL);
+        reader->listenKey = NULL;
+    }
+
     if (reader->worker != NULL) {
         WorkerEnd(reader->worker);
     }
@@ -133,7 +543,31 @@ static void _ReaderExit(ThreadData _reader) {
     Log(AIO4C_LOG_LEVEL_DEBUG, "exited");
 }
 
-Reader* NewReader(char* pipeName, aio4c_size_t bufferSize) {
+static void _ReaderEventHandler(Event event, Connection* connection, Reader* reader) {
+    if (reader->queue == NULL || !EnqueueEventItem(reader->queue, event, (EventSource)connection)) {
+        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_READER)) {
+            FreeConnection(&connection);
+        }
+        return;
+    }
+
+    SelectorWakeUp(reader->selector);
+}
+
+static void _ReaderInboundHandler(Event event, Connection* connection, Reader* reader) {
+    if (event != AIO4C_INBOUND_DATA_EVENT) {
+        return;
+    }
+
+    /* only this reader thread reads the connection, the counter is sampled by the acceptor */
+    reader->bytesRead += BufferGetPosition(connection->readBuffer);
+}
+
+Reader* NewReader(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy) {
+    return NewListeningReader(pipeName, bufferSize, policy, -1, NULL, NULL);
+}
+
+Reader* NewListeningReader(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy, aio4c_socket_t listenSocket, void (*acceptHandler)(Reader*,aio4c_socket_t,void*), void* acceptArg) {
     Reader* reader = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
 
@@ -150,10 +584,28 @@ Reader* NewReader(char* pipeName, aio4c_size_t bufferSize) {
     }
 
     reader->selector   = NULL;
+    reader->timers     = NULL;
     reader->queue      = NULL;
     reader->worker     = NULL;
     reader->bufferSize = bufferSize;
     reader->load       = 0;
+    reader->bytesRead  = 0;
+    reader->connectionPool = NewConnectionPool();
+    reader->bufferPool = NULL;
+    reader->listenSocket = listenSocket;
+    reader->listenKey  = NULL;
+    reader->listenLock = NewLock();
+    reader->acceptHandler = acceptHandler;
+    reader->acceptArg  = acceptArg;
+    AIO4C_LIST_INITIALIZER(&reader->suspended);
+    reader->suspendedCount = 0;
+    reader->flowCheck  = false;
+    reader->memoryWatched = false;
+    reader->listenPaused = false;
+    reader->handlers   = NewEventQueue();
+    EventHandlerAdd(reader->handlers, NewEventHandler(AIO4C_PENDING_CLOSE_EVENT, (EventCallback)_ReaderEventHandler, (EventData)reader, true));
+    EventHandlerAdd(reader->handlers, NewEventHandler(AIO4C_CLOSE_EVENT, (EventCallback)_ReaderEventHandler, (EventData)reader, true));
+    EventHandlerAdd(reader->handlers, NewEventHandler(AIO4C_INBOUND_DATA_EVENT, (EventCallback)_ReaderInboundHandler, (EventData)reader, false));
 
     if (pipeName != NULL) {
         reader->pipe       = pipeName;
@@ -175,24 +627,36 @@ Reader* NewReader(char* pipeName, aio4c_size_t bufferSize) {
 
     if (reader->thread == NULL) {
         FreeSelector(&reader->selector);
+        FreeTimerWheel(&reader->timers);
         if (reader->pipe != NULL) {
             aio4c_free(reader->pipe);
         }
         if (reader->name != NULL) {
             aio4c_free(reader->name);
         }
+        FreeEventQueue(&reader->handlers);
+        FreeConnectionPool(&reader->connectionPool);
+        FreeBufferPool(&reader->bufferPool);
+        FreeLock(&reader->listenLock);
         aio4c_free(reader);
         return NULL;
     }
 
+    ThreadSetPolicy(reader->thread, policy);
+
     if (!ThreadStart(reader->thread)) {
         FreeSelector(&reader->selector);
+        FreeTimerWheel(&reader->timers);
         if (reader->pipe != NULL) {
             aio4c_free(reader->pipe);
         }
         if (reader->name != NULL) {
             aio4c_free(reader->name);
         }
+        FreeEventQueue(&reader->handlers);
+        FreeConnectionPool(&reader->connectionPool);
+        FreeBufferPool(&reader->bufferPool);
+        FreeLock(&reader->listenLock);
         aio4c_free(reader);
         return NULL;
     }
@@ -200,29 +664,131 @@ Reader* NewReader(char* pipeName, aio4c_size_t bufferSize) {
     return reader;
 }
 
-static void _ReaderEventHandler(Event event, Connection* connection, Reader* reader) {
-    if (reader->queue == NULL || !EnqueueEventItem(reader->queue, event, (EventSource)connection)) {
-        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_READER)) {
-            FreeConnection(&connection);
-        }
+void ReaderManageConnection(Reader* reader, Connection* connection) {
+    connection->reader = reader;
+
+    /* counted at once, so that connections accepted in a burst see each other */
+    AtomicAdd(&reader->load, 1);
+
+    if (!EnqueueDataItem(reader->queue, connection)) {
+        AtomicSub(&reader->load, 1);
+        Log(AIO4C_LOG_LEVEL_WARN, "reader will not manage connection %s", ConnectionGetString(connection));
         return;
     }
 
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_READER] = reader->handlers;
+
+    WorkerManageConnection(reader->worker, connection);
+
     SelectorWakeUp(reader->selector);
 }
 
-void ReaderManageConnection(Reader* reader, Connection* connection) {
-    if (!EnqueueDataItem(reader->queue, connection)) {
-        Log(AIO4C_LOG_LEVEL_WARN, "reader will not manage connection %s", connection->string);
-        return;
+bool ConnectionMigrate(Connection* connection, Reader* target) {
+    Reader* source = connection->reader;
+    unsigned int closedBy = 0;
+
+    if (source == NULL || target == NULL || source == target || connection->state != AIO4C_CONNECTION_STATE_CONNECTED) {
+        return false;
     }
 
-    ConnectionAddSystemHandler(connection, AIO4C_PENDING_CLOSE_EVENT, aio4c_connection_handler(_ReaderEventHandler), aio4c_connection_handler_arg(reader), true);
-    ConnectionAddSystemHandler(connection, AIO4C_CLOSE_EVENT, aio4c_connection_handler(_ReaderEventHandler), aio4c_connection_handler_arg(reader), true);
+    /* take the migration owner, the connection cannot be freed until it reaches the target */
+    do {
+        closedBy = AtomicGet(&connection->closedBy);
+        if (!(closedBy & AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MIGRATION))) {
+            return false;
+        }
+    } while (!AtomicCompareAndSwap(&connection->closedBy, closedBy, closedBy & ~AIO4C_CONNECTION_OWNER_MASK(AIO4C_CONNECTION_OWNER_MIGRATION)));
 
-    WorkerManageConnection(reader->worker, connection);
+    connection->migrateTo = target;
+
+    /* timers fire on the source pipe, connections using them stay there */
+    if (TimerWheelPending(source->timers, &connection->timers)) {
+        connection->migrateTo = NULL;
+        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+            FreeConnection(&connection);
+        }
+        return false;
+    }
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "migrating connection %s from pipe %s to pipe %s", ConnectionGetString(connection), source->pipe, target->pipe);
+
+    if (source->queue == NULL || !EnqueueEventItem(source->queue, AIO4C_MIGRATE_EVENT, (EventSource)connection)) {
+        connection->migrateTo = NULL;
+        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+            FreeConnection(&connection);
+        }
+        return false;
+    }
+
+    SelectorWakeUp(source->selector);
+
+    return true;
+}
+
+bool ConnectionScheduleTimer(Connection* connection, int delay, void (*callback)(Connection*,void*), void* arg, TimerId* id) {
+    Reader* reader = connection->reader;
+    TimerId timer;
+    bool earlier = false;
+
+    if (reader == NULL || reader->timers == NULL || connection->state == AIO4C_CONNECTION_STATE_CLOSED || connection->migrateTo != NULL) {
+        return false;
+    }
+
+    if (!TimerWheelSchedule(reader->timers, &connection->timers, delay, (TimerCallback)callback, (void*)connection, arg, &timer, &earlier)) {
+        return false;
+    }
+
+    /* the reader may have cancelled the connection timers before this one was added */
+    if (connection->state == AIO4C_CONNECTION_STATE_CLOSED || connection->migrateTo != NULL) {
+        TimerCancel(timer);
+        return false;
+    }
+
+    if (earlier) {
+        SelectorWakeUp(reader->selector);
+    }
+
+    if (id != NULL) {
+        *id = timer;
+    }
+
+    return true;
+}
+
+bool ConnectionCancelTimer(Connection* connection __attribute__((unused)), TimerId id) {
+    return TimerCancel(id);
+}
+
+bool ReaderAdoptConnection(Reader* reader, Connection* connection, bool pendingWrite) {
+    connection->reader = reader;
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_READER] = reader->handlers;
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WORKER] = reader->worker->handlers;
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WRITER] = reader->worker->writer->handlers;
+
+    /* must be done before the reader takes the connection, it may be freed afterwards */
+    if (pendingWrite) {
+        EventDispatch(reader->worker->writer->handlers, AIO4C_OUTBOUND_DATA_EVENT, (EventSource)connection, NULL, false);
+    }
+
+    if (!EnqueueEventItem(reader->queue, AIO4C_MIGRATE_EVENT, (EventSource)connection)) {
+        return false;
+    }
 
     SelectorWakeUp(reader->selector);
+
+    return true;
+}
+
+void ReaderStopListening(Reader* reader) {
+    /* once the lock is held, no accept handler is running for this reader */
+    TakeLock(reader->listenLock);
+    reader->acceptHandler = NULL;
+    reader->acceptArg = NULL;
+    ReleaseLock(reader->listenLock);
+
+    if (reader->selector != NULL) {
+        SelectorWakeUp(reader->selector);
+    }
 }
 
 void ReaderEnd(Reader* reader) {
@@ -239,6 +805,15 @@ void ReaderEnd(Reader* reader) {
     }
 
     FreeSelector(&reader->selector);
+    FreeTimerWheel(&reader->timers);
+
+    if (reader->listenSocket != -1) {
+#ifndef AIO4C_WIN32
+        close(reader->listenSocket);
+#else /* AIO4C_WIN32 */
+        closesocket(reader->listenSocket);
+#endif /* AIO4C_WIN32 */
+    }
 
     if (reader->name != NULL) {
         aio4c_free(reader->name);
@@ -248,6 +823,11 @@ void ReaderEnd(Reader* reader) {
         aio4c_free(reader->pipe);
     }
 
+    FreeEventQueue(&reader->handlers);
+    FreeConnectionPool(&reader->connectionPool);
+    FreeBufferPool(&reader->bufferPool);
+    FreeLock(&reader->listenLock);
+
     aio4c_free(reader);
 }
 
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/segment.h>
+
+#include <aio4c/acceptor.h>
+#include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/clock.h>
+#include <aio4c/lock.h>
+#include <aio4c/log.h>
+#include <aio4c/stats.h>
+#include <aio4c/types.h>
+
+#ifndef AIO4C_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif /* AIO4C_WIN32 */
+
+#include <string.h>
+
+typedef struct s_StatsSegmentSource {
+    int  (*collect)(void*,PipeCounters*,int,int*);
+    void*  source;
+} StatsSegmentSource;
+
+char* AIO4C_STATS_SEGMENT = NULL;
+
+static StatsSegment*      _statsSegment = NULL;
+static bool               _statsSegmentMapped = false;
+static aio4c_clock_t      _statsSegmentCreated = 0;
+/* sources are registered from any thread, and collected by the stats thread */
+static StatsSegmentSource _statsSegmentSources[AIO4C_STATS_SEGMENT_MAX_SOURCES];
+static Lock*              _statsSegmentLock = NULL;
+/* collected before each update, publishing is serialized by the stats lock */
+static PipeCounters       _statsSegmentPipes[AIO4C_STATS_SEGMENT_MAX_PIPES];
+
+#ifndef AIO4C_WIN32
+
+static StatsSegment* _StatsSegmentMap(char* path) {
+    StatsSegment* segment = NULL;
+    int fd = -1;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot create statistics segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    /* extends the file to the segment size, the hole reading as zeroes */
+    if (lseek(fd, sizeof(StatsSegment) - 1, SEEK_SET) == (off_t)-1 || write(fd, "", 1) != 1) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot size statistics segment %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    segment = (StatsSegment*)mmap(NULL, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment == (StatsSegment*)MAP_FAILED) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot map statistics segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    return segment;
+}
+
+static void _StatsSegmentUnmap(StatsSegment* segment) {
+    munmap((void*)segment, sizeof(StatsSegment));
+}
+
+StatsSegment* StatsSegmentOpen(char* path) {
+    StatsSegment* segment = NULL;
+    struct stat status;
+    int fd = -1;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "cannot open statistics segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &status) != 0 || status.st_size != (off_t)sizeof(StatsSegment)) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "%s is not a statistics segment of version %d", path, AIO4C_STATS_SEGMENT_VERSION);
+        close(fd);
+        return NULL;
+    }
+
+    segment = (StatsSegment*)mmap(NULL, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (segment == (StatsSegment*)MAP_FAILED) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "cannot map statistics segment %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (segment->magic != AIO4C_STATS_SEGMENT_MAGIC || segment->version != AIO4C_STATS_SEGMENT_VERSION || segment->size != sizeof(StatsSegment)) {
+        Log(AIO4C_LOG_LEVEL_ERROR, "%s is not a statistics segment of version %d", path, AIO4C_STATS_SEGMENT_VERSION);
+        munmap((void*)segment, sizeof(StatsSegment));
+        return NULL;
+    }
+
+    return segment;
+}
+
+void StatsSegmentClose(StatsSegment** segment) {
+    if (segment != NULL && *segment != NULL) {
+        munmap((void*)*segment, sizeof(StatsSegment));
+        *segment = NULL;
+    }
+}
+
+#else /* AIO4C_WIN32 */
+
+static StatsSegment* _StatsSegmentMap(char* path __attribute__((unused))) {
+    Log(AIO4C_LOG_LEVEL_WARN, "statistics segment not supported");
+    return NULL;
+}
+
+static void _StatsSegmentUnmap(StatsSegment* segment __attribute__((unused))) {
+}
+
+StatsSegment* StatsSegmentOpen(char* path __attribute__((unused))) {
+    Log(AIO4C_LOG_LEVEL_ERROR, "statistics segment not supported");
+    return NULL;
+}
+
+void StatsSegmentClose(StatsSegment** segment __attribute__((unused))) {
+}
+
+#endif /* AIO4C_WIN32 */
+
+static void _StatsSegmentInit(StatsSegment* segment, int interval) {
+    memset(_statsSegmentSources, 0, sizeof(_statsSegmentSources));
+    if (_statsSegmentLock == NULL) {
+        _statsSegmentLock = NewLock();
+    }
+
+    segment->version = AIO4C_STATS_SEGMENT_VERSION;
+    segment->size = sizeof(StatsSegment);
+    segment->sequence = 0;
+#ifndef AIO4C_WIN32
+    segment->pid = (long long)getpid();
+#else /* AIO4C_WIN32 */
+    segment->pid = (long long)GetCurrentProcessId();
+#endif /* AIO4C_WIN32 */
+    segment->interval = interval;
+    segment->running = true;
+    segment->timeProbes = AIO4C_TIME_MAX_PROBE_TYPE;
+    segment->sizeProbes = AIO4C_PROBE_MAX_SIZE_TYPE;
+    segment->buckets = AIO4C_STATS_HISTOGRAM_BUCKETS;
+    /* readers ignore the segment until its layout is fully described */
+    AtomicBarrier();
+    segment->magic = AIO4C_STATS_SEGMENT_MAGIC;
+
+    _statsSegmentCreated = ClockNow();
+    _statsSegment = segment;
+}
+
+bool StatsSegmentCreate(char* path, int interval) {
+    StatsSegment* segment = NULL;
+
+    if (path != NULL) {
+        if ((segment = _StatsSegmentMap(path)) == NULL) {
+            return false;
+        }
+        _statsSegmentMapped = true;
+        Log(AIO4C_LOG_LEVEL_INFO, "publishing statistics into %s", path);
+    } else if ((segment = aio4c_malloc(sizeof(StatsSegment))) == NULL) {
+        return false;
+    }
+
+    _StatsSegmentInit(segment, interval);
+
+    return true;
+}
+
+StatsSegment* StatsSegmentGet(void) {
+    return _statsSegment;
+}
+
+void StatsSegmentDestroy(void) {
+    if (_statsSegment != NULL) {
+        if (_statsSegmentMapped) {
+            _StatsSegmentUnmap(_statsSegment);
+        } else {
+            aio4c_free(_statsSegment);
+        }
+        _statsSegment = NULL;
+        _statsSegmentMapped = false;
+    }
+
+    if (_statsSegmentLock != NULL) {
+        FreeLock(&_statsSegmentLock);
+    }
+}
+
+void StatsSegmentPublish(long long* times, long long* sizes, long long (*histograms)[AIO4C_STATS_HISTOGRAM_BUCKETS], bool running) {
+    StatsSegment* segment = _statsSegment;
+    int i = 0, pipes = 0, connections = 0;
+
+    if (segment == NULL) {
+        return;
+    }
+
+    /* collected first, so that readers never spin while sources are walked */
+    TakeLock(_statsSegmentLock);
+    for (i = 0; i < AIO4C_STATS_SEGMENT_MAX_SOURCES && pipes < AIO4C_STATS_SEGMENT_MAX_PIPES; i++) {
+        if (_statsSegmentSources[i].collect != NULL) {
+            pipes += _statsSegmentSources[i].collect(_statsSegmentSources[i].source, &_statsSegmentPipes[pipes], AIO4C_STATS_SEGMENT_MAX_PIPES - pipes, &connections);
+        }
+    }
+    ReleaseLock(_statsSegmentLock);
+
+    /* readers discard any copy taken while the sequence is odd or changed */
+    segment->sequence++;
+    AtomicBarrier();
+
+    segment->running = running;
+    segment->updates++;
+    segment->elapsed = (unsigned long long)ClockElapsed(_statsSegmentCreated, ClockNow());
+    memcpy(segment->times, times, sizeof(segment->times));
+    memcpy(segment->sizes, sizes, sizeof(segment->sizes));
+    memcpy(segment->histograms, histograms, sizeof(segment->histograms));
+    segment->memoryUsed = MemoryGetUsed();
+    segment->connections = connections;
+    memcpy(segment->counters, _statsSegmentPipes, pipes * sizeof(PipeCounters));
+    segment->pipes = pipes;
+
+    AtomicBarrier();
+    segment->sequence++;
+}
+
+bool StatsSegmentAddPipes(int (*collect)(void*,PipeCounters*,int,int*), void* source) {
+    bool added = false;
+    int i = 0;
+
+    if (_statsSegmentLock == NULL) {
+        return false;
+    }
+
+    TakeLock(_statsSegmentLock);
+    for (i = 0; i < AIO4C_STATS_SEGMENT_MAX_SOURCES && !added; i++) {
+        if (_statsSegmentSources[i].collect == NULL) {
+            _statsSegmentSources[i].collect = collect;
+            _statsSegmentSources[i].source = source;
+            added = true;
+        }
+    }
+    ReleaseLock(_statsSegmentLock);
+
+    return added;
+}
+
+void StatsSegmentRemovePipes(void* source) {
+    int i = 0;
+
+    if (_statsSegmentLock == NULL) {
+        return;
+    }
+
+    TakeLock(_statsSegmentLock);
+    for (i = 0; i < AIO4C_STATS_SEGMENT_MAX_SOURCES; i++) {
+        if (_statsSegmentSources[i].source == source) {
+            _statsSegmentSources[i].collect = NULL;
+            _statsSegmentSources[i].source = NULL;
+        }
+    }
+    ReleaseLock(_statsSegmentLock);
+}
+
+bool StatsSegmentRead(StatsSegment* segment, StatsSegment* copy) {
+    unsigned int before = 0, after = 0;
+    int i = 0;
+
+    for (i = 0; i < AIO4C_STATS_SEGMENT_READ_RETRIES; i++) {
+        before = segment->sequence;
+        AtomicBarrier();
+
+        if ((before & 1) != 0) {
+            continue;
+        }
+
+        memcpy(copy, segment, sizeof(StatsSegment));
+        AtomicBarrier();
+        after = segment->sequence;
+
+        if (before == after) {
+            return true;
+        }
+    }
+
+    return false;
+}
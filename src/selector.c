@@ -492,6 +492,10 @@ void Unregister(Selector* selector, SelectionKey* key, bool unregisterAll, bool*
 }
 
 int _Select(char* file, int line, Selector* selector) {
+    return _SelectTimeout(file, line, selector, -1);
+}
+
+int _SelectTimeout(char* file, int line, Selector* selector, int timeout) {
     int nbPolls = 0;
     unsigned char dummy = 0;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
@@ -504,6 +508,14 @@ int _Select(char* file, int line, Selector* selector) {
     fd_set wSet, rSet, eSet;
     int i = 0, maxFd = 0;
     bool fdAdded = false;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 0 };
+    struct timeval* pTv = NULL;
+
+    if (timeout >= 0) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        pTv = &tv;
+    }
 
     FD_ZERO(&wSet);
     FD_ZERO(&rSet);
@@ -546,9 +558,9 @@ int _Select(char* file, int line, Selector* selector) {
 #ifndef AIO4C_WIN32
 
 #ifdef AIO4C_HAVE_POLL
-    while ((nbPolls = poll(selector->polls, selector->numPolls, -1)) < 0) {
+    while ((nbPolls = poll(selector->polls, selector->numPolls, timeout)) < 0) {
 #else /* AIO4C_HAVE_POLL */
-    while ((nbPolls = select(maxFd, &rSet, &wSet, &eSet, NULL)) < 0) {
+    while ((nbPolls = select(maxFd, &rSet, &wSet, &eSet, pTv)) < 0) {
 #endif /* AIO4C_HAVE_POLL */
         if (errno != EINTR) {
             code.error = errno;
@@ -560,9 +572,9 @@ int _Select(char* file, int line, Selector* selector) {
 #else /* AIO4C_WIN32 */
 
 #ifdef AIO4C_HAVE_POLL
-    while ((nbPolls = WSAPoll(selector->polls, selector->numPolls, -1)) == SOCKET_ERROR) {
+    while ((nbPolls = WSAPoll(selector->polls, selector->numPolls, timeout)) == SOCKET_ERROR) {
 #else /* AIO4C_HAVE_POLL */
-    while ((nbPolls = select(maxFd, &rSet, &wSet, &eSet, NULL)) == SOCKET_ERROR) {
+    while ((nbPolls = select(maxFd, &rSet, &wSet, &eSet, pTv)) == SOCKET_ERROR) {
 #endif /* AIO4C_HAVE_POLL */
         code.source = AIO4C_ERRNO_SOURCE_WSA;
         code.selector = selector;
@@ -27,11 +27,14 @@
 #include <aio4c/address.h>
 #include <aio4c/alloc.h>
 #include <aio4c/buffer.h>
+#include <aio4c/clock.h>
 #include <aio4c/error.h>
+#include <aio4c/handover.h>
 #include <aio4c/log.h>
 #include <aio4c/types.h>
 
 #include <string.h>
+#include <time.h>
 
 #ifndef AIO4C_WIN32
 
@@ -47,7 +50,9 @@ static bool _serverInit(ThreadData _server) {
     ConnectionAddHandler(server->factory, AIO4C_WRITE_EVENT, aio4c_connection_handler(server->handler), NULL, false);
     ConnectionAddHandler(server->factory, AIO4C_CLOSE_EVENT, aio4c_connection_handler(server->handler), NULL, true);
     ConnectionAddHandler(server->factory, AIO4C_FREE_EVENT, aio4c_connection_handler(server->handler), NULL, true);
-    server->acceptor = NewAcceptor(ThreadGetName(server->thread), server->address, server->factory, server->nbPipes);
+    ConnectionAddHandler(server->factory, AIO4C_IDLE_EVENT, aio4c_connection_handler(server->handler), NULL, false);
+    ConnectionAddHandler(server->factory, AIO4C_OVERLOAD_EVENT, aio4c_connection_handler(server->handler), NULL, false);
+    server->acceptor = NewAcceptor(ThreadGetName(server->thread), server->address, server->factory, server->nbPipes, server->policies, server->internal);
 
     if (server->acceptor == NULL) {
         return false;
@@ -84,11 +89,13 @@ static void _serverExit(ThreadData _server) {
     FreeBufferPool(&server->pool);
     FreeConnection(&server->factory);
     FreeQueue(&server->queue);
+    aio4c_free(server->policies);
 }
 
 Server* NewServer(AddressType type, char* host, aio4c_port_t port, int bufferSize, int nbPipes, void (*handler)(Event,Connection*,void*), void* handlerArg, void* (*dataFactory)(Connection*,void*)) {
     Server* server = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    int i = 0;
 
     if ((server = aio4c_malloc(sizeof(Server))) == NULL) {
 #ifndef AIO4C_WIN32
@@ -110,6 +117,30 @@ Server* NewServer(AddressType type, char* host, aio4c_port_t port, int bufferSiz
     server->handler    = handler;
     server->queue      = NewQueue();
     server->nbPipes    = nbPipes;
+    server->internal   = false;
+    server->policies   = aio4c_malloc(nbPipes * sizeof(ThreadPolicy));
+
+    if (server->policies == NULL) {
+#ifndef AIO4C_WIN32
+        code.error = errno;
+#else /* AIO4C_WIN32 */
+        code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+        code.size = nbPipes * sizeof(ThreadPolicy);
+        code.type = "ThreadPolicy";
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+        FreeAddress(&server->address);
+        FreeBufferPool(&server->pool);
+        FreeConnection(&server->factory);
+        FreeQueue(&server->queue);
+        aio4c_free(server);
+        return NULL;
+    }
+
+    for (i = 0; i < nbPipes; i++) {
+        ThreadPolicyForPipe(&server->policies[i], i, nbPipes);
+    }
+
     server->thread     = NewThread(
             "server",
             _serverInit,
@@ -122,6 +153,7 @@ Server* NewServer(AddressType type, char* host, aio4c_port_t port, int bufferSiz
         FreeBufferPool(&server->pool);
         FreeConnection(&server->factory);
         FreeQueue(&server->queue);
+        aio4c_free(server->policies);
         aio4c_free(server);
         return NULL;
     }
@@ -129,6 +161,54 @@ Server* NewServer(AddressType type, char* host, aio4c_port_t port, int bufferSiz
     return server;
 }
 
+bool ServerSetPipePolicy(Server* server, int pipe, ThreadPolicy* policy) {
+    if (server == NULL || server->acceptor != NULL || pipe < 0 || pipe >= server->nbPipes) {
+        return false;
+    }
+
+    if (policy != NULL) {
+        memcpy(&server->policies[pipe], policy, sizeof(ThreadPolicy));
+    } else {
+        memset(&server->policies[pipe], 0, sizeof(ThreadPolicy));
+    }
+
+    return true;
+}
+
+bool ServerSetTimeouts(Server* server, ConnectionTimeouts* timeouts) {
+    if (server == NULL || server->acceptor != NULL) {
+        return false;
+    }
+
+    /* copied to each accepted connection */
+    ConnectionSetTimeouts(server->factory, timeouts);
+
+    return true;
+}
+
+bool ServerSetOverloadControl(Server* server, OverloadControl* overload) {
+    if (server == NULL || server->acceptor != NULL) {
+        return false;
+    }
+
+    /* copied to each accepted connection, the workers shed from their queue with it */
+    ConnectionSetOverloadControl(server->factory, overload);
+
+    return true;
+}
+
+bool ServerSetInternal(Server* server) {
+    if (server == NULL || server->acceptor != NULL) {
+        return false;
+    }
+
+    /* serves the library itself, the settings meant for the application do not apply */
+    server->internal = true;
+    ConnectionSetOverloadControl(server->factory, NULL);
+
+    return true;
+}
+
 bool ServerStart(Server* server) {
     return ThreadStart(server->thread);
 }
@@ -147,3 +227,96 @@ void ServerStop(Server* server) {
         EnqueueExitItem(server->queue);
     }
 }
+
+int ServerDrain(Server* server, int timeout) {
+    aio4c_time_t deadline = 0;
+    int remaining = 0;
+#ifndef AIO4C_WIN32
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = AIO4C_SERVER_DRAIN_INTERVAL * 1000000L };
+#endif /* AIO4C_WIN32 */
+
+    if (server == NULL || server->thread == NULL) {
+        return 0;
+    }
+
+    if (server->acceptor == NULL) {
+        ServerStop(server);
+        return 0;
+    }
+
+    deadline = (ClockMicroseconds() / 1000) + ((timeout > 0) ? timeout : 0);
+
+    /* connections left once the deadline is reached are closed by the acceptor when stopped */
+    while ((remaining = AcceptorDrain(server->acceptor)) > 0 && (ClockMicroseconds() / 1000) < deadline) {
+#ifndef AIO4C_WIN32
+        nanosleep(&interval, NULL);
+#else /* AIO4C_WIN32 */
+        Sleep(AIO4C_SERVER_DRAIN_INTERVAL);
+#endif /* AIO4C_WIN32 */
+    }
+
+    if (remaining > 0) {
+        Log(AIO4C_LOG_LEVEL_WARN, "%d connections still open after %d ms, closing them", remaining, timeout);
+    } else {
+        Log(AIO4C_LOG_LEVEL_INFO, "all connections drained");
+    }
+
+    ServerStop(server);
+
+    return remaining;
+}
+
+int ServerHandOver(Server* server, char* path, int timeout) {
+    aio4c_socket_t sockets[AIO4C_HANDOVER_MAX_SOCKETS];
+    int count = 0;
+
+    if (server == NULL || server->acceptor == NULL) {
+        return -1;
+    }
+
+    if ((count = AcceptorGetListeningSockets(server->acceptor, sockets, AIO4C_HANDOVER_MAX_SOCKETS)) == 0) {
+        return -1;
+    }
+
+    /* this server goes on accepting if the sockets could not be handed over */
+    if (!HandOverSend(path, sockets, count, AIO4C_HANDOVER_TIMEOUT)) {
+        return -1;
+    }
+
+    /* the sockets stay open in the process that received them */
+    return ServerDrain(server, timeout);
+}
+
+int ServerGetPipesLoad(Server* server, PipeLoad* loads, int size) {
+    if (server == NULL || server->acceptor == NULL) {
+        return 0;
+    }
+
+    return AcceptorGetPipesLoad(server->acceptor, loads, size);
+}
+
+bool ServerGetCounters(Server* server, AcceptorCounters* counters) {
+    if (server == NULL || server->acceptor == NULL) {
+        return false;
+    }
+
+    AcceptorGetCounters(server->acceptor, counters);
+
+    return true;
+}
+
+int ServerGetPipesCounters(Server* server, PipeCounters* counters, int size) {
+    if (server == NULL || server->acceptor == NULL) {
+        return 0;
+    }
+
+    return AcceptorGetPipesCounters(server->acceptor, counters, size);
+}
+
+int ServerGetConnectionsCounters(Server* server, void (*visitor)(Connection*,ConnectionCounters*,void*), void* arg) {
+    if (server == NULL || server->acceptor == NULL) {
+        return 0;
+    }
+
+    return AcceptorGetConnectionsCounters(server->acceptor, visitor, arg);
+}
@@ -23,9 +23,11 @@
  */
 #include <aio4c/stats.h>
 
-#if AIO4C_ENABLE_STATS
-
+#include <aio4c/atomic.h>
+#include <aio4c/clock.h>
 #include <aio4c/log.h>
+#include <aio4c/metrics.h>
+#include <aio4c/segment.h>
 #include <aio4c/thread.h>
 #include <aio4c/types.h>
 
@@ -36,31 +38,74 @@
 #else /* AIO4C_WIN32 */
 
 #include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #endif /* AIO4C_WIN32 */
 
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* only written by the thread owning it, summed by the readers */
+typedef struct s_StatsShard {
+    volatile long long   timeProbes[AIO4C_TIME_MAX_PROBE_TYPE];
+    volatile long long   sizeProbes[AIO4C_PROBE_MAX_SIZE_TYPE];
+    volatile long long   histograms[AIO4C_TIME_MAX_PROBE_TYPE][AIO4C_STATS_HISTOGRAM_BUCKETS];
+    volatile bool        owned;
+    struct s_StatsShard* next;
+} StatsShard;
+
 char* AIO4C_STATS_OUTPUT_FILE = NULL;
 bool AIO4C_STATS_ENABLE_PERIODIC_OUTPUT = false;
 int AIO4C_STATS_INTERVAL = 0;
-
-static Thread*          _statsThread = NULL;
-static FILE*            _statsFile = NULL;
-static double           _timeProbes[AIO4C_TIME_MAX_PROBE_TYPE];
-static double           _sizeProbes[AIO4C_PROBE_MAX_SIZE_TYPE];
+volatile unsigned int AIO4C_STATS_PROBES = (AIO4C_ENABLE_STATS ? AIO4C_PROBE_CATEGORY_ALL : AIO4C_PROBE_CATEGORY_NONE);
+int AIO4C_STATS_SIGNAL = 0;
+
+char* ProbeCategoryString[AIO4C_PROBE_MAX_CATEGORY] = {
+    "memory",
+    "buffer",
+    "network",
+    "process",
+    "thread",
+    "latency",
+    "jni",
+    "connection"
+};
+
+static Thread*              _statsThread = NULL;
+static FILE*                _statsFile = NULL;
+static StatsShard* volatile _statsShards = NULL;
+static __thread StatsShard* _statsShard = NULL;
+/* categories restored when probes are toggled back on by signal */
+static volatile unsigned int _statsSignalProbes = AIO4C_PROBE_CATEGORY_ALL;
+/* histograms summed at the previous sample, and the summaries of the values probed since */
+static long long            _statsHistograms[AIO4C_TIME_MAX_PROBE_TYPE][AIO4C_STATS_HISTOGRAM_BUCKETS];
+static long long            _statsSampled[AIO4C_TIME_MAX_PROBE_TYPE][AIO4C_STATS_HISTOGRAM_BUCKETS];
+static ProbeTimeSummary     _statsIntervals[AIO4C_TIME_MAX_PROBE_TYPE];
 #ifndef AIO4C_WIN32
-static pthread_mutex_t  _timeProbesLock;
-static pthread_mutex_t  _sizeProbesLock;
+static pthread_mutex_t      _statsLock;
 #else /* AIO4C_WIN32 */
-static CRITICAL_SECTION _timeProbesLock;
-static CRITICAL_SECTION _sizeProbesLock;
+static CRITICAL_SECTION     _statsLock;
 #endif /* AIO4C_WIN32 */
 
+char* ProbeTimeTypeString[AIO4C_TIME_MAX_PROBE_TYPE] = {
+    "MEMORY ALLOCATION",
+    "BUFFER ALLOCATION",
+    "NETWORK READ",
+    "NETWORK WRITE",
+    "SELECT OVERHEAD",
+    "DATA PROCESS",
+    "BLOCK",
+    "IDLE",
+    "LATENCY",
+    "JNI OVERHEAD"
+};
+
 static bool _statsInit(ThreadData dummy __attribute__((unused))) {
 #ifndef AIO4C_WIN32
     pid_t pid = getpid();
@@ -69,6 +114,7 @@ static bool _statsInit(ThreadData dummy __attribute__((unused))) {
 #endif /* AIO4C_WIN32 */
 
     char filename[128];
+    int i = 0;
 
     if (AIO4C_STATS_OUTPUT_FILE == NULL) {
         memset(filename, 0, 128);
@@ -79,7 +125,13 @@ static bool _statsInit(ThreadData dummy __attribute__((unused))) {
     _statsFile = fopen(AIO4C_STATS_OUTPUT_FILE, "w");
 
     if (_statsFile != NULL) {
-        fprintf(_statsFile, "TIME (s);ALLOCATED MEMORY (kb);READ DATA (kb/s);WRITTEN DATA (kb/s);PROCESSED DATA (kb/s);CONNECTIONS;IDLE TIME (ms);LATENCY (ms);SELECT OVERHEAD (ms)\n");
+        fprintf(_statsFile, "TIME (s);ALLOCATED MEMORY (kb);READ DATA (kb/s);WRITTEN DATA (kb/s);PROCESSED DATA (kb/s);CONNECTIONS;IDLE TIME (ms);LATENCY (ms);SELECT OVERHEAD (ms)");
+        for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+            fprintf(_statsFile, ";%s COUNT;%s MIN (us);%s P50 (us);%s P90 (us);%s P99 (us);%s P99.9 (us);%s MAX (us)",
+                    ProbeTimeTypeString[i], ProbeTimeTypeString[i], ProbeTimeTypeString[i], ProbeTimeTypeString[i],
+                    ProbeTimeTypeString[i], ProbeTimeTypeString[i], ProbeTimeTypeString[i]);
+        }
+        fprintf(_statsFile, "\n");
     } else {
         Log(AIO4C_LOG_LEVEL_WARN, "cannot open stat file %s for writing: %s\n", AIO4C_STATS_OUTPUT_FILE, strerror(errno));
         return false;
@@ -88,13 +140,17 @@ static bool _statsInit(ThreadData dummy __attribute__((unused))) {
     return true;
 }
 
-void _PrintStats(void);
+void _PrintStats(bool interval);
 
 void _WriteStats(void);
 
+static void _StatsSample(bool running);
+
 static bool _statsRun(ThreadData dummy __attribute__((unused))) {
+    _StatsSample(true);
+
     if (AIO4C_STATS_ENABLE_PERIODIC_OUTPUT) {
-        _PrintStats();
+        _PrintStats(true);
     }
 
     if (_statsFile != NULL) {
@@ -116,18 +172,322 @@ static void _statsExit(ThreadData dummy __attribute__((unused))) {
     }
 }
 
+static StatsShard* _StatsShardAcquire(void) {
+    StatsShard* shard = NULL;
+    void* block = NULL;
+
+    /* shards left by exited threads are reused, keeping their counts */
+    for (shard = _statsShards; shard != NULL; shard = shard->next) {
+        if (!shard->owned && AtomicCompareAndSwap(&shard->owned, false, true)) {
+            return shard;
+        }
+    }
+
+    /* not allocated with aio4c_malloc, which is probed itself */
+    if ((block = calloc(1, sizeof(StatsShard) + AIO4C_STATS_CACHE_LINE_SIZE)) == NULL) {
+        return NULL;
+    }
+
+    /* each shard starts its own cache lines, so that no two threads write to the same one */
+    shard = (StatsShard*)(((uintptr_t)block + AIO4C_STATS_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(AIO4C_STATS_CACHE_LINE_SIZE - 1));
+    shard->owned = true;
+
+    do {
+        shard->next = _statsShards;
+    } while (!AtomicCompareAndSwap(&_statsShards, shard->next, shard));
+
+    return shard;
+}
+
+int StatsBucket(long long value) {
+    int msb = 0;
+
+    if (value < (2 << AIO4C_STATS_HISTOGRAM_SUB_BITS)) {
+        return (value > 0) ? (int)value : 0;
+    }
+
+    if (value >= (1LL << AIO4C_STATS_HISTOGRAM_MAX_BITS)) {
+        return AIO4C_STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    /* each power of two is split in linear sub buckets, keeping the relative error bounded */
+    msb = 63 - __builtin_clzll((unsigned long long)value);
+
+    return ((msb - AIO4C_STATS_HISTOGRAM_SUB_BITS + 1) << AIO4C_STATS_HISTOGRAM_SUB_BITS) +
+        (int)((value >> (msb - AIO4C_STATS_HISTOGRAM_SUB_BITS)) & ((1 << AIO4C_STATS_HISTOGRAM_SUB_BITS) - 1));
+}
+
+long long StatsBucketHighest(int bucket) {
+    int msb = 0;
+    long long sub = 0;
+
+    if (bucket < (2 << AIO4C_STATS_HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+
+    msb = (bucket >> AIO4C_STATS_HISTOGRAM_SUB_BITS) + AIO4C_STATS_HISTOGRAM_SUB_BITS - 1;
+    sub = bucket & ((1 << AIO4C_STATS_HISTOGRAM_SUB_BITS) - 1);
+
+    return (1LL << msb) + ((sub + 1) << (msb - AIO4C_STATS_HISTOGRAM_SUB_BITS)) - 1;
+}
+
+static long long _StatsBucketLowest(int bucket) {
+    if (bucket < (2 << AIO4C_STATS_HISTOGRAM_SUB_BITS)) {
+        return bucket;
+    }
+
+    return StatsBucketHighest(bucket - 1) + 1;
+}
+
+void StatsSummarize(long long* buckets, ProbeTimeSummary* summary) {
+    long long ranks[4] = { 0, 0, 0, 0 };
+    long long* values[4] = { &summary->p50, &summary->p90, &summary->p99, &summary->p999 };
+    int permille[4] = { 500, 900, 990, 999 };
+    long long seen = 0;
+    int i = 0, next = 0;
+
+    memset(summary, 0, sizeof(ProbeTimeSummary));
+
+    for (i = 0; i < AIO4C_STATS_HISTOGRAM_BUCKETS; i++) {
+        summary->count += buckets[i];
+    }
+
+    if (summary->count <= 0) {
+        return;
+    }
+
+    for (i = 0; i < 4; i++) {
+        ranks[i] = (summary->count * permille[i] + 999) / 1000;
+    }
+
+    /* percentiles are reported as the highest value of their bucket */
+    for (i = 0; i < AIO4C_STATS_HISTOGRAM_BUCKETS; i++) {
+        if (buckets[i] <= 0) {
+            continue;
+        }
+
+        if (seen == 0) {
+            summary->min = _StatsBucketLowest(i);
+        }
+
+        seen += buckets[i];
+
+        while (next < 4 && seen >= ranks[next]) {
+            *values[next++] = StatsBucketHighest(i);
+        }
+
+        summary->max = StatsBucketHighest(i);
+    }
+}
+
+static void _StatsCollect(double* timeProbes, double* sizeProbes, long long (*histograms)[AIO4C_STATS_HISTOGRAM_BUCKETS]) {
+    StatsShard* shard = NULL;
+    int i = 0, j = 0;
+
+    memset(timeProbes, 0, AIO4C_TIME_MAX_PROBE_TYPE * sizeof(double));
+    memset(sizeProbes, 0, AIO4C_PROBE_MAX_SIZE_TYPE * sizeof(double));
+
+    if (histograms != NULL) {
+        memset(histograms, 0, AIO4C_TIME_MAX_PROBE_TYPE * sizeof(*histograms));
+    }
+
+    for (shard = _statsShards; shard != NULL; shard = shard->next) {
+        for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+            timeProbes[i] += (double)shard->timeProbes[i];
+        }
+        for (i = 0; i < AIO4C_PROBE_MAX_SIZE_TYPE; i++) {
+            sizeProbes[i] += (double)shard->sizeProbes[i];
+        }
+        for (i = 0; histograms != NULL && i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+            for (j = 0; j < AIO4C_STATS_HISTOGRAM_BUCKETS; j++) {
+                histograms[i][j] += shard->histograms[i][j];
+            }
+        }
+    }
+}
+
+static void _StatsSample(bool running) {
+    double timeProbes[AIO4C_TIME_MAX_PROBE_TYPE];
+    double sizeProbes[AIO4C_PROBE_MAX_SIZE_TYPE];
+    long long times[AIO4C_TIME_MAX_PROBE_TYPE];
+    long long sizes[AIO4C_PROBE_MAX_SIZE_TYPE];
+    long long delta[AIO4C_STATS_HISTOGRAM_BUCKETS];
+    int i = 0, j = 0;
+
+#ifndef AIO4C_WIN32
+    pthread_mutex_lock(&_statsLock);
+#else /* AIO4C_WIN32 */
+    EnterCriticalSection(&_statsLock);
+#endif /* AIO4C_WIN32 */
+
+    _StatsCollect(timeProbes, sizeProbes, _statsSampled);
+
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        for (j = 0; j < AIO4C_STATS_HISTOGRAM_BUCKETS; j++) {
+            delta[j] = _statsSampled[i][j] - _statsHistograms[i][j];
+            _statsHistograms[i][j] = _statsSampled[i][j];
+        }
+        StatsSummarize(delta, &_statsIntervals[i]);
+        times[i] = (long long)timeProbes[i];
+    }
+
+    for (i = 0; i < AIO4C_PROBE_MAX_SIZE_TYPE; i++) {
+        sizes[i] = (long long)sizeProbes[i];
+    }
+
+    StatsSegmentPublish(times, sizes, _statsSampled, running);
+
+#ifndef AIO4C_WIN32
+    pthread_mutex_unlock(&_statsLock);
+#else /* AIO4C_WIN32 */
+    LeaveCriticalSection(&_statsLock);
+#endif /* AIO4C_WIN32 */
+}
+
+bool StatsGetTimeSummary(ProbeTimeType type, ProbeTimeSummary* summary, bool interval) {
+    long long buckets[AIO4C_STATS_HISTOGRAM_BUCKETS];
+    StatsShard* shard = NULL;
+    int i = 0;
+
+    if (type < 0 || type >= AIO4C_TIME_MAX_PROBE_TYPE || summary == NULL) {
+        return false;
+    }
+
+    /* intervals are only sampled by the stats thread */
+    if (interval) {
+#ifndef AIO4C_WIN32
+        pthread_mutex_lock(&_statsLock);
+#else /* AIO4C_WIN32 */
+        EnterCriticalSection(&_statsLock);
+#endif /* AIO4C_WIN32 */
+        memcpy(summary, &_statsIntervals[type], sizeof(ProbeTimeSummary));
+#ifndef AIO4C_WIN32
+        pthread_mutex_unlock(&_statsLock);
+#else /* AIO4C_WIN32 */
+        LeaveCriticalSection(&_statsLock);
+#endif /* AIO4C_WIN32 */
+        return true;
+    }
+
+    memset(buckets, 0, sizeof(buckets));
+
+    for (shard = _statsShards; shard != NULL; shard = shard->next) {
+        for (i = 0; i < AIO4C_STATS_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] += shard->histograms[type][i];
+        }
+    }
+
+    StatsSummarize(buckets, summary);
+
+    return true;
+}
+
+long long StatsGetSize(ProbeSizeType type) {
+    StatsShard* shard = NULL;
+    long long size = 0;
+
+    if (type < 0 || type >= AIO4C_PROBE_MAX_SIZE_TYPE) {
+        return 0;
+    }
+
+    for (shard = _statsShards; shard != NULL; shard = shard->next) {
+        size += (long long)shard->sizeProbes[type];
+    }
+
+    return size;
+}
+
+void StatsEnable(unsigned int categories) {
+    AtomicOr(&AIO4C_STATS_PROBES, categories & AIO4C_PROBE_CATEGORY_ALL);
+}
+
+void StatsDisable(unsigned int categories) {
+    AtomicAnd(&AIO4C_STATS_PROBES, ~categories);
+}
+
+unsigned int StatsParseCategories(char* categories) {
+    unsigned int mask = AIO4C_PROBE_CATEGORY_NONE;
+    char* name = categories;
+    char* endptr = NULL;
+    long value = 0;
+    size_t length = 0;
+    int i = 0;
+
+    value = strtol(categories, &endptr, 0);
+    if (endptr != categories && *endptr == '\0' && value >= 0 && value < INT_MAX) {
+        return (unsigned int)value & AIO4C_PROBE_CATEGORY_ALL;
+    }
+
+    while (name != NULL && *name != '\0') {
+        endptr = strchr(name, ',');
+        length = (endptr != NULL) ? (size_t)(endptr - name) : strlen(name);
+
+        if (length == 3 && strncmp(name, "all", length) == 0) {
+            mask |= AIO4C_PROBE_CATEGORY_ALL;
+        }
+
+        for (i = 0; i < AIO4C_PROBE_MAX_CATEGORY; i++) {
+            if (strlen(ProbeCategoryString[i]) == length && strncmp(name, ProbeCategoryString[i], length) == 0) {
+                mask |= (1u << i);
+            }
+        }
+
+        name = (endptr != NULL) ? endptr + 1 : NULL;
+    }
+
+    return mask;
+}
+
+#ifndef AIO4C_WIN32
+static void _StatsSignalHandler(int signum __attribute__((unused))) {
+    unsigned int probes = AtomicGet(&AIO4C_STATS_PROBES);
+
+    if (probes != AIO4C_PROBE_CATEGORY_NONE) {
+        _statsSignalProbes = probes;
+        StatsDisable(AIO4C_PROBE_CATEGORY_ALL);
+    } else {
+        StatsEnable(_statsSignalProbes);
+    }
+}
+#endif /* AIO4C_WIN32 */
+
 void StatsInit(void) {
-    memset(_timeProbes, 0, AIO4C_TIME_MAX_PROBE_TYPE * sizeof(double));
-    memset(_sizeProbes, 0, AIO4C_PROBE_MAX_SIZE_TYPE * sizeof(double));
+#ifndef AIO4C_WIN32
+    struct sigaction action;
+#endif /* AIO4C_WIN32 */
+
+    memset(_statsHistograms, 0, sizeof(_statsHistograms));
+    memset(_statsIntervals, 0, sizeof(_statsIntervals));
 
 #ifndef AIO4C_WIN32
-    pthread_mutex_init(&_timeProbesLock, NULL);
-    pthread_mutex_init(&_sizeProbesLock, NULL);
+    pthread_mutex_init(&_statsLock, NULL);
 #else /* AIO4C_WIN32 */
-    InitializeCriticalSection(&_timeProbesLock);
-    InitializeCriticalSection(&_sizeProbesLock);
+    InitializeCriticalSection(&_statsLock);
 #endif /* AIO4C_WIN32 */
 
+#ifndef AIO4C_WIN32
+    if (AIO4C_STATS_SIGNAL > 0) {
+        memset(&action, 0, sizeof(struct sigaction));
+        action.sa_handler = _StatsSignalHandler;
+#ifdef SA_RESTART
+        action.sa_flags = SA_RESTART;
+#endif /* SA_RESTART */
+        sigemptyset(&action.sa_mask);
+
+        if (sigaction(AIO4C_STATS_SIGNAL, &action, NULL) != 0) {
+            Log(AIO4C_LOG_LEVEL_WARN, "cannot toggle statistics with signal %d: %s", AIO4C_STATS_SIGNAL, strerror(errno));
+        }
+    }
+#endif /* AIO4C_WIN32 */
+
+    /* a segment is only useful if it is updated, the metrics endpoint serves its snapshots */
+    if (AIO4C_STATS_SEGMENT != NULL || AIO4C_METRICS_PORT > 0) {
+        if (!AIO4C_STATS_INTERVAL) {
+            AIO4C_STATS_INTERVAL = 1;
+        }
+        StatsSegmentCreate(AIO4C_STATS_SEGMENT, AIO4C_STATS_INTERVAL);
+    }
+
     _statsThread = NULL;
     if (AIO4C_STATS_INTERVAL) {
         _statsThread = NewThread("stats",
@@ -142,52 +502,43 @@ void StatsInit(void) {
     }
 }
 
-void _ProbeTime(ProbeTimeType type, struct timeval* start, struct timeval* stop) {
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
+void _ProbeTime(ProbeTimeType type, aio4c_clock_t start, aio4c_clock_t stop) {
+    long long elapsed = ClockElapsed(start, stop) / 1000LL;
 
-    _timeProbes[type] += (double)(stop->tv_sec - start->tv_sec) * 1000000.0 + (double)(stop->tv_usec - start->tv_usec);
+    if (_statsShard == NULL && (_statsShard = _StatsShardAcquire()) == NULL) {
+        return;
+    }
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
+    _statsShard->timeProbes[type] += elapsed;
+    _statsShard->histograms[type][StatsBucket(elapsed)]++;
 }
 
 void _ProbeSize(ProbeSizeType type, int size) {
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
+    if (_statsShard == NULL && (_statsShard = _StatsShardAcquire()) == NULL) {
+        return;
+    }
 
-    _sizeProbes[type] += (double)size;
+    _statsShard->sizeProbes[type] += size;
+}
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
+void StatsThreadExit(void) {
+    if (_statsShard != NULL) {
+        _statsShard->owned = false;
+        _statsShard = NULL;
+    }
 }
 
 static double _elapsedTime(void) {
-    static struct timeval _start;
+    static aio4c_clock_t _start = 0;
     static bool _initialized = false;
-    struct timeval _stop;
     double result = 0.0;
 
     if (!_initialized) {
-        gettimeofday(&_start, NULL);
+        _start = ClockNow();
         _initialized = true;
     }
 
-    gettimeofday(&_stop, NULL);
-
-    result = (double)(_stop.tv_sec - _start.tv_sec) * 1000000.0 + (double)(_stop.tv_usec - _start.tv_usec);
+    result = (double)ClockElapsed(_start, ClockNow()) / 1000.0;
 
     if (GetNumThreads() > 0) {
         result *= GetNumThreads();
@@ -233,87 +584,65 @@ static void _ConvertSize(double size, double* result, char** unit) {
     *unit = "tb";
 }
 
-static void _ptimes(char* label, ProbeTimeType tType) {
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
-
-    pstats("=== %s: %.3f s [%.3f%%]\n", label, _timeProbes[tType] / 1000000.0,
-            _timeProbes[tType] * 100.0 / _elapsedTime());
-
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
+static void _ptimes(char* label, double* timeProbes, ProbeTimeType tType) {
+    pstats("=== %s: %.3f s [%.3f%%]\n", label, timeProbes[tType] / 1000000.0,
+            timeProbes[tType] * 100.0 / _elapsedTime());
 }
 
-static void _pstats(char* label, ProbeTimeType tType, ProbeSizeType sType) {
+static void _pstats(char* label, double* timeProbes, double* sizeProbes, ProbeTimeType tType, ProbeSizeType sType) {
     double size = 0.0;
     char* unit = NULL;
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
+    _ConvertSize(sizeProbes[sType], &size, &unit);
 
-    _ConvertSize(_sizeProbes[sType], &size, &unit);
+    pstats("=== %s: %.3f %s in %.3f s [%.3f%%]\n", label, size, unit,
+            timeProbes[tType] / 1000000.0,
+            timeProbes[tType] * 100.0 / _elapsedTime());
+}
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_sizeProbesLock);
-    pthread_mutex_lock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_sizeProbesLock);
-    EnterCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
+static void _psummary(ProbeTimeType tType, bool interval) {
+    ProbeTimeSummary summary;
 
-    pstats("=== %s: %.3f %s in %.3f s [%.3f%%]\n", label, size, unit,
-            _timeProbes[tType] / 1000000.0,
-            _timeProbes[tType] * 100.0 / _elapsedTime());
+    StatsGetTimeSummary(tType, &summary, interval);
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
+    if (summary.count == 0) {
+        return;
+    }
+
+    pstats("=== %-17s: %lld probes, min %lld us, p50 %lld us, p90 %lld us, p99 %lld us, p99.9 %lld us, max %lld us\n",
+            ProbeTimeTypeString[tType], summary.count, summary.min, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
 }
 
-void _PrintStats(void) {
+void _PrintStats(bool interval) {
     static double lastAlloc = 0.0, lastFree = 0.0;
     long _alloc = 0L, _free = 0L;
+    double timeProbes[AIO4C_TIME_MAX_PROBE_TYPE];
+    double sizeProbes[AIO4C_PROBE_MAX_SIZE_TYPE];
+    int i = 0;
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
+    _StatsCollect(timeProbes, sizeProbes, NULL);
 
-    _alloc = (long)_sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATE_COUNT] - lastAlloc;
-    lastAlloc = _sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATE_COUNT];
-    _free = (long)_sizeProbes[AIO4C_PROBE_MEMORY_FREE_COUNT] - lastFree;
-    lastFree = _sizeProbes[AIO4C_PROBE_MEMORY_FREE_COUNT];
-
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
+    _alloc = (long)sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATE_COUNT] - lastAlloc;
+    lastAlloc = sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATE_COUNT];
+    _free = (long)sizeProbes[AIO4C_PROBE_MEMORY_FREE_COUNT] - lastFree;
+    lastFree = sizeProbes[AIO4C_PROBE_MEMORY_FREE_COUNT];
 
      pstats("================= STATISTICS ===================%c", '\n');
-    _pstats("ALLOCATED MEMORY ", AIO4C_TIME_PROBE_MEMORY_ALLOCATION, AIO4C_PROBE_MEMORY_ALLOCATED_SIZE);
-    _pstats("ALLOCATED BUFFERS", AIO4C_TIME_PROBE_BUFFER_ALLOCATION, AIO4C_PROBE_BUFFER_ALLOCATED_SIZE);
+    _pstats("ALLOCATED MEMORY ", timeProbes, sizeProbes, AIO4C_TIME_PROBE_MEMORY_ALLOCATION, AIO4C_PROBE_MEMORY_ALLOCATED_SIZE);
+    _pstats("ALLOCATED BUFFERS", timeProbes, sizeProbes, AIO4C_TIME_PROBE_BUFFER_ALLOCATION, AIO4C_PROBE_BUFFER_ALLOCATED_SIZE);
     pstats("=== MEMORY ALLOCATION: %ld allocations, %ld frees\n", _alloc, _free);
-    _pstats("NETWORK READ     ", AIO4C_TIME_PROBE_NETWORK_READ, AIO4C_PROBE_NETWORK_READ_SIZE);
-    _pstats("NETWORK WRITE    ", AIO4C_TIME_PROBE_NETWORK_WRITE, AIO4C_PROBE_NETWORK_WRITE_SIZE);
-    _pstats("PROCESSED DATA   ", AIO4C_TIME_PROBE_DATA_PROCESS, AIO4C_PROBE_PROCESSED_DATA_SIZE);
-    _pstats("LATENCY          ", AIO4C_TIME_PROBE_LATENCY, AIO4C_PROBE_LATENCY_COUNT);
-    _ptimes("IDLE TIME        ", AIO4C_TIME_PROBE_IDLE);
-    _ptimes("BLOCKED TIME     ", AIO4C_TIME_PROBE_BLOCK);
-    _ptimes("JNI OVERHEAD     ", AIO4C_TIME_PROBE_JNI_OVERHEAD);
+    _pstats("NETWORK READ     ", timeProbes, sizeProbes, AIO4C_TIME_PROBE_NETWORK_READ, AIO4C_PROBE_NETWORK_READ_SIZE);
+    _pstats("NETWORK WRITE    ", timeProbes, sizeProbes, AIO4C_TIME_PROBE_NETWORK_WRITE, AIO4C_PROBE_NETWORK_WRITE_SIZE);
+    _pstats("PROCESSED DATA   ", timeProbes, sizeProbes, AIO4C_TIME_PROBE_DATA_PROCESS, AIO4C_PROBE_PROCESSED_DATA_SIZE);
+    _pstats("LATENCY          ", timeProbes, sizeProbes, AIO4C_TIME_PROBE_LATENCY, AIO4C_PROBE_LATENCY_COUNT);
+    _ptimes("IDLE TIME        ", timeProbes, AIO4C_TIME_PROBE_IDLE);
+    _ptimes("BLOCKED TIME     ", timeProbes, AIO4C_TIME_PROBE_BLOCK);
+    _ptimes("JNI OVERHEAD     ", timeProbes, AIO4C_TIME_PROBE_JNI_OVERHEAD);
      pstats("=== RUNNING THREADS  : %d\n", GetNumThreads());
+     pstats("=== PERCENTILES %s\n", interval ? "(INTERVAL)" : "(CUMULATIVE)");
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        _psummary(i, interval);
+    }
      pstats("=================    END     ===================%c", '\n');
 }
 
@@ -325,6 +654,10 @@ void _WriteStats(void) {
     struct timeval time;
     static double lastRead = 0.0, lastWrite = 0.0, lastProcess = 0.0, lastIdle = 0.0, lastLatency = 0.0, lastLatencyCount = 0.0, lastSelectOverhead = 0.0;
     double read = 0.0, write = 0.0, process = 0.0, idle = 0.0, allocated = 0.0, connections = 0.0, latency = 0.0, latencyCount = 0.0, selectOverhead = 0.0;
+    double timeProbes[AIO4C_TIME_MAX_PROBE_TYPE];
+    double sizeProbes[AIO4C_PROBE_MAX_SIZE_TYPE];
+    ProbeTimeSummary summary;
+    int i = 0;
 
     if (_statsFile == NULL) {
         return;
@@ -337,44 +670,38 @@ void _WriteStats(void) {
 
     gettimeofday(&time, NULL);
 
-#ifndef AIO4C_WIN32
-    pthread_mutex_lock(&_timeProbesLock);
-    pthread_mutex_lock(&_sizeProbesLock);
-#else /* AIO4C_WIN32 */
-    EnterCriticalSection(&_timeProbesLock);
-    EnterCriticalSection(&_sizeProbesLock);
-#endif /* AIO4C_WIN32 */
-
-    read =  _sizeProbes[AIO4C_PROBE_NETWORK_READ_SIZE] - lastRead;
-    lastRead = _sizeProbes[AIO4C_PROBE_NETWORK_READ_SIZE];
-    write = _sizeProbes[AIO4C_PROBE_NETWORK_WRITE_SIZE] - lastWrite;
-    lastWrite = _sizeProbes[AIO4C_PROBE_NETWORK_WRITE_SIZE];
-    process = _sizeProbes[AIO4C_PROBE_PROCESSED_DATA_SIZE] - lastProcess;
-    lastProcess = _sizeProbes[AIO4C_PROBE_PROCESSED_DATA_SIZE];
-    latencyCount = _sizeProbes[AIO4C_PROBE_LATENCY_COUNT] - lastLatencyCount;
-    lastLatencyCount = _sizeProbes[AIO4C_PROBE_LATENCY_COUNT];
-    idle = _timeProbes[AIO4C_TIME_PROBE_IDLE] - lastIdle;
-    lastIdle = _timeProbes[AIO4C_TIME_PROBE_IDLE];
-    allocated = _sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATED_SIZE];
-    connections = _sizeProbes[AIO4C_PROBE_CONNECTION_COUNT];
-    latency = _timeProbes[AIO4C_TIME_PROBE_LATENCY] - lastLatency;
-    lastLatency = _timeProbes[AIO4C_TIME_PROBE_LATENCY];
-    selectOverhead = _timeProbes[AIO4C_TIME_PROBE_SELECT_OVERHEAD] - lastSelectOverhead;
-    lastSelectOverhead = _timeProbes[AIO4C_TIME_PROBE_SELECT_OVERHEAD];
-
-#ifndef AIO4C_WIN32
-    pthread_mutex_unlock(&_sizeProbesLock);
-    pthread_mutex_unlock(&_timeProbesLock);
-#else /* AIO4C_WIN32 */
-    LeaveCriticalSection(&_sizeProbesLock);
-    LeaveCriticalSection(&_timeProbesLock);
-#endif /* AIO4C_WIN32 */
-
-    fprintf(_statsFile, "%u;%d,%d;%d,%d;%d,%d;%d,%d;%d;%d,%d;%d,%d;%d,%d\n", (unsigned int)(time.tv_sec - _start.tv_sec),
+    _StatsCollect(timeProbes, sizeProbes, NULL);
+
+    read =  sizeProbes[AIO4C_PROBE_NETWORK_READ_SIZE] - lastRead;
+    lastRead = sizeProbes[AIO4C_PROBE_NETWORK_READ_SIZE];
+    write = sizeProbes[AIO4C_PROBE_NETWORK_WRITE_SIZE] - lastWrite;
+    lastWrite = sizeProbes[AIO4C_PROBE_NETWORK_WRITE_SIZE];
+    process = sizeProbes[AIO4C_PROBE_PROCESSED_DATA_SIZE] - lastProcess;
+    lastProcess = sizeProbes[AIO4C_PROBE_PROCESSED_DATA_SIZE];
+    latencyCount = sizeProbes[AIO4C_PROBE_LATENCY_COUNT] - lastLatencyCount;
+    lastLatencyCount = sizeProbes[AIO4C_PROBE_LATENCY_COUNT];
+    idle = timeProbes[AIO4C_TIME_PROBE_IDLE] - lastIdle;
+    lastIdle = timeProbes[AIO4C_TIME_PROBE_IDLE];
+    allocated = sizeProbes[AIO4C_PROBE_MEMORY_ALLOCATED_SIZE];
+    connections = sizeProbes[AIO4C_PROBE_CONNECTION_COUNT];
+    latency = timeProbes[AIO4C_TIME_PROBE_LATENCY] - lastLatency;
+    lastLatency = timeProbes[AIO4C_TIME_PROBE_LATENCY];
+    selectOverhead = timeProbes[AIO4C_TIME_PROBE_SELECT_OVERHEAD] - lastSelectOverhead;
+    lastSelectOverhead = timeProbes[AIO4C_TIME_PROBE_SELECT_OVERHEAD];
+
+    fprintf(_statsFile, "%u;%d,%d;%d,%d;%d,%d;%d,%d;%d;%d,%d;%d,%d;%d,%d", (unsigned int)(time.tv_sec - _start.tv_sec),
             floatWithComma(allocated / 1024.0),
             floatWithComma(read / 1024.0), floatWithComma(write / 1024.0), floatWithComma(process / 1024.0), (int)connections,
             floatWithComma(idle / 1000.0), floatWithComma(latencyCount>0?(latency / 1000.0 / latencyCount):0.0),
             floatWithComma(selectOverhead>0.0?(selectOverhead / 1000.0 / write):0.0));
+
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        StatsGetTimeSummary(i, &summary, true);
+        fprintf(_statsFile, ";%lld;%lld;%lld;%lld;%lld;%lld;%lld", summary.count, summary.min,
+                summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+    }
+
+    fprintf(_statsFile, "\n");
 }
 
 void StatsEnd(void) {
@@ -382,9 +709,11 @@ void StatsEnd(void) {
         ThreadStop(_statsThread);
         ThreadJoin(_statsThread);
     }
+    if (StatsSegmentGet() != NULL) {
+        _StatsSample(false);
+        StatsSegmentDestroy();
+    }
     if (AIO4C_STATS_ENABLE_PERIODIC_OUTPUT) {
-        _PrintStats();
+        _PrintStats(false);
     }
 }
-
-#endif /* AIO4C_ENABLE_STATS */
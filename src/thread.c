@@ -21,6 +21,10 @@
  * Aio4c    <http://aio4c.so>.   If   not,   see
  * <http://www.gnu.org/licenses/>.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif /* _GNU_SOURCE */
+
 #include <aio4c/thread.h>
 
 #include <aio4c/alloc.h>
@@ -34,13 +38,24 @@
 #ifndef AIO4C_WIN32
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif /* __linux__ */
 #else /* AIO4C_WIN32 */
 #include <winbase.h>
 #endif /* AIO4C_WIN32 */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(SYS_getcpu) && defined(SYS_set_mempolicy)
+/* from linux/mempolicy.h, not always installed with the C library headers */
+#define AIO4C_MPOL_PREFERRED 1
+#endif /* SYS_getcpu && SYS_set_mempolicy */
+
 struct s_Thread {
     char*                name;
 #ifndef AIO4C_WIN32
@@ -58,8 +73,17 @@ struct s_Thread {
     ThreadRoutine        run;
     ThreadFinalization   exit;
     ThreadData           arg;
+    ThreadPolicy         policy;
 };
 
+char* AIO4C_THREAD_CPUS = NULL;
+
+bool AIO4C_THREAD_LOCAL_MEMORY = false;
+
+int AIO4C_THREAD_PRIORITY = 0;
+
+bool AIO4C_THREAD_LOCK_MEMORY = false;
+
 
 char* ThreadStateString[AIO4C_THREAD_STATE_MAX] = {
     "NONE",
@@ -95,6 +119,10 @@ static void _ThreadCleanup(Thread* thread) {
         thread->exit(thread->arg);
     }
 
+    MemoryFlush();
+
+    StatsThreadExit();
+
     thread->state = AIO4C_THREAD_STATE_EXITED;
 
     _numThreadsRunning--;
@@ -116,7 +144,118 @@ static void _ThreadCleanup(Thread* thread) {
 #endif /* AIO4C_WIN32 */
 }
 
+static int _ThreadPolicyCpus(ThreadPolicy* policy, int* cpus) {
+    int cpu = 0;
+    int count = 0;
+
+    for (cpu = 0; cpu < AIO4C_THREAD_MAX_CPUS; cpu++) {
+        if (policy->cpus[cpu / 8] & (1 << (cpu % 8))) {
+            if (cpus != NULL) {
+                cpus[count] = cpu;
+            }
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static void _ThreadApplyPolicy(Thread* thread) {
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    ThreadPolicy* policy = &thread->policy;
+    int cpu = 0;
+    int nbCpus = 0;
+#ifndef AIO4C_WIN32
+#ifdef AIO4C_HAVE_AFFINITY
+    cpu_set_t set;
+#endif /* AIO4C_HAVE_AFFINITY */
+#ifdef AIO4C_MPOL_PREFERRED
+    unsigned int current = 0;
+    unsigned int node = 0;
+    unsigned long nodes = 0;
+#endif /* AIO4C_MPOL_PREFERRED */
+    struct sched_param param;
+#else /* AIO4C_WIN32 */
+    DWORD_PTR mask = 0;
+#endif /* AIO4C_WIN32 */
+
+    code.thread = thread;
+
+    if ((nbCpus = _ThreadPolicyCpus(policy, NULL)) > 0) {
+#ifndef AIO4C_WIN32
+#ifdef AIO4C_HAVE_AFFINITY
+        CPU_ZERO(&set);
+
+        for (cpu = 0; cpu < AIO4C_THREAD_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (policy->cpus[cpu / 8] & (1 << (cpu % 8))) {
+                CPU_SET(cpu, &set);
+            }
+        }
+
+        /* pid 0 designates the calling thread, not the whole process */
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &set) != 0) {
+            code.error = errno;
+            Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_AFFINITY_ERROR, &code);
+        } else {
+            Log(AIO4C_LOG_LEVEL_DEBUG, "pinned to %d cpus", nbCpus);
+        }
+#else /* AIO4C_HAVE_AFFINITY */
+        Log(AIO4C_LOG_LEVEL_WARN, "cpu affinity not supported, thread %s not pinned", thread->name);
+#endif /* AIO4C_HAVE_AFFINITY */
+#else /* AIO4C_WIN32 */
+        for (cpu = 0; cpu < AIO4C_THREAD_MAX_CPUS && cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++) {
+            if (policy->cpus[cpu / 8] & (1 << (cpu % 8))) {
+                mask |= ((DWORD_PTR)1 << cpu);
+            }
+        }
+
+        if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+            code.source = AIO4C_ERRNO_SOURCE_SYS;
+            Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_AFFINITY_ERROR, &code);
+        }
+#endif /* AIO4C_WIN32 */
+    }
+
+    if (policy->localMemory) {
+#ifdef AIO4C_MPOL_PREFERRED
+        /* once pinned, the current cpu belongs to the node the thread will stay on */
+        if (syscall(SYS_getcpu, &current, &node, NULL) != 0) {
+            code.error = errno;
+            Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_MEMORY_POLICY_ERROR, &code);
+        } else if (node < sizeof(nodes) * 8) {
+            nodes = (1UL << node);
+            if (syscall(SYS_set_mempolicy, AIO4C_MPOL_PREFERRED, &nodes, sizeof(nodes) * 8) != 0) {
+                code.error = errno;
+                Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_MEMORY_POLICY_ERROR, &code);
+            } else {
+                Log(AIO4C_LOG_LEVEL_DEBUG, "allocating memory on node %u", node);
+            }
+        }
+#else /* AIO4C_MPOL_PREFERRED */
+        Log(AIO4C_LOG_LEVEL_WARN, "numa memory policy not supported, thread %s allocates anywhere", thread->name);
+#endif /* AIO4C_MPOL_PREFERRED */
+    }
+
+    if (policy->priority > 0) {
+#ifndef AIO4C_WIN32
+        memset(&param, 0, sizeof(struct sched_param));
+        param.sched_priority = policy->priority;
+
+        if ((code.error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) != 0) {
+            Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_SCHEDULING_ERROR, &code);
+        }
+#else /* AIO4C_WIN32 */
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) == 0) {
+            code.source = AIO4C_ERRNO_SOURCE_SYS;
+            Raise(AIO4C_LOG_LEVEL_WARN, AIO4C_THREAD_ERROR_TYPE, AIO4C_THREAD_SCHEDULING_ERROR, &code);
+        }
+#endif /* AIO4C_WIN32 */
+    }
+}
+
 static Thread* _runThread(Thread* thread) {
+    _ThreadApplyPolicy(thread);
+
     TakeLock(thread->lock);
 
 #ifndef AIO4C_WIN32
@@ -319,10 +458,106 @@ Thread* NewThread(char* name, ThreadInitialization initialize, ThreadRoutine rou
     thread->exit = finalize;
     thread->arg = data;
     thread->running = false;
+    memset(&thread->policy, 0, sizeof(ThreadPolicy));
 
     return thread;
 }
 
+bool ThreadPolicyAddCpus(ThreadPolicy* policy, char* cpus) {
+    ThreadPolicy parsed;
+    char* current = cpus;
+    char* endptr = NULL;
+    long first = 0;
+    long last = 0;
+    long cpu = 0;
+
+    if (cpus == NULL) {
+        return false;
+    }
+
+    memcpy(&parsed, policy, sizeof(ThreadPolicy));
+
+    while (*current != '\0') {
+        first = strtol(current, &endptr, 10);
+        if (endptr == current || first < 0 || first >= AIO4C_THREAD_MAX_CPUS) {
+            return false;
+        }
+
+        last = first;
+        current = endptr;
+
+        if (*current == '-') {
+            current++;
+            last = strtol(current, &endptr, 10);
+            if (endptr == current || last < first || last >= AIO4C_THREAD_MAX_CPUS) {
+                return false;
+            }
+            current = endptr;
+        }
+
+        for (cpu = first; cpu <= last; cpu++) {
+            parsed.cpus[cpu / 8] |= (1 << (cpu % 8));
+        }
+
+        if (*current == ',') {
+            current++;
+        } else if (*current != '\0') {
+            return false;
+        }
+    }
+
+    memcpy(policy, &parsed, sizeof(ThreadPolicy));
+
+    return true;
+}
+
+void ThreadPolicyForPipe(ThreadPolicy* policy, int pipe, int nbPipes) {
+    ThreadPolicy all;
+    int cpus[AIO4C_THREAD_MAX_CPUS];
+    int nbCpus = 0;
+    int first = 0;
+    int last = 0;
+    int i = 0;
+
+    memset(policy, 0, sizeof(ThreadPolicy));
+    memset(&all, 0, sizeof(ThreadPolicy));
+
+    policy->localMemory = AIO4C_THREAD_LOCAL_MEMORY;
+    policy->priority = AIO4C_THREAD_PRIORITY;
+
+    if (AIO4C_THREAD_CPUS == NULL || pipe < 0 || !ThreadPolicyAddCpus(&all, AIO4C_THREAD_CPUS)) {
+        return;
+    }
+
+    if ((nbCpus = _ThreadPolicyCpus(&all, cpus)) == 0) {
+        return;
+    }
+
+    if (nbPipes > 0 && nbCpus >= nbPipes) {
+        first = (pipe * nbCpus) / nbPipes;
+        last = ((pipe + 1) * nbCpus) / nbPipes;
+    } else {
+        first = pipe % nbCpus;
+        last = first + 1;
+    }
+
+    for (i = first; i < last; i++) {
+        policy->cpus[cpus[i] / 8] |= (1 << (cpus[i] % 8));
+    }
+}
+
+void ThreadSetPolicy(Thread* thread, ThreadPolicy* policy) {
+    if (policy != NULL) {
+        memcpy(&thread->policy, policy, sizeof(ThreadPolicy));
+    } else {
+        memset(&thread->policy, 0, sizeof(ThreadPolicy));
+    }
+}
+
+ThreadPolicy* ThreadGetPolicy(Thread* thread) {
+    return &thread->policy;
+}
+
 char* ThreadGetName(Thread* thread) {
     return thread->name;
 }
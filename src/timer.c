@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/timer.h>
+
+#include <aio4c/alloc.h>
+#include <aio4c/clock.h>
+#include <aio4c/error.h>
+#include <aio4c/list.h>
+#include <aio4c/lock.h>
+#include <aio4c/log.h>
+#include <aio4c/types.h>
+
+#ifndef AIO4C_WIN32
+#include <errno.h>
+#endif /* AIO4C_WIN32 */
+
+#include <limits.h>
+#include <string.h>
+
+#define AIO4C_TIMER_ROOT_BITS 8
+#define AIO4C_TIMER_ROOT_SIZE (1 << AIO4C_TIMER_ROOT_BITS)
+#define AIO4C_TIMER_ROOT_MASK (AIO4C_TIMER_ROOT_SIZE - 1)
+#define AIO4C_TIMER_LEVEL_BITS 6
+#define AIO4C_TIMER_LEVEL_SIZE (1 << AIO4C_TIMER_LEVEL_BITS)
+#define AIO4C_TIMER_LEVEL_MASK (AIO4C_TIMER_LEVEL_SIZE - 1)
+#define AIO4C_TIMER_SHIFT(level) ((level) == 0 ? 0 : AIO4C_TIMER_ROOT_BITS + ((level) - 1) * AIO4C_TIMER_LEVEL_BITS)
+#define AIO4C_TIMER_RANGE(level) ((aio4c_time_t)1 << (AIO4C_TIMER_ROOT_BITS + (level) * AIO4C_TIMER_LEVEL_BITS))
+#define AIO4C_TIMER_MAX_DELAY (AIO4C_TIMER_RANGE(AIO4C_TIMER_WHEEL_LEVELS - 1) - 1)
+
+struct s_Timer {
+    TimerWheel*   wheel;
+    aio4c_time_t  expire;
+    TimerCallback callback;
+    void*         source;
+    void*         arg;
+    unsigned int  generation;
+    int           level;
+    Timer**       list;
+    Timer*        prev;
+    Timer*        next;
+    Timer**       owner;
+    Timer*        ownerPrev;
+    Timer*        ownerNext;
+};
+
+struct s_TimerWheel {
+    Lock*        lock;
+    volatile aio4c_time_t current;
+    aio4c_time_t deadline;
+    bool         sleeping;
+    int          counts[AIO4C_TIMER_WHEEL_LEVELS];
+    Timer*       slots[AIO4C_TIMER_WHEEL_LEVELS][AIO4C_TIMER_ROOT_SIZE];
+    Timer*       expired;
+    Timer*       free;
+    List         batches;
+};
+
+TimerWheel* NewTimerWheel(void) {
+    TimerWheel* wheel = NULL;
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+
+    if ((wheel = aio4c_malloc(sizeof(TimerWheel))) == NULL) {
+#ifndef AIO4C_WIN32
+        code.error = errno;
+#else /* AIO4C_WIN32 */
+        code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+        code.size = sizeof(TimerWheel);
+        code.type = "TimerWheel";
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+        return NULL;
+    }
+
+    AIO4C_LIST_INITIALIZER(&wheel->batches);
+    wheel->lock     = NewLock();
+    wheel->current  = (ClockMicroseconds() / 1000) + 1;
+    wheel->sleeping = false;
+    wheel->expired  = NULL;
+    wheel->free     = NULL;
+
+    return wheel;
+}
+
+aio4c_time_t TimerWheelGetTime(TimerWheel* wheel) {
+    /* only the driving thread moves the time forward, a stale value is harmless */
+    return wheel->current - 1;
+}
+
+static bool _TimerWheelGrow(TimerWheel* wheel) {
+    Timer* batch = NULL;
+    Node* node = NULL;
+    ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
+    int i = 0;
+
+    if ((batch = aio4c_malloc(AIO4C_TIMER_BATCH_SIZE * sizeof(Timer))) == NULL) {
+#ifndef AIO4C_WIN32
+        code.error = errno;
+#else /* AIO4C_WIN32 */
+        code.source = AIO4C_ERRNO_SOURCE_SYS;
+#endif /* AIO4C_WIN32 */
+        code.size = AIO4C_TIMER_BATCH_SIZE * sizeof(Timer);
+        code.type = "Timer";
+        Raise(AIO4C_LOG_LEVEL_ERROR, AIO4C_ALLOC_ERROR_TYPE, AIO4C_ALLOC_ERROR, &code);
+        return false;
+    }
+
+    if ((node = NewNode(batch)) == NULL) {
+        aio4c_free(batch);
+        return false;
+    }
+
+    ListAddLast(&wheel->batches, node);
+
+    for (i = 0; i < AIO4C_TIMER_BATCH_SIZE; i++) {
+        batch[i].wheel = wheel;
+        batch[i].next  = wheel->free;
+        wheel->free    = &batch[i];
+    }
+
+    return true;
+}
+
+static void _TimerLink(Timer** list, Timer* timer) {
+    timer->list = list;
+    timer->prev = NULL;
+    timer->next = *list;
+
+    if (*list != NULL) {
+        (*list)->prev = timer;
+    }
+
+    *list = timer;
+}
+
+static void _TimerUnlink(Timer* timer) {
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        *timer->list = timer->next;
+    }
+
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+
+    if (timer->level >= 0) {
+        timer->wheel->counts[timer->level]--;
+    }
+
+    timer->list = NULL;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+static void _TimerPlace(TimerWheel* wheel, Timer* timer) {
+    aio4c_time_t expire = timer->expire;
+    aio4c_time_t delay = 0;
+    int level = 0, index = 0;
+
+    if (expire < wheel->current) {
+        expire = wheel->current;
+    }
+
+    delay = expire - wheel->current;
+
+    if (delay > AIO4C_TIMER_MAX_DELAY) {
+        /* kept in the last level, placed again when it is cascaded */
+        delay = AIO4C_TIMER_MAX_DELAY;
+        expire = wheel->current + delay;
+    }
+
+    for (level = 0; level < AIO4C_TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delay < AIO4C_TIMER_RANGE(level)) {
+            break;
+        }
+    }
+
+    if (level == 0) {
+        index = (int)(expire & AIO4C_TIMER_ROOT_MASK);
+    } else {
+        index = (int)((expire >> AIO4C_TIMER_SHIFT(level)) & AIO4C_TIMER_LEVEL_MASK);
+    }
+
+    timer->level = level;
+    wheel->counts[level]++;
+    _TimerLink(&wheel->slots[level][index], timer);
+}
+
+static void _TimerRecycle(TimerWheel* wheel, Timer* timer) {
+    if (timer->list != NULL) {
+        _TimerUnlink(timer);
+    }
+
+    if (timer->owner != NULL) {
+        if (timer->ownerPrev != NULL) {
+            timer->ownerPrev->ownerNext = timer->ownerNext;
+        } else {
+            *timer->owner = timer->ownerNext;
+        }
+
+        if (timer->ownerNext != NULL) {
+            timer->ownerNext->ownerPrev = timer->ownerPrev;
+        }
+    }
+
+    timer->generation++;
+    timer->callback  = NULL;
+    timer->source    = NULL;
+    timer->arg       = NULL;
+    timer->owner     = NULL;
+    timer->ownerPrev = NULL;
+    timer->ownerNext = NULL;
+    timer->next      = wheel->free;
+    wheel->free      = timer;
+}
+
+bool TimerWheelSchedule(TimerWheel* wheel, Timer** owner, int delay, TimerCallback callback, void* source, void* arg, TimerId* id, bool* earlier) {
+    Timer* timer = NULL;
+
+    if (delay < 0) {
+        delay = 0;
+    }
+
+    TakeLock(wheel->lock);
+
+    if (wheel->free == NULL && !_TimerWheelGrow(wheel)) {
+        ReleaseLock(wheel->lock);
+        return false;
+    }
+
+    timer = wheel->free;
+    wheel->free = timer->next;
+
+    timer->expire   = (ClockMicroseconds() / 1000) + (aio4c_time_t)delay;
+    timer->callback = callback;
+    timer->source   = source;
+    timer->arg      = arg;
+
+    if (timer->expire < wheel->current) {
+        timer->expire = wheel->current;
+    }
+
+    _TimerPlace(wheel, timer);
+
+    if (owner != NULL) {
+        timer->owner     = owner;
+        timer->ownerPrev = NULL;
+        timer->ownerNext = *owner;
+
+        if (*owner != NULL) {
+            (*owner)->ownerPrev = timer;
+        }
+
+        *owner = timer;
+    }
+
+    if (id != NULL) {
+        id->timer      = timer;
+        id->generation = timer->generation;
+    }
+
+    if (earlier != NULL) {
+        *earlier = false;
+
+        if (!wheel->sleeping || timer->expire < wheel->deadline) {
+            /* avoids waking up the driving thread again for later timers */
+            wheel->sleeping = true;
+            wheel->deadline = timer->expire;
+            *earlier = true;
+        }
+    }
+
+    ReleaseLock(wheel->lock);
+
+    return true;
+}
+
+bool TimerCancel(TimerId id) {
+    TimerWheel* wheel = NULL;
+    Timer* timer = id.timer;
+
+    if (timer == NULL) {
+        return false;
+    }
+
+    wheel = timer->wheel;
+
+    TakeLock(wheel->lock);
+
+    if (timer->generation != id.generation || timer->list == NULL) {
+        ReleaseLock(wheel->lock);
+        return false;
+    }
+
+    _TimerRecycle(wheel, timer);
+
+    ReleaseLock(wheel->lock);
+
+    return true;
+}
+
+int TimerWheelCancelAll(TimerWheel* wheel, Timer** owner) {
+    int cancelled = 0;
+
+    TakeLock(wheel->lock);
+
+    while (*owner != NULL) {
+        _TimerRecycle(wheel, *owner);
+        cancelled++;
+    }
+
+    ReleaseLock(wheel->lock);
+
+    return cancelled;
+}
+
+bool TimerWheelPending(TimerWheel* wheel, Timer** owner) {
+    bool pending = false;
+
+    TakeLock(wheel->lock);
+    pending = (*owner != NULL);
+    ReleaseLock(wheel->lock);
+
+    return pending;
+}
+
+static int _TimerWheelLowestLevel(TimerWheel* wheel) {
+    int level = 0;
+
+    for (level = 0; level < AIO4C_TIMER_WHEEL_LEVELS; level++) {
+        if (wheel->counts[level] > 0) {
+            return level;
+        }
+    }
+
+    return -1;
+}
+
+static aio4c_time_t _TimerWheelNextBoundary(aio4c_time_t time, int level) {
+    aio4c_time_t mask = ((aio4c_time_t)1 << AIO4C_TIMER_SHIFT(level)) - 1;
+
+    if ((time & mask) == 0) {
+        return time;
+    }
+
+    return (time | mask) + 1;
+}
+
+int TimerWheelNextTimeout(TimerWheel* wheel) {
+    aio4c_time_t next = 0, now = 0;
+    int level = 0, i = 0;
+    bool found = false;
+
+    TakeLock(wheel->lock);
+
+    if ((level = _TimerWheelLowestLevel(wheel)) < 0) {
+        wheel->sleeping = false;
+        ReleaseLock(wheel->lock);
+        return -1;
+    }
+
+    if (level == 0) {
+        for (i = 0; i < AIO4C_TIMER_ROOT_SIZE; i++) {
+            if (wheel->slots[0][(wheel->current + i) & AIO4C_TIMER_ROOT_MASK] != NULL) {
+                next = wheel->current + i;
+                found = true;
+                break;
+            }
+        }
+
+        for (level = 1; level < AIO4C_TIMER_WHEEL_LEVELS; level++) {
+            if (wheel->counts[level] > 0) {
+                break;
+            }
+        }
+    }
+
+    if (level < AIO4C_TIMER_WHEEL_LEVELS) {
+        /* upper level timers are moved down at their level boundaries */
+        aio4c_time_t boundary = _TimerWheelNextBoundary(wheel->current, level);
+
+        if (!found || boundary < next) {
+            next = boundary;
+        }
+    }
+
+    wheel->sleeping = true;
+    wheel->deadline = next;
+
+    ReleaseLock(wheel->lock);
+
+    now = (ClockMicroseconds() / 1000);
+
+    if (next <= now) {
+        return 0;
+    }
+
+    if (next - now > INT_MAX) {
+        return INT_MAX;
+    }
+
+    return (int)(next - now);
+}
+
+static void _TimerWheelCascade(TimerWheel* wheel, int level) {
+    Timer** slot = &wheel->slots[level][(wheel->current >> AIO4C_TIMER_SHIFT(level)) & AIO4C_TIMER_LEVEL_MASK];
+    Timer* timer = NULL;
+
+    while ((timer = *slot) != NULL) {
+        _TimerUnlink(timer);
+        _TimerPlace(wheel, timer);
+    }
+}
+
+static void _TimerWheelTick(TimerWheel* wheel) {
+    Timer** slot = NULL;
+    Timer* timer = NULL;
+    int level = 0;
+
+    if ((wheel->current & AIO4C_TIMER_ROOT_MASK) == 0) {
+        for (level = 1; level < AIO4C_TIMER_WHEEL_LEVELS; level++) {
+            _TimerWheelCascade(wheel, level);
+
+            if (((wheel->current >> AIO4C_TIMER_SHIFT(level)) & AIO4C_TIMER_LEVEL_MASK) != 0) {
+                break;
+            }
+        }
+    }
+
+    slot = &wheel->slots[0][wheel->current & AIO4C_TIMER_ROOT_MASK];
+
+    while ((timer = *slot) != NULL) {
+        _TimerUnlink(timer);
+        timer->level = -1;
+        _TimerLink(&wheel->expired, timer);
+    }
+
+    wheel->current++;
+}
+
+int TimerWheelAdvance(TimerWheel* wheel, aio4c_time_t now) {
+    Timer* timer = NULL;
+    TimerCallback callback = NULL;
+    void* source = NULL;
+    void* arg = NULL;
+    int level = 0, fired = 0;
+    aio4c_time_t next = 0;
+
+    TakeLock(wheel->lock);
+
+    while (wheel->current <= now) {
+        if ((level = _TimerWheelLowestLevel(wheel)) < 0) {
+            wheel->current = now + 1;
+            break;
+        }
+
+        /* nothing happens before the boundary of the lowest used level */
+        next = _TimerWheelNextBoundary(wheel->current, level);
+
+        if (next > now) {
+            wheel->current = now + 1;
+            break;
+        }
+
+        wheel->current = next;
+
+        _TimerWheelTick(wheel);
+
+        while ((timer = wheel->expired) != NULL) {
+            callback = timer->callback;
+            source   = timer->source;
+            arg      = timer->arg;
+
+            _TimerRecycle(wheel, timer);
+
+            ReleaseLock(wheel->lock);
+            callback(source, arg);
+            fired++;
+            TakeLock(wheel->lock);
+        }
+    }
+
+    ReleaseLock(wheel->lock);
+
+    return fired;
+}
+
+int TimerWheelExpire(TimerWheel* wheel) {
+    return TimerWheelAdvance(wheel, (ClockMicroseconds() / 1000));
+}
+
+void FreeTimerWheel(TimerWheel** pWheel) {
+    TimerWheel* wheel = NULL;
+    Node* node = NULL;
+
+    if (pWheel != NULL && (wheel = *pWheel) != NULL) {
+        while (!ListEmpty(&wheel->batches)) {
+            node = ListPop(&wheel->batches);
+            aio4c_free(node->data);
+            FreeNode(&node);
+        }
+
+        FreeLock(&wheel->lock);
+
+        aio4c_free(wheel);
+        *pWheel = NULL;
+    }
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c/trace.h>
+
+#include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/clock.h>
+#include <aio4c/log.h>
+#include <aio4c/thread.h>
+#include <aio4c/types.h>
+
+#ifndef AIO4C_WIN32
+#include <unistd.h>
+#endif /* AIO4C_WIN32 */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct s_TraceEvent {
+    aio4c_clock_t start;
+    aio4c_clock_t stop;
+    unsigned int  trace;
+    TracePoint    point;
+} TraceEvent;
+
+typedef struct s_TraceRing {
+    TraceEvent                  events[AIO4C_TRACE_RING_SIZE];
+    volatile unsigned long long head;
+    int                         reads;
+    char                        name[AIO4C_TRACE_NAME_SIZE];
+} TraceRing;
+
+typedef struct s_TraceExported {
+    TraceEvent event;
+    int        ring;
+} TraceExported;
+
+char* TracePointString[AIO4C_TRACE_POINT_MAX] = {
+    "read",
+    "enqueue",
+    "dequeue",
+    "handler",
+    "write interest",
+    "send"
+};
+
+/* phases a request goes through once it crossed each point */
+static char* _tracePhaseString[AIO4C_TRACE_POINT_MAX] = {
+    "reader",
+    "worker queue",
+    "worker",
+    "worker",
+    "writer queue",
+    "writer"
+};
+
+int   AIO4C_TRACE_RATE = 0;
+char* AIO4C_TRACE_FILE = NULL;
+
+static TraceRing*            _traceRings[AIO4C_TRACE_MAX_RINGS];
+static volatile int          _traceRingsCount = 0;
+static volatile unsigned int _traceNext = 0;
+static __thread TraceRing*   _traceRing = NULL;
+
+static TraceRing* _TraceRingAcquire(void) {
+    TraceRing* ring = NULL;
+    Thread* self = NULL;
+    int index = 0;
+
+    do {
+        if ((index = AtomicGet(&_traceRingsCount)) >= AIO4C_TRACE_MAX_RINGS) {
+            return NULL;
+        }
+    } while (!AtomicCompareAndSwap(&_traceRingsCount, index, index + 1));
+
+    /* not allocated with aio4c_malloc, which is probed itself, rings are kept until exit */
+    if ((ring = calloc(1, sizeof(TraceRing))) == NULL) {
+        return NULL;
+    }
+
+    if ((self = _ThreadSelf()) != NULL && ThreadGetName(self) != NULL) {
+        snprintf(ring->name, AIO4C_TRACE_NAME_SIZE, "%s", ThreadGetName(self));
+    } else {
+        snprintf(ring->name, AIO4C_TRACE_NAME_SIZE, "thread-%d", index);
+    }
+
+    AtomicBarrier();
+    _traceRings[index] = ring;
+
+    return ring;
+}
+
+unsigned int _TraceSample(void) {
+    unsigned int trace = 0;
+
+    if (_traceRing == NULL && (_traceRing = _TraceRingAcquire()) == NULL) {
+        return 0;
+    }
+
+    if (++_traceRing->reads < AIO4C_TRACE_RATE) {
+        return 0;
+    }
+
+    _traceRing->reads = 0;
+
+    do {
+        trace = AtomicAdd(&_traceNext, 1u) + 1u;
+    } while (trace == 0);
+
+    return trace;
+}
+
+void _TraceRecord(unsigned int trace, TracePoint point, aio4c_clock_t start, aio4c_clock_t stop) {
+    TraceEvent* event = NULL;
+
+    if (_traceRing == NULL && (_traceRing = _TraceRingAcquire()) == NULL) {
+        return;
+    }
+
+    event = &_traceRing->events[_traceRing->head & (AIO4C_TRACE_RING_SIZE - 1)];
+    event->start = start;
+    event->stop = stop;
+    event->trace = trace;
+    event->point = point;
+
+    /* the event is complete before it is counted, exports check the head after copying */
+    AtomicBarrier();
+    _traceRing->head++;
+}
+
+static int _TraceCompare(const void* _a, const void* _b) {
+    const TraceExported* a = (const TraceExported*)_a;
+    const TraceExported* b = (const TraceExported*)_b;
+
+    if (a->event.trace != b->event.trace) {
+        return (a->event.trace < b->event.trace) ? -1 : 1;
+    }
+
+    if (a->event.start != b->event.start) {
+        return (ClockElapsed(b->event.start, a->event.start) < 0) ? -1 : 1;
+    }
+
+    return (int)a->event.point - (int)b->event.point;
+}
+
+static int _TraceCopy(TraceRing* ring, int index, TraceExported* exported) {
+    unsigned long long head = 0, first = 0, last = 0, i = 0;
+    int count = 0;
+
+    head = ring->head;
+    first = (head > AIO4C_TRACE_RING_SIZE) ? head - AIO4C_TRACE_RING_SIZE : 0;
+    AtomicBarrier();
+
+    for (i = first; i < head; i++) {
+        memcpy(&exported[count].event, &ring->events[i & (AIO4C_TRACE_RING_SIZE - 1)], sizeof(TraceEvent));
+        exported[count].ring = index;
+        count++;
+    }
+
+    /* events whose slot was reused while being copied are dropped */
+    AtomicBarrier();
+    last = ring->head;
+    if (last >= AIO4C_TRACE_RING_SIZE && last - AIO4C_TRACE_RING_SIZE + 1 > first) {
+        i = last - AIO4C_TRACE_RING_SIZE + 1 - first;
+        if (i >= (unsigned long long)count) {
+            return 0;
+        }
+        memmove(exported, &exported[i], (count - i) * sizeof(TraceExported));
+        count -= (int)i;
+    }
+
+    return count;
+}
+
+static double _TraceMicroseconds(aio4c_clock_t origin, aio4c_clock_t stamp) {
+    return (double)ClockElapsed(origin, stamp) / 1000.0;
+}
+
+static void _TraceWriteAsync(FILE* file, long pid, char* name, char phase, unsigned int trace, double ts, bool* first) {
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"%c\",\"id\":\"0x%x\",\"ts\":%.3f,\"pid\":%ld,\"tid\":0}",
+            (*first) ? "" : ",", name, phase, trace, ts, pid);
+    *first = false;
+}
+
+static void _TraceWriteRequest(FILE* file, long pid, TraceExported* events, int count, aio4c_clock_t origin, bool* first) {
+    unsigned int trace = events[0].event.trace;
+    aio4c_clock_t cursor = events[0].event.start;
+    TracePoint crossed = events[0].event.point;
+    int i = 0;
+
+    _TraceWriteAsync(file, pid, "request", 'b', trace, _TraceMicroseconds(origin, events[0].event.start), first);
+
+    /* phases are nested in the request one after the other, points being crossed in the order they are declared */
+    for (i = 0; i < count; i++) {
+        if (ClockElapsed(cursor, events[i].event.start) < 0) {
+            if ((int)events[i].event.point > (int)crossed) {
+                crossed = events[i].event.point;
+            }
+            if (ClockElapsed(cursor, events[i].event.stop) > 0) {
+                cursor = events[i].event.stop;
+            }
+            continue;
+        }
+
+        if (i > 0 && ClockElapsed(cursor, events[i].event.start) > 0) {
+            _TraceWriteAsync(file, pid, _tracePhaseString[crossed], 'b', trace, _TraceMicroseconds(origin, cursor), first);
+            _TraceWriteAsync(file, pid, _tracePhaseString[crossed], 'e', trace, _TraceMicroseconds(origin, events[i].event.start), first);
+        }
+
+        if (events[i].event.stop != events[i].event.start) {
+            _TraceWriteAsync(file, pid, TracePointString[events[i].event.point], 'b', trace, _TraceMicroseconds(origin, events[i].event.start), first);
+            _TraceWriteAsync(file, pid, TracePointString[events[i].event.point], 'e', trace, _TraceMicroseconds(origin, events[i].event.stop), first);
+        }
+
+        cursor = events[i].event.stop;
+        if ((int)events[i].event.point > (int)crossed) {
+            crossed = events[i].event.point;
+        }
+    }
+
+    _TraceWriteAsync(file, pid, "request", 'e', trace, _TraceMicroseconds(origin, cursor), first);
+}
+
+bool TraceWrite(FILE* file) {
+    TraceExported* exported = NULL;
+    aio4c_clock_t origin = 0;
+    int rings = 0, count = 0, i = 0, j = 0;
+    bool first = true;
+#ifndef AIO4C_WIN32
+    long pid = (long)getpid();
+#else /* AIO4C_WIN32 */
+    long pid = (long)GetCurrentProcessId();
+#endif /* AIO4C_WIN32 */
+
+    rings = AtomicGet(&_traceRingsCount);
+
+    if (rings > 0 && (exported = aio4c_malloc(rings * AIO4C_TRACE_RING_SIZE * sizeof(TraceExported))) == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot allocate %d trace events for export", rings * AIO4C_TRACE_RING_SIZE);
+        return false;
+    }
+
+    for (i = 0; i < rings; i++) {
+        if (_traceRings[i] != NULL) {
+            count += _TraceCopy(_traceRings[i], i, &exported[count]);
+        }
+    }
+
+    if (count > 0) {
+        qsort(exported, count, sizeof(TraceExported), _TraceCompare);
+        origin = exported[0].event.start;
+        for (i = 1; i < count; i++) {
+            if (ClockElapsed(origin, exported[i].event.start) < 0) {
+                origin = exported[i].event.start;
+            }
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (i = 0; i < rings; i++) {
+        if (_traceRings[i] != NULL) {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    (first) ? "" : ",", pid, i + 1, _traceRings[i]->name);
+            first = false;
+        }
+    }
+
+    /* points are shown on the thread that crossed them */
+    for (i = 0; i < count; i++) {
+        if (exported[i].event.stop != exported[i].event.start) {
+            fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"aio4c\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%d,\"args\":{\"trace\":%u}}",
+                    (first) ? "" : ",", TracePointString[exported[i].event.point], _TraceMicroseconds(origin, exported[i].event.start),
+                    _TraceMicroseconds(exported[i].event.start, exported[i].event.stop), pid, exported[i].ring + 1, exported[i].event.trace);
+        } else {
+            fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"aio4c\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%ld,\"tid\":%d,\"args\":{\"trace\":%u}}",
+                    (first) ? "" : ",", TracePointString[exported[i].event.point], _TraceMicroseconds(origin, exported[i].event.start),
+                    pid, exported[i].ring + 1, exported[i].event.trace);
+        }
+        first = false;
+    }
+
+    for (i = 0; i < count; i = j) {
+        for (j = i + 1; j < count && exported[j].event.trace == exported[i].event.trace; j++);
+        _TraceWriteRequest(file, pid, &exported[i], j - i, origin, &first);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (exported != NULL) {
+        aio4c_free(exported);
+    }
+
+    return (ferror(file) == 0);
+}
+
+bool TraceExport(char* path) {
+    FILE* file = NULL;
+    bool written = false;
+
+    if ((file = fopen(path, "w")) == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot open trace file %s for writing: %s", path, strerror(errno));
+        return false;
+    }
+
+    written = TraceWrite(file);
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+
+    if (written) {
+        Log(AIO4C_LOG_LEVEL_INFO, "traces exported into %s", path);
+    } else {
+        Log(AIO4C_LOG_LEVEL_WARN, "cannot write trace file %s", path);
+    }
+
+    return written;
+}
+
+void TraceEnd(void) {
+    char filename[128];
+#ifndef AIO4C_WIN32
+    long pid = (long)getpid();
+#else /* AIO4C_WIN32 */
+    long pid = (long)GetCurrentProcessId();
+#endif /* AIO4C_WIN32 */
+
+    if (AIO4C_TRACE_RATE <= 0) {
+        return;
+    }
+
+    if (AIO4C_TRACE_FILE == NULL) {
+        memset(filename, 0, sizeof(filename));
+        snprintf(filename, sizeof(filename), "trace-%ld.json", pid);
+        TraceExport(filename);
+    } else {
+        TraceExport(AIO4C_TRACE_FILE);
+    }
+}
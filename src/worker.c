@@ -24,13 +24,17 @@
 #include <aio4c/worker.h>
 
 #include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
 #include <aio4c/buffer.h>
+#include <aio4c/clock.h>
 #include <aio4c/connection.h>
 #include <aio4c/error.h>
 #include <aio4c/event.h>
 #include <aio4c/log.h>
+#include <aio4c/reader.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
+#include <aio4c/trace.h>
 #include <aio4c/types.h>
 #include <aio4c/writer.h>
 
@@ -40,17 +44,33 @@
 
 #endif /* AIO4C_WIN32 */
 
+#include <string.h>
+
+/* pending bytes and tasks queued to one worker, 0 meaning unlimited */
+WaterMarks AIO4C_WORKER_WATER_MARKS = {
+    .highBytes = 64 * 1024 * 1024,
+    .lowBytes  = 32 * 1024 * 1024,
+    .highItems = 0,
+    .lowItems  = 0
+};
+
+typedef struct s_WorkerRemoval {
+    Worker*     worker;
+    Connection* connection;
+} WorkerRemoval;
+
 static bool _WorkerInit(ThreadData _worker) {
     Worker* worker = (Worker*)_worker;
     if ((worker->queue = NewQueue()) == NULL) {
         return false;
     }
 
+    /* allocated by the worker thread itself to follow the pipe's memory policy */
     if ((worker->pool = NewBufferPool(worker->bufferSize)) == NULL) {
         return false;
     }
 
-    if ((worker->writer = NewWriter(worker->pipe, worker->bufferSize)) == NULL) {
+    if ((worker->writer = NewWriter(worker->pipe, worker->bufferSize, ThreadGetPolicy(worker->thread))) == NULL) {
         return false;
     }
 
@@ -59,11 +79,87 @@ static bool _WorkerInit(ThreadData _worker) {
     return true;
 }
 
+static bool _AboveHighMarks(WaterMarks* marks, volatile int* items, volatile int* bytes) {
+    return (marks->highItems > 0 && AtomicGet(items) >= marks->highItems) ||
+           (marks->highBytes > 0 && AtomicGet(bytes) >= marks->highBytes);
+}
+
+static bool _BelowLowMarks(WaterMarks* marks, volatile int* items, volatile int* bytes) {
+    return (marks->highItems <= 0 || AtomicGet(items) <= marks->lowItems) &&
+           (marks->highBytes <= 0 || AtomicGet(bytes) <= marks->lowBytes);
+}
+
+bool WorkerAboveHighMarks(Worker* worker, Connection* connection) {
+    return MemoryGetState() >= AIO4C_MEMORY_CRITICAL ||
+           _AboveHighMarks(&connection->marks, &connection->pendingItems, &connection->pendingBytes) ||
+           _AboveHighMarks(&worker->marks, &worker->pendingItems, &worker->pendingBytes);
+}
+
+bool WorkerBelowLowMarks(Worker* worker, Connection* connection) {
+    return MemoryGetState() == AIO4C_MEMORY_NORMAL &&
+           _BelowLowMarks(&connection->marks, &connection->pendingItems, &connection->pendingBytes) &&
+           _BelowLowMarks(&worker->marks, &worker->pendingItems, &worker->pendingBytes);
+}
+
+static void _WorkerTaskQueued(Worker* worker, Connection* connection, int size) {
+    AtomicAdd(&connection->pendingItems, 1);
+    AtomicAdd(&connection->pendingBytes, size);
+    AtomicAdd(&worker->pendingItems, 1);
+    AtomicAdd(&worker->pendingBytes, size);
+}
+
+static void _WorkerTaskDone(Worker* worker, Connection* connection, int size) {
+    Reader* reader = connection->reader;
+    WaterMarks* marks = &worker->marks;
+    int items = 0, bytes = 0;
+    bool crossed = false;
+
+    AtomicSub(&connection->pendingItems, 1);
+    AtomicSub(&connection->pendingBytes, size);
+    items = AtomicSub(&worker->pendingItems, 1);
+    bytes = AtomicSub(&worker->pendingBytes, size);
+
+    if (reader == NULL || reader->suspendedCount == 0) {
+        return;
+    }
+
+    /* when the whole pipe goes below its low marks, every suspended connection may resume */
+    crossed = (marks->highItems > 0 && items == marks->lowItems) ||
+              (marks->highBytes > 0 && bytes <= marks->lowBytes && bytes + size > marks->lowBytes);
+
+    if ((crossed && _BelowLowMarks(marks, &worker->pendingItems, &worker->pendingBytes)) ||
+        (connection->readSuspended && WorkerBelowLowMarks(worker, connection))) {
+        reader->flowCheck = true;
+        SelectorWakeUp(reader->selector);
+    }
+}
+
+/*
+ * The sojourn time is that of the whole queue, whichever connections fill it.
+ * Target and interval are those of the Server, copied to each of its connections.
+ */
+static bool _WorkerShouldShed(Worker* worker, Connection* connection, aio4c_clock_t enqueued) {
+    aio4c_clock_t now = 0;
+
+    if (enqueued == 0 || connection->overload.target <= 0) {
+        return false;
+    }
+
+    now = ClockNow();
+
+    return OverloadShouldShed(&connection->overload, &worker->shedding,
+            (aio4c_time_t)(ClockElapsed(0, now) / 1000),
+            (aio4c_time_t)(ClockElapsed(enqueued, now) / 1000),
+            AtomicGet(&worker->pendingItems) > 1);
+}
+
 static bool _removeCallback(QueueItem* item, QueueDiscriminant discriminant) {
+    WorkerRemoval* removal = (WorkerRemoval*)discriminant;
     Buffer* buffer = NULL;
     if (QueueItemGetType(item) == AIO4C_QUEUE_ITEM_TASK) {
-        if (QueueTaskItemGetConnection(item) == (Connection*)discriminant) {
+        if (QueueTaskItemGetConnection(item) == removal->connection) {
             buffer = QueueTaskItemGetBuffer(item);
+            _WorkerTaskDone(removal->worker, removal->connection, BufferGetLimit(buffer));
             ReleaseBuffer(&buffer);
             return true;
         }
@@ -77,6 +173,11 @@ static bool _WorkerRun(ThreadData _worker) {
     QueueItem* item = NewQueueItem();
     Connection* connection = NULL;
     Buffer* buffer = NULL;
+    WorkerRemoval removal;
+    int size = 0;
+    aio4c_clock_t enqueued = 0, start = 0;
+    unsigned int trace = 0;
+    bool timed = false;
 
     while (Dequeue(worker->queue, item, true)) {
         switch (QueueItemGetType(item)) {
@@ -85,22 +186,55 @@ static bool _WorkerRun(ThreadData _worker) {
                 return false;
             case AIO4C_QUEUE_ITEM_TASK:
                 connection = QueueTaskItemGetConnection(item);
-                Log(AIO4C_LOG_LEVEL_DEBUG, "dequeued task for connection %s", connection->string);
+                Log(AIO4C_LOG_LEVEL_DEBUG, "dequeued task for connection %s", ConnectionGetString(connection));
                 ProbeTimeStart(AIO4C_TIME_PROBE_DATA_PROCESS);
+                enqueued = QueueTaskItemGetTime(item);
+                /* only this worker thread updates its counters, they are read by AcceptorGetPipesCounters */
+                worker->counters.tasks++;
+                if ((timed = (enqueued != 0 && ProbeEnabled(AIO4C_PROBE_CATEGORY_PROCESS)))) {
+                    start = ClockNow();
+                    worker->counters.waitTime += ClockElapsed(enqueued, start);
+                }
+                trace = QueueTaskItemGetTrace(item);
+                TraceMark(trace, AIO4C_TRACE_POINT_DEQUEUE);
                 buffer = QueueTaskItemGetBuffer(item);
+                size = BufferGetLimit(buffer);
                 connection->dataBuffer = buffer;
-                ConnectionProcessData(connection);
+                connection->traceProcess = trace;
+                if (_WorkerShouldShed(worker, connection, enqueued)) {
+                    Log(AIO4C_LOG_LEVEL_DEBUG, "shedding task for connection %s", ConnectionGetString(connection));
+                    AtomicAdd(&worker->rejected, 1);
+                    ConnectionOverload(connection);
+                } else {
+                    ConnectionProcessData(connection);
+                }
+                connection->traceProcess = 0;
                 connection->dataBuffer = NULL;
                 ProbeSize(AIO4C_PROBE_PROCESSED_DATA_SIZE,BufferGetPosition(buffer));
                 ReleaseBuffer(&buffer);
+                _WorkerTaskDone(worker, connection, size);
+                if (timed) {
+                    worker->counters.processTime += ClockElapsed(start, ClockNow());
+                }
                 ProbeTimeEnd(AIO4C_TIME_PROBE_DATA_PROCESS);
                 break;
             case AIO4C_QUEUE_ITEM_EVENT:
                 connection = (Connection*)QueueEventItemGetSource(item);
-                Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", connection->string);
-                RemoveAll(worker->queue, _removeCallback, (QueueDiscriminant)connection);
+                if (QueueEventItemGetEvent(item) == AIO4C_MIGRATE_EVENT) {
+                    /* every task of the migrating connection was processed, let the writer flush its data */
+                    if (!EnqueueEventItem(worker->writer->queue, AIO4C_MIGRATE_EVENT, (EventSource)connection)) {
+                        if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+                            FreeConnection(&connection);
+                        }
+                    }
+                    break;
+                }
+                Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", ConnectionGetString(connection));
+                removal.worker = worker;
+                removal.connection = connection;
+                RemoveAll(worker->queue, _removeCallback, (QueueDiscriminant)&removal);
                 if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_WORKER)) {
-                    Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", connection->string);
+                    Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", ConnectionGetString(connection));
                     FreeConnection(&connection);
                 }
                 break;
@@ -126,7 +260,63 @@ static void _WorkerExit(ThreadData _worker) {
     Log(AIO4C_LOG_LEVEL_DEBUG, "exited");
 }
 
-Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize) {
+static void _WorkerCloseHandler(Event event, Connection* source, Worker* worker) {
+    if (worker->queue == NULL || !EnqueueEventItem(worker->queue, event, (EventSource)source)) {
+        if (ConnectionNoMoreUsed(source, AIO4C_CONNECTION_OWNER_WORKER)) {
+            FreeConnection(&source);
+        }
+    }
+}
+
+static void _WorkerReadHandler(Event event, Connection* source, Worker* worker) {
+    Buffer* bufferCopy = NULL;
+    Event eventToProcess = AIO4C_OUTBOUND_DATA_EVENT;
+    aio4c_clock_t enqueued = 0;
+    int size = 0;
+
+    ProbeTimeStart(AIO4C_TIME_PROBE_DATA_PROCESS);
+
+    if (event != AIO4C_INBOUND_DATA_EVENT || source->state == AIO4C_CONNECTION_STATE_CLOSED) {
+        return;
+    }
+
+    /* past the memory budget the copy is not kept by the pool, and the reader suspends the connection right after */
+    if ((bufferCopy = AllocateBuffer(worker->pool)) == NULL && (bufferCopy = NewBuffer(worker->bufferSize)) == NULL) {
+        Log(AIO4C_LOG_LEVEL_WARN, "no buffer available for connection %s, memory is %s", ConnectionGetString(source), MemoryStateString[MemoryGetState()]);
+        return;
+    }
+
+    if (event == AIO4C_INBOUND_DATA_EVENT) {
+        BufferFlip(source->readBuffer);
+
+        BufferCopy(bufferCopy, source->readBuffer);
+
+        BufferReset(source->readBuffer);
+
+        eventToProcess = AIO4C_READ_EVENT;
+    }
+
+    /* accounted first, the task may be processed before EnqueueTaskItem returns */
+    size = BufferGetLimit(bufferCopy);
+    _WorkerTaskQueued(worker, source, size);
+
+    TraceMark(source->traceRead, AIO4C_TRACE_POINT_ENQUEUE);
+
+    /* the time of enqueue is only needed to shed tasks or to account how long they waited */
+    if (source->overload.target > 0 || ProbeEnabled(AIO4C_PROBE_CATEGORY_PROCESS)) {
+        enqueued = ClockNow();
+    }
+
+    if (!EnqueueTaskItem(worker->queue, eventToProcess, source, bufferCopy, enqueued, source->traceRead)) {
+        ReleaseBuffer(&bufferCopy);
+        _WorkerTaskDone(worker, source, size);
+        return;
+    }
+
+    ProbeTimeEnd(AIO4C_TIME_PROBE_DATA_PROCESS);
+}
+
+Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy) {
     Worker* worker = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
 
@@ -146,6 +336,14 @@ Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize) {
     worker->pool       = NULL;
     worker->writer     = NULL;
     worker->bufferSize = bufferSize;
+    worker->pendingItems = 0;
+    worker->pendingBytes = 0;
+    memcpy(&worker->marks, &AIO4C_WORKER_WATER_MARKS, sizeof(WaterMarks));
+    memset(&worker->shedding, 0, sizeof(OverloadState));
+    worker->rejected   = 0;
+    worker->handlers   = NewEventQueue();
+    EventHandlerAdd(worker->handlers, NewEventHandler(AIO4C_INBOUND_DATA_EVENT, (EventCallback)_WorkerReadHandler, (EventData)worker, false));
+    EventHandlerAdd(worker->handlers, NewEventHandler(AIO4C_CLOSE_EVENT, (EventCallback)_WorkerCloseHandler, (EventData)worker, true));
 
     if (pipeName != NULL) {
         worker->pipe       = pipeName;
@@ -169,14 +367,18 @@ Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize) {
         if (worker->name != NULL) {
             aio4c_free(worker->name);
         }
+        FreeEventQueue(&worker->handlers);
         aio4c_free(worker);
         return NULL;
     }
 
+    ThreadSetPolicy(worker->thread, policy);
+
     if (!ThreadStart(worker->thread)) {
         if (worker->name != NULL) {
             aio4c_free(worker->name);
         }
+        FreeEventQueue(&worker->handlers);
         aio4c_free(worker);
         return NULL;
     }
@@ -184,47 +386,8 @@ Worker* NewWorker(char* pipeName, aio4c_size_t bufferSize) {
     return worker;
 }
 
-static void _WorkerCloseHandler(Event event, Connection* source, Worker* worker) {
-    if (worker->queue == NULL || !EnqueueEventItem(worker->queue, event, (EventSource)source)) {
-        if (ConnectionNoMoreUsed(source, AIO4C_CONNECTION_OWNER_WORKER)) {
-            FreeConnection(&source);
-        }
-    }
-}
-
-static void _WorkerReadHandler(Event event, Connection* source, Worker* worker) {
-    Buffer* bufferCopy = NULL;
-    Event eventToProcess = AIO4C_OUTBOUND_DATA_EVENT;
-
-    ProbeTimeStart(AIO4C_TIME_PROBE_DATA_PROCESS);
-
-    if (event != AIO4C_INBOUND_DATA_EVENT || source->state == AIO4C_CONNECTION_STATE_CLOSED) {
-        return;
-    }
-
-    bufferCopy = AllocateBuffer(worker->pool);
-
-    if (event == AIO4C_INBOUND_DATA_EVENT) {
-        BufferFlip(source->readBuffer);
-
-        BufferCopy(bufferCopy, source->readBuffer);
-
-        BufferReset(source->readBuffer);
-
-        eventToProcess = AIO4C_READ_EVENT;
-    }
-
-    if (!EnqueueTaskItem(worker->queue, eventToProcess, source, bufferCopy)) {
-        ReleaseBuffer(&bufferCopy);
-        return;
-    }
-
-    ProbeTimeEnd(AIO4C_TIME_PROBE_DATA_PROCESS);
-}
-
 void WorkerManageConnection(Worker* worker, Connection* connection) {
-    ConnectionAddSystemHandler(connection, AIO4C_INBOUND_DATA_EVENT, aio4c_connection_handler(_WorkerReadHandler), aio4c_connection_handler_arg(worker), false);
-    ConnectionAddSystemHandler(connection, AIO4C_CLOSE_EVENT, aio4c_connection_handler(_WorkerCloseHandler), aio4c_connection_handler_arg(worker), true);
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WORKER] = worker->handlers;
     ConnectionManagedBy(connection, AIO4C_CONNECTION_OWNER_WORKER);
     WriterManageConnection(worker->writer, connection);
 }
@@ -242,6 +405,8 @@ void WorkerEnd(Worker* worker) {
         aio4c_free(worker->name);
     }
 
+    FreeEventQueue(&worker->handlers);
+
     aio4c_free(worker);
 }
 
@@ -29,6 +29,7 @@
 #include <aio4c/error.h>
 #include <aio4c/event.h>
 #include <aio4c/log.h>
+#include <aio4c/reader.h>
 #include <aio4c/stats.h>
 #include <aio4c/thread.h>
 
@@ -55,7 +56,9 @@ static bool _WriterInit(ThreadData _writer) {
 static bool _WriterRemove(QueueItem* item, QueueDiscriminant discriminant) {
     switch (QueueItemGetType(item)) {
         case AIO4C_QUEUE_ITEM_EVENT:
-            if ((Connection*)QueueEventItemGetSource(item) == (Connection*)discriminant) {
+            /* migration events hold a reference on the connection and must reach their handler */
+            if ((Connection*)QueueEventItemGetSource(item) == (Connection*)discriminant &&
+                QueueEventItemGetEvent(item) != AIO4C_MIGRATE_EVENT) {
                 return true;
             }
             break;
@@ -66,11 +69,54 @@ static bool _WriterRemove(QueueItem* item, QueueDiscriminant discriminant) {
     return false;
 }
 
+static bool _WriterRemoveWrites(QueueItem* item, QueueDiscriminant discriminant) {
+    return (QueueItemGetType(item) == AIO4C_QUEUE_ITEM_EVENT &&
+            (Connection*)QueueEventItemGetSource(item) == (Connection*)discriminant &&
+            QueueEventItemGetEvent(item) == AIO4C_OUTBOUND_DATA_EVENT);
+}
+
+static bool _WriterFindClose(QueueItem* item, void* arg) {
+    Connection** connection = (Connection**)arg;
+
+    if (QueueItemGetType(item) == AIO4C_QUEUE_ITEM_EVENT &&
+        (Connection*)QueueEventItemGetSource(item) == *connection &&
+        QueueEventItemGetEvent(item) == AIO4C_CLOSE_EVENT) {
+        *connection = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void _WriterMigrate(Writer* writer, Connection* connection) {
+    Connection* closing = connection;
+    bool pendingWrite = false;
+
+    /* a close queued here must release the writer owner, the connection then stays on this pipe */
+    QueueForEach(writer->queue, _WriterFindClose, &closing);
+
+    if (closing != NULL && connection->state != AIO4C_CONNECTION_STATE_CLOSED) {
+        /* pending write interests are handed to the target writer, a later close is still processed here */
+        pendingWrite = RemoveAll(writer->queue, _WriterRemoveWrites, (QueueDiscriminant)connection);
+
+        if (ReaderAdoptConnection(connection->migrateTo, connection, pendingWrite)) {
+            return;
+        }
+    }
+
+    Log(AIO4C_LOG_LEVEL_DEBUG, "migration aborted for connection %s", ConnectionGetString(connection));
+
+    if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_MIGRATION)) {
+        FreeConnection(&connection);
+    }
+}
+
 static bool _WriterRun(ThreadData _writer) {
     Writer* writer = (Writer*)_writer;
     QueueItem* item = NewQueueItem();
     Connection* connection = NULL;
     Event event = AIO4C_INIT_EVENT;
+    unsigned long long written = 0;
 
     while (Dequeue(writer->queue, item, true)) {
         Log(AIO4C_LOG_LEVEL_DEBUG, "dequeued item %d", QueueItemGetType(item));
@@ -83,20 +129,32 @@ static bool _WriterRun(ThreadData _writer) {
                 connection = (Connection*)QueueEventItemGetSource(item);
                 switch(event) {
                     case AIO4C_OUTBOUND_DATA_EVENT:
-                        Log(AIO4C_LOG_LEVEL_DEBUG, "processing write interest for connection %s", connection->string);
+                        if (connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WRITER] != writer->handlers) {
+                            /* the connection was migrated to another pipe meanwhile */
+                            EventDispatch(connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WRITER], event, (EventSource)connection, NULL, false);
+                            break;
+                        }
+                        Log(AIO4C_LOG_LEVEL_DEBUG, "processing write interest for connection %s", ConnectionGetString(connection));
+                        written = connection->counters.bytesOut;
+                        writer->counters.writes++;
                         if (ConnectionWrite(connection)) {
-                            Log(AIO4C_LOG_LEVEL_DEBUG, "did not write all data for connection %s, reenqueueing", connection->string);
+                            Log(AIO4C_LOG_LEVEL_DEBUG, "did not write all data for connection %s, reenqueueing", ConnectionGetString(connection));
+                            writer->counters.shortWrites++;
                             EnqueueEventItem(writer->queue, QueueEventItemGetEvent(item), QueueEventItemGetSource(item));
                         }
+                        writer->counters.bytesOut += connection->counters.bytesOut - written;
                         break;
                     case AIO4C_CLOSE_EVENT:
                         RemoveAll(writer->queue, _WriterRemove, (QueueDiscriminant)connection);
-                        Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", connection->string);
+                        Log(AIO4C_LOG_LEVEL_DEBUG, "close received for connection %s", ConnectionGetString(connection));
                         if (ConnectionNoMoreUsed(connection, AIO4C_CONNECTION_OWNER_WRITER)) {
-                            Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", connection->string);
+                            Log(AIO4C_LOG_LEVEL_DEBUG, "freeing connection %s", ConnectionGetString(connection));
                             FreeConnection(&connection);
                         }
                         break;
+                    case AIO4C_MIGRATE_EVENT:
+                        _WriterMigrate(writer, connection);
+                        break;
                     default:
                         Log(AIO4C_LOG_LEVEL_WARN, "received unexpected event %d", event);
                         break;
@@ -119,7 +177,15 @@ static void _WriterExit(ThreadData _writer) {
     Log(AIO4C_LOG_LEVEL_DEBUG, "exited");
 }
 
-Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize) {
+static void _WriterEventHandler(Event event, Connection* source, Writer* writer) {
+    Log(AIO4C_LOG_LEVEL_DEBUG, "sending event %d for connection %s to writer %s", event, ConnectionGetString(source), ThreadGetName(writer->thread));
+    if (!EnqueueEventItem(writer->queue, event, (EventSource)source)) {
+        Log(AIO4C_LOG_LEVEL_WARN, "event %d for connection %s lost", event, ConnectionGetString(source));
+        return;
+    }
+}
+
+Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize, ThreadPolicy* policy) {
     Writer* writer = NULL;
     ErrorCode code = AIO4C_ERROR_CODE_INITIALIZER;
 
@@ -137,6 +203,9 @@ Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize) {
 
     writer->queue        = NULL;
     writer->bufferSize   = bufferSize;
+    writer->handlers     = NewEventQueue();
+    EventHandlerAdd(writer->handlers, NewEventHandler(AIO4C_OUTBOUND_DATA_EVENT, (EventCallback)_WriterEventHandler, (EventData)writer, false));
+    EventHandlerAdd(writer->handlers, NewEventHandler(AIO4C_CLOSE_EVENT, (EventCallback)_WriterEventHandler, (EventData)writer, true));
     if (pipeName != NULL) {
         writer->name         = aio4c_malloc(strlen(pipeName) + 1 + 7);
         if (writer->name != NULL) {
@@ -156,14 +225,18 @@ Writer* NewWriter(char* pipeName, aio4c_size_t bufferSize) {
         if (writer->name != NULL) {
             aio4c_free(writer->name);
         }
+        FreeEventQueue(&writer->handlers);
         aio4c_free(writer);
         return NULL;
     }
 
+    ThreadSetPolicy(writer->thread, policy);
+
     if (!ThreadStart(writer->thread)) {
         if (writer->name != NULL) {
             aio4c_free(writer->name);
         }
+        FreeEventQueue(&writer->handlers);
         aio4c_free(writer);
         return NULL;
     }
@@ -184,19 +257,12 @@ void WriterEnd(Writer* writer) {
         aio4c_free(writer->name);
     }
 
-    aio4c_free(writer);
-}
+    FreeEventQueue(&writer->handlers);
 
-static void _WriterEventHandler(Event event, Connection* source, Writer* writer) {
-    Log(AIO4C_LOG_LEVEL_DEBUG, "sending event %d for connection %s to writer %s", event, source->string, ThreadGetName(writer->thread));
-    if (!EnqueueEventItem(writer->queue, event, (EventSource)source)) {
-        Log(AIO4C_LOG_LEVEL_WARN, "event %d for connection %s lost", event, source->string);
-        return;
-    }
+    aio4c_free(writer);
 }
 
 void WriterManageConnection(Writer* writer, Connection* connection) {
-    ConnectionAddSystemHandler(connection, AIO4C_OUTBOUND_DATA_EVENT, aio4c_connection_handler(_WriterEventHandler), aio4c_connection_handler_arg(writer), false);
-    ConnectionAddSystemHandler(connection, AIO4C_CLOSE_EVENT, aio4c_connection_handler(_WriterEventHandler), aio4c_connection_handler_arg(writer), true);
+    connection->ownerHandlers[AIO4C_CONNECTION_OWNER_WRITER] = writer->handlers;
     ConnectionManagedBy(connection, AIO4C_CONNECTION_OWNER_WRITER);
 }
@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/acceptor.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+
+#define MS 1000ULL
+
+static volatile aio4c_time_t bucket;
+
+/* takes as many tokens as possible at the given time */
+static int drain(aio4c_time_t now, int rate, int burst) {
+    int count = 0;
+
+    while (AcceptorTakeToken(&bucket, now, rate, burst)) {
+        count++;
+        assert(count <= 1000);
+    }
+
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    aio4c_time_t start = 1000 * MS, due = 0;
+    int i = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    /* no rate admits everything */
+    bucket = 0;
+    for (i = 0; i < 1000; i++) {
+        assert(AcceptorTakeToken(&bucket, start, 0, 0));
+    }
+
+    assert(bucket == 0);
+
+    /* a full bucket admits a whole burst at once */
+    bucket = 0;
+    assert(drain(start, 10, 3) == 3);
+
+    /* a rejection does not take a token */
+    due = bucket;
+    assert(!AcceptorTakeToken(&bucket, start, 10, 3));
+    assert(bucket == due);
+
+    /* then it refills at the rate */
+    assert(drain(start + 50 * MS, 10, 3) == 0);
+    assert(drain(start + 100 * MS, 10, 3) == 1);
+    assert(drain(start + 250 * MS, 10, 3) == 1);
+    assert(drain(start + 300 * MS, 10, 3) == 1);
+
+    /* never holding more than the burst */
+    assert(drain(start + 10000 * MS, 10, 3) == 3);
+
+    /* connections arriving at the rate are all admitted */
+    bucket = 0;
+    for (i = 0; i < 100; i++) {
+        assert(AcceptorTakeToken(&bucket, start + i * 100 * MS, 10, 1));
+    }
+
+    /* but not faster */
+    assert(!AcceptorTakeToken(&bucket, start + 99 * 100 * MS + 99 * MS, 10, 1));
+
+    /* the burst defaults to the rate */
+    bucket = 0;
+    assert(drain(start, 5, 0) == 5);
+    assert(drain(start + 1000 * MS, 5, 0) == 5);
+
+    Aio4cEnd();
+
+    return 0;
+}
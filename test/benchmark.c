@@ -31,7 +31,6 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -115,7 +114,7 @@ static unsigned int crc32(unsigned char* b, size_t n) {
 }
 // End of CRC-32 algorithm
 
-#define BUFSZ (blockSize + sizeof(struct timeval) + sizeof(int))
+#define BUFSZ (blockSize + sizeof(aio4c_clock_t) + sizeof(int))
 
 static int blockSize = 4096;
 static unsigned long int clientDataSize = 1073741824;
@@ -143,12 +142,13 @@ static void clientHandler(Event event, Connection* connection, ClientHandlerData
     Buffer* buf = NULL;
     unsigned int crc = 0, ck = 0;
     unsigned char* data = NULL;
-    struct timeval now, req;
+    aio4c_clock_t stamp = 0;
+    int position = 0;
     double percent = 0.0;
     int i = 0;
     ClientData* cd = (ClientData*)_cd;
-    data = malloc(blockSize + sizeof(struct timeval));
-    memset(data, 0, blockSize + sizeof(struct timeval));
+    data = malloc(blockSize + sizeof(aio4c_clock_t));
+    memset(data, 0, blockSize + sizeof(aio4c_clock_t));
 
     switch(event) {
         case AIO4C_CONNECTED_EVENT:
@@ -157,9 +157,10 @@ static void clientHandler(Event event, Connection* connection, ClientHandlerData
         case AIO4C_WRITE_EVENT:
             buf = connection->writeBuffer;
             random(data);
-            gettimeofday((struct timeval*)&data[blockSize - 1], NULL);
-            BufferPut(buf, data, blockSize + sizeof(struct timeval));
-            crc = crc32(data, blockSize + sizeof(struct timeval));
+            position = BufferGetPosition(buf);
+            BufferPut(buf, data, blockSize);
+            BufferPutTimestamp(buf);
+            crc = crc32(&BufferGetBytes(buf)[position], blockSize + sizeof(aio4c_clock_t));
             Log(AIO4C_LOG_LEVEL_DEBUG, "sending CRC %u", crc);
             BufferPutInt(buf, &crc);
             break;
@@ -167,13 +168,11 @@ static void clientHandler(Event event, Connection* connection, ClientHandlerData
             buf = connection->dataBuffer;
             LogBuffer(AIO4C_LOG_LEVEL_DEBUG, buf);
             BufferGet(buf, data, blockSize);
-            BufferGet(buf, &req, sizeof(struct timeval));
-            memcpy(&data[blockSize], &req, sizeof(struct timeval));
+            BufferGetTimestamp(buf, &stamp);
+            memcpy(&data[blockSize], &stamp, sizeof(aio4c_clock_t));
             BufferGetInt(buf, &crc);
-            ck = crc32(data, blockSize + sizeof(struct timeval));
-            gettimeofday(&now, NULL);
-            ProbeSize(AIO4C_PROBE_LATENCY_COUNT, 1);
-            ProbeTime(AIO4C_TIME_PROBE_LATENCY, &req, &now);
+            ck = crc32(data, blockSize + sizeof(aio4c_clock_t));
+            ProbeLatency(stamp);
             if (ck != crc) {
                 Log(AIO4C_LOG_LEVEL_DEBUG, "checksum error (received: %u, computed: %u)", ck, crc);
                 ConnectionClose(connection, false);
@@ -218,9 +217,9 @@ static void serverHandler(Event event, Connection* connection, unsigned char* da
         case AIO4C_READ_EVENT:
             buf = ConnectionGetReadBuffer(connection);
             BufferGet(buf, data, BUFSZ);
-            _crc = (unsigned int*)&data[blockSize + sizeof(struct timeval)];
+            _crc = (unsigned int*)&data[blockSize + sizeof(aio4c_clock_t)];
             crc = *_crc;
-            ck = crc32((unsigned char*)data, blockSize + sizeof(struct timeval));
+            ck = crc32((unsigned char*)data, blockSize + sizeof(aio4c_clock_t));
             Log(AIO4C_LOG_LEVEL_DEBUG, "received CRC: %u, computed: %u", crc, ck);
             if (ck != crc) {
                 ConnectionClose(connection, false);
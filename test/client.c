@@ -27,13 +27,12 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 
 static int maxRequests = 0;
 
 void onRead(Connection* source) {
     Buffer* buffer = source->dataBuffer;
-    struct timeval ping, pong, now;
+    aio4c_clock_t ping = 0, pong = 0;
     int mySeq = 0;
     aio4c_byte_t* data = BufferGetBytes(buffer);
 
@@ -41,12 +40,10 @@ void onRead(Connection* source) {
 
     if (memcmp(&data[BufferGetPosition(buffer)], "PONG ", 6) == 0) {
         BufferPosition(buffer, BufferGetPosition(buffer) + 6);
-        BufferGet(buffer, &ping, sizeof(struct timeval));
-        BufferGet(buffer, &pong, sizeof(struct timeval));
+        BufferGetTimestamp(buffer, &ping);
+        BufferGetTimestamp(buffer, &pong);
         BufferGetInt(buffer, &mySeq);
-        gettimeofday(&now, NULL);
-        ProbeSize(AIO4C_PROBE_LATENCY_COUNT, 1);
-        ProbeTime(AIO4C_TIME_PROBE_LATENCY, &ping, &now);
+        ProbeLatency(ping);
         if (maxRequests != 0 && mySeq > maxRequests) {
             ConnectionClose(source, false);
         }
@@ -59,14 +56,12 @@ void onRead(Connection* source) {
 
 void onWrite(Connection* source, int* seq) {
     Buffer* buffer = source->writeBuffer;
-    struct timeval ping;
 
     if (source->state != AIO4C_CONNECTION_STATE_PENDING_CLOSE) {
         (*seq) ++;
 
-        gettimeofday(&ping, NULL);
         BufferPutString(buffer, "PING ");
-        BufferPut(buffer, &ping, sizeof(struct timeval));
+        BufferPutTimestamp(buffer);
         BufferPutInt(buffer, seq);
 
         BufferFlip(buffer);
@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/contention.h>
+#include <aio4c/lock.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static unsigned long long histogram[AIO4C_CONTENTION_BUCKETS];
+
+static void record(long long wait, unsigned long long count) {
+    histogram[ContentionBucket(wait)] += count;
+}
+
+/* acquisitions of the locks first taken in this file, the freed one apart */
+static void report(unsigned long long* alive, unsigned long long* freed) {
+    FILE* file = tmpfile();
+    char line[256];
+    char* label = NULL;
+    bool locks = false;
+
+    *alive = *freed = 0;
+
+    assert(file != NULL);
+    assert(ContentionWrite(file, 16));
+    rewind(file);
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "LOCK ", 5) == 0) {
+            locks = true;
+        } else if (locks && (label = strstr(line, "(contention.c:")) != NULL) {
+            label = strchr(label, ')') + 1;
+            if (strncmp(label, " freed", 6) == 0) {
+                assert(sscanf(label + 6, "%llu", freed) == 1);
+            } else {
+                assert(sscanf(label, "%llu", alive) == 1);
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+int main(int argc, char* argv[]) {
+    Lock* lock = NULL;
+    unsigned long long alive = 0, freed = 0;
+    int i = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    /* bucket n holds the waits of n significant bits */
+    assert(ContentionBucket(-1) == 0);
+    assert(ContentionBucket(0) == 0);
+    assert(ContentionBucket(1) == 1);
+    assert(ContentionBucket(2) == 2);
+    assert(ContentionBucket(3) == 2);
+    assert(ContentionBucket(4) == 3);
+    assert(ContentionBucket(1023) == 10);
+    assert(ContentionBucket(1024) == 11);
+
+    for (i = 1; i < AIO4C_CONTENTION_BUCKETS - 1; i++) {
+        assert(ContentionBucket(1LL << (i - 1)) == i);
+        assert(ContentionBucket((1LL << i) - 1) == i);
+    }
+
+    /* longer waits fall in the last bucket */
+    assert(ContentionBucket(1LL << (AIO4C_CONTENTION_BUCKETS - 1)) == AIO4C_CONTENTION_BUCKETS - 1);
+    assert(ContentionBucket(1LL << 62) == AIO4C_CONTENTION_BUCKETS - 1);
+
+    /* no wait, no percentile */
+    memset(histogram, 0, sizeof(histogram));
+    assert(ContentionPercentile(histogram, 0, 0, 0.50) == 0.0);
+
+    /* a single wait is reported as its bucket upper bound, but never beyond the longest */
+    record(3000, 1);
+    assert(ContentionPercentile(histogram, 1, 5000, 0.50) == 4.096);
+    assert(ContentionPercentile(histogram, 1, 3000, 0.99) == 3.0);
+
+    /* 90 waits of 1us and 10 of 1ms: the median stays in the first bucket, p99 in the last */
+    memset(histogram, 0, sizeof(histogram));
+    record(1000, 90);
+    record(1000000, 10);
+    assert(ContentionPercentile(histogram, 100, 1000000, 0.50) == 1.024);
+    assert(ContentionPercentile(histogram, 100, 1000000, 0.90) == 1.024);
+    assert(ContentionPercentile(histogram, 100, 1000000, 0.91) == 1000.0);
+    assert(ContentionPercentile(histogram, 100, 2000000, 0.99) == 1048.576);
+
+    /* the smallest fraction still ranks the first wait */
+    assert(ContentionPercentile(histogram, 100, 1000000, 0.0) == 1.024);
+
+    /* waits of zero nanoseconds have a zero upper bound */
+    memset(histogram, 0, sizeof(histogram));
+    record(0, 4);
+    assert(ContentionPercentile(histogram, 4, 0, 0.99) == 0.0);
+
+    /* a lock is accounted from the first time it is taken */
+    AIO4C_CONTENTION_TOP = 16;
+
+    lock = NewLock();
+    for (i = 0; i < 3; i++) {
+        ReleaseLock(TakeLock(lock));
+    }
+
+    report(&alive, &freed);
+    assert(alive == 3 && freed == 0);
+
+    /* and once freed, a lock allocated at the same address starts over */
+    FreeLock(&lock);
+    lock = NewLock();
+    ReleaseLock(TakeLock(lock));
+
+    report(&alive, &freed);
+    assert(alive == 1 && freed == 3);
+
+    FreeLock(&lock);
+
+    AIO4C_CONTENTION_TOP = 0;
+
+    Aio4cEnd();
+
+    return 0;
+}
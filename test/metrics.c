@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/alloc.h>
+#include <aio4c/metrics.h>
+#include <aio4c/segment.h>
+#include <aio4c/stats.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIZE (1024 * 1024)
+
+static char output[SIZE];
+
+static void render(StatsSegment* snapshot) {
+    FILE* file = NULL;
+    size_t size = 0;
+
+    assert((file = tmpfile()) != NULL);
+    assert(MetricsWrite(file, snapshot));
+    rewind(file);
+    size = fread(output, 1, SIZE - 1, file);
+    assert(size > 0 && size < SIZE - 1);
+    output[size] = '\0';
+    assert(fclose(file) == 0);
+}
+
+/* the value of the sample starting with the given name and labels */
+static char* sample(char* series) {
+    char line[256];
+    char* found = NULL;
+
+    snprintf(line, sizeof(line), "\n%s ", series);
+    assert((found = strstr(output, line)) != NULL);
+    assert(strstr(found + 1, line) == NULL);
+
+    return found + strlen(line);
+}
+
+static long long count(char* series) {
+    return atoll(sample(series));
+}
+
+int main(int argc, char* argv[]) {
+    StatsSegment* snapshot = NULL;
+    char probe[64], series[256], le[32];
+    char* line = NULL, *next = NULL, *type = NULL;
+    long long previous = 0, current = 0, highest = 0;
+    int i = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    assert((snapshot = aio4c_malloc(sizeof(StatsSegment))) != NULL);
+    memset(snapshot, 0, sizeof(StatsSegment));
+
+    for (i = 0; ProbeTimeTypeString[0][i] != '\0' && i < (int)sizeof(probe) - 1; i++) {
+        probe[i] = (ProbeTimeTypeString[0][i] == ' ') ? '_' : (char)tolower((unsigned char)ProbeTimeTypeString[0][i]);
+    }
+    probe[i] = '\0';
+
+    /* three durations of 5us, two of 1000us */
+    snapshot->histograms[0][StatsBucket(5)] = 3;
+    snapshot->histograms[0][StatsBucket(1000)] = 2;
+    snapshot->times[0] = 3 * 5 + 2 * 1000;
+    snapshot->sizes[AIO4C_PROBE_NETWORK_READ_SIZE] = 4096;
+    snapshot->pipes = 2;
+    snapshot->counters[0].connections = 7;
+    snapshot->counters[1].bytesIn = 1234;
+    snapshot->counters[1].pollTime = 1500000000ULL;
+    snapshot->counters[1].poolBuffers = 48;
+    snapshot->counters[1].poolUsed = 14;
+    snapshot->counters[1].poolFree = 34;
+    snapshot->memoryUsed = 65536;
+    snapshot->connections = 7;
+    snapshot->updates = 42;
+
+    render(snapshot);
+
+    /* every family is described once, right before its samples */
+    for (line = output; *line != '\0'; line = next) {
+        assert((next = strchr(line, '\n')) != NULL);
+        *next++ = '\0';
+
+        if (strncmp(line, "# HELP ", 7) == 0) {
+            assert(strncmp(next, "# TYPE ", 7) == 0);
+            assert(strncmp(next + 7, line + 7, strcspn(line + 7, " ")) == 0);
+            type = next + 7 + strcspn(line + 7, " ") + 1;
+            assert(strncmp(type, "counter\n", 8) == 0 || strncmp(type, "gauge\n", 6) == 0 || strncmp(type, "histogram\n", 10) == 0);
+        } else if (line[0] != '#') {
+            assert(strchr(line, ' ') != NULL);
+        }
+
+        next[-1] = '\n';
+    }
+
+    assert(strncmp(output, "# HELP aio4c_probe_duration_seconds ", 36) == 0);
+    assert(strstr(output, "\n# TYPE aio4c_probe_duration_seconds histogram\n") != NULL);
+    assert(strstr(output, "\n# TYPE aio4c_pipe_connections gauge\n") != NULL);
+    assert(strstr(output, "\n# TYPE aio4c_pipe_read_bytes_total counter\n") != NULL);
+
+    /* buckets are cumulative, bounded by powers of two microseconds */
+    previous = 0;
+    for (i = 0; i < AIO4C_STATS_HISTOGRAM_BUCKETS; i++) {
+        highest = StatsBucketHighest(i) + 1;
+        if ((highest & (highest - 1)) != 0) {
+            continue;
+        }
+
+        snprintf(le, sizeof(le), "%g", (double)highest / 1e6);
+        snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"%s\"}", probe, le);
+        current = count(series);
+        assert(current >= previous);
+        assert(current == ((highest > 5) ? 3 : 0) + ((highest > 1000) ? 2 : 0));
+        previous = current;
+    }
+
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"8e-06\"}", probe);
+    assert(count(series) == 3);
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"0.000512\"}", probe);
+    assert(count(series) == 3);
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"0.001024\"}", probe);
+    assert(count(series) == 5);
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_bucket{probe=\"%s\",le=\"+Inf\"}", probe);
+    assert(count(series) == 5);
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_count{probe=\"%s\"}", probe);
+    assert(count(series) == 5);
+    snprintf(series, sizeof(series), "aio4c_probe_duration_seconds_sum{probe=\"%s\"}", probe);
+    assert(strncmp(sample(series), "0.002015\n", 9) == 0);
+
+    /* size probes and pipe counters, durations in seconds */
+    assert(count("aio4c_network_read_bytes_total") == 4096);
+    assert(count("aio4c_pipe_connections{pipe=\"0\"}") == 7);
+    assert(count("aio4c_pipe_connections{pipe=\"1\"}") == 0);
+    assert(count("aio4c_pipe_read_bytes_total{pipe=\"1\"}") == 1234);
+    assert(strncmp(sample("aio4c_pipe_poll_seconds_total{pipe=\"1\"}"), "1.500000000\n", 12) == 0);
+    assert(strstr(output, "{pipe=\"2\"}") == NULL);
+    assert(count("aio4c_stats_updates_total") == 42);
+
+    /* gauges are taken from values accounted whether statistics are enabled or not */
+    assert(count("aio4c_memory_used_bytes") == 65536);
+    assert(count("aio4c_connections") == 7);
+    assert(count("aio4c_pipe_pool_buffers{pipe=\"1\"}") == 48);
+    assert(count("aio4c_pipe_pool_used_buffers{pipe=\"1\"}") == 14);
+    assert(count("aio4c_pipe_pool_free_buffers{pipe=\"1\"}") == 34);
+    assert(count("aio4c_pipe_pool_buffers{pipe=\"0\"}") == 0);
+    assert(strstr(output, "aio4c_memory_allocated_bytes") == NULL);
+
+    aio4c_free(snapshot);
+
+    Aio4cEnd();
+
+    return 0;
+}
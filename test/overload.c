@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/connection.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <string.h>
+
+#define MS 1000ULL
+
+static OverloadControl control = { .target = 5, .interval = 100 };
+static OverloadState state;
+
+static aio4c_time_t root(int count) {
+    aio4c_time_t r = 0;
+
+    while ((r + 1) * (r + 1) <= (aio4c_time_t)count) {
+        r++;
+    }
+
+    return r;
+}
+
+/* offers one task per microsecond between start and stop, and records when tasks are shed */
+static int run(aio4c_time_t start, aio4c_time_t stop, aio4c_time_t sojourn, bool backlog, aio4c_time_t* shed, int size) {
+    aio4c_time_t now = 0;
+    int count = 0;
+
+    for (now = start; now < stop; now++) {
+        if (OverloadShouldShed(&control, &state, now, sojourn, backlog)) {
+            assert(count < size);
+            shed[count++] = now;
+        }
+    }
+
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    OverloadControl disabled = { .target = 0, .interval = 100 };
+    aio4c_time_t shed[64];
+    aio4c_time_t start = 1000 * MS;
+    int count = 0, i = 0, previous = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    /* interval divided by the integer square root of the count */
+    assert(OverloadControlLaw(0, 100 * MS, 1) == 100 * MS);
+    assert(OverloadControlLaw(0, 100 * MS, 3) == 100 * MS);
+    assert(OverloadControlLaw(0, 100 * MS, 4) == 50 * MS);
+    assert(OverloadControlLaw(0, 100 * MS, 9) == 33333);
+    assert(OverloadControlLaw(0, 100 * MS, 99) == 11111);
+    assert(OverloadControlLaw(0, 100 * MS, 100) == 10 * MS);
+    assert(OverloadControlLaw(7, 100 * MS, 16) == 25 * MS + 7);
+
+    /* nothing is shed when disabled, whatever the sojourn time */
+    memset(&state, 0, sizeof(OverloadState));
+    for (i = 0; i < 1000; i++) {
+        assert(!OverloadShouldShed(&disabled, &state, start + i * MS, 1000 * MS, true));
+    }
+
+    /* nor when the task was alone in the queue */
+    memset(&state, 0, sizeof(OverloadState));
+    assert(run(start, start + 500 * MS, 10 * MS, false, shed, 64) == 0);
+
+    /* nor when tasks wait less than the target */
+    assert(run(start, start + 500 * MS, 5 * MS - 1, true, shed, 64) == 0);
+    assert(!state.dropping);
+
+    /* above the target for a whole interval, then shed at interval / sqrt(count) */
+    memset(&state, 0, sizeof(OverloadState));
+    count = run(start, start + 1000 * MS, 10 * MS, true, shed, 64);
+    assert(count > 9);
+    assert(shed[0] == start + 100 * MS);
+    assert(state.dropping);
+    assert(state.count == count);
+
+    /* the next task is shed interval / sqrt(n) after the n-th one */
+    for (i = 1; i < count; i++) {
+        assert(shed[i] - shed[i - 1] == 100 * MS / root(i));
+    }
+
+    assert(shed[3] - shed[2] == 100 * MS);
+    assert(shed[4] - shed[3] == 50 * MS);
+    assert(shed[9] - shed[8] == 33333);
+
+    /* one task below the target stops shedding */
+    start += 1000 * MS;
+    assert(run(start, start + 1, 1 * MS, true, shed, 64) == 0);
+    assert(!state.dropping);
+    assert(state.firstAbove == 0);
+
+    /* coming back shortly resumes near the previous rate once above for an interval */
+    previous = state.count;
+    count = run(start + 1, start + 101 * MS + 1, 10 * MS, true, shed, 64);
+    assert(count == 1);
+    assert(shed[0] == start + 1 + 100 * MS);
+    assert(state.count == previous - 1);
+
+    /* coming back later starts over */
+    start += 101 * MS + 1;
+    assert(run(start, start + 1000 * MS, 10 * MS, true, shed, 64) > 1);
+    assert(state.count - state.lastCount > 1);
+    start += 1000 * MS;
+    assert(run(start, start + 1, 1 * MS, true, shed, 64) == 0);
+    start += 10000 * MS;
+    count = run(start, start + 101 * MS, 10 * MS, true, shed, 64);
+    assert(count == 1);
+    assert(state.count == 1);
+
+    Aio4cEnd();
+
+    return 0;
+}
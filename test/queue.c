@@ -154,6 +154,41 @@ void action4(Queue* queue, int* pCount) {
     *pCount = count;
 }
 
+static bool aio4c_visit(QueueItem* item, void* arg) {
+    int* remaining = (int*)arg;
+
+    dprintf("\t\tvisiting %d\n", ((Data*)QueueDataItemGet(item))->a);
+
+    return (--(*remaining) > 0);
+}
+
+void action5(Queue* queue, int* pCount) {
+    int count = *pCount;
+    int stop = 0;
+    int remaining = INT_MAX;
+
+    dprintf("\tvisiting all %d items\n", count);
+
+    if (QueueForEach(queue, aio4c_visit, &remaining) != count) {
+        fprintf(stderr, "visited %d items out of %d\n", INT_MAX - remaining, count);
+        exit(EXIT_FAILURE);
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    stop = rand() % count + 1;
+    remaining = stop;
+
+    dprintf("\tvisiting %d items\n", stop);
+
+    if (QueueForEach(queue, aio4c_visit, &remaining) != stop) {
+        fprintf(stderr, "visit did not stop after %d items\n", stop);
+        exit(EXIT_FAILURE);
+    }
+}
+
 __attribute__((noreturn)) static void usage(char* argv0) {
     fprintf(stderr, "usage: %s  [-Qd] [-Qn count]\n", argv0);
     fprintf(stderr, "where:\n");
@@ -167,11 +202,12 @@ __attribute__((noreturn)) static void usage(char* argv0) {
 int main(int argc, char* argv[]) {
     QueueItem* item = NULL;
     int count = 0, j = 0, action = 0, progress = 0;
-    void (*actions[4])(Queue*,int*) = {
+    void (*actions[5])(Queue*,int*) = {
         action1,
         action2,
         action3,
-        action4
+        action4,
+        action5
     };
     double percent = 0.0;
     int i = 0;
@@ -221,11 +257,16 @@ int main(int argc, char* argv[]) {
     Queue* queue = NewQueue();
 
     for (j = 1; j <= COUNT; j++) {
-        action = rand() % 4;
+        action = rand() % 5;
         dprintf("before action %d: %d\n", action + 1, count);
         actions[action](queue,&count);
         dprintf("after action %d: %d\n", action + 1, count);
 
+        if (QueueGetSize(queue) != count) {
+            fprintf(stderr, "queue size %d does not match item count %d\n", QueueGetSize(queue), count);
+            return EXIT_FAILURE;
+        }
+
         if (progress) {
             percent = (double)(j * 100.0) / ((double)(COUNT));
 
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/alloc.h>
+#include <aio4c/atomic.h>
+#include <aio4c/segment.h>
+#include <aio4c/thread.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <string.h>
+
+#define UPDATES 200000
+
+static StatsSegment* segment = NULL;
+static volatile bool done = false;
+
+/* publishes like the statistics thread: every field holds the number of the update */
+static void update(unsigned long long value) {
+    int i = 0;
+
+    segment->sequence++;
+    AtomicBarrier();
+
+    segment->updates = value;
+    segment->elapsed = value;
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        segment->times[i] = (long long)value;
+        segment->histograms[i][AIO4C_STATS_HISTOGRAM_BUCKETS - 1] = (long long)value;
+    }
+
+    AtomicBarrier();
+    segment->sequence++;
+}
+
+static bool writer(ThreadData dummy __attribute__((unused))) {
+    unsigned long long value = 0;
+
+    for (value = 1; value <= UPDATES; value++) {
+        update(value);
+    }
+
+    done = true;
+
+    return false;
+}
+
+static void check(StatsSegment* copy) {
+    int i = 0;
+
+    assert((copy->sequence & 1) == 0);
+    assert(copy->elapsed == copy->updates);
+
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        assert(copy->times[i] == (long long)copy->updates);
+        assert(copy->histograms[i][AIO4C_STATS_HISTOGRAM_BUCKETS - 1] == (long long)copy->updates);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    StatsSegment* copy = NULL;
+    Thread* thread = NULL;
+    unsigned long long last = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    assert((segment = aio4c_malloc(sizeof(StatsSegment))) != NULL);
+    assert((copy = aio4c_malloc(sizeof(StatsSegment))) != NULL);
+    memset(segment, 0, sizeof(StatsSegment));
+    segment->magic = AIO4C_STATS_SEGMENT_MAGIC;
+
+    /* a stable segment is copied at once */
+    update(1);
+    assert(StatsSegmentRead(segment, copy));
+    assert(memcmp(copy, segment, sizeof(StatsSegment)) == 0);
+    check(copy);
+
+    /* a segment left in the middle of an update is never copied */
+    segment->sequence++;
+    memset(copy, 0, sizeof(StatsSegment));
+    assert(!StatsSegmentRead(segment, copy));
+    assert(copy->magic == 0);
+
+    /* until the update completes */
+    segment->updates = 2;
+    segment->sequence++;
+    assert(StatsSegmentRead(segment, copy));
+    assert(copy->updates == 2);
+
+    /* snapshots taken while updates go on are consistent, and never go back in time */
+    update(0);
+    assert((thread = NewThread("writer", NULL, writer, NULL, NULL)) != NULL);
+    assert(ThreadStart(thread));
+
+    while (!done) {
+        if (StatsSegmentRead(segment, copy)) {
+            check(copy);
+            assert(copy->updates >= last);
+            last = copy->updates;
+        }
+    }
+
+    ThreadJoin(thread);
+
+    assert(StatsSegmentRead(segment, copy));
+    check(copy);
+    assert(copy->updates == UPDATES);
+    assert(copy->sequence == segment->sequence);
+
+    aio4c_free(copy);
+    aio4c_free(segment);
+
+    Aio4cEnd();
+
+    return 0;
+}
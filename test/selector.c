@@ -271,6 +271,7 @@ int main(int argc, char* argv[]) {
     int consumerType = 0, producerType = 1;
     int* _consumerType = &consumerType, *_producerType = &producerType;
     Thread* consumer = NULL, * producer = NULL;
+    Selector* idle = NULL;
     int ko = 1;
 #ifndef AIO4C_WIN32
     int urandom = -1;
@@ -278,6 +279,10 @@ int main(int argc, char* argv[]) {
 
     Aio4cInit(argc, argv, NULL, NULL);
 
+    assert((idle = NewSelector()) != NULL);
+    assert(SelectTimeout(idle, 10) == 0);
+    FreeSelector(&idle);
+
     channel(fds[0], &to[0]);
     channel(fds[1], &to[1]);
 
@@ -26,18 +26,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 #include <unistd.h>
 
 typedef struct s_Data {
-    struct timeval ping;
+    aio4c_clock_t ping;
     int lastSeq;
 } Data;
 
 static void serverHandler(Event event, Connection* source, Data* data) {
     Buffer* buffer = NULL;
     int curSeq = 0;
-    struct timeval pong;
     aio4c_byte_t* bdata = NULL;
 
     switch (event) {
@@ -47,7 +45,7 @@ static void serverHandler(Event event, Connection* source, Data* data) {
             LogBuffer(AIO4C_LOG_LEVEL_DEBUG, buffer);
             if (memcmp(&bdata[BufferGetPosition(buffer)], "PING ", 6) == 0) {
                 BufferPosition(buffer, BufferGetPosition(buffer) + 6);
-                BufferGet(buffer, &data->ping, sizeof(struct timeval));
+                BufferGetTimestamp(buffer, &data->ping);
                 BufferGetInt(buffer, &curSeq);
                 if (curSeq == data->lastSeq + 1) {
                     data->lastSeq ++;
@@ -64,9 +62,8 @@ static void serverHandler(Event event, Connection* source, Data* data) {
         case AIO4C_WRITE_EVENT:
             buffer = source->writeBuffer;
             BufferPutString(buffer, "PONG ");
-            gettimeofday(&pong, NULL);
-            BufferPut(buffer, &data->ping, sizeof(struct timeval));
-            BufferPut(buffer, &pong, sizeof(struct timeval));
+            BufferPut(buffer, &data->ping, sizeof(aio4c_clock_t));
+            BufferPutTimestamp(buffer);
             BufferPutInt(buffer, &data->lastSeq);
             BufferFlip(buffer);
             LogBuffer(AIO4C_LOG_LEVEL_DEBUG, buffer);
@@ -0,0 +1,164 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/buffer.h>
+#include <aio4c/stats.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <string.h>
+
+#define SUB_BUCKETS (1 << AIO4C_STATS_HISTOGRAM_SUB_BITS)
+
+static long long buckets[AIO4C_STATS_HISTOGRAM_BUCKETS];
+
+static void record(long long value, long long count) {
+    buckets[StatsBucket(value)] += count;
+}
+
+int main(int argc, char* argv[]) {
+    ProbeTimeSummary summary;
+    BufferPool* pool = NULL;
+    Buffer* buffer = NULL;
+    unsigned int probes = AIO4C_STATS_PROBES;
+    long long gauge = 0;
+    long long lowest = 0, highest = 0, value = 0;
+    int i = 0;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    /* small values each have their own bucket */
+    for (i = 0; i < 2 * SUB_BUCKETS; i++) {
+        assert(StatsBucket(i) == i);
+        assert(StatsBucketHighest(i) == i);
+    }
+
+    assert(StatsBucket(-1) == 0);
+
+    /* then each power of two is split in SUB_BUCKETS buckets of equal width */
+    assert(StatsBucket(32) == 32);
+    assert(StatsBucketHighest(32) == 33);
+    assert(StatsBucket(33) == 32);
+    assert(StatsBucket(34) == 33);
+    assert(StatsBucketHighest(47) == 63);
+    assert(StatsBucket(63) == 47);
+    assert(StatsBucket(64) == 48);
+    assert(StatsBucketHighest(48) == 67);
+
+    /* every bucket ends right before the next one starts, and is at most 1/SUB_BUCKETS wide */
+    for (i = 1; i < AIO4C_STATS_HISTOGRAM_BUCKETS; i++) {
+        lowest = StatsBucketHighest(i - 1) + 1;
+        highest = StatsBucketHighest(i);
+        assert(highest >= lowest);
+        assert(StatsBucket(lowest) == i);
+        assert(StatsBucket(highest) == i);
+        assert((highest - lowest + 1) * SUB_BUCKETS <= lowest || i < 2 * SUB_BUCKETS);
+    }
+
+    /* values beyond the range fall in the last bucket */
+    assert(StatsBucketHighest(AIO4C_STATS_HISTOGRAM_BUCKETS - 1) == (1LL << AIO4C_STATS_HISTOGRAM_MAX_BITS) - 1);
+    assert(StatsBucket(1LL << AIO4C_STATS_HISTOGRAM_MAX_BITS) == AIO4C_STATS_HISTOGRAM_BUCKETS - 1);
+    assert(StatsBucket(1LL << 62) == AIO4C_STATS_HISTOGRAM_BUCKETS - 1);
+
+    /* an empty histogram summarizes to zero */
+    memset(buckets, 0, sizeof(buckets));
+    StatsSummarize(buckets, &summary);
+    assert(summary.count == 0 && summary.min == 0 && summary.max == 0 && summary.p50 == 0 && summary.p999 == 0);
+
+    /* a single value is reported as its bucket */
+    record(1000, 1);
+    StatsSummarize(buckets, &summary);
+    highest = StatsBucketHighest(StatsBucket(1000));
+    assert(summary.count == 1);
+    assert(summary.min == StatsBucketHighest(StatsBucket(1000) - 1) + 1);
+    assert(summary.min <= 1000 && 1000 <= highest);
+    assert(summary.p50 == highest && summary.p90 == highest && summary.p99 == highest && summary.p999 == highest);
+    assert(summary.max == highest);
+
+    /* percentiles are the highest value of the bucket holding their rank */
+    memset(buckets, 0, sizeof(buckets));
+    for (value = 1; value <= 1000; value++) {
+        record(value * 1000, 1);
+    }
+
+    StatsSummarize(buckets, &summary);
+    assert(summary.count == 1000);
+    assert(summary.min == StatsBucketHighest(StatsBucket(1000) - 1) + 1);
+    assert(summary.p50 == StatsBucketHighest(StatsBucket(500000)));
+    assert(summary.p90 == StatsBucketHighest(StatsBucket(900000)));
+    assert(summary.p99 == StatsBucketHighest(StatsBucket(990000)));
+    assert(summary.p999 == StatsBucketHighest(StatsBucket(999000)));
+    assert(summary.max == StatsBucketHighest(StatsBucket(1000000)));
+
+    /* with a bounded relative error */
+    assert(summary.p50 >= 500000 && summary.p50 * SUB_BUCKETS <= 500000 * (SUB_BUCKETS + 1));
+    assert(summary.p99 >= 990000 && summary.p99 * SUB_BUCKETS <= 990000 * (SUB_BUCKETS + 1));
+
+    /* a long tail only moves the highest percentiles */
+    record(5000000000LL, 2);
+    StatsSummarize(buckets, &summary);
+    assert(summary.count == 1002);
+    assert(summary.p99 == StatsBucketHighest(StatsBucket(992000)));
+    assert(summary.p999 >= 5000000000LL);
+    assert(summary.max == summary.p999);
+
+    /* gauges stay right when their category is toggled between a delta and its opposite */
+    StatsEnable(AIO4C_PROBE_CATEGORY_CONNECTION);
+    gauge = StatsGetSize(AIO4C_PROBE_CONNECTION_COUNT);
+    ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, 1);
+    StatsDisable(AIO4C_PROBE_CATEGORY_CONNECTION);
+    assert(StatsGetSize(AIO4C_PROBE_CONNECTION_COUNT) == gauge + 1);
+    ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, -1);
+    assert(StatsGetSize(AIO4C_PROBE_CONNECTION_COUNT) == gauge);
+    ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, 1);
+    StatsEnable(AIO4C_PROBE_CATEGORY_CONNECTION);
+    ProbeSize(AIO4C_PROBE_CONNECTION_COUNT, -1);
+    assert(StatsGetSize(AIO4C_PROBE_CONNECTION_COUNT) == gauge);
+
+    assert((pool = NewBufferPool(512)) != NULL);
+    gauge = StatsGetSize(AIO4C_PROBE_BUFFER_ALLOCATED_SIZE);
+    StatsDisable(AIO4C_PROBE_CATEGORY_BUFFER);
+    assert((buffer = AllocateBuffer(pool)) != NULL);
+    assert(StatsGetSize(AIO4C_PROBE_BUFFER_ALLOCATED_SIZE) == gauge + 512);
+    StatsEnable(AIO4C_PROBE_CATEGORY_BUFFER);
+    ReleaseBuffer(&buffer);
+    assert(StatsGetSize(AIO4C_PROBE_BUFFER_ALLOCATED_SIZE) == gauge);
+    FreeBufferPool(&pool);
+
+    /* while counters only count what happened with their category enabled */
+    gauge = StatsGetSize(AIO4C_PROBE_NETWORK_READ_SIZE);
+    StatsDisable(AIO4C_PROBE_CATEGORY_NETWORK);
+    ProbeSize(AIO4C_PROBE_NETWORK_READ_SIZE, 100);
+    assert(StatsGetSize(AIO4C_PROBE_NETWORK_READ_SIZE) == gauge);
+    StatsEnable(AIO4C_PROBE_CATEGORY_NETWORK);
+    ProbeSize(AIO4C_PROBE_NETWORK_READ_SIZE, 100);
+    assert(StatsGetSize(AIO4C_PROBE_NETWORK_READ_SIZE) == gauge + 100);
+
+    StatsDisable(AIO4C_PROBE_CATEGORY_ALL);
+    StatsEnable(probes);
+
+    Aio4cEnd();
+
+    return 0;
+}
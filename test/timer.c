@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/alloc.h>
+#include <aio4c/clock.h>
+#include <aio4c/timer.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct s_Data {
+    int          delay;
+    aio4c_time_t fired;
+    int          count;
+    bool         cancelled;
+    TimerId      id;
+} Data;
+
+static int COUNT = 100000;
+static TimerWheel* wheel = NULL;
+static Data* data = NULL;
+static Timer* owner = NULL;
+static int fired = 0;
+
+static aio4c_time_t now(void) {
+    return ClockMicroseconds() / 1000;
+}
+
+static void callback(void* source, void* arg __attribute__((unused))) {
+    Data* d = (Data*)source;
+
+    assert(!d->cancelled);
+    d->fired = TimerWheelGetTime(wheel);
+    d->count++;
+    fired++;
+}
+
+static void owned(void* source __attribute__((unused)), void* arg __attribute__((unused))) {
+    assert(false);
+}
+
+static void rearm(void* source, void* arg) {
+    int* remaining = (int*)arg;
+
+    (*remaining)--;
+
+    /* callbacks may schedule timers on the wheel firing them */
+    if (*remaining > 0) {
+        assert(TimerWheelSchedule(wheel, NULL, 1000, rearm, source, arg, NULL, NULL));
+    }
+}
+
+static int delay(int i) {
+    switch (i % 4) {
+        case 0:
+            return rand() % 256;
+        case 1:
+            return rand() % (1 << 14);
+        case 2:
+            return rand() % (1 << 20);
+        default:
+            /* beyond the wheel range */
+            return rand() % (1 << 28);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    aio4c_time_t start = 0, stop = 0, time = 0, end = 0;
+    TimerId id;
+    int i = 0, cancelled = 0, remaining = 5;
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    srand(getpid());
+
+    assert((wheel = NewTimerWheel()) != NULL);
+    assert((data = aio4c_malloc(COUNT * sizeof(Data))) != NULL);
+    assert(TimerWheelNextTimeout(wheel) == -1);
+
+    start = now();
+
+    for (i = 0; i < COUNT; i++) {
+        data[i].delay = delay(i);
+        assert(TimerWheelSchedule(wheel, NULL, data[i].delay, callback, &data[i], NULL, &data[i].id, NULL));
+    }
+
+    stop = now();
+
+    for (i = 0; i < COUNT; i += 3) {
+        assert(TimerCancel(data[i].id));
+        assert(!TimerCancel(data[i].id));
+        data[i].cancelled = true;
+        cancelled++;
+    }
+
+    assert(TimerWheelNextTimeout(wheel) >= 0);
+
+    for (i = 0; i < 10; i++) {
+        assert(TimerWheelSchedule(wheel, &owner, 10, owned, NULL, NULL, NULL, NULL));
+    }
+
+    assert(TimerWheelPending(wheel, &owner));
+    assert(TimerWheelCancelAll(wheel, &owner) == 10);
+    assert(!TimerWheelPending(wheel, &owner));
+    assert(owner == NULL);
+
+    assert(TimerWheelSchedule(wheel, NULL, 1000, rearm, NULL, &remaining, &id, NULL));
+
+    time = TimerWheelGetTime(wheel);
+    end = stop + (1 << 28);
+
+    while (time < end) {
+        time += 1 + rand() % 100000;
+        TimerWheelAdvance(wheel, time);
+    }
+
+    assert(fired == COUNT - cancelled);
+    assert(remaining == 0);
+    assert(!TimerCancel(id));
+    assert(TimerWheelNextTimeout(wheel) == -1);
+
+    for (i = 0; i < COUNT; i++) {
+        if (data[i].cancelled) {
+            assert(data[i].count == 0);
+        } else {
+            assert(data[i].count == 1);
+            assert(data[i].fired >= start + (aio4c_time_t)data[i].delay);
+            /* timers due before the wheel time fire on its next tick */
+            assert(data[i].fired <= stop + (aio4c_time_t)data[i].delay + 1);
+        }
+    }
+
+    aio4c_free(data);
+    FreeTimerWheel(&wheel);
+    assert(wheel == NULL);
+
+    Aio4cEnd();
+
+    return 0;
+}
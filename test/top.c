@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <aio4c.h>
+#include <aio4c/segment.h>
+#include <aio4c/stats.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NANOSECONDS 1000000000.0
+
+__attribute__((noreturn)) static void usage(char* argv0) {
+    fprintf(stderr, "usage: %s [-i interval] [-n count] [-h] segment\n", argv0);
+    fprintf(stderr, "where:\n");
+    fprintf(stderr, "\t-i interval: defines the number of seconds between two displays (default: 1)\n");
+    fprintf(stderr, "\t-n count   : defines the number of displays before exiting (default: 0 = unlimited)\n");
+    fprintf(stderr, "\t-h         : displays this help message\n");
+    fprintf(stderr, "\tsegment    : file given with -Sm to the observed process\n");
+    exit(EXIT_SUCCESS);
+}
+
+static double rate(long long current, long long previous, double elapsed) {
+    return (elapsed > 0.0) ? (double)(current - previous) / elapsed : 0.0;
+}
+
+static double ratio(long long current, long long previous, long long currentTotal, long long previousTotal) {
+    return (currentTotal > previousTotal) ? (double)(current - previous) / (double)(currentTotal - previousTotal) : 0.0;
+}
+
+static void displayProbes(StatsSegment* current, StatsSegment* previous, double elapsed) {
+    long long delta[AIO4C_STATS_HISTOGRAM_BUCKETS];
+    ProbeTimeSummary summary;
+    int i = 0, j = 0;
+
+    printf("%-18s %12s %12s %10s %10s %10s %10s\n", "PROBE", "COUNT/s", "MEAN (us)", "P50 (us)", "P99 (us)", "P99.9 (us)", "MAX (us)");
+
+    for (i = 0; i < AIO4C_TIME_MAX_PROBE_TYPE; i++) {
+        for (j = 0; j < AIO4C_STATS_HISTOGRAM_BUCKETS; j++) {
+            delta[j] = current->histograms[i][j] - previous->histograms[i][j];
+        }
+        StatsSummarize(delta, &summary);
+        printf("%-18s %12.1f %12.1f %10lld %10lld %10lld %10lld\n", ProbeTimeTypeString[i],
+                (double)summary.count / elapsed,
+                (summary.count > 0) ? (double)(current->times[i] - previous->times[i]) / (double)summary.count : 0.0,
+                summary.p50, summary.p99, summary.p999, summary.max);
+    }
+
+    printf("\n%-18s %12.1f kb/s\n", "READ", rate(current->sizes[AIO4C_PROBE_NETWORK_READ_SIZE], previous->sizes[AIO4C_PROBE_NETWORK_READ_SIZE], elapsed) / 1024.0);
+    printf("%-18s %12.1f kb/s\n", "WRITTEN", rate(current->sizes[AIO4C_PROBE_NETWORK_WRITE_SIZE], previous->sizes[AIO4C_PROBE_NETWORK_WRITE_SIZE], elapsed) / 1024.0);
+    printf("%-18s %12.1f kb/s\n", "PROCESSED", rate(current->sizes[AIO4C_PROBE_PROCESSED_DATA_SIZE], previous->sizes[AIO4C_PROBE_PROCESSED_DATA_SIZE], elapsed) / 1024.0);
+    printf("%-18s %12lld kb\n", "ALLOCATED", current->memoryUsed / 1024);
+    printf("%-18s %12d\n", "CONNECTIONS", current->connections);
+}
+
+static void displayPipes(StatsSegment* current, StatsSegment* previous, double elapsed) {
+    PipeCounters* c = NULL;
+    PipeCounters* p = NULL;
+    PipeCounters zero;
+    int i = 0;
+
+    memset(&zero, 0, sizeof(PipeCounters));
+
+    printf("\n%-4s %6s %10s %10s %8s %6s %6s %8s %10s %10s %6s %10s %10s %10s %10s\n", "PIPE", "CONNS", "LOOPS/s", "WAKEUPS/s", "READY",
+            "POLL%", "DISP%", "QUEUED", "TASKS/s", "WAIT (us)", "PROC%", "WRITES/s", "SHORT/s", "IN kb/s", "OUT kb/s");
+
+    for (i = 0; i < current->pipes && i < AIO4C_STATS_SEGMENT_MAX_PIPES; i++) {
+        c = &current->counters[i];
+        /* pipes appearing since the previous update start from zero */
+        p = (i < previous->pipes) ? &previous->counters[i] : &zero;
+        printf("%-4d %6d %10.1f %10.1f %8.2f %6.1f %6.1f %8d %10.1f %10.1f %6.1f %10.1f %10.1f %10.1f %10.1f\n", i, c->connections,
+                rate(c->iterations, p->iterations, elapsed),
+                rate(c->wakeups, p->wakeups, elapsed),
+                ratio(c->readyKeys, p->readyKeys, c->wakeups, p->wakeups),
+                rate(c->pollTime, p->pollTime, elapsed) * 100.0 / NANOSECONDS,
+                rate(c->dispatchTime, p->dispatchTime, elapsed) * 100.0 / NANOSECONDS,
+                c->pendingItems,
+                rate(c->tasks, p->tasks, elapsed),
+                ratio(c->waitTime, p->waitTime, c->tasks, p->tasks) / 1000.0,
+                rate(c->processTime, p->processTime, elapsed) * 100.0 / NANOSECONDS,
+                rate(c->writes, p->writes, elapsed),
+                rate(c->shortWrites, p->shortWrites, elapsed),
+                rate(c->bytesIn, p->bytesIn, elapsed) / 1024.0,
+                rate(c->bytesOut, p->bytesOut, elapsed) / 1024.0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int optind = 0;
+    long int optvalue = 0;
+    char* endptr = NULL;
+    int interval = 1;
+    int count = 0;
+    int displayed = 0;
+    char* path = NULL;
+    StatsSegment* segment = NULL;
+    StatsSegment* current = NULL;
+    StatsSegment* previous = NULL;
+    StatsSegment* swap = NULL;
+    double elapsed = 0.0;
+    bool clear = false;
+    int result = EXIT_SUCCESS;
+
+    for (optind = 1; optind < argc; optind++) {
+        switch (argv[optind][0]) {
+            case '-':
+                switch (argv[optind][1]) {
+                    case 'i':
+                        if (optind + 1 < argc) {
+                            optvalue = strtol(argv[optind + 1], &endptr, 10);
+                            if (optvalue > 0 && optvalue < INT_MAX) {
+                                interval = (int)optvalue;
+                            }
+                            optind++;
+                        }
+                        break;
+                    case 'n':
+                        if (optind + 1 < argc) {
+                            optvalue = strtol(argv[optind + 1], &endptr, 10);
+                            if (optvalue >= 0 && optvalue < INT_MAX) {
+                                count = (int)optvalue;
+                            }
+                            optind++;
+                        }
+                        break;
+                    case 'h':
+                        usage(argv[0]);
+                    default:
+                        break;
+                }
+                break;
+            default:
+                path = argv[optind];
+                break;
+        }
+    }
+
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    current = malloc(sizeof(StatsSegment));
+    previous = malloc(sizeof(StatsSegment));
+
+    if (current == NULL || previous == NULL || (segment = StatsSegmentOpen(path)) == NULL || !StatsSegmentRead(segment, previous)) {
+        fprintf(stderr, "cannot read statistics segment %s\n", path);
+        result = EXIT_FAILURE;
+    }
+
+    clear = (isatty(STDOUT_FILENO) != 0);
+
+    while (result == EXIT_SUCCESS && previous->running && (count == 0 || displayed < count)) {
+        sleep(interval);
+
+        if (!StatsSegmentRead(segment, current)) {
+            continue;
+        }
+
+        /* the process updates the segment at its own pace */
+        if (current->updates == previous->updates) {
+            continue;
+        }
+
+        elapsed = (double)(current->elapsed - previous->elapsed) / NANOSECONDS;
+
+        if (clear) {
+            printf("\033[H\033[2J");
+        }
+
+        printf("aio4c-top - pid %lld - update %llu - %.1fs elapsed%s\n\n", current->pid, current->updates,
+                (double)current->elapsed / NANOSECONDS, current->running ? "" : " - exited");
+
+        displayProbes(current, previous, elapsed);
+        displayPipes(current, previous, elapsed);
+        fflush(stdout);
+
+        displayed++;
+
+        swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    if (result == EXIT_SUCCESS && !previous->running) {
+        fprintf(stderr, "process %lld exited\n", previous->pid);
+    }
+
+    StatsSegmentClose(&segment);
+
+    if (current != NULL) {
+        free(current);
+    }
+
+    if (previous != NULL) {
+        free(previous);
+    }
+
+    Aio4cEnd();
+
+    return result;
+}
@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2011 blakawk
+ *
+ * This file is part of Aio4c <http://aio4c.so>.
+ *
+ * Aio4c <http://aio4c.so> is free software: you
+ * can  redistribute  it  and/or modify it under
+ * the  terms  of the GNU General Public License
+ * as published by the Free Software Foundation,
+ * version 3 of the License.
+ *
+ * Aio4c <http://aio4c.so> is distributed in the
+ * hope  that it will be useful, but WITHOUT ANY
+ * WARRANTY;  without  even the implied warranty
+ * of   MERCHANTABILITY   or   FITNESS   FOR   A
+ * PARTICULAR PURPOSE.
+ *
+ * See  the  GNU General Public License for more
+ * details.  You  should have received a copy of
+ * the  GNU  General  Public  License along with
+ * Aio4c    <http://aio4c.so>.   If   not,   see
+ * <http://www.gnu.org/licenses/>.
+ */
+#include <aio4c.h>
+#include <aio4c/clock.h>
+#include <aio4c/trace.h>
+#include <aio4c/types.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BASE 1000u
+#define MAX_ASYNC 64
+
+typedef struct s_Async {
+    char   name[AIO4C_TRACE_NAME_SIZE];
+    char   phase;
+    double ts;
+} Async;
+
+/* events recorded into the ring of the main thread, which is never reset */
+static unsigned long long recorded = 0;
+
+static void record(unsigned int trace, TracePoint point, aio4c_clock_t start, aio4c_clock_t stop) {
+    _TraceRecord(trace, point, start, stop);
+    recorded++;
+}
+
+static FILE* export(void) {
+    FILE* file = NULL;
+
+    assert((file = tmpfile()) != NULL);
+    assert(TraceWrite(file));
+    rewind(file);
+
+    return file;
+}
+
+/* the request slices of a trace, in the order they were written */
+static int asyncs(unsigned int trace, Async* slices) {
+    FILE* file = export();
+    char line[512];
+    unsigned int id = 0;
+    int count = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "{\"name\":\"%31[^\"]\",\"cat\":\"request\",\"ph\":\"%c\",\"id\":\"0x%x\",\"ts\":%lf",
+                   slices[count].name, &slices[count].phase, &id, &slices[count].ts) == 4 && id == trace) {
+            assert(++count < MAX_ASYNC);
+        }
+    }
+
+    assert(fclose(file) == 0);
+
+    return count;
+}
+
+/* the events kept by the rings, and the range of the ones recorded by wrap() */
+static int kept(unsigned int* oldest, unsigned int* newest) {
+    FILE* file = export();
+    char line[512];
+    char* args = NULL;
+    unsigned int trace = 0;
+    int count = 0;
+
+    *oldest = (unsigned int)-1;
+    *newest = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strstr(line, "\"cat\":\"aio4c\"") == NULL) {
+            continue;
+        }
+        assert((args = strstr(line, "\"args\":{\"trace\":")) != NULL);
+        trace = (unsigned int)atol(args + strlen("\"args\":{\"trace\":"));
+        if (trace >= BASE) {
+            if (trace < *oldest) {
+                *oldest = trace;
+            }
+            if (trace > *newest) {
+                *newest = trace;
+            }
+        }
+        count++;
+    }
+
+    assert(fclose(file) == 0);
+
+    return count;
+}
+
+static void check(Async* slices, int count, char** expected) {
+    Async* opened[MAX_ASYNC];
+    int depth = 0, i = 0;
+
+    for (i = 0; i < count; i++) {
+        assert(expected[i] != NULL);
+        assert(strcmp(slices[i].name, expected[i]) == 0);
+        if (i > 0) {
+            assert(slices[i].ts >= slices[i - 1].ts);
+        }
+
+        /* every slice ends before the one enclosing it, the request enclosing them all */
+        if (slices[i].phase == 'b') {
+            assert(i == 0 || depth > 0);
+            opened[depth++] = &slices[i];
+        } else {
+            assert(slices[i].phase == 'e');
+            assert(depth > 0);
+            depth--;
+            assert(strcmp(opened[depth]->name, slices[i].name) == 0);
+            assert(slices[i].ts >= opened[depth]->ts);
+        }
+    }
+
+    assert(expected[count] == NULL);
+    assert(depth == 0);
+}
+
+static void phases(void) {
+    Async slices[MAX_ASYNC];
+    int count = 0;
+    char* request[] = {
+        "request",
+        "reader", "reader",
+        "worker queue", "worker queue",
+        "worker", "worker",
+        "handler", "handler",
+        "writer queue", "writer queue",
+        "send", "send",
+        "request",
+        NULL
+    };
+    char* shortRequest[] = {
+        "request",
+        "reader", "reader",
+        "send", "send",
+        "request",
+        NULL
+    };
+
+    /* recorded out of order, as by the reader, worker and writer threads */
+    record(1, AIO4C_TRACE_POINT_SEND, 7000, 7500);
+    record(1, AIO4C_TRACE_POINT_READ, 1000, 1000);
+    record(2, AIO4C_TRACE_POINT_READ, 2000, 2000);
+    record(1, AIO4C_TRACE_POINT_ENQUEUE, 1200, 1200);
+    record(1, AIO4C_TRACE_POINT_DEQUEUE, 3000, 3000);
+    /* write interest enabled by the handler runs within it */
+    record(1, AIO4C_TRACE_POINT_WRITE_INTEREST, 4000, 4000);
+    record(1, AIO4C_TRACE_POINT_PROCESS, 3100, 5100);
+    record(2, AIO4C_TRACE_POINT_SEND, 2500, 2600);
+
+    count = asyncs(1, slices);
+    check(slices, count, request);
+    assert(slices[0].phase == 'b' && slices[count - 1].phase == 'e');
+    assert(slices[8].ts > slices[7].ts);
+    assert(slices[count - 1].ts > slices[0].ts);
+
+    count = asyncs(2, slices);
+    check(slices, count, shortRequest);
+
+    assert(asyncs(3, slices) == 0);
+}
+
+static void wrap(void) {
+    unsigned long long first = 0;
+    unsigned int oldest = 0, newest = 0, trace = BASE;
+    int count = 0;
+
+    assert(recorded < AIO4C_TRACE_RING_SIZE - 1);
+
+    /* the ring is not full yet, every event is kept */
+    while (recorded < AIO4C_TRACE_RING_SIZE - 1) {
+        record(trace, AIO4C_TRACE_POINT_READ, trace * 10, trace * 10);
+        trace++;
+    }
+    count = kept(&oldest, &newest);
+    assert(count == AIO4C_TRACE_RING_SIZE - 1);
+    assert(oldest == BASE && newest == trace - 1);
+
+    /* once full, the oldest slot is the next to be written, and may be torn */
+    record(trace, AIO4C_TRACE_POINT_READ, trace * 10, trace * 10);
+    trace++;
+    count = kept(&oldest, &newest);
+    assert(count == AIO4C_TRACE_RING_SIZE - 1);
+    assert(oldest == BASE && newest == trace - 1);
+
+    /* wrapped, events from first are copied and last - AIO4C_TRACE_RING_SIZE + 1 - first of them dropped */
+    while (recorded < AIO4C_TRACE_RING_SIZE + 10) {
+        record(trace, AIO4C_TRACE_POINT_READ, trace * 10, trace * 10);
+        trace++;
+    }
+    first = recorded - AIO4C_TRACE_RING_SIZE;
+    count = kept(&oldest, &newest);
+    assert(count == AIO4C_TRACE_RING_SIZE - (int)(recorded - AIO4C_TRACE_RING_SIZE + 1 - first));
+    assert(count == AIO4C_TRACE_RING_SIZE - 1);
+    /* the events recorded by phases() were the oldest, they are all gone */
+    assert(oldest == BASE + (unsigned int)(first + 1 - (recorded - (trace - BASE))));
+    assert(newest == trace - 1);
+}
+
+int main(int argc, char* argv[]) {
+    Aio4cInit(argc, argv, NULL, NULL);
+
+    phases();
+    wrap();
+
+    Aio4cEnd();
+
+    return 0;
+}